@@ -0,0 +1,232 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Allocation Counter
+//
+// AllocationCounter.cpp: implementation of the AllocationCounter
+// class and the operator new and delete that feed it.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "AllocationCounter.h"
+
+#include <stdlib.h>
+#include <malloc.h>
+#include <atomic>
+#include <new>
+
+#ifdef _WIN32
+#include <crtdbg.h>
+#define BlockSize(p)	_msize(p)
+#else
+#define BlockSize(p)	malloc_usable_size(p)
+#endif
+
+// Plain globals so they're ready before any constructor runs new
+static std::atomic<int> thisFrame[ALLOC_TAG_COUNT];
+static std::atomic<int> lastFrame[ALLOC_TAG_COUNT];
+static std::atomic<long long> total(0);
+static std::atomic<long long> totalBytes(0);
+static std::atomic<long long> liveBytes(0);
+static std::atomic<long long> peakBytes(0);
+static bool mallocHooked = false;
+
+// Each thread's current tag, and whether it's inside our operator
+// new so the malloc hook doesn't count the same block twice
+static thread_local int currentTag = ALLOC_OTHER;
+static thread_local bool insideNew = false;
+
+static const char *tagNames[ALLOC_TAG_COUNT] = {
+	"other",
+	"simulation",
+	"rendering",
+	"textures",
+	"audio",
+	"models"
+};
+
+void AllocationCounter::Count(size_t bytes)
+{
+	thisFrame[currentTag].fetch_add(1, std::memory_order_relaxed);
+	total.fetch_add(1, std::memory_order_relaxed);
+	totalBytes.fetch_add((long long)bytes, std::memory_order_relaxed);
+}
+
+void AllocationCounter::Added(size_t bytes)
+{
+	long long live = liveBytes.fetch_add((long long)bytes, std::memory_order_relaxed) + bytes;
+	long long peak = peakBytes.load(std::memory_order_relaxed);
+
+	while (live > peak && !peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+		;
+}
+
+void AllocationCounter::Removed(size_t bytes)
+{
+	liveBytes.fetch_sub((long long)bytes, std::memory_order_relaxed);
+}
+
+#if defined(_MSC_VER) && defined(_DEBUG)
+static int MallocHook(int type, void *, size_t size, int blockUse, long, const unsigned char *, int)
+{
+	// The CRT's own bookkeeping isn't anything we asked for
+	if ((type == _HOOK_ALLOC || type == _HOOK_REALLOC) && blockUse != _CRT_BLOCK && !insideNew)
+		AllocationCounter::Count(size);
+
+	return TRUE;
+}
+#endif
+
+bool AllocationCounter::HookMalloc()
+{
+#if defined(_MSC_VER) && defined(_DEBUG)
+	_CrtSetAllocHook(MallocHook);
+	mallocHooked = true;
+#endif
+
+	return mallocHooked;
+}
+
+bool AllocationCounter::CountsMalloc()
+{
+	return mallocHooked;
+}
+
+void AllocationCounter::NewFrame()
+{
+	for (int i = 0; i < ALLOC_TAG_COUNT; i++)
+		lastFrame[i] = thisFrame[i].exchange(0);
+}
+
+int AllocationCounter::ThisFrame()
+{
+	int count = 0;
+
+	for (int i = 0; i < ALLOC_TAG_COUNT; i++)
+		count += thisFrame[i];
+
+	return count;
+}
+
+int AllocationCounter::ThisFrame(int tag)
+{
+	return thisFrame[tag];
+}
+
+int AllocationCounter::LastFrame()
+{
+	int count = 0;
+
+	for (int i = 0; i < ALLOC_TAG_COUNT; i++)
+		count += lastFrame[i];
+
+	return count;
+}
+
+int AllocationCounter::LastFrame(int tag)
+{
+	return lastFrame[tag];
+}
+
+long long AllocationCounter::Total()
+{
+	return total;
+}
+
+long long AllocationCounter::TotalBytes()
+{
+	return totalBytes;
+}
+
+long long AllocationCounter::LiveBytes()
+{
+	return liveBytes;
+}
+
+long long AllocationCounter::PeakBytes()
+{
+	return peakBytes;
+}
+
+const char *AllocationCounter::TagName(int tag)
+{
+	if (tag < 0 || tag >= ALLOC_TAG_COUNT)
+		return "?";
+
+	return tagNames[tag];
+}
+
+//////////////////////////////////////////////////////////////////////
+// AllocationScope
+//////////////////////////////////////////////////////////////////////
+
+AllocationScope::AllocationScope(int tag)
+{
+	previous = currentTag;
+	currentTag = tag;
+}
+
+AllocationScope::~AllocationScope()
+{
+	currentTag = previous;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Global operator new and delete
+//////////////////////////////////////////////////////////////////////
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+	AllocationCounter::Count(size);
+
+	insideNew = true;
+	void *p = malloc(size ? size : 1);
+	insideNew = false;
+
+	if (p != NULL)
+		AllocationCounter::Added(BlockSize(p));
+
+	return p;
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+	return operator new(size, std::nothrow);
+}
+
+void *operator new(size_t size)
+{
+	void *p = operator new(size, std::nothrow);
+	if (p == NULL)
+		throw std::bad_alloc();
+
+	return p;
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+	if (p == NULL)
+		return;
+
+	AllocationCounter::Removed(BlockSize(p));
+	free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	operator delete(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+	operator delete(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+	operator delete(p);
+}
@@ -0,0 +1,90 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Allocation Counter
+//
+// AllocationCounter.h: interface for the AllocationCounter and
+// AllocationScope classes. AllocationCounter.cpp replaces the
+// global operator new and delete so every heap allocation made
+// through them is counted. The game calls NewFrame() at the
+// start of each frame, which makes LastFrame() the number of
+// allocations the whole of the previous frame made. Once the
+// game is up and running that should be zero.
+//
+// Each allocation is also put down to a subsystem. Whatever
+// a thread allocates goes to the tag of the innermost
+// AllocationScope it is in, or ALLOC_OTHER outside of one, so
+// the loader and mixer threads can be told apart from the
+// game's own frame.
+//
+// The bytes currently allocated (and the most there has ever
+// been) are kept too, so a leak shows up as a peak that keeps
+// going up. Only memory from operator new goes into the byte
+// totals.
+//
+// malloc, calloc and realloc called directly are only counted in
+// Visual C++ debug builds, through the CRT's allocation hook.
+// Release builds and other compilers have no hook, so there a
+// frame that only mallocs looks clean. CountsMalloc() says which
+// it is, and the soak test warns when it can't see malloc.
+//
+// Usage:
+// AllocationCounter::HookMalloc();				// Once, at startup
+// AllocationCounter::NewFrame();				// Top of the frame
+//
+// {
+//		AllocationScope scope(ALLOC_SIMULATION);	// Anything allocated in here
+//		...										// is the simulation's fault
+// }
+//
+// int allocs = AllocationCounter::LastFrame();	// The frame before
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <stddef.h>
+
+// Who asked for the memory
+enum AllocTag {
+	ALLOC_OTHER,
+	ALLOC_SIMULATION,
+	ALLOC_RENDERING,
+	ALLOC_TEXTURES,
+	ALLOC_AUDIO,
+	ALLOC_MODELS,
+	ALLOC_TAG_COUNT
+};
+
+class AllocationCounter
+{
+public:
+	static void Count(size_t bytes);			// Called for every allocation
+	static void Added(size_t bytes);			// A block of this size is now in use
+	static void Removed(size_t bytes);			// A block of this size was freed
+	static bool HookMalloc();					// Counts malloc too, false if this build can't
+	static bool CountsMalloc();					// True once HookMalloc() has worked
+	static void NewFrame();						// Starts counting a new frame
+	static int ThisFrame();						// Allocations so far this frame
+	static int ThisFrame(int tag);				// The same for one subsystem
+	static int LastFrame();						// Allocations made during the last frame
+	static int LastFrame(int tag);				// The same for one subsystem
+	static long long Total();					// Allocations since the game started
+	static long long TotalBytes();				// Bytes asked for since the game started
+	static long long LiveBytes();				// Bytes allocated right now
+	static long long PeakBytes();				// The most LiveBytes has ever been
+	static const char *TagName(int tag);		// A tag's name for printing
+};
+
+// Puts everything this thread allocates down to a tag until it goes
+class AllocationScope
+{
+public:
+	AllocationScope(int tag);
+	~AllocationScope();
+
+private:
+	int previous;
+};
+
+#endif ALLOCATIONCOUNTER_H
@@ -0,0 +1,406 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Animation Clip
+//
+// AnimationClip.cpp: implementation of the AnimationClip class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "AnimationClip.h"
+
+#include <math.h>
+#include <string.h>
+
+#define CLIP_MAX_FRAMES		3600	// A minute at 60 poses a second, longer clips are cut short
+#define CLIP_STILL			1e-4f	// How far from not moving at all still counts as not moving
+
+// The matrices are three axes then a position, which is how the
+// loader turns the file's z up into y up and back again
+static const float toModel[POSE_FLOATS] = { 1, 0, 0,  0, 0, -1,  0, 1, 0,  0, 0, 0 };
+static const float toFile[POSE_FLOATS] = { 1, 0, 0,  0, 0, 1,  0, -1, 0,  0, 0, 0 };
+static const float identity[POSE_FLOATS] = { 1, 0, 0,  0, 1, 0,  0, 0, 1,  0, 0, 0 };
+
+// out = a * b, out can't be a or b
+static void Multiply(const float *a, const float *b, float *out)
+{
+	for (int c = 0; c < 4; c++)
+	{
+		for (int r = 0; r < 3; r++)
+		{
+			out[c*3+r] = a[r]*b[c*3] + a[3+r]*b[c*3+1] + a[6+r]*b[c*3+2];
+
+			// Positions move, axes don't
+			if (c == 3)
+				out[c*3+r] += a[9+r];
+		}
+	}
+}
+
+static void Invert(const float *a, float *out)
+{
+	// The cofactors of the 3x3 part, transposed
+	float i[9];
+
+	i[0] = a[4]*a[8] - a[7]*a[5];
+	i[1] = a[7]*a[2] - a[1]*a[8];
+	i[2] = a[1]*a[5] - a[4]*a[2];
+	i[3] = a[6]*a[5] - a[3]*a[8];
+	i[4] = a[0]*a[8] - a[6]*a[2];
+	i[5] = a[3]*a[2] - a[0]*a[5];
+	i[6] = a[3]*a[7] - a[6]*a[4];
+	i[7] = a[6]*a[1] - a[0]*a[7];
+	i[8] = a[0]*a[4] - a[3]*a[1];
+
+	float det = a[0]*i[0] + a[3]*i[1] + a[6]*i[2];
+
+	// Squashed flat, it can't be undone
+	if (det == 0.0f)
+	{
+		memcpy(out, identity, sizeof(identity));
+		return;
+	}
+
+	for (int k = 0; k < 9; k++)
+		out[k] = i[k] / det;
+
+	for (int r = 0; r < 3; r++)
+		out[9+r] = -(out[r]*a[9] + out[3+r]*a[10] + out[6+r]*a[11]);
+}
+
+// A rotation key as a quaternion (w, x, y, z). 3ds turns the other
+// way to what the angle says, so it's negated.
+static void AxisAngle(const float *key, float *q)
+{
+	float length = sqrtf(key[1]*key[1] + key[2]*key[2] + key[3]*key[3]);
+	float half = -0.5f * key[0];
+	float s = length > 0.0f ? sinf(half) / length : 0.0f;
+
+	q[0] = length > 0.0f ? cosf(half) : 1.0f;
+	q[1] = key[1] * s;
+	q[2] = key[2] * s;
+	q[3] = key[3] * s;
+}
+
+// out = a * b
+static void QuatMultiply(const float *a, const float *b, float *out)
+{
+	float q[4];
+
+	q[0] = a[0]*b[0] - a[1]*b[1] - a[2]*b[2] - a[3]*b[3];
+	q[1] = a[0]*b[1] + a[1]*b[0] + a[2]*b[3] - a[3]*b[2];
+	q[2] = a[0]*b[2] - a[1]*b[3] + a[2]*b[0] + a[3]*b[1];
+	q[3] = a[0]*b[3] + a[1]*b[2] - a[2]*b[1] + a[3]*b[0];
+
+	memcpy(out, q, sizeof(q));
+}
+
+static void Slerp(const float *a, const float *b, float t, float *out)
+{
+	float d = a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[3]*b[3];
+	float sign = 1.0f;
+
+	// Go the short way round
+	if (d < 0.0f)
+	{
+		d = -d;
+		sign = -1.0f;
+	}
+
+	float ka = 1.0f - t;
+	float kb = t;
+
+	// Close together a straight line is just as good and doesn't divide by nothing
+	if (d < 0.9995f)
+	{
+		float angle = acosf(d);
+		float s = sinf(angle);
+
+		ka = sinf((1.0f - t) * angle) / s;
+		kb = sinf(t * angle) / s;
+	}
+
+	float length = 0.0f;
+
+	for (int k = 0; k < 4; k++)
+	{
+		out[k] = ka * a[k] + kb * sign * b[k];
+		length += out[k] * out[k];
+	}
+
+	length = sqrtf(length);
+
+	for (int k = 0; k < 4; k++)
+		out[k] /= length;
+}
+
+// A track's value at a frame, held at the ends
+static void Interpolate(const std::vector<AnimationClip::Key> &keys, float frame, int count, bool rotation, float *out)
+{
+	if (keys.size() == 1 || frame <= keys[0].frame)
+	{
+		memcpy(out, keys[0].v, count * sizeof(float));
+		return;
+	}
+
+	if (frame >= keys.back().frame)
+	{
+		memcpy(out, keys.back().v, count * sizeof(float));
+		return;
+	}
+
+	size_t k = 1;
+
+	while (keys[k].frame < frame)
+		k++;
+
+	const AnimationClip::Key &a = keys[k-1];
+	const AnimationClip::Key &b = keys[k];
+	float t = b.frame > a.frame ? (frame - a.frame) / (b.frame - a.frame) : 1.0f;
+
+	if (rotation)
+	{
+		Slerp(a.v, b.v, t, out);
+		return;
+	}
+
+	for (int i = 0; i < count; i++)
+		out[i] = a.v[i] + (b.v[i] - a.v[i]) * t;
+}
+
+AnimationClip::AnimationClip()
+{
+	poses = NULL;
+	numObjects = 0;
+	numFrames = 0;
+	rate = 0.0f;
+	length = 0.0f;
+}
+
+AnimationClip::~AnimationClip()
+{
+	Clear();
+}
+
+void AnimationClip::Clear()
+{
+	delete [] poses;
+
+	poses = NULL;
+	numObjects = 0;
+	numFrames = 0;
+	rate = 0.0f;
+	length = 0.0f;
+}
+
+void AnimationClip::Bake(const std::vector<Node> &nodes, int numObjects, int firstFrame, int lastFrame, float keyRate, float poseRate)
+{
+	Clear();
+
+	if (nodes.empty() || numObjects <= 0 || keyRate <= 0.0f || poseRate <= 0.0f)
+		return;
+
+	int numNodes = (int)nodes.size();
+
+	// Turn the rotations into quaternions, each one on top of the last,
+	// and find the last frame anything happens on
+	std::vector<Node> keyed(nodes);
+	int last = firstFrame;
+
+	for (int n = 0; n < numNodes; n++)
+	{
+		std::vector<Key> &rot = keyed[n].rot;
+
+		for (size_t k = 0; k < rot.size(); k++)
+		{
+			float q[4];
+			AxisAngle(rot[k].v, q);
+
+			if (k > 0)
+				QuatMultiply(q, rot[k-1].v, q);
+
+			memcpy(rot[k].v, q, sizeof(q));
+		}
+
+		const std::vector<Key> *tracks[3] = { &keyed[n].pos, &keyed[n].rot, &keyed[n].scale };
+
+		for (int t = 0; t < 3; t++)
+		{
+			if (!tracks[t]->empty() && tracks[t]->back().frame > last)
+				last = tracks[t]->back().frame;
+		}
+	}
+
+	if (last > lastFrame)
+		last = lastFrame;
+
+	// A file with its frames the wrong way round still gets its first one
+	float span = ((float)last - (float)firstFrame) / keyRate * poseRate;
+	int frames = span < 0.0f ? 1 : span >= CLIP_MAX_FRAMES ? CLIP_MAX_FRAMES : (int)span + 1;
+
+	// Find each node's parent by its id
+	std::vector<int> parents(numNodes, -1);
+
+	for (int n = 0; n < numNodes; n++)
+	{
+		for (int p = 0; p < numNodes && nodes[n].parent >= 0; p++)
+		{
+			if (nodes[p].id == nodes[n].parent && p != n)
+			{
+				parents[n] = p;
+				break;
+			}
+		}
+	}
+
+	std::vector<float> world(numNodes * POSE_FLOATS);
+	std::vector<float> rest(numNodes * POSE_FLOATS);
+	std::vector<int> state(numNodes, 0);
+
+	// The vertices are where the first frame puts them, so that's
+	// what every pose starts from
+	for (int n = 0; n < numNodes; n++)
+		World(keyed, parents, n, (float)firstFrame, world, state);
+
+	for (int n = 0; n < numNodes; n++)
+		Invert(&world[n * POSE_FLOATS], &rest[n * POSE_FLOATS]);
+
+	poses = new float[frames * numObjects * POSE_FLOATS];
+	this->numObjects = numObjects;
+	bool moves = false;
+
+	for (int f = 0; f < frames; f++)
+	{
+		float frame = firstFrame + f * keyRate / poseRate;
+		float *row = &poses[f * numObjects * POSE_FLOATS];
+
+		// Objects without a node stay where they are
+		for (int i = 0; i < numObjects; i++)
+			memcpy(&row[i * POSE_FLOATS], identity, sizeof(identity));
+
+		state.assign(numNodes, 0);
+
+		for (int n = 0; n < numNodes; n++)
+		{
+			int object = nodes[n].object;
+
+			if (object < 0 || object >= numObjects)
+				continue;
+
+			World(keyed, parents, n, frame, world, state);
+
+			// From the first frame to this one, then into the loader's space
+			float move[POSE_FLOATS];
+			float file[POSE_FLOATS];
+			float *pose = &row[object * POSE_FLOATS];
+
+			Multiply(&world[n * POSE_FLOATS], &rest[n * POSE_FLOATS], move);
+			Multiply(move, toFile, file);
+			Multiply(toModel, file, pose);
+
+			for (int k = 0; k < POSE_FLOATS; k++)
+			{
+				if (fabsf(pose[k] - identity[k]) > CLIP_STILL)
+					moves = true;
+			}
+		}
+	}
+
+	// Nothing to play, don't keep it
+	if (!moves)
+	{
+		Clear();
+		return;
+	}
+
+	numFrames = frames;
+	rate = poseRate;
+	length = (frames - 1) / poseRate;
+}
+
+void AnimationClip::World(const std::vector<Node> &nodes, const std::vector<int> &parents, int n, float frame, std::vector<float> &world, std::vector<int> &state)
+{
+	// Done already, or one of its own children (which a broken file could do)
+	if (state[n] != 0)
+		return;
+
+	state[n] = 1;
+
+	const Node &node = nodes[n];
+	float pos[3] = { 0.0f, 0.0f, 0.0f };
+	float rot[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+	float scale[3] = { 1.0f, 1.0f, 1.0f };
+
+	if (!node.pos.empty())
+		Interpolate(node.pos, frame, 3, false, pos);
+	if (!node.rot.empty())
+		Interpolate(node.rot, frame, 4, true, rot);
+	if (!node.scale.empty())
+		Interpolate(node.scale, frame, 3, false, scale);
+
+	// Moved, turned and then scaled
+	float w = rot[0], x = rot[1], y = rot[2], z = rot[3];
+	float local[POSE_FLOATS] = {
+		(1 - 2*(y*y + z*z)) * scale[0], (2*(x*y + w*z)) * scale[0], (2*(x*z - w*y)) * scale[0],
+		(2*(x*y - w*z)) * scale[1], (1 - 2*(x*x + z*z)) * scale[1], (2*(y*z + w*x)) * scale[1],
+		(2*(x*z + w*y)) * scale[2], (2*(y*z - w*x)) * scale[2], (1 - 2*(x*x + y*y)) * scale[2],
+		pos[0], pos[1], pos[2]
+	};
+
+	float *out = &world[n * POSE_FLOATS];
+	int p = parents[n];
+
+	if (p >= 0)
+	{
+		World(nodes, parents, p, frame, world, state);
+
+		// A parent that's still being worked out is a loop, leave it out
+		if (state[p] == 2)
+			Multiply(&world[p * POSE_FLOATS], local, out);
+		else
+			memcpy(out, local, sizeof(local));
+	}
+	else
+		memcpy(out, local, sizeof(local));
+
+	state[n] = 2;
+}
+
+void AnimationClip::Sample(float time, int object, float *matrix)
+{
+	float pose[POSE_FLOATS];
+
+	if (numFrames == 0 || object < 0 || object >= numObjects)
+		memcpy(pose, identity, sizeof(identity));
+	else
+	{
+		// Loop, and find the poses either side
+		float t = time > 0.0f && length > 0.0f ? fmodf(time, length) : 0.0f;
+		float f = t * rate;
+		int i = (int)f;
+
+		if (i > numFrames - 2)
+			i = numFrames - 2;
+		if (i < 0)
+			i = 0;
+
+		float blend = f - i;
+
+		if (blend > 1.0f)
+			blend = 1.0f;
+
+		const float *a = &poses[(i * numObjects + object) * POSE_FLOATS];
+		const float *b = numFrames > 1 ? a + numObjects * POSE_FLOATS : a;
+
+		for (int k = 0; k < POSE_FLOATS; k++)
+			pose[k] = a[k] + (b[k] - a[k]) * blend;
+	}
+
+	// Out to a 4x4 OpenGL matrix, a column at a time
+	for (int c = 0; c < 4; c++)
+	{
+		matrix[c*4]   = pose[c*3];
+		matrix[c*4+1] = pose[c*3+1];
+		matrix[c*4+2] = pose[c*3+2];
+		matrix[c*4+3] = c == 3 ? 1.0f : 0.0f;
+	}
+}
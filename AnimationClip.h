@@ -0,0 +1,93 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Animation Clip
+//
+// AnimationClip.h: interface for the AnimationClip class.
+// Holds the keyframes of a 3ds file baked into poses. The file
+// keeps a track of keys for the position, rotation and scale of
+// every node in its hierarchy, and working out where an object
+// is means interpolating all of them and all of its parents'.
+// Bake() does that once when the model loads, for every object
+// at a fixed number of poses a second, so drawing a frame is
+// just finding the two poses either side of it and blending.
+//
+// A pose is the matrix that takes an object from where the file
+// has its vertices (the first frame) to where it is at that time,
+// so the first frame is always the model as it was before.
+//
+// The clip belongs to the model, not to whatever's drawing it,
+// so any number of copies of the model can play it at their own
+// times without baking it again.
+//
+// Usage:
+// AnimationClip clip;
+//
+// clip.Bake(nodes, numObjects, firstFrame, lastFrame, 30.0f, 30.0f);
+// if (clip.numFrames > 0)
+// {
+//     float matrix[16];
+//     clip.Sample(seconds, object, matrix);	// Loops
+//     glMultMatrixf(matrix);
+// }
+//
+// The keys are as the 3ds file has them, z up, with each
+// rotation an angle and axis on top of the key before it. The
+// poses are for the loader's y up vertices.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef ANIMATIONCLIP_H
+#define ANIMATIONCLIP_H
+
+#include <vector>
+
+#define POSE_FLOATS		12		// A pose is a 3x4 matrix, three axes and a position
+
+class AnimationClip
+{
+public:
+	// A key from one of the tracks, three numbers or an angle and axis
+	struct Key {
+		int frame;					// The frame of the file's animation it's on
+		float v[4];					// x, y, z, or the angle (radians) then the axis
+	};
+
+	// A node in the file's hierarchy
+	struct Node {
+		int id;						// The number other nodes call it by
+		int parent;					// Its parent's id, -1 if it's at the top
+		int object;					// The model's object it moves, -1 for none
+		std::vector<Key> pos;		// Where it is
+		std::vector<Key> rot;		// Which way it's turned
+		std::vector<Key> scale;		// How big it is
+	};
+
+	int numObjects;				// The objects in each frame
+	int numFrames;				// The frames, 0 if nothing moves
+	float rate;					// Frames a second
+	float length;				// How long it takes to play, in seconds
+
+	AnimationClip();
+	virtual ~AnimationClip();
+
+	// Bakes the nodes' tracks from firstFrame to the last key (no further
+	// than lastFrame), keyRate being how fast the file plays them and
+	// poseRate how many poses a second to keep
+	void Bake(const std::vector<Node> &nodes, int numObjects, int firstFrame, int lastFrame, float keyRate, float poseRate);
+	// The object's pose time seconds in, as an OpenGL matrix
+	void Sample(float time, int object, float *matrix);
+	// Throws the poses away
+	void Clear();
+
+private:
+	// A clip owns its poses, so it can't be copied
+	AnimationClip(const AnimationClip &);
+	AnimationClip &operator=(const AnimationClip &);
+
+	float *poses;				// numFrames rows of numObjects poses
+
+	// Where a node is in the file's space at a frame, parents included
+	void World(const std::vector<Node> &nodes, const std::vector<int> &parents, int n, float frame, std::vector<float> &world, std::vector<int> &state);
+};
+
+#endif ANIMATIONCLIP_H
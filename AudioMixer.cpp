@@ -0,0 +1,547 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Audio Mixer
+//
+// AudioMixer.cpp: implementation of the AudioMixer class and
+// its backends.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "AudioMixer.h"
+#include "AllocationCounter.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef _WIN32
+#pragma comment(lib, "winmm.lib")
+#endif
+
+// Things a command can ask for
+#define COMMAND_PLAY		0
+#define COMMAND_STOP_ALL	1
+
+//////////////////////////////////////////////////////////////////////
+// NullBackend
+//////////////////////////////////////////////////////////////////////
+
+NullBackend::NullBackend(bool rt)
+{
+	realTime = rt;
+	rate = SOUND_RATE;
+}
+
+bool NullBackend::Open(int r, int channels, int blockFrames)
+{
+	rate = r;
+	next = std::chrono::steady_clock::now();
+	return true;
+}
+
+void NullBackend::Write(const short *samples, int frames)
+{
+	if (!realTime)
+		return;
+
+	// Wait until a sound card would have wanted this block
+	next += std::chrono::microseconds((long long)frames * 1000000 / rate);
+	std::this_thread::sleep_until(next);
+}
+
+void NullBackend::Close()
+{
+
+}
+
+//////////////////////////////////////////////////////////////////////
+// WaveFileBackend
+//////////////////////////////////////////////////////////////////////
+
+static void WriteLittle(FILE *file, unsigned int v, int bytes)
+{
+	for (int i = 0; i < bytes; i++)
+		fputc((v >> (8 * i)) & 0xFF, file);
+}
+
+WaveFileBackend::WaveFileBackend(const char *n, bool rt) : clock(rt)
+{
+	strncpy(name, n, sizeof(name) - 1);
+	name[sizeof(name) - 1] = 0;
+	file = NULL;
+	channels = SOUND_CHANNELS;
+	dataSize = 0;
+}
+
+WaveFileBackend::~WaveFileBackend()
+{
+	Close();
+}
+
+bool WaveFileBackend::Open(int rate, int ch, int blockFrames)
+{
+	file = fopen(name, "wb");
+	if (file == NULL)
+		return false;
+
+	channels = ch;
+	dataSize = 0;
+
+	// The sizes get filled in when we close
+	fwrite("RIFF", 1, 4, file);
+	WriteLittle(file, 0, 4);
+	fwrite("WAVEfmt ", 1, 8, file);
+	WriteLittle(file, 16, 4);
+	WriteLittle(file, 1, 2);
+	WriteLittle(file, channels, 2);
+	WriteLittle(file, rate, 4);
+	WriteLittle(file, rate * channels * 2, 4);
+	WriteLittle(file, channels * 2, 2);
+	WriteLittle(file, 16, 2);
+	fwrite("data", 1, 4, file);
+	WriteLittle(file, 0, 4);
+
+	return clock.Open(rate, ch, blockFrames);
+}
+
+void WaveFileBackend::Write(const short *samples, int frames)
+{
+	if (file == NULL)
+		return;
+
+	fwrite(samples, sizeof(short), frames * channels, file);
+	dataSize += frames * channels * sizeof(short);
+
+	clock.Write(samples, frames);
+}
+
+void WaveFileBackend::Close()
+{
+	if (file == NULL)
+		return;
+
+	fseek(file, 4, SEEK_SET);
+	WriteLittle(file, 36 + dataSize, 4);
+	fseek(file, 40, SEEK_SET);
+	WriteLittle(file, dataSize, 4);
+
+	fclose(file);
+	file = NULL;
+}
+
+//////////////////////////////////////////////////////////////////////
+// WaveOutBackend
+//////////////////////////////////////////////////////////////////////
+
+#ifdef _WIN32
+
+WaveOutBackend::WaveOutBackend()
+{
+	device = NULL;
+	done = NULL;
+	memset(headers, 0, sizeof(headers));
+	memset(buffers, 0, sizeof(buffers));
+	blockBytes = 0;
+	channels = SOUND_CHANNELS;
+}
+
+WaveOutBackend::~WaveOutBackend()
+{
+	Close();
+}
+
+bool WaveOutBackend::Open(int rate, int ch, int blockFrames)
+{
+	WAVEFORMATEX format;
+	memset(&format, 0, sizeof(format));
+	format.wFormatTag = WAVE_FORMAT_PCM;
+	format.nChannels = ch;
+	format.nSamplesPerSec = rate;
+	format.wBitsPerSample = 16;
+	format.nBlockAlign = ch * 2;
+	format.nAvgBytesPerSec = rate * format.nBlockAlign;
+
+	done = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (done == NULL)
+		return false;
+
+	if (waveOutOpen(&device, WAVE_MAPPER, &format, (DWORD_PTR)done, 0, CALLBACK_EVENT) != MMSYSERR_NOERROR)
+	{
+		CloseHandle(done);
+		done = NULL;
+		device = NULL;
+		return false;
+	}
+
+	channels = ch;
+	blockBytes = blockFrames * ch * sizeof(short);
+
+	for (int i = 0; i < WAVEOUT_BUFFERS; i++)
+	{
+		buffers[i] = (short *)malloc(blockBytes);
+		memset(&headers[i], 0, sizeof(WAVEHDR));
+		headers[i].lpData = (LPSTR)buffers[i];
+		headers[i].dwBufferLength = blockBytes;
+		waveOutPrepareHeader(device, &headers[i], sizeof(WAVEHDR));
+
+		// Mark it as done so the first Write can use it
+		headers[i].dwFlags |= WHDR_DONE;
+	}
+
+	return true;
+}
+
+void WaveOutBackend::Write(const short *samples, int frames)
+{
+	if (device == NULL)
+		return;
+
+	// Wait for the card to give us back a buffer
+	for (;;)
+	{
+		for (int i = 0; i < WAVEOUT_BUFFERS; i++)
+		{
+			if (headers[i].dwFlags & WHDR_DONE)
+			{
+				int bytes = frames * channels * sizeof(short);
+				if (bytes > blockBytes)
+					bytes = blockBytes;
+
+				memcpy(buffers[i], samples, bytes);
+				headers[i].dwBufferLength = bytes;
+				headers[i].dwFlags &= ~WHDR_DONE;
+				waveOutWrite(device, &headers[i], sizeof(WAVEHDR));
+				return;
+			}
+		}
+
+		WaitForSingleObject(done, INFINITE);
+	}
+}
+
+void WaveOutBackend::Close()
+{
+	if (device == NULL)
+		return;
+
+	waveOutReset(device);
+
+	for (int i = 0; i < WAVEOUT_BUFFERS; i++)
+	{
+		waveOutUnprepareHeader(device, &headers[i], sizeof(WAVEHDR));
+		free(buffers[i]);
+		buffers[i] = NULL;
+	}
+
+	waveOutClose(device);
+	CloseHandle(done);
+
+	device = NULL;
+	done = NULL;
+}
+
+#endif
+
+//////////////////////////////////////////////////////////////////////
+// AudioMixer
+//////////////////////////////////////////////////////////////////////
+
+AudioMixer::AudioMixer()
+{
+	memset(voices, 0, sizeof(voices));
+	ringHead = 0;
+	ringTail = 0;
+	backend = NULL;
+	running = false;
+	active = 0;
+	dropped = 0;
+	stolen = 0;
+	culled = 0;
+
+	SetListener(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f);
+	SetDistances(5.0f, 80.0f);
+}
+
+AudioMixer::~AudioMixer()
+{
+	Stop();
+}
+
+bool AudioMixer::Start(AudioBackend *output)
+{
+	Stop();
+
+	if (output == NULL || !output->Open(SOUND_RATE, SOUND_CHANNELS, MIXER_BLOCK_FRAMES))
+	{
+		delete output;
+		return false;
+	}
+
+	backend = output;
+	running = true;
+	thread = std::thread(&AudioMixer::ThreadMain, this);
+
+	return true;
+}
+
+void AudioMixer::Stop()
+{
+	if (running)
+	{
+		running = false;
+		thread.join();
+	}
+
+	if (backend != NULL)
+	{
+		backend->Close();
+		delete backend;
+		backend = NULL;
+	}
+}
+
+bool AudioMixer::Push(const Command &c)
+{
+	unsigned int head = ringHead.load(std::memory_order_relaxed);
+	unsigned int tail = ringTail.load(std::memory_order_acquire);
+
+	// Full, drop it rather than wait
+	if (head - tail >= MIXER_RING_SIZE)
+	{
+		dropped++;
+		return false;
+	}
+
+	ring[head & (MIXER_RING_SIZE - 1)] = c;
+	ringHead.store(head + 1, std::memory_order_release);
+
+	return true;
+}
+
+bool AudioMixer::Pop(Command *c)
+{
+	unsigned int tail = ringTail.load(std::memory_order_relaxed);
+	unsigned int head = ringHead.load(std::memory_order_acquire);
+
+	if (tail == head)
+		return false;
+
+	*c = ring[tail & (MIXER_RING_SIZE - 1)];
+	ringTail.store(tail + 1, std::memory_order_release);
+
+	return true;
+}
+
+bool AudioMixer::Play(const short *samples, int frames, float volume, float pan)
+{
+	if (samples == NULL || frames <= 0 || volume <= 0.0f)
+		return false;
+
+	if (pan < -1.0f) pan = -1.0f;
+	if (pan > 1.0f) pan = 1.0f;
+
+	// Keep the middle at full volume and fade the far side out
+	float left = volume * (pan > 0.0f ? 1.0f - pan : 1.0f);
+	float right = volume * (pan < 0.0f ? 1.0f + pan : 1.0f);
+
+	Command c;
+	c.type = COMMAND_PLAY;
+	c.samples = samples;
+	c.frames = frames;
+	c.gainLeft = (int)(left * 32768.0f);
+	c.gainRight = (int)(right * 32768.0f);
+
+	return Push(c);
+}
+
+void AudioMixer::SetListener(float x, float y, float z, float atX, float atY, float atZ)
+{
+	listener[0] = x;
+	listener[1] = y;
+	listener[2] = z;
+
+	// Right is forward crossed with up, flat on the ground
+	float fx = atX - x;
+	float fz = atZ - z;
+	float length = sqrtf(fx * fx + fz * fz);
+
+	if (length > 0.0001f)
+	{
+		right[0] = -fz / length;
+		right[1] = 0.0f;
+		right[2] = fx / length;
+	}
+}
+
+void AudioMixer::SetDistances(float fullVolume, float silent)
+{
+	reference = fullVolume;
+	maximum = silent > fullVolume ? silent : fullVolume + 1.0f;
+}
+
+bool AudioMixer::PlayAt(const short *samples, int frames, float volume, float x, float y, float z)
+{
+	float dx = x - listener[0];
+	float dy = y - listener[1];
+	float dz = z - listener[2];
+	float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+
+	// Inverse distance, so twice as far is half as loud
+	float gain = volume * reference / (distance > reference ? distance : reference);
+
+	// Fade out over the last quarter so sounds don't pop at the edge
+	float fadeStart = maximum * 0.75f;
+	if (distance > fadeStart)
+		gain *= (maximum - distance) / (maximum - fadeStart);
+
+	if (gain < MIXER_CULL_GAIN)
+	{
+		culled++;
+		return false;
+	}
+
+	// How far off to the side it is, -1 is hard left and 1 hard right
+	float pan = 0.0f;
+	if (distance > 0.0001f)
+		pan = (dx * right[0] + dy * right[1] + dz * right[2]) / distance;
+
+	return Play(samples, frames, gain, pan);
+}
+
+void AudioMixer::StopAll()
+{
+	Command c;
+	memset(&c, 0, sizeof(c));
+	c.type = COMMAND_STOP_ALL;
+
+	Push(c);
+}
+
+void AudioMixer::StartVoice(const Command &c)
+{
+	int slot = -1;
+	int furthest = -1;
+
+	for (int i = 0; i < MIXER_VOICES; i++)
+	{
+		if (!voices[i].active)
+		{
+			slot = i;
+			break;
+		}
+
+		// Remember the one that's been playing longest in case we need it
+		if (furthest < 0 || voices[i].position > voices[furthest].position)
+			furthest = i;
+	}
+
+	if (slot < 0)
+	{
+		slot = furthest;
+		stolen++;
+	}
+
+	Voice &v = voices[slot];
+	v.samples = c.samples;
+	v.frames = c.frames;
+	v.position = 0;
+	v.gainLeft = c.gainLeft;
+	v.gainRight = c.gainRight;
+	v.active = true;
+}
+
+void AudioMixer::Render(short *out, int frames)
+{
+	// Pick up whatever the game asked for since the last block
+	Command c;
+	while (Pop(&c))
+	{
+		if (c.type == COMMAND_PLAY)
+			StartVoice(c);
+		else if (c.type == COMMAND_STOP_ALL)
+		{
+			for (int i = 0; i < MIXER_VOICES; i++)
+				voices[i].active = false;
+		}
+	}
+
+	while (frames > 0)
+	{
+		int count = frames < MIXER_BLOCK_FRAMES ? frames : MIXER_BLOCK_FRAMES;
+		memset(mix, 0, count * SOUND_CHANNELS * sizeof(int));
+
+		for (int i = 0; i < MIXER_VOICES; i++)
+		{
+			Voice &v = voices[i];
+			if (!v.active)
+				continue;
+
+			int left = v.frames - v.position;
+			int n = left < count ? left : count;
+			const short *src = v.samples + v.position * SOUND_CHANNELS;
+
+			for (int f = 0; f < n; f++)
+			{
+				mix[f * 2] += (src[f * 2] * v.gainLeft) >> 15;
+				mix[f * 2 + 1] += (src[f * 2 + 1] * v.gainRight) >> 15;
+			}
+
+			v.position += n;
+			if (v.position >= v.frames)
+				v.active = false;
+		}
+
+		// Clip the sums back into 16 bits
+		for (int s = 0; s < count * SOUND_CHANNELS; s++)
+		{
+			int value = mix[s];
+			if (value > 32767) value = 32767;
+			if (value < -32768) value = -32768;
+			out[s] = (short)value;
+		}
+
+		out += count * SOUND_CHANNELS;
+		frames -= count;
+	}
+
+	int playing = 0;
+	for (int i = 0; i < MIXER_VOICES; i++)
+		if (voices[i].active)
+			playing++;
+
+	active = playing;
+}
+
+void AudioMixer::ThreadMain()
+{
+	AllocationScope scope(ALLOC_AUDIO);
+	short block[MIXER_BLOCK_FRAMES * SOUND_CHANNELS];
+
+	while (running)
+	{
+		Render(block, MIXER_BLOCK_FRAMES);
+
+		// This is what keeps us from running ahead of the sound card
+		backend->Write(block, MIXER_BLOCK_FRAMES);
+	}
+}
+
+int AudioMixer::ActiveVoices()
+{
+	return active;
+}
+
+int AudioMixer::Dropped()
+{
+	return dropped;
+}
+
+int AudioMixer::Stolen()
+{
+	return stolen;
+}
+
+int AudioMixer::Culled()
+{
+	return culled;
+}
@@ -0,0 +1,198 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Audio Mixer
+//
+// AudioMixer.h: interface for the AudioMixer class and the
+// backends it can play through. PlaySound can only play one
+// sound at a time, so this mixes any number of them (up to
+// MIXER_VOICES) itself on its own thread and hands the result
+// to a backend.
+//
+// The game never waits on the mixer. Play() just writes a
+// command into a ring buffer that only the game thread writes
+// and only the mixer thread reads, so no locks are needed. If
+// the ring is ever full the sound is dropped rather than
+// making the game wait. When every voice is busy the one
+// that has played the longest makes way for the new sound.
+//
+// All sounds have to be 16 bit stereo at SOUND_RATE, which is
+// what the SoundBank gives us. The samples aren't copied so
+// they have to stay around while they're playing.
+//
+// Backends:
+// WaveOutBackend  - plays through the sound card (Windows only)
+// WaveFileBackend - writes everything to a WAV file
+// NullBackend     - throws it all away
+//
+// Sounds can also be played at a point in the world. They get
+// quieter with distance from the listener (set from the camera)
+// and are panned to the side they're on. Anything that would be
+// too quiet to hear is dropped before it ever reaches the mixer
+// thread, so far away gunfire costs nothing to mix.
+//
+// The file and null backends can keep real time or run as fast
+// as they can, and Render() can be called directly without
+// starting the thread, so the mixer works without a sound card.
+//
+// Usage:
+// AudioMixer mixer;
+//
+// mixer.Start(new WaveOutBackend());	// The mixer deletes it
+// mixer.Play(bank.Samples(SOUND_SHOOT), bank.Frames(SOUND_SHOOT), 1.0f, 0.0f);
+//
+// // Positional sounds
+// mixer.SetListener(eyeX, eyeY, eyeZ, atX, atY, atZ);
+// mixer.PlayAt(samples, frames, 1.0f, x, y, z);
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef AUDIOMIXER_H
+#define AUDIOMIXER_H
+
+#include "SoundBank.h"
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#define MIXER_VOICES		32		// Sounds that can play at once
+#define MIXER_RING_SIZE		256		// Commands that can be waiting, must be a power of two
+#define MIXER_BLOCK_FRAMES	512		// Frames mixed at a time, about 12ms
+#define MIXER_CULL_GAIN		0.004f	// Quieter than this isn't worth playing (about -48dB)
+
+// Where the mixed sound goes
+class AudioBackend
+{
+public:
+	virtual bool Open(int rate, int channels, int blockFrames) = 0;	// Gets ready to take blocks
+	virtual void Write(const short *samples, int frames) = 0;			// Takes a block, waits if it's too early for it
+	virtual void Close() = 0;											// Finishes up
+	virtual ~AudioBackend() {}
+};
+
+// Throws the sound away
+class NullBackend : public AudioBackend
+{
+public:
+	NullBackend(bool realTime = true);
+	virtual bool Open(int rate, int channels, int blockFrames);
+	virtual void Write(const short *samples, int frames);
+	virtual void Close();
+
+private:
+	bool realTime;					// True: take as long as playing it would
+	int rate;
+	std::chrono::steady_clock::time_point next;
+};
+
+// Writes the sound to a WAV file
+class WaveFileBackend : public AudioBackend
+{
+public:
+	WaveFileBackend(const char *name, bool realTime = false);
+	virtual ~WaveFileBackend();
+	virtual bool Open(int rate, int channels, int blockFrames);
+	virtual void Write(const short *samples, int frames);
+	virtual void Close();
+
+private:
+	char name[260];
+	FILE *file;
+	NullBackend clock;				// Keeps us in real time if asked to
+	int channels;
+	unsigned int dataSize;			// Bytes of samples written so far
+};
+
+#ifdef _WIN32
+#include <windows.h>
+#include <mmsystem.h>
+
+#define WAVEOUT_BUFFERS	4			// Blocks queued on the sound card
+
+// Plays the sound through the sound card
+class WaveOutBackend : public AudioBackend
+{
+public:
+	WaveOutBackend();
+	virtual ~WaveOutBackend();
+	virtual bool Open(int rate, int channels, int blockFrames);
+	virtual void Write(const short *samples, int frames);
+	virtual void Close();
+
+private:
+	HWAVEOUT device;
+	HANDLE done;					// Signalled when the card finishes a block
+	WAVEHDR headers[WAVEOUT_BUFFERS];
+	short *buffers[WAVEOUT_BUFFERS];
+	int blockBytes;
+	int channels;
+};
+#endif
+
+class AudioMixer
+{
+public:
+	bool Start(AudioBackend *output);				// Starts the mixer thread playing through output
+	void Stop();									// Stops the thread and closes the backend
+	bool Play(const short *samples, int frames, float volume, float pan);	// Queues a sound, pan is -1 (left) to 1 (right)
+	bool PlayAt(const short *samples, int frames, float volume, float x, float y, float z);	// Queues a sound at a point in the world
+	void SetListener(float x, float y, float z, float atX, float atY, float atZ);	// Where we hear from and which way we face
+	void SetDistances(float fullVolume, float silent);	// Full volume closer than fullVolume, nothing past silent
+	void StopAll();									// Silences every voice
+	void Render(short *out, int frames);			// Mixes the next frames, used by the thread or by hand
+	int ActiveVoices();								// Voices that were playing after the last block
+	int Dropped();									// Sounds that were lost because the ring was full
+	int Stolen();									// Sounds cut short to make room for new ones
+	int Culled();									// Positional sounds too far away to hear
+	AudioMixer();									// Constructor
+	virtual ~AudioMixer();							// Destructor
+
+private:
+	// Something the game wants the mixer to do
+	struct Command {
+		int type;
+		const short *samples;
+		int frames;
+		int gainLeft;			// 1.15 fixed point
+		int gainRight;
+	};
+
+	// One sound being played
+	struct Voice {
+		const short *samples;
+		int frames;
+		int position;			// The next frame to play
+		int gainLeft;
+		int gainRight;
+		bool active;
+	};
+
+	bool Push(const Command &c);
+	bool Pop(Command *c);
+	void StartVoice(const Command &c);
+	void ThreadMain();
+
+	Command ring[MIXER_RING_SIZE];
+	std::atomic<unsigned int> ringHead;			// Only the game thread writes this
+	std::atomic<unsigned int> ringTail;			// Only the mixer thread writes this
+
+	// Only touched by the game thread
+	float listener[3];
+	float right[3];								// Points out of the listener's right ear
+	float reference;
+	float maximum;
+	int culled;
+
+	Voice voices[MIXER_VOICES];
+	int mix[MIXER_BLOCK_FRAMES * SOUND_CHANNELS];	// Sums before clipping
+
+	AudioBackend *backend;
+	std::thread thread;
+	std::atomic<bool> running;
+	std::atomic<int> active;
+	std::atomic<int> dropped;
+	std::atomic<int> stolen;
+};
+
+#endif AUDIOMIXER_H
@@ -0,0 +1,271 @@
+//////////////////////////////////////////////////////////////////////
+//
+// GL State
+//
+// GLState.cpp: implementation of the GLState class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "GLState.h"
+
+#include "glew.h"			// For the buffer functions, it includes gl.h
+
+#include <string.h>
+
+GLState *GLState::instance = NULL;
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+GLState::GLState()
+{
+	memset(&stats, 0, sizeof(stats));
+	Forget();
+}
+
+GLState *GLState::Get()
+{
+	// Lives as long as the context does, which is until the game exits
+	if (instance == NULL)
+		instance = new GLState();
+
+	return instance;
+}
+
+void GLState::Forget()
+{
+	memset(caps, -1, sizeof(caps));
+	memset(arrays, -1, sizeof(arrays));
+	textureKnown = false;
+	buffersKnown = false;
+	blendKnown = false;
+	colorKnown = false;
+}
+
+void GLState::ForgetColor()
+{
+	colorKnown = false;
+}
+
+void GLState::NewFrame()
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+int GLState::CapIndex(unsigned int cap)
+{
+	switch (cap)
+	{
+	case GL_LIGHTING:		return CAP_LIGHTING;
+	case GL_LIGHT0:			return CAP_LIGHT0;
+	case GL_LIGHT1:			return CAP_LIGHT1;
+	case GL_LIGHT2:			return CAP_LIGHT2;
+	case GL_LIGHT3:			return CAP_LIGHT3;
+	case GL_DEPTH_TEST:		return CAP_DEPTH_TEST;
+	case GL_BLEND:			return CAP_BLEND;
+	case GL_TEXTURE_2D:		return CAP_TEXTURE_2D;
+	case GL_NORMALIZE:		return CAP_NORMALIZE;
+	case GL_COLOR_MATERIAL:	return CAP_COLOR_MATERIAL;
+	}
+
+	return -1;
+}
+
+int GLState::ArrayIndex(unsigned int array)
+{
+	switch (array)
+	{
+	case GL_VERTEX_ARRAY:			return ARRAY_VERTEX;
+	case GL_NORMAL_ARRAY:			return ARRAY_NORMAL;
+	case GL_TEXTURE_COORD_ARRAY:	return ARRAY_TEXCOORD;
+	case GL_COLOR_ARRAY:			return ARRAY_COLOR;
+	}
+
+	return -1;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Capabilities and arrays
+//////////////////////////////////////////////////////////////////////
+
+void GLState::Set(unsigned int cap, bool on)
+{
+	int i = CapIndex(cap);
+
+	if (i >= 0)
+	{
+		if (caps[i] == (on ? 1 : 0))
+		{
+			stats.skippedToggles++;
+			return;
+		}
+		caps[i] = on ? 1 : 0;
+	}
+
+	if (on)
+		glEnable(cap);
+	else
+		glDisable(cap);
+
+	stats.toggles++;
+}
+
+void GLState::Enable(unsigned int cap)
+{
+	Set(cap, true);
+}
+
+void GLState::Disable(unsigned int cap)
+{
+	Set(cap, false);
+}
+
+void GLState::EnableArray(unsigned int array)
+{
+	int i = ArrayIndex(array);
+
+	if (i >= 0)
+	{
+		if (arrays[i] == 1)
+		{
+			stats.skippedArrays++;
+			return;
+		}
+		arrays[i] = 1;
+	}
+
+	glEnableClientState(array);
+	stats.arrays++;
+}
+
+void GLState::DisableArray(unsigned int array)
+{
+	int i = ArrayIndex(array);
+
+	if (i >= 0)
+	{
+		if (arrays[i] == 0)
+		{
+			stats.skippedArrays++;
+			return;
+		}
+		arrays[i] = 0;
+	}
+
+	glDisableClientState(array);
+	stats.arrays++;
+}
+
+void GLState::SetArray(unsigned int array, bool on)
+{
+	if (on)
+		EnableArray(array);
+	else
+		DisableArray(array);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Textures, blending and color
+//////////////////////////////////////////////////////////////////////
+
+bool GLState::BindTexture(unsigned int id)
+{
+	if (textureKnown && texture == id)
+	{
+		stats.skippedBinds++;
+		return false;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, id);
+	texture = id;
+	textureKnown = true;
+	stats.textureBinds++;
+	return true;
+}
+
+void GLState::DeleteTexture(unsigned int id)
+{
+	glDeleteTextures(1, &id);
+
+	// OpenGL goes back to texture 0 when the bound one is deleted
+	if (textureKnown && texture == id)
+		texture = 0;
+}
+
+void GLState::BindBuffers(unsigned int vertices, unsigned int indices)
+{
+	// Without buffer objects everything comes from memory anyway
+	if (glBindBuffer == NULL)
+		return;
+
+	if (buffersKnown && vertexBuffer == vertices && indexBuffer == indices)
+	{
+		stats.skippedBufferBinds++;
+		return;
+	}
+
+	if (!buffersKnown || vertexBuffer != vertices)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, vertices);
+		stats.bufferBinds++;
+	}
+	if (!buffersKnown || indexBuffer != indices)
+	{
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices);
+		stats.bufferBinds++;
+	}
+
+	vertexBuffer = vertices;
+	indexBuffer = indices;
+	buffersKnown = true;
+}
+
+void GLState::DeleteBuffer(unsigned int id)
+{
+	glDeleteBuffers(1, &id);
+
+	// Like textures, deleting a bound buffer binds 0 in its place
+	if (buffersKnown)
+	{
+		if (vertexBuffer == id)
+			vertexBuffer = 0;
+		if (indexBuffer == id)
+			indexBuffer = 0;
+	}
+}
+
+void GLState::BlendFunc(unsigned int src, unsigned int dst)
+{
+	if (blendKnown && blendSrc == src && blendDst == dst)
+	{
+		stats.skippedBlendFuncs++;
+		return;
+	}
+
+	glBlendFunc(src, dst);
+	blendSrc = src;
+	blendDst = dst;
+	blendKnown = true;
+	stats.blendFuncs++;
+}
+
+void GLState::Color(float r, float g, float b, float a)
+{
+	float rgba[4] = { r, g, b, a };
+	Color(rgba);
+}
+
+void GLState::Color(const float *rgba)
+{
+	if (colorKnown && memcmp(color, rgba, sizeof(color)) == 0)
+	{
+		stats.skippedColors++;
+		return;
+	}
+
+	glColor4fv(rgba);
+	memcpy(color, rgba, sizeof(color));
+	colorKnown = true;
+	stats.colors++;
+}
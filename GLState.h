@@ -0,0 +1,128 @@
+//////////////////////////////////////////////////////////////////////
+//
+// GL State
+//
+// GLState.h: interface for the GLState class.
+// Remembers what has been switched on, bound and set in OpenGL
+// so that asking for it again doesn't make another call. Every
+// piece of drawing code goes through it: a glEnable or a
+// glBindTexture made behind its back would leave it thinking
+// the old state is still set.
+//
+// It shadows the capabilities the game switches (lighting, the
+// lights, depth testing, blending, texturing), the client arrays,
+// the bound texture, the vertex and index buffers, the blend
+// function and the current color.
+// Other capabilities are passed straight to OpenGL. Until
+// something has been set once it isn't known, so the first call
+// always goes through.
+//
+// The current color becomes undefined after drawing with a color
+// array, ForgetColor() says so. Forget() drops everything, for
+// code that had to change state some other way.
+//
+// Client arrays read from the bound buffers, so code drawing
+// from arrays in memory binds 0 first. The shader renderer's
+// buffers live in its vertex array objects and don't go
+// through here.
+//
+// Usage:
+// GLState *gl = GLState::Get();
+//
+// gl->NewFrame();							// Starts this frame's counts
+// gl->Enable(GL_TEXTURE_2D);
+// gl->BindTexture(id);						// Only calls glBindTexture if id isn't bound
+// gl->Color(1.0f, 1.0f, 1.0f);
+// printf("%d skipped\n", gl->stats.skippedBinds);
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+// The calls made since NewFrame() and the ones that weren't needed
+struct GLStateStats {
+	int toggles;				// glEnable and glDisable
+	int arrays;					// glEnableClientState and glDisableClientState
+	int textureBinds;
+	int bufferBinds;
+	int blendFuncs;
+	int colors;
+	int skippedToggles;
+	int skippedArrays;
+	int skippedBinds;
+	int skippedBufferBinds;
+	int skippedBlendFuncs;
+	int skippedColors;
+};
+
+class GLState
+{
+public:
+	GLStateStats stats;
+
+	static GLState *Get();						// The state of the one context the game has
+
+	void Enable(unsigned int cap);				// glEnable unless it already is
+	void Disable(unsigned int cap);				// glDisable unless it already is
+	void Set(unsigned int cap, bool on);		// Enable() or Disable()
+	void EnableArray(unsigned int array);		// glEnableClientState unless it already is
+	void DisableArray(unsigned int array);		// glDisableClientState unless it already is
+	void SetArray(unsigned int array, bool on);	// EnableArray() or DisableArray()
+	bool BindTexture(unsigned int id);			// glBindTexture(GL_TEXTURE_2D), false if it was already bound
+	void DeleteTexture(unsigned int id);		// glDeleteTextures, which unbinds it if it's bound
+	void BindBuffers(unsigned int vertices, unsigned int indices);	// The array and element array buffers, 0 for memory
+	void DeleteBuffer(unsigned int id);			// glDeleteBuffers, which unbinds it if it's bound
+	void BlendFunc(unsigned int src, unsigned int dst);
+	void Color(float r, float g, float b, float a = 1.0f);
+	void Color(const float *rgba);
+	void ForgetColor();							// After a color array, the current color isn't known
+	void Forget();								// Nothing is known, everything is set again
+	void NewFrame();							// Zeroes the counts
+
+private:
+	// The capabilities and arrays that are shadowed
+	enum {
+		CAP_LIGHTING,
+		CAP_LIGHT0,
+		CAP_LIGHT1,
+		CAP_LIGHT2,
+		CAP_LIGHT3,
+		CAP_DEPTH_TEST,
+		CAP_BLEND,
+		CAP_TEXTURE_2D,
+		CAP_NORMALIZE,
+		CAP_COLOR_MATERIAL,
+		CAP_COUNT
+	};
+
+	enum {
+		ARRAY_VERTEX,
+		ARRAY_NORMAL,
+		ARRAY_TEXCOORD,
+		ARRAY_COLOR,
+		ARRAY_COUNT
+	};
+
+	// What's set, -1 when it isn't known
+	signed char caps[CAP_COUNT];
+	signed char arrays[ARRAY_COUNT];
+	unsigned int texture;
+	unsigned int vertexBuffer;
+	unsigned int indexBuffer;
+	unsigned int blendSrc;
+	unsigned int blendDst;
+	float color[4];
+	bool textureKnown;
+	bool buffersKnown;
+	bool blendKnown;
+	bool colorKnown;
+
+	static GLState *instance;
+
+	GLState();
+	int CapIndex(unsigned int cap);				// -1 if it isn't shadowed
+	int ArrayIndex(unsigned int array);
+};
+
+#endif GLSTATE_H
@@ -5,9 +5,9 @@
 //
 // GLTexture.cpp: implementation of the GLTexture class.
 // This class loads a texture file and prepares it
-// to be used in OpenGL. It can open a bitmap or a
-// targa file. The min filter is set to mipmap b/c
-// they look better and the performance cost on
+// to be used in OpenGL. It can open a bitmap, a
+// targa, a png or a jpeg file. The min filter is
+// set to mipmap b/c they look better and the performance cost on
 // modern video cards in negligible. I leave all of
 // the texture management to the application. I have
 // included the ability to load the texture from a
@@ -17,6 +17,16 @@
 // (including the quotes). The targa's id must be
 // surrounded by quotation marks (i.e. "Texture.tga").
 //
+// Png and jpeg files can also be loaded in the background
+// with LoadAsync(). The texture stays plain grey (or keeps
+// whatever it had before) until the TextureStreamer has
+// decoded the file and uploaded it, so the game has to call
+// TextureStreamer::Get()->Pump() each frame.
+//
+// Every texture tells the TextureManager how big it is and
+// when it's used, so the manager can shrink the ones that
+// haven't been drawn for a while when memory gets tight.
+//
 // Usage:
 // GLTexture tex;
 // GLTexture tex1;
@@ -32,9 +42,16 @@
 // tex3.BuildColorTexture(255, 0, 0);	// Builds a solid red texture
 // tex3.Use();				 // Binds the targa for use
 //
+// // Decode a big texture without stopping the game
+// tex.LoadAsync("texture.jpg");
+//
 //////////////////////////////////////////////////////////////////////
 
 #include "GLTexture.h"
+#include "ImageDecoder.h"
+#include "TextureStreamer.h"
+#include "TextureManager.h"
+#include "GLState.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -47,34 +64,93 @@
 
 GLTexture::GLTexture()
 {
-
+	texturename = NULL;
+	nameBlock = NULL;
+	texture[0] = 0;
+	width = 0;
+	height = 0;
+	residency = -1;
 }
 
 GLTexture::~GLTexture()
 {
+	Unload();
+}
 
+void GLTexture::Unload()
+{
+	// Make sure a worker doesn't hand us a texture after we're gone
+	TextureStreamer::Cancel(this);
+	TextureManager::Forget(this);
+
+	if (texture[0] != 0)
+		GLState::Get()->DeleteTexture(texture[0]);
+
+	// strtok can leave texturename pointing into the middle of the
+	// copy, so it's the start of the block that gets freed
+	free(nameBlock);
+
+	texturename = NULL;
+	nameBlock = NULL;
+	texture[0] = 0;
+	width = 0;
+	height = 0;
 }
 
-void GLTexture::Load(char *name)
+void GLTexture::SetName(char *name)
 {
-	// make the texture name all lower case
-	texturename = _strlwr(_strdup(name));
+	// Copy it before freeing the old one, name might be the old one
+	char *copy = _strlwr(_strdup(name));
+
+	free(nameBlock);
+	nameBlock = copy;
+	texturename = copy;
 
 	// strip "'s
 	if (strstr(texturename, "\""))
 		texturename = strtok(texturename, "\"");
+}
+
+void GLTexture::Load(char *name)
+{
+	// make the texture name all lower case
+	SetName(name);
 
 	// check the file extension to see what type of texture
 	if(strstr(texturename, ".bmp"))	
 		LoadBMP(texturename);
 	if(strstr(texturename, ".tga"))	
 		LoadTGA(texturename);
+	if(strstr(texturename, ".png"))	
+		LoadPNG(texturename);
+	if(strstr(texturename, ".jpg") || strstr(texturename, ".jpeg"))	
+		LoadJPG(texturename);
+}
+
+void GLTexture::LoadAsync(char *name)
+{
+	// make the texture name all lower case
+	SetName(name);
+
+	// Only the png and jpeg decoders are thread safe, the rest load now
+	if (!strstr(texturename, ".png") && !strstr(texturename, ".jpg") && !strstr(texturename, ".jpeg"))
+	{
+		Load(texturename);
+		return;
+	}
+
+	// Give it something to show until the real one is ready, if there
+	// is already a texture (like a material's color) we keep that
+	if (texture[0] == 0)
+		BuildColorTexture(128, 128, 128);
+
+	TextureStreamer::Get()->Request(this, texturename);
 }
 
 void GLTexture::LoadFromResource(char *name)
 {
 	// make the texture name all lower case
-	texturename = _strlwr(_strdup(name));
+	SetName(name);
 
 	// check the file extension to see what type of texture
 	if(strstr(texturename, ".bmp"))
@@ -85,8 +161,21 @@ void GLTexture::LoadFromResource(char *name)
 
 void GLTexture::Use()
 {
-	glEnable(GL_TEXTURE_2D);								// Enable texture mapping
-	glBindTexture(GL_TEXTURE_2D, texture[0]);				// Bind the texture as the current one
+	GLState *gl = GLState::Get();
+	gl->Enable(GL_TEXTURE_2D);								// Enable texture mapping, unless it is
+	gl->BindTexture(texture[0]);							// Bind the texture, unless it already is
+
+	Touch();
+}
+
+unsigned int GLTexture::Touch()
+{
+	// Let the manager know we still need it, or it shrinks the texture
+	// and never brings it back
+	if (residency >= 0)
+		TextureManager::Get()->Touch(residency);
+
+	return texture[0];
 }
 
 void GLTexture::LoadBMP(char *name)
@@ -108,11 +197,12 @@ void GLTexture::LoadBMP(char *name)
 	width = TextureImage[0]->sizeX;
 	height = TextureImage[0]->sizeY;
 
-	// Generate the OpenGL texture id
-	glGenTextures(1, &texture[0]);
+	// Generate the OpenGL texture id, unless we're replacing one
+	if (texture[0] == 0)
+		glGenTextures(1, &texture[0]);
 
 	// Bind this texture to its id
-	glBindTexture(GL_TEXTURE_2D, texture[0]);
+	GLState::Get()->BindTexture(texture[0]);
 
 	// Use mipmapping filter
 	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_NEAREST);
@@ -120,6 +210,7 @@ void GLTexture::LoadBMP(char *name)
 
 	// Generate the mipmaps
 	gluBuild2DMipmaps(GL_TEXTURE_2D, 3, TextureImage[0]->sizeX, TextureImage[0]->sizeY, GL_RGB, GL_UNSIGNED_BYTE, TextureImage[0]->data);
+	TextureManager::Get()->Track(this);
 
 	// Cleanup
 	if (TextureImage[0])
@@ -206,11 +297,91 @@ void GLTexture::LoadTGA(char *name)
 	if (bpp == 24)
 		type = GL_RGB;
 	
-	// Generate the OpenGL texture id
-	glGenTextures(1, &texture[0]);
+	// Generate the OpenGL texture id, unless we're replacing one
+	if (texture[0] == 0)
+		glGenTextures(1, &texture[0]);
+
+	// Bind this texture to its id
+	GLState::Get()->BindTexture(texture[0]);
+
+	// Use mipmapping filter
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+
+	// Generate the mipmaps
+	gluBuild2DMipmaps(GL_TEXTURE_2D, type, width, height, type, GL_UNSIGNED_BYTE, imageData);
+	TextureManager::Get()->Track(this);
+
+	// Cleanup
+	free(imageData);
+}
+
+// Reads the whole file into memory and decodes it, png or jpeg
+static unsigned char *DecodeImageFile(char *name, ImageInfo *info)
+{
+	FILE *file = fopen(name, "rb");
+
+	if (file == NULL)
+		return NULL;
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	unsigned char *data = (unsigned char *)malloc(size > 0 ? size : 1);
+
+	if (data == NULL || fread(data, 1, size, file) != (size_t)size)
+	{
+		free(data);
+		fclose(file);
+		return NULL;
+	}
+
+	fclose(file);
+
+	unsigned char *pixels = NULL;
+
+	if (ReadImageInfo(data, size, info))
+	{
+		pixels = (unsigned char *)malloc(ImageSize(info));
+
+		if (pixels != NULL && !DecodeImage(data, size, info, pixels))
+		{
+			free(pixels);
+			pixels = NULL;
+		}
+	}
+
+	free(data);
+	return pixels;
+}
+
+void GLTexture::LoadPNG(char *name)
+{
+	ImageInfo info;
+
+	// Decode the file
+	unsigned char *imageData = DecodeImageFile(name, &info);
+
+	// If the file couldn't be read, return from the function
+	if (imageData == NULL)
+		return;
+
+	GLuint type = info.components == 4 ? GL_RGBA : GL_RGB;
+
+	// Just in case we want to use the width and height later
+	width = info.width;
+	height = info.height;
+
+	// Generate the OpenGL texture id, unless we're replacing one
+	if (texture[0] == 0)
+		glGenTextures(1, &texture[0]);
 
 	// Bind this texture to its id
-	glBindTexture(GL_TEXTURE_2D, texture[0]);
+	GLState::Get()->BindTexture(texture[0]);
+
+	// Rows are tightly packed
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
 	// Use mipmapping filter
 	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_NEAREST);
@@ -218,11 +389,51 @@ void GLTexture::LoadTGA(char *name)
 
 	// Generate the mipmaps
 	gluBuild2DMipmaps(GL_TEXTURE_2D, type, width, height, type, GL_UNSIGNED_BYTE, imageData);
+	TextureManager::Get()->Track(this);
 
 	// Cleanup
 	free(imageData);
 }
 
+void GLTexture::LoadJPG(char *name)
+{
+	// The decoder works out the format from the file itself
+	LoadPNG(name);
+}
+
+void GLTexture::UploadMipmaps(unsigned char *data, int w, int h, int components, int levels)
+{
+	GLuint type = components == 4 ? GL_RGBA : GL_RGB;
+
+	width = w;
+	height = h;
+
+	// Generate the OpenGL texture id, unless we're replacing one
+	if (texture[0] == 0)
+		glGenTextures(1, &texture[0]);
+
+	// Bind this texture to its id
+	GLState::Get()->BindTexture(texture[0]);
+
+	// Rows are tightly packed
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	// Use mipmapping filter
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+
+	// The levels are stored one after the other, largest first
+	for (int i = 0; i < levels; i++)
+	{
+		glTexImage2D(GL_TEXTURE_2D, i, type, w, h, 0, type, GL_UNSIGNED_BYTE, data);
+
+		data += w * h * components;
+		w = w > 1 ? w / 2 : 1;
+		h = h > 1 ? h / 2 : 1;
+	}
+
+	TextureManager::Get()->Track(this);
+}
 
 void GLTexture::LoadBMPResource(char *name)
 {
@@ -261,11 +472,12 @@ void GLTexture::LoadBMPResource(char *name)
 		ptr[i*3+2] = temp;
 	}
 
-	// Generate the OpenGL texture id
-	glGenTextures(1, &texture[0]);
+	// Generate the OpenGL texture id, unless we're replacing one
+	if (texture[0] == 0)
+		glGenTextures(1, &texture[0]);
 
 	// Bind this texture to its id
-	glBindTexture(GL_TEXTURE_2D, texture[0]);
+	GLState::Get()->BindTexture(texture[0]);
 
 	// Use mipmapping filter
 	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_NEAREST);
@@ -273,6 +485,7 @@ void GLTexture::LoadBMPResource(char *name)
 
 	// Generate the mipmaps
 	gluBuild2DMipmaps(GL_TEXTURE_2D, 3, width, height, GL_RGB, GL_UNSIGNED_BYTE, (unsigned char *)buffer+sizeof(BITMAPINFO)+2);
+	TextureManager::Get()->Track(this);
 	//gluBuild2DMipmaps(GL_TEXTURE_2D, 3, width, height, GL_RGB, GL_UNSIGNED_BYTE, bmp->bmBits);
 
 	// Cleanup
@@ -355,11 +568,12 @@ void GLTexture::LoadTGAResource(char *name)
 	if (bpp == 24)
 		type = GL_RGB;
 	
-	// Generate the OpenGL texture id
-	glGenTextures(1, &texture[0]);
+	// Generate the OpenGL texture id, unless we're replacing one
+	if (texture[0] == 0)
+		glGenTextures(1, &texture[0]);
 
 	// Bind this texture to its id
-	glBindTexture(GL_TEXTURE_2D, texture[0]);
+	GLState::Get()->BindTexture(texture[0]);
 
 	// Use mipmapping filter
 	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_NEAREST);
@@ -367,6 +581,7 @@ void GLTexture::LoadTGAResource(char *name)
 
 	// Generate the mipmaps
 	gluBuild2DMipmaps(GL_TEXTURE_2D, type, width, height, type, GL_UNSIGNED_BYTE, imageData);
+	TextureManager::Get()->Track(this);
 
 	// Cleanup
 	free(imageData);
@@ -386,11 +601,12 @@ void GLTexture::BuildColorTexture(unsigned char r, unsigned char g, unsigned cha
 		data[i+2] = b;
 	}
 
-	// Generate the OpenGL texture id
-	glGenTextures(1, &texture[0]);
+	// Generate the OpenGL texture id, unless we're replacing one
+	if (texture[0] == 0)
+		glGenTextures(1, &texture[0]);
 
 	// Bind this texture to its id
-	glBindTexture(GL_TEXTURE_2D, texture[0]);
+	GLState::Get()->BindTexture(texture[0]);
 
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
@@ -400,4 +616,5 @@ void GLTexture::BuildColorTexture(unsigned char r, unsigned char g, unsigned cha
 
 	// Generate the texture
 	gluBuild2DMipmaps(GL_TEXTURE_2D, 3, 2, 2, GL_RGB, GL_UNSIGNED_BYTE, data);
+	TextureManager::Get()->Track(this);
 }
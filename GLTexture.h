@@ -5,9 +5,9 @@
 //
 // GLTexture.h: interface for the GLTexture class.
 // This class loads a texture file and prepares it
-// to be used in OpenGL. It can open a bitmap or a
-// targa file. The min filter is set to mipmap b/c
-// they look better and the performance cost on
+// to be used in OpenGL. It can open a bitmap, a
+// targa, a png or a jpeg file. The min filter is
+// set to mipmap b/c they look better and the performance cost on
 // modern video cards in negligible. I leave all of
 // the texture management to the application. I have
 // included the ability to load the texture from a
@@ -17,6 +17,16 @@
 // (including the quotes). The targa's id must be
 // surrounded by quotation marks (i.e. "Texture.tga").
 //
+// Png and jpeg files can also be loaded in the background
+// with LoadAsync(). The texture stays plain grey (or keeps
+// whatever it had before) until the TextureStreamer has
+// decoded the file and uploaded it, so the game has to call
+// TextureStreamer::Get()->Pump() each frame.
+//
+// Every texture tells the TextureManager how big it is and
+// when it's used, so the manager can shrink the ones that
+// haven't been drawn for a while when memory gets tight.
+//
 // Usage:
 // GLTexture tex;
 // GLTexture tex1;
@@ -32,6 +42,12 @@
 // tex3.BuildColorTexture(255, 0, 0);	// Builds a solid red texture
 // tex3.Use();				 // Binds the targa for use
 //
+// // Decode a big texture without stopping the game
+// tex.LoadAsync("texture.jpg");
+//
+// // Give the memory back, the destructor does this too
+// tex.Unload();
+//
 //////////////////////////////////////////////////////////////////////
 
 #ifndef GLTEXTURE_H
@@ -51,17 +67,31 @@ public:
 	unsigned int texture[1];						// OpenGL's number for the texture
 	int width;										// Texture's width
 	int height;										// Texture's height
+	int residency;									// Our slot in the TextureManager, -1 if not counted
 	void Use();										// Binds the texture for use
+	unsigned int Touch();							// Marks it used without binding it, returns texture[0]
 	void BuildColorTexture(unsigned char r, unsigned char g, unsigned char b);	// Sometimes we want a texture of uniform color
 	void LoadTGAResource(char *name);				// Load a targa from the resources
 	void LoadBMPResource(char *name);				// Load a bitmap from the resources
 	void LoadFromResource(char *name);				// Load the texture from a resource
+	void UploadMipmaps(unsigned char *data, int w, int h, int components, int levels);	// Hands a prebuilt mip chain to OpenGL
+	void LoadAsync(char *name);						// Load the texture on the TextureStreamer's threads
+	void LoadJPG(char *name);						// Loads a jpeg file
+	void LoadPNG(char *name);						// Loads a png file
 	void LoadTGA(char *name);						// Loads a targa file
 	void LoadBMP(char *name);						// Loads a bitmap file
 	void Load(char *name);							// Load the texture
+	void Unload();									// Deletes the OpenGL texture and forgets the name
 	GLTexture();									// Constructor
 	virtual ~GLTexture();							// Destructor
 
+private:
+	char *nameBlock;								// The copy texturename points into, ours to free
+	void SetName(char *name);						// Keeps a lower case copy of the name
+
+	// Each texture owns its OpenGL name, so they can't be copied
+	GLTexture(const GLTexture &);
+	GLTexture &operator=(const GLTexture &);
 };
 
 #endif GLTEXTURE_H
\ No newline at end of file
@@ -0,0 +1,270 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Glyph Font
+//
+// GlyphFont.cpp: implementation of the GlyphFont and TextLayout
+// classes.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "GlyphFont.h"
+
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+// Blank pixels left either side of a glyph for the smoothing to spill into
+#define GLYPH_MARGIN	1
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+GlyphFont::GlyphFont()
+{
+	atlas = NULL;
+	height = 0;
+	ascent = 0;
+
+	for (int i = 0; i < GLYPH_COUNT; i++)
+	{
+		glyphs[i].region = -1;
+		glyphs[i].left = 0;
+		glyphs[i].advance = 0;
+	}
+}
+
+bool GlyphFont::Create(TextureAtlas *fontAtlas, const char *face, int pixelHeight, bool bold)
+{
+	atlas = fontAtlas;
+
+	HDC dc = CreateCompatibleDC(NULL);
+	if (dc == NULL)
+		return false;
+
+	HFONT font = CreateFontA(-pixelHeight, 0, 0, 0, bold ? FW_BOLD : FW_NORMAL, FALSE, FALSE, FALSE,
+		ANSI_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, ANTIALIASED_QUALITY, DEFAULT_PITCH, face);
+	if (font == NULL)
+	{
+		DeleteDC(dc);
+		return false;
+	}
+
+	HGDIOBJ oldFont = SelectObject(dc, font);
+
+	TEXTMETRICA tm;
+	GetTextMetricsA(dc, &tm);
+	height = tm.tmHeight;
+	ascent = tm.tmAscent;
+
+	// Somewhere to draw one glyph at a time. A positive height makes
+	// the rows go bottom up, the same way round as our textures
+	int cellWidth = tm.tmMaxCharWidth + 2 * GLYPH_MARGIN;
+
+	BITMAPINFO info;
+	memset(&info, 0, sizeof(info));
+	info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+	info.bmiHeader.biWidth = cellWidth;
+	info.bmiHeader.biHeight = height;
+	info.bmiHeader.biPlanes = 1;
+	info.bmiHeader.biBitCount = 32;
+	info.bmiHeader.biCompression = BI_RGB;
+
+	void *bits = NULL;
+	HBITMAP bitmap = CreateDIBSection(dc, &info, DIB_RGB_COLORS, &bits, NULL, 0);
+	if (bitmap == NULL || bits == NULL)
+	{
+		SelectObject(dc, oldFont);
+		DeleteObject(font);
+		DeleteDC(dc);
+		return false;
+	}
+
+	HGDIOBJ oldBitmap = SelectObject(dc, bitmap);
+	SetTextColor(dc, RGB(255, 255, 255));
+	SetBkColor(dc, RGB(0, 0, 0));
+	SetBkMode(dc, OPAQUE);
+
+	unsigned char *pixels = (unsigned char *)malloc(cellWidth * height * 4);
+
+	for (int i = 0; i < GLYPH_COUNT && pixels != NULL; i++)
+	{
+		char c = (char)(GLYPH_FIRST + i);
+
+		SIZE extent;
+		GetTextExtentPoint32A(dc, &c, 1, &extent);
+
+		glyphs[i].advance = extent.cx;
+		glyphs[i].left = -GLYPH_MARGIN;
+
+		// Space moves the pen but has nothing to draw
+		if (c == ' ')
+			continue;
+
+		int w = extent.cx + 2 * GLYPH_MARGIN;
+		if (w > cellWidth)
+			w = cellWidth;
+
+		memset(bits, 0, cellWidth * height * 4);
+		TextOutA(dc, GLYPH_MARGIN, 0, &c, 1);
+		GdiFlush();
+
+		// White text on black, so any channel is how much it covers
+		const unsigned char *src = (const unsigned char *)bits;
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < w; x++)
+			{
+				unsigned char *dst = pixels + (y * w + x) * 4;
+
+				dst[0] = 255;
+				dst[1] = 255;
+				dst[2] = 255;
+				dst[3] = src[(y * cellWidth + x) * 4 + 1];
+			}
+		}
+
+		char name[64];
+		sprintf(name, "%s %d %c", face, pixelHeight, c);
+		glyphs[i].region = atlas->Add(name, pixels, w, height, 4);
+	}
+
+	free(pixels);
+
+	SelectObject(dc, oldBitmap);
+	SelectObject(dc, oldFont);
+	DeleteObject(bitmap);
+	DeleteObject(font);
+	DeleteDC(dc);
+
+	return true;
+}
+
+const Glyph *GlyphFont::Find(char c)
+{
+	if (c < GLYPH_FIRST || c > GLYPH_LAST)
+		return NULL;
+
+	return &glyphs[c - GLYPH_FIRST];
+}
+
+int GlyphFont::Width(const char *text)
+{
+	int width = 0;
+
+	for (const char *p = text; *p; p++)
+	{
+		const Glyph *g = Find(*p);
+		if (g != NULL)
+			width += g->advance;
+	}
+
+	return width;
+}
+
+int GlyphFont::Height()
+{
+	return height;
+}
+
+int GlyphFont::Ascent()
+{
+	return ascent;
+}
+
+TextureAtlas *GlyphFont::Atlas()
+{
+	return atlas;
+}
+
+//////////////////////////////////////////////////////////////////////
+// TextLayout
+//////////////////////////////////////////////////////////////////////
+
+TextLayout::TextLayout()
+{
+	font = NULL;
+	text[0] = 0;
+	numQuads = 0;
+	width = 0;
+	rebuilds = 0;
+}
+
+bool TextLayout::Set(GlyphFont *newFont, const char *newText)
+{
+	// Nothing to do if it still says the same thing
+	if (font == newFont && strncmp(text, newText, TEXT_LAYOUT_MAX - 1) == 0)
+		return false;
+
+	font = newFont;
+	strncpy(text, newText, TEXT_LAYOUT_MAX - 1);
+	text[TEXT_LAYOUT_MAX - 1] = 0;
+
+	numQuads = 0;
+	width = 0;
+
+	if (font == NULL)
+		return true;
+
+	float top = (float)-font->Ascent();
+	float bottom = top + font->Height();
+	int pen = 0;
+
+	for (const char *p = text; *p; p++)
+	{
+		const Glyph *g = font->Find(*p);
+		if (g == NULL)
+			continue;
+
+		const AtlasRegion *region = font->Atlas()->Region(g->region);
+		if (region != NULL)
+		{
+			Quad &q = quads[numQuads++];
+			q.region = g->region;
+			q.x0 = (float)(pen + g->left);
+			q.y0 = top;
+			q.x1 = q.x0 + region->width;
+			q.y1 = bottom;
+		}
+
+		pen += g->advance;
+	}
+
+	width = pen;
+	rebuilds++;
+
+	return true;
+}
+
+void TextLayout::Add(AtlasBatch *batch, float x, float y)
+{
+	if (font == NULL)
+		return;
+
+	TextureAtlas *atlas = font->Atlas();
+
+	for (int i = 0; i < numQuads; i++)
+	{
+		const Quad &q = quads[i];
+
+		// The glyph's bottom row is at t = 0 and y goes down the screen
+		batch->Region(atlas->Region(q.region));
+		batch->Rect(x + q.x0, y + q.y1, x + q.x1, y + q.y0, 0.0f);
+	}
+}
+
+const char *TextLayout::Text()
+{
+	return text;
+}
+
+int TextLayout::Width()
+{
+	return width;
+}
+
+int TextLayout::Rebuilds()
+{
+	return rebuilds;
+}
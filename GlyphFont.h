@@ -0,0 +1,101 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Glyph Font
+//
+// GlyphFont.h: interface for the GlyphFont and TextLayout
+// classes. glutBitmapCharacter draws every letter with its own
+// glBitmap call, every frame. A GlyphFont draws each printable
+// character once at startup (with Windows' own font renderer)
+// and packs them into a TextureAtlas, so text becomes a row of
+// textured quads that can go in an AtlasBatch with everything
+// else.
+//
+// A TextLayout is one string that has already been turned
+// into quads. Set() only does the work again when the text is
+// different from last time, so a score that hasn't changed
+// costs nothing but a strcmp. Layouts never allocate memory.
+//
+// Positions are in pixels with y going down the screen, the
+// same as the HUD's glOrtho. x, y is the left end of the
+// baseline, which is where glRasterPos used to put the text.
+//
+// Usage:
+// TextureAtlas fonts;
+// GlyphFont font;
+// TextLayout score;
+// AtlasBatch text;
+//
+// fonts.Create(512);
+// font.Create(&fonts, "Arial", 18, false);	// Packs every glyph
+// fonts.Build();
+//
+// score.Set(&font, "Score: 10");				// Lays it out if it changed
+// text.Begin();
+// text.Color(1.0f, 1.0f, 1.0f);
+// score.Add(&text, 20, 60);
+// text.Draw(&fonts);							// All the text in one go
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef GLYPHFONT_H
+#define GLYPHFONT_H
+
+#include "TextureAtlas.h"
+
+#define GLYPH_FIRST			32		// Space
+#define GLYPH_LAST			126		// Tilde
+#define GLYPH_COUNT			(GLYPH_LAST - GLYPH_FIRST + 1)
+#define TEXT_LAYOUT_MAX		128		// Longest string a layout can hold
+
+// One character as it sits in the atlas
+struct Glyph {
+	int region;			// Its region in the atlas, -1 if it has no pixels
+	int left;			// Pixels from the pen to the left edge of the region
+	int advance;		// How far the pen moves after it
+};
+
+class GlyphFont
+{
+public:
+	bool Create(TextureAtlas *atlas, const char *face, int pixelHeight, bool bold);	// Draws every glyph into the atlas
+	const Glyph *Find(char c);					// The glyph for a character, or NULL
+	int Width(const char *text);				// Width of a string in pixels
+	int Height();								// Height of a line
+	int Ascent();								// Baseline to the top of the line
+	TextureAtlas *Atlas();						// Where the glyphs are
+	GlyphFont();								// Constructor
+
+private:
+	TextureAtlas *atlas;
+	Glyph glyphs[GLYPH_COUNT];
+	int height;
+	int ascent;
+};
+
+class TextLayout
+{
+public:
+	bool Set(GlyphFont *font, const char *text);	// Lays the text out if it changed, true if it did
+	void Add(AtlasBatch *batch, float x, float y);	// Puts the quads in the batch with the baseline at x, y
+	const char *Text();							// What it says
+	int Width();								// Width in pixels
+	int Rebuilds();								// Times Set() had to lay it out
+	TextLayout();								// Constructor
+
+private:
+	// One character's quad, relative to the start of the baseline
+	struct Quad {
+		int region;
+		float x0, y0;			// Top left
+		float x1, y1;			// Bottom right
+	};
+
+	GlyphFont *font;
+	char text[TEXT_LAYOUT_MAX];
+	Quad quads[TEXT_LAYOUT_MAX];
+	int numQuads;
+	int width;
+	int rebuilds;
+};
+
+#endif GLYPHFONT_H
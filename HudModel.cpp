@@ -0,0 +1,92 @@
+//////////////////////////////////////////////////////////////////////
+//
+// HUD Model
+//
+// HudModel.cpp: implementation of the HudModel class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "HudModel.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char *AmmoTypeName(int type)
+{
+	switch (type)
+	{
+		case HUD_AMMO_HIGH_DAMAGE	: return " [High Damage]";
+		case HUD_AMMO_NORMAL		: return " [NORMAL]";
+		case HUD_AMMO_EXPLOSIVE		: return " [EXPLOSIVE]";
+		case HUD_AMMO_FAST_FIRE		: return " [FAST FIRE]";
+	}
+
+	return " [Regular]";
+}
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+HudModel::HudModel()
+{
+	font = NULL;
+	memset(&shown, 0, sizeof(shown));
+	valid = false;
+	formats = 0;
+}
+
+void HudModel::Create(GlyphFont *hudFont)
+{
+	font = hudFont;
+	valid = false;
+	formats = 0;
+}
+
+void HudModel::Update(const HudState &state)
+{
+	// Big enough for anything a layout can hold
+	char text[TEXT_LAYOUT_MAX];
+
+	if (!valid || state.score != shown.score || state.winningScore != shown.winningScore)
+	{
+		snprintf(text, sizeof(text), "Score: %d/%d", state.score, state.winningScore);
+		score.Set(font, text);
+		formats++;
+	}
+
+	if (!valid || state.level != shown.level)
+	{
+		snprintf(text, sizeof(text), "Level: %d", state.level);
+		level.Set(font, text);
+
+		snprintf(text, sizeof(text), "Level %d Complete! Starting Level %d", state.level - 1, state.level);
+		completion.Set(font, text);
+		formats += 2;
+	}
+
+	if (!valid || state.ammo != shown.ammo || state.maxAmmo != shown.maxAmmo ||
+		state.reserves != shown.reserves || state.ammoType != shown.ammoType ||
+		state.reloading != shown.reloading)
+	{
+		snprintf(text, sizeof(text), "Ammo: %d/%d (Reserves: %d)%s%s", state.ammo, state.maxAmmo,
+			state.reserves, AmmoTypeName(state.ammoType), state.reloading ? " (Reloading...)" : "");
+		ammo.Set(font, text);
+		formats++;
+	}
+
+	if (!valid || state.seconds != shown.seconds)
+	{
+		snprintf(text, sizeof(text), "Time: %d:%02d", state.seconds / 60, state.seconds % 60);
+		timer.Set(font, text);
+		formats++;
+	}
+
+	shown = state;
+	valid = true;
+}
+
+int HudModel::Formats()
+{
+	return formats;
+}
@@ -0,0 +1,73 @@
+//////////////////////////////////////////////////////////////////////
+//
+// HUD Model
+//
+// HudModel.h: interface for the HudModel class.
+// The HUD used to build its strings with std::string and
+// std::to_string every frame, which is several trips to the
+// heap per frame to say the same thing as last time. The game
+// now fills in a HudState with the numbers it wants shown and
+// the HudModel compares them with the ones it showed before.
+// Only the lines whose numbers changed are formatted again,
+// into a buffer on the stack, and handed to their TextLayout.
+//
+// Usage:
+// HudModel hud;
+// HudState state;
+//
+// hud.Create(&font);
+// state.score = playerScore; ...				// Every frame
+// hud.Update(state);							// Formats what changed
+// hud.score.Add(&batch, 20, 60);
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef HUDMODEL_H
+#define HUDMODEL_H
+
+#include "GlyphFont.h"
+
+// What the ammo line says it's loaded with
+enum HudAmmoType {
+	HUD_AMMO_REGULAR,
+	HUD_AMMO_HIGH_DAMAGE,
+	HUD_AMMO_NORMAL,
+	HUD_AMMO_EXPLOSIVE,
+	HUD_AMMO_FAST_FIRE
+};
+
+// Everything the HUD text shows
+struct HudState {
+	int score;
+	int winningScore;
+	int level;
+	int ammo;
+	int maxAmmo;
+	int reserves;
+	int ammoType;			// One of the HudAmmoTypes
+	bool reloading;
+	int seconds;			// Whole seconds left on the timer
+};
+
+class HudModel
+{
+public:
+	TextLayout score;
+	TextLayout level;
+	TextLayout ammo;
+	TextLayout timer;
+	TextLayout completion;						// "Level 1 Complete!..." for the current level
+
+	void Create(GlyphFont *font);				// Sets the font, everything is formatted on the next Update
+	void Update(const HudState &state);			// Formats the lines whose values changed
+	int Formats();								// Lines formatted since Create
+	HudModel();									// Constructor
+
+private:
+	GlyphFont *font;
+	HudState shown;								// What the layouts say now
+	bool valid;									// False until the first Update
+	int formats;
+};
+
+#endif HUDMODEL_H
@@ -0,0 +1,1785 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Image Decoder
+//
+// ImageDecoder.cpp: implementation of the PNG, JPEG and BMP decoders.
+// The PNG decoder carries its own inflate so we don't need
+// zlib, and the JPEG decoder handles the baseline files that
+// every modelling package exports. They decode straight into
+// the caller's buffer and only allocate the scratch memory
+// they can't do without.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "ImageDecoder.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+//////////////////////////////////////////////////////////////////////
+// Inflate (RFC 1951)
+//////////////////////////////////////////////////////////////////////
+
+// Codes up to this many bits long are decoded with a single table lookup
+#define INFLATE_FAST_BITS	9
+#define INFLATE_FAST_SIZE	(1 << INFLATE_FAST_BITS)
+
+// A canonical huffman code
+struct InflateHuffman {
+	unsigned short fast[INFLATE_FAST_SIZE];	// (length << 9) | symbol for short codes, 0 otherwise
+	unsigned short count[16];				// The number of codes of each length
+	unsigned short symbol[288];				// The symbols ordered by their codes
+};
+
+// Reads the compressed data a few bits at a time, least significant bit first
+struct InflateStream {
+	const unsigned char *in;	// The compressed data
+	size_t inSize;				// The size of the compressed data
+	size_t inPos;				// The next byte to read
+	unsigned int bitBuf;		// Bits that have been read but not used yet
+	int bitCount;				// The number of bits in bitBuf
+	int overrun;				// The number of bytes we made up past the end
+	unsigned char *out;			// Where the decompressed data goes
+	size_t outSize;				// The size of the output buffer
+	size_t outPos;				// The next byte to write
+};
+
+static const unsigned short lengthBase[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char lengthExtra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short distBase[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const unsigned char distExtra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static void InflateFill(InflateStream *s, int bits)
+{
+	while (s->bitCount < bits)
+	{
+		unsigned int b = 0;
+
+		// Feed zeros past the end so the decoder can't run off the buffer,
+		// and count them so we can tell a truncated stream from a good one
+		if (s->inPos < s->inSize)
+			b = s->in[s->inPos++];
+		else
+			s->overrun++;
+
+		s->bitBuf |= b << s->bitCount;
+		s->bitCount += 8;
+	}
+}
+
+static unsigned int InflateBits(InflateStream *s, int bits)
+{
+	if (bits == 0)
+		return 0;
+
+	InflateFill(s, bits);
+
+	unsigned int value = s->bitBuf & ((1u << bits) - 1);
+	s->bitBuf >>= bits;
+	s->bitCount -= bits;
+
+	return value;
+}
+
+static bool InflateBuildHuffman(InflateHuffman *h, const unsigned char *lengths, int n)
+{
+	unsigned short offsets[16];
+
+	memset(h->count, 0, sizeof(h->count));
+	memset(h->fast, 0, sizeof(h->fast));
+
+	for (int i = 0; i < n; i++)
+		h->count[lengths[i]]++;
+	h->count[0] = 0;
+
+	// Make sure the lengths describe a valid prefix code
+	int left = 1;
+	for (int len = 1; len < 16; len++)
+	{
+		left <<= 1;
+		left -= h->count[len];
+		if (left < 0)
+			return false;
+	}
+
+	// Sort the symbols by length, then by value
+	offsets[1] = 0;
+	for (int len = 1; len < 15; len++)
+		offsets[len + 1] = offsets[len] + h->count[len];
+
+	for (int sym = 0; sym < n; sym++)
+		if (lengths[sym] != 0)
+			h->symbol[offsets[lengths[sym]]++] = (unsigned short)sym;
+
+	// Fill the lookup table with the short codes. Deflate stores the
+	// codes most significant bit first so they have to be reversed.
+	int code = 0;
+	int index = 0;
+	for (int len = 1; len <= INFLATE_FAST_BITS; len++)
+	{
+		for (int i = 0; i < h->count[len]; i++, code++, index++)
+		{
+			int reversed = 0;
+			for (int b = 0; b < len; b++)
+				reversed |= ((code >> b) & 1) << (len - 1 - b);
+
+			for (int j = reversed; j < INFLATE_FAST_SIZE; j += 1 << len)
+				h->fast[j] = (unsigned short)((len << 9) | h->symbol[index]);
+		}
+		code <<= 1;
+	}
+
+	return true;
+}
+
+static int InflateDecode(InflateStream *s, const InflateHuffman *h)
+{
+	InflateFill(s, 16);
+
+	// Most codes are short enough to find in one go
+	unsigned short entry = h->fast[s->bitBuf & (INFLATE_FAST_SIZE - 1)];
+	if (entry != 0)
+	{
+		int len = entry >> 9;
+		s->bitBuf >>= len;
+		s->bitCount -= len;
+		return entry & 511;
+	}
+
+	// Otherwise walk the code a bit at a time
+	int code = 0;
+	int first = 0;
+	int index = 0;
+	for (int len = 1; len < 16; len++)
+	{
+		code |= (s->bitBuf >> (len - 1)) & 1;
+		int count = h->count[len];
+		if (code - count < first)
+		{
+			s->bitBuf >>= len;
+			s->bitCount -= len;
+			return h->symbol[index + (code - first)];
+		}
+		index += count;
+		first += count;
+		first <<= 1;
+		code <<= 1;
+	}
+
+	return -1;
+}
+
+static bool InflateStored(InflateStream *s)
+{
+	// Stored blocks start on a byte boundary
+	InflateBits(s, s->bitCount & 7);
+
+	unsigned int len = InflateBits(s, 16);
+	unsigned int nlen = InflateBits(s, 16);
+
+	if ((len ^ 0xFFFF) != nlen || s->outPos + len > s->outSize)
+		return false;
+
+	// Use up whatever is left in the bit buffer then copy the rest
+	while (len > 0 && s->bitCount >= 8)
+	{
+		s->out[s->outPos++] = (unsigned char)InflateBits(s, 8);
+		len--;
+	}
+
+	if (s->inPos + len > s->inSize)
+		return false;
+
+	memcpy(s->out + s->outPos, s->in + s->inPos, len);
+	s->outPos += len;
+	s->inPos += len;
+
+	return true;
+}
+
+static bool InflateCodes(InflateStream *s, const InflateHuffman *lencode, const InflateHuffman *distcode)
+{
+	for (;;)
+	{
+		int sym = InflateDecode(s, lencode);
+
+		if (sym < 0 || s->overrun > 4)
+			return false;
+
+		if (sym < 256)
+		{
+			// A literal byte
+			if (s->outPos >= s->outSize)
+				return false;
+			s->out[s->outPos++] = (unsigned char)sym;
+		}
+		else if (sym == 256)
+		{
+			// End of the block
+			return true;
+		}
+		else
+		{
+			// A match with an earlier part of the output
+			sym -= 257;
+			if (sym >= 29)
+				return false;
+			size_t len = lengthBase[sym] + InflateBits(s, lengthExtra[sym]);
+
+			int dsym = InflateDecode(s, distcode);
+			if (dsym < 0 || dsym >= 30)
+				return false;
+			size_t dist = distBase[dsym] + InflateBits(s, distExtra[dsym]);
+
+			if (dist > s->outPos || s->outPos + len > s->outSize)
+				return false;
+
+			// The source and destination can overlap so copy byte by byte
+			unsigned char *dst = s->out + s->outPos;
+			const unsigned char *src = dst - dist;
+			for (size_t i = 0; i < len; i++)
+				dst[i] = src[i];
+			s->outPos += len;
+		}
+	}
+}
+
+// The fixed codes never change so they are only built once
+struct InflateFixedCodes {
+	InflateHuffman lencode;
+	InflateHuffman distcode;
+
+	InflateFixedCodes()
+	{
+		unsigned char lengths[288];
+		int i;
+
+		for (i = 0; i < 144; i++) lengths[i] = 8;
+		for (; i < 256; i++) lengths[i] = 9;
+		for (; i < 280; i++) lengths[i] = 7;
+		for (; i < 288; i++) lengths[i] = 8;
+		InflateBuildHuffman(&lencode, lengths, 288);
+
+		for (i = 0; i < 30; i++) lengths[i] = 5;
+		InflateBuildHuffman(&distcode, lengths, 30);
+	}
+};
+
+static bool InflateFixed(InflateStream *s)
+{
+	// Function statics are initialized once even with several decoding threads
+	static const InflateFixedCodes fixed;
+
+	return InflateCodes(s, &fixed.lencode, &fixed.distcode);
+}
+
+static bool InflateDynamic(InflateStream *s)
+{
+	static const unsigned char order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+	unsigned char lengths[320];
+	InflateHuffman lencode;
+	InflateHuffman distcode;
+
+	int nlen = InflateBits(s, 5) + 257;
+	int ndist = InflateBits(s, 5) + 1;
+	int ncode = InflateBits(s, 4) + 4;
+
+	if (nlen > 286 || ndist > 30)
+		return false;
+
+	// Read the code that the literal/length and distance code lengths are coded with
+	memset(lengths, 0, 19);
+	for (int i = 0; i < ncode; i++)
+		lengths[order[i]] = (unsigned char)InflateBits(s, 3);
+
+	if (!InflateBuildHuffman(&lencode, lengths, 19))
+		return false;
+
+	// Read the literal/length and distance code lengths
+	int index = 0;
+	while (index < nlen + ndist)
+	{
+		int sym = InflateDecode(s, &lencode);
+		if (sym < 0 || s->overrun > 4)
+			return false;
+
+		if (sym < 16)
+		{
+			lengths[index++] = (unsigned char)sym;
+		}
+		else
+		{
+			unsigned char len = 0;
+			int repeat;
+
+			if (sym == 16)
+			{
+				// Repeat the last length 3 to 6 times
+				if (index == 0)
+					return false;
+				len = lengths[index - 1];
+				repeat = 3 + InflateBits(s, 2);
+			}
+			else if (sym == 17)
+				repeat = 3 + InflateBits(s, 3);		// 3 to 10 zeros
+			else
+				repeat = 11 + InflateBits(s, 7);	// 11 to 138 zeros
+
+			if (index + repeat > nlen + ndist)
+				return false;
+			while (repeat--)
+				lengths[index++] = len;
+		}
+	}
+
+	// There has to be an end of block code
+	if (lengths[256] == 0)
+		return false;
+
+	if (!InflateBuildHuffman(&lencode, lengths, nlen) ||
+		!InflateBuildHuffman(&distcode, lengths + nlen, ndist))
+		return false;
+
+	return InflateCodes(s, &lencode, &distcode);
+}
+
+// Decompresses a zlib stream into out, which must be exactly outSize bytes
+static bool Inflate(const unsigned char *in, size_t inSize, unsigned char *out, size_t outSize)
+{
+	InflateStream s;
+
+	// Check the zlib header, we only know about deflate without a preset dictionary
+	if (inSize < 2 || (in[0] & 0x0F) != 8 || ((in[0] << 8) | in[1]) % 31 != 0 || (in[1] & 0x20))
+		return false;
+
+	s.in = in + 2;
+	s.inSize = inSize - 2;
+	s.inPos = 0;
+	s.bitBuf = 0;
+	s.bitCount = 0;
+	s.overrun = 0;
+	s.out = out;
+	s.outSize = outSize;
+	s.outPos = 0;
+
+	int last;
+	do
+	{
+		last = InflateBits(&s, 1);
+		int type = InflateBits(&s, 2);
+		bool ok;
+
+		switch (type)
+		{
+			case 0	:
+				ok = InflateStored(&s);
+				break;
+			case 1	:
+				ok = InflateFixed(&s);
+				break;
+			case 2	:
+				ok = InflateDynamic(&s);
+				break;
+			default	:
+				ok = false;
+				break;
+		}
+
+		if (!ok || s.overrun > 4)
+			return false;
+	} while (!last);
+
+	return s.outPos == outSize;
+}
+
+//////////////////////////////////////////////////////////////////////
+// PNG
+//////////////////////////////////////////////////////////////////////
+
+// Everything we need from the chunks in front of the image data
+struct PNGHeader {
+	int width;
+	int height;
+	int bitDepth;
+	int colorType;
+	int interlace;
+	int channels;					// Samples per pixel in the file
+	unsigned char palette[256 * 4];	// RGBA palette entries
+	int paletteSize;
+	bool hasKey;					// True: tRNS gave us a transparent colour
+	unsigned short key[3];			// The transparent grey or RGB value
+	bool hasAlpha;					// True: the decoded image has an alpha channel
+};
+
+static unsigned int ReadBE32(const unsigned char *p)
+{
+	return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | p[3];
+}
+
+static bool IsPNG(const unsigned char *data, size_t size)
+{
+	static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	return size >= 8 && memcmp(data, signature, 8) == 0;
+}
+
+static bool ReadPNGHeader(const unsigned char *data, size_t size, PNGHeader *h)
+{
+	size_t pos = 8;
+	bool gotHeader = false;
+
+	memset(h, 0, sizeof(PNGHeader));
+
+	// Walk the chunks up to the first IDAT
+	while (pos + 12 <= size)
+	{
+		unsigned int len = ReadBE32(data + pos);
+		const unsigned char *type = data + pos + 4;
+		const unsigned char *body = data + pos + 8;
+
+		if (len > size - pos - 12)
+			return false;
+
+		if (memcmp(type, "IHDR", 4) == 0)
+		{
+			if (len < 13)
+				return false;
+
+			h->width = (int)ReadBE32(body);
+			h->height = (int)ReadBE32(body + 4);
+			h->bitDepth = body[8];
+			h->colorType = body[9];
+			h->interlace = body[12];
+			gotHeader = true;
+		}
+		else if (memcmp(type, "PLTE", 4) == 0)
+		{
+			h->paletteSize = len / 3;
+			if (h->paletteSize > 256)
+				return false;
+
+			for (int i = 0; i < h->paletteSize; i++)
+			{
+				h->palette[i * 4] = body[i * 3];
+				h->palette[i * 4 + 1] = body[i * 3 + 1];
+				h->palette[i * 4 + 2] = body[i * 3 + 2];
+				h->palette[i * 4 + 3] = 255;
+			}
+		}
+		else if (memcmp(type, "tRNS", 4) == 0)
+		{
+			if (h->colorType == 3)
+			{
+				// Alpha values for the palette entries
+				for (unsigned int i = 0; i < len && i < 256; i++)
+					h->palette[i * 4 + 3] = body[i];
+				h->hasAlpha = true;
+			}
+			else if (h->colorType == 0 && len >= 2)
+			{
+				h->key[0] = (unsigned short)((body[0] << 8) | body[1]);
+				h->hasKey = true;
+				h->hasAlpha = true;
+			}
+			else if (h->colorType == 2 && len >= 6)
+			{
+				for (int i = 0; i < 3; i++)
+					h->key[i] = (unsigned short)((body[i * 2] << 8) | body[i * 2 + 1]);
+				h->hasKey = true;
+				h->hasAlpha = true;
+			}
+		}
+		else if (memcmp(type, "IDAT", 4) == 0 || memcmp(type, "IEND", 4) == 0)
+		{
+			break;
+		}
+
+		pos += len + 12;
+	}
+
+	if (!gotHeader || h->width <= 0 || h->height <= 0 || h->width > 16384 || h->height > 16384)
+		return false;
+
+	// Check the bit depth is allowed for the colour type
+	switch (h->colorType)
+	{
+		case 0	:
+			h->channels = 1;
+			if (h->bitDepth != 1 && h->bitDepth != 2 && h->bitDepth != 4 && h->bitDepth != 8 && h->bitDepth != 16)
+				return false;
+			break;
+		case 2	:
+			h->channels = 3;
+			if (h->bitDepth != 8 && h->bitDepth != 16)
+				return false;
+			break;
+		case 3	:
+			h->channels = 1;
+			if (h->bitDepth != 1 && h->bitDepth != 2 && h->bitDepth != 4 && h->bitDepth != 8)
+				return false;
+			if (h->paletteSize == 0)
+				return false;
+			break;
+		case 4	:
+			h->channels = 2;
+			h->hasAlpha = true;
+			if (h->bitDepth != 8 && h->bitDepth != 16)
+				return false;
+			break;
+		case 6	:
+			h->channels = 4;
+			h->hasAlpha = true;
+			if (h->bitDepth != 8 && h->bitDepth != 16)
+				return false;
+			break;
+		default	:
+			return false;
+	}
+
+	// Interlaced images aren't worth the code for textures
+	return h->interlace == 0;
+}
+
+static unsigned char Paeth(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = abs(p - a);
+	int pb = abs(p - b);
+	int pc = abs(p - c);
+
+	if (pa <= pb && pa <= pc)
+		return (unsigned char)a;
+	if (pb <= pc)
+		return (unsigned char)b;
+	return (unsigned char)c;
+}
+
+// Undoes the per row filters in place, leaving the filter type bytes where they were
+static bool UnfilterPNG(unsigned char *raw, int height, size_t stride, int bpp)
+{
+	unsigned char *prior = NULL;
+
+	for (int y = 0; y < height; y++)
+	{
+		unsigned char *row = raw + y * (stride + 1);
+		unsigned char filter = row[0];
+		unsigned char *cur = row + 1;
+		unsigned char *up = prior ? prior + 1 : NULL;
+
+		switch (filter)
+		{
+			case 0	:
+				break;
+			case 1	:
+				for (size_t i = bpp; i < stride; i++)
+					cur[i] = (unsigned char)(cur[i] + cur[i - bpp]);
+				break;
+			case 2	:
+				if (up)
+					for (size_t i = 0; i < stride; i++)
+						cur[i] = (unsigned char)(cur[i] + up[i]);
+				break;
+			case 3	:
+				for (size_t i = 0; i < stride; i++)
+				{
+					int left = i >= (size_t)bpp ? cur[i - bpp] : 0;
+					int above = up ? up[i] : 0;
+					cur[i] = (unsigned char)(cur[i] + ((left + above) >> 1));
+				}
+				break;
+			case 4	:
+				for (size_t i = 0; i < stride; i++)
+				{
+					int left = i >= (size_t)bpp ? cur[i - bpp] : 0;
+					int above = up ? up[i] : 0;
+					int corner = (up && i >= (size_t)bpp) ? up[i - bpp] : 0;
+					cur[i] = (unsigned char)(cur[i] + Paeth(left, above, corner));
+				}
+				break;
+			default	:
+				return false;
+		}
+
+		prior = row;
+	}
+
+	return true;
+}
+
+// Reads sample x of a row, scaled up to 16 bits so the colour key compares correctly
+static unsigned int PNGSample(const unsigned char *row, int x, int bitDepth)
+{
+	switch (bitDepth)
+	{
+		case 16	:
+			return (row[x * 2] << 8) | row[x * 2 + 1];
+		case 8	:
+			return row[x];
+		default	:
+		{
+			int perByte = 8 / bitDepth;
+			int shift = 8 - bitDepth * (x % perByte + 1);
+			return (row[x / perByte] >> shift) & ((1 << bitDepth) - 1);
+		}
+	}
+}
+
+static bool DecodePNG(const unsigned char *data, size_t size, unsigned char *pixels)
+{
+	PNGHeader h;
+
+	if (!ReadPNGHeader(data, size, &h))
+		return false;
+
+	// Gather up the compressed data, which can be split over any number of IDAT chunks
+	size_t compressedSize = 0;
+	size_t pos = 8;
+	while (pos + 12 <= size)
+	{
+		unsigned int len = ReadBE32(data + pos);
+		if (len > size - pos - 12)
+			return false;
+		if (memcmp(data + pos + 4, "IDAT", 4) == 0)
+			compressedSize += len;
+		pos += len + 12;
+	}
+
+	unsigned char *compressed = (unsigned char *)malloc(compressedSize);
+
+	size_t stride = ((size_t)h.width * h.channels * h.bitDepth + 7) / 8;
+	size_t rawSize = (stride + 1) * h.height;
+	unsigned char *raw = (unsigned char *)malloc(rawSize);
+
+	if (compressed == NULL || raw == NULL)
+	{
+		free(compressed);
+		free(raw);
+		return false;
+	}
+
+	size_t filled = 0;
+	pos = 8;
+	while (pos + 12 <= size)
+	{
+		unsigned int len = ReadBE32(data + pos);
+		if (memcmp(data + pos + 4, "IDAT", 4) == 0)
+		{
+			memcpy(compressed + filled, data + pos + 8, len);
+			filled += len;
+		}
+		pos += len + 12;
+	}
+
+	int bpp = (h.channels * h.bitDepth + 7) / 8;
+	bool ok = Inflate(compressed, compressedSize, raw, rawSize) && UnfilterPNG(raw, h.height, stride, bpp);
+
+	free(compressed);
+
+	if (!ok)
+	{
+		free(raw);
+		return false;
+	}
+
+	// Expand whatever the file had into RGB or RGBA
+	int outComponents = h.hasAlpha ? 4 : 3;
+	int maxValue = (1 << h.bitDepth) - 1;
+
+	for (int y = 0; y < h.height; y++)
+	{
+		const unsigned char *row = raw + y * (stride + 1) + 1;
+		unsigned char *dst = pixels + (size_t)(h.height - 1 - y) * h.width * outComponents;
+
+		for (int x = 0; x < h.width; x++, dst += outComponents)
+		{
+			unsigned char rgba[4];
+
+			switch (h.colorType)
+			{
+				case 0	:
+				{
+					unsigned int g = PNGSample(row, x, h.bitDepth);
+					rgba[0] = rgba[1] = rgba[2] = (unsigned char)(h.bitDepth == 16 ? g >> 8 : g * 255 / maxValue);
+					rgba[3] = (h.hasKey && g == h.key[0]) ? 0 : 255;
+					break;
+				}
+				case 2	:
+				{
+					unsigned int r = PNGSample(row, x * 3, h.bitDepth);
+					unsigned int g = PNGSample(row, x * 3 + 1, h.bitDepth);
+					unsigned int b = PNGSample(row, x * 3 + 2, h.bitDepth);
+					int shift = h.bitDepth == 16 ? 8 : 0;
+					rgba[0] = (unsigned char)(r >> shift);
+					rgba[1] = (unsigned char)(g >> shift);
+					rgba[2] = (unsigned char)(b >> shift);
+					rgba[3] = (h.hasKey && r == h.key[0] && g == h.key[1] && b == h.key[2]) ? 0 : 255;
+					break;
+				}
+				case 3	:
+				{
+					unsigned int index = PNGSample(row, x, h.bitDepth);
+					if ((int)index >= h.paletteSize)
+						index = 0;
+					memcpy(rgba, h.palette + index * 4, 4);
+					break;
+				}
+				case 4	:
+				{
+					int shift = h.bitDepth == 16 ? 8 : 0;
+					rgba[0] = rgba[1] = rgba[2] = (unsigned char)(PNGSample(row, x * 2, h.bitDepth) >> shift);
+					rgba[3] = (unsigned char)(PNGSample(row, x * 2 + 1, h.bitDepth) >> shift);
+					break;
+				}
+				default	:
+				{
+					int shift = h.bitDepth == 16 ? 8 : 0;
+					for (int c = 0; c < 4; c++)
+						rgba[c] = (unsigned char)(PNGSample(row, x * 4 + c, h.bitDepth) >> shift);
+					break;
+				}
+			}
+
+			memcpy(dst, rgba, outComponents);
+		}
+	}
+
+	free(raw);
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+// JPEG
+//////////////////////////////////////////////////////////////////////
+
+#define JPEG_FAST_BITS	9
+
+// The order the coefficients are stored in the file
+static const unsigned char zigzag[64 + 16] = {
+	 0,  1,  8, 16,  9,  2,  3, 10,
+	17, 24, 32, 25, 18, 11,  4,  5,
+	12, 19, 26, 33, 40, 48, 41, 34,
+	27, 20, 13,  6,  7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36,
+	29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46,
+	53, 60, 61, 54, 47, 55, 62, 63,
+	// Extra entries so a corrupt run length can't index past the end
+	63, 63, 63, 63, 63, 63, 63, 63,
+	63, 63, 63, 63, 63, 63, 63, 63 };
+
+struct JPEGHuffman {
+	unsigned char fast[1 << JPEG_FAST_BITS];	// Index into the symbols for short codes, 255 otherwise
+	unsigned char size[257];					// The length of each code
+	unsigned short code[256];					// The codes themselves
+	unsigned char values[256];					// The symbols
+	int maxCode[18];							// The largest code of each length, shifted up to 16 bits
+	int delta[17];								// Turns a code of a given length into a symbol index
+};
+
+struct JPEGComponent {
+	int id;					// The component id from the frame header
+	int h;					// Horizontal sampling factor
+	int v;					// Vertical sampling factor
+	int tq;					// Quantization table
+	int hd;					// DC huffman table for the current scan
+	int ha;					// AC huffman table for the current scan
+	int dcPred;				// The last DC value
+	int planeWidth;			// The width of the decoded plane
+	int planeHeight;		// The height of the decoded plane
+	unsigned char *plane;	// The decoded samples
+};
+
+struct JPEGDecoder {
+	const unsigned char *data;
+	size_t size;
+	size_t pos;
+
+	int width;
+	int height;
+	int numComponents;
+	JPEGComponent comp[3];
+	int hMax;
+	int vMax;
+	int mcusX;
+	int mcusY;
+
+	unsigned short quant[4][64];
+	JPEGHuffman huffDC[4];
+	JPEGHuffman huffAC[4];
+	int restartInterval;
+
+	// Entropy coded data is read most significant bit first
+	unsigned int bitBuf;
+	int bitCount;
+	int marker;			// The marker that stopped the bit reader, 0 if none
+	bool error;
+
+	// Turning the planes into RGB, set up once the frame has been read
+	unsigned char *pixels;	// Where the RGB goes
+	int rowsDone;			// Rows of pixels converted so far
+	int *columns[3];		// Which sample of each plane every column of the image uses
+	int chromaShift;		// 0 or 1 if chroma is full or half width next to full luma, otherwise -1
+	int crR[256];			// How far each chroma sample moves red, green and blue
+	int cbB[256];
+	int cbG[256];			// The green ones are still in 16 bit fixed point, they're
+	int crG[256];			// added together first
+	unsigned char limit[1024];	// Clamps a sum to 0-255, zero is at LIMIT_OFFSET
+};
+
+static int ReadBE16(JPEGDecoder *j)
+{
+	if (j->pos + 2 > j->size)
+	{
+		j->error = true;
+		return 0;
+	}
+
+	int value = (j->data[j->pos] << 8) | j->data[j->pos + 1];
+	j->pos += 2;
+	return value;
+}
+
+static int ReadByte(JPEGDecoder *j)
+{
+	if (j->pos >= j->size)
+	{
+		j->error = true;
+		return 0;
+	}
+
+	return j->data[j->pos++];
+}
+
+static bool BuildJPEGHuffman(JPEGHuffman *h, const int *counts)
+{
+	int k = 0;
+
+	// Work out the length of each code
+	for (int i = 0; i < 16; i++)
+		for (int j = 0; j < counts[i]; j++)
+		{
+			if (k >= 256)
+				return false;
+			h->size[k++] = (unsigned char)(i + 1);
+		}
+	h->size[k] = 0;
+
+	// Then the codes themselves
+	int code = 0;
+	k = 0;
+	for (int len = 1; len <= 16; len++)
+	{
+		h->delta[len] = k - code;
+		while (h->size[k] == len)
+			h->code[k++] = (unsigned short)(code++);
+		if (code - 1 >= (1 << len))
+			return false;
+		h->maxCode[len] = code << (16 - len);
+		code <<= 1;
+	}
+	h->maxCode[17] = 0x7FFFFFFF;
+
+	// Short codes go in the lookup table
+	memset(h->fast, 255, sizeof(h->fast));
+	for (int i = 0; i < k; i++)
+	{
+		int len = h->size[i];
+		if (len <= JPEG_FAST_BITS)
+		{
+			int first = h->code[i] << (JPEG_FAST_BITS - len);
+			int count = 1 << (JPEG_FAST_BITS - len);
+			for (int j = 0; j < count; j++)
+				h->fast[first + j] = (unsigned char)i;
+		}
+	}
+
+	return true;
+}
+
+static void JPEGFill(JPEGDecoder *j)
+{
+	while (j->bitCount <= 24)
+	{
+		int b = 0;
+
+		// Once we've hit a marker just feed in zeros
+		if (j->marker == 0 && j->pos < j->size)
+		{
+			b = j->data[j->pos];
+			if (b == 0xFF)
+			{
+				int next = j->pos + 1 < j->size ? j->data[j->pos + 1] : 0xD9;
+				if (next == 0)
+				{
+					// A stuffed 0xFF byte
+					j->pos += 2;
+				}
+				else
+				{
+					// A real marker, leave it for the parser
+					j->marker = next;
+					b = 0;
+				}
+			}
+			else
+			{
+				j->pos++;
+			}
+		}
+
+		j->bitBuf |= (unsigned int)b << (24 - j->bitCount);
+		j->bitCount += 8;
+	}
+}
+
+static int JPEGDecode(JPEGDecoder *j, const JPEGHuffman *h)
+{
+	if (j->bitCount < 16)
+		JPEGFill(j);
+
+	int k = h->fast[j->bitBuf >> (32 - JPEG_FAST_BITS)];
+	if (k < 255)
+	{
+		int len = h->size[k];
+		j->bitBuf <<= len;
+		j->bitCount -= len;
+		return h->values[k];
+	}
+
+	// The code wasn't in the lookup table so search by length
+	unsigned int top = j->bitBuf >> 16;
+	int len;
+	for (len = 1; len <= 16; len++)
+		if ((int)top < h->maxCode[len])
+			break;
+
+	if (len > 16)
+	{
+		j->error = true;
+		return 0;
+	}
+
+	int index = (j->bitBuf >> (32 - len)) + h->delta[len];
+	if (index < 0 || index > 255 || h->size[index] != len)
+	{
+		j->error = true;
+		return 0;
+	}
+
+	j->bitBuf <<= len;
+	j->bitCount -= len;
+	return h->values[index];
+}
+
+// Reads a signed value that takes up n bits
+static int JPEGReceive(JPEGDecoder *j, int n)
+{
+	if (n == 0)
+		return 0;
+	if (n > 16)
+	{
+		j->error = true;
+		return 0;
+	}
+
+	if (j->bitCount < n)
+		JPEGFill(j);
+
+	int value = (int)(j->bitBuf >> (32 - n));
+	j->bitBuf <<= n;
+	j->bitCount -= n;
+
+	// Values with a leading zero are negative
+	if (value < (1 << (n - 1)))
+		value -= (1 << n) - 1;
+
+	return value;
+}
+
+// Returns false if the block only has a DC term, which is most of them
+static bool JPEGDecodeBlock(JPEGDecoder *j, JPEGComponent *c, int block[64])
+{
+	const JPEGHuffman *dc = &j->huffDC[c->hd];
+	const JPEGHuffman *ac = &j->huffAC[c->ha];
+	const unsigned short *q = j->quant[c->tq];
+
+	memset(block, 0, 64 * sizeof(int));
+
+	int t = JPEGDecode(j, dc);
+	c->dcPred += JPEGReceive(j, t);
+	block[0] = c->dcPred * q[0];
+	bool hasAC = false;
+
+	for (int k = 1; k < 64;)
+	{
+		int rs = JPEGDecode(j, ac);
+		int run = rs >> 4;
+		int s = rs & 15;
+
+		if (s == 0)
+		{
+			if (run != 15)
+				break;		// End of block
+			k += 16;		// Sixteen zeros
+		}
+		else
+		{
+			k += run;
+			block[zigzag[k]] = JPEGReceive(j, s) * q[k & 63];
+			k++;
+			hasAC = true;
+		}
+	}
+
+	return hasAC;
+}
+
+// Fixed point versions of the IDCT constants, scaled by 4096
+#define FIX(x)	((int)((x) * 4096.0f + 0.5f))
+
+// One dimensional 8 point inverse DCT (Loeffler, Ligtenberg and Moschytz)
+#define IDCT_1D(s0, s1, s2, s3, s4, s5, s6, s7)						\
+	int e0, e1, e2, e3, o0, o1, o2, o3;								\
+	{																\
+		int z1 = (s2 + s6) * FIX(0.541196100f);						\
+		int t2 = z1 + s6 * FIX(-1.847759065f);						\
+		int t3 = z1 + s2 * FIX(0.765366865f);						\
+		int t0 = (s0 + s4) * 4096;									\
+		int t1 = (s0 - s4) * 4096;									\
+		e0 = t0 + t3;												\
+		e3 = t0 - t3;												\
+		e1 = t1 + t2;												\
+		e2 = t1 - t2;												\
+	}																\
+	{																\
+		int a0 = s7, a1 = s5, a2 = s3, a3 = s1;						\
+		int z3 = a0 + a2;											\
+		int z4 = a1 + a3;											\
+		int z1 = a0 + a3;											\
+		int z2 = a1 + a2;											\
+		int z5 = (z3 + z4) * FIX(1.175875602f);						\
+		a0 *= FIX(0.298631336f);									\
+		a1 *= FIX(2.053119869f);									\
+		a2 *= FIX(3.072711026f);									\
+		a3 *= FIX(1.501321110f);									\
+		z1 = z5 + z1 * FIX(-0.899976223f);							\
+		z2 = z5 + z2 * FIX(-2.562915447f);							\
+		z3 *= FIX(-1.961570560f);									\
+		z4 *= FIX(-0.390180644f);									\
+		o0 = a0 + z1 + z3;											\
+		o1 = a1 + z2 + z4;											\
+		o2 = a2 + z2 + z3;											\
+		o3 = a3 + z1 + z4;											\
+	}
+
+static unsigned char Clamp(int x)
+{
+	if ((unsigned int)x > 255)
+		return x < 0 ? 0 : 255;
+	return (unsigned char)x;
+}
+
+static void JPEGInverseDCT(int block[64], unsigned char *out, int stride)
+{
+	int temp[64];
+
+	// Columns first, keeping two extra bits of precision
+	for (int i = 0; i < 8; i++)
+	{
+		int *in = block + i;
+		int *t = temp + i;
+
+		// Columns with only a DC term are really common
+		if (in[8] == 0 && in[16] == 0 && in[24] == 0 && in[32] == 0 && in[40] == 0 && in[48] == 0 && in[56] == 0)
+		{
+			int dc = in[0] * 4;
+			t[0] = t[8] = t[16] = t[24] = t[32] = t[40] = t[48] = t[56] = dc;
+			continue;
+		}
+
+		IDCT_1D(in[0], in[8], in[16], in[24], in[32], in[40], in[48], in[56])
+
+		e0 += 512; e1 += 512; e2 += 512; e3 += 512;
+		t[0]  = (e0 + o3) >> 10;
+		t[56] = (e0 - o3) >> 10;
+		t[8]  = (e1 + o2) >> 10;
+		t[48] = (e1 - o2) >> 10;
+		t[16] = (e2 + o1) >> 10;
+		t[40] = (e2 - o1) >> 10;
+		t[24] = (e3 + o0) >> 10;
+		t[32] = (e3 - o0) >> 10;
+	}
+
+	// Then the rows. That leaves everything scaled up by 1 << 17, and
+	// we add 128 on the way down to get back to unsigned samples.
+	for (int i = 0; i < 8; i++, out += stride)
+	{
+		int *t = temp + i * 8;
+
+		// A flat row is the same sample all the way along
+		if (t[1] == 0 && t[2] == 0 && t[3] == 0 && t[4] == 0 && t[5] == 0 && t[6] == 0 && t[7] == 0)
+		{
+			memset(out, Clamp((t[0] * 4096 + 65536 + (128 << 17)) >> 17), 8);
+			continue;
+		}
+
+		IDCT_1D(t[0], t[1], t[2], t[3], t[4], t[5], t[6], t[7])
+
+		int bias = 65536 + (128 << 17);
+		e0 += bias; e1 += bias; e2 += bias; e3 += bias;
+		out[0] = Clamp((e0 + o3) >> 17);
+		out[7] = Clamp((e0 - o3) >> 17);
+		out[1] = Clamp((e1 + o2) >> 17);
+		out[6] = Clamp((e1 - o2) >> 17);
+		out[2] = Clamp((e2 + o1) >> 17);
+		out[5] = Clamp((e2 - o1) >> 17);
+		out[3] = Clamp((e3 + o0) >> 17);
+		out[4] = Clamp((e3 - o0) >> 17);
+	}
+}
+
+// The inverse DCT of a block with only a DC term, which comes out flat.
+// Gives the same samples JPEGInverseDCT() would.
+static void JPEGFlatBlock(int dc, unsigned char *out, int stride)
+{
+	unsigned char sample = Clamp(((dc + 4) >> 3) + 128);
+
+	for (int i = 0; i < 8; i++, out += stride)
+		memset(out, sample, 8);
+}
+
+// Where zero is in the decoder's clamping table, room for the most
+// a chroma sample can push a pixel below black
+#define LIMIT_OFFSET	384
+
+// Gets ready to turn the planes into RGB, once we know their sizes
+static bool JPEGStartConvert(JPEGDecoder *j)
+{
+	for (int c = 0; c < j->numComponents; c++)
+	{
+		j->columns[c] = (int *)malloc(j->width * sizeof(int));
+		if (j->columns[c] == NULL)
+			return false;
+
+		for (int x = 0; x < j->width; x++)
+			j->columns[c][x] = x * j->comp[c].h / j->hMax;
+	}
+
+	// YCbCr to RGB with 16 bits of fraction, looked up instead of
+	// multiplied. Luma is whole, so each chroma sample just moves it
+	// by a whole amount and the sum is clamped through limit
+	for (int i = 0; i < 256; i++)
+	{
+		j->crR[i] = ((i - 128) * 91881 + 32768) >> 16;
+		j->cbB[i] = ((i - 128) * 116130 + 32768) >> 16;
+		j->cbG[i] = (i - 128) * -22554;
+		j->crG[i] = (i - 128) * -46802 + 32768;
+	}
+	for (int i = 0; i < 1024; i++)
+		j->limit[i] = Clamp(i - LIMIT_OFFSET);
+
+	// Nearly every file has full width luma and chroma at full or half
+	// width, those rows are read straight along instead of through columns
+	j->chromaShift = -1;
+	if (j->numComponents == 3 && j->comp[0].h == j->hMax && j->comp[1].h == j->comp[2].h)
+	{
+		if (j->comp[1].h == j->hMax)
+			j->chromaShift = 0;
+		else if (j->comp[1].h * 2 == j->hMax)
+			j->chromaShift = 1;
+	}
+
+	return true;
+}
+
+// Upsamples and converts the rows up to last to RGB, flipping so the
+// bottom row comes first. Done a row of MCUs at a time while the
+// samples are still in the cache.
+static void JPEGConvertRows(JPEGDecoder *j, int last)
+{
+	const int *crR = j->crR;
+	const int *cbB = j->cbB;
+	const int *cbG = j->cbG;
+	const int *crG = j->crG;
+	const unsigned char *l = j->limit + LIMIT_OFFSET;
+
+	for (int y = j->rowsDone; y < last; y++)
+	{
+		unsigned char *dst = j->pixels + (size_t)(j->height - 1 - y) * j->width * 3;
+
+		if (j->numComponents == 1)
+		{
+			const unsigned char *grey = j->comp[0].plane + y * j->comp[0].planeWidth;
+			for (int x = 0; x < j->width; x++, dst += 3)
+				dst[0] = dst[1] = dst[2] = grey[x];
+			continue;
+		}
+
+		const unsigned char *rows[3];
+		for (int c = 0; c < 3; c++)
+			rows[c] = j->comp[c].plane + (y * j->comp[c].v / j->vMax) * j->comp[c].planeWidth;
+
+		if (j->chromaShift == 1)
+		{
+			// Each chroma sample covers two pixels
+			for (int x = 0; x < j->width; x += 2, dst += 6)
+			{
+				int cb = rows[1][x >> 1];
+				int cr = rows[2][x >> 1];
+				int r = crR[cr];
+				int g = (cbG[cb] + crG[cr]) >> 16;
+				int b = cbB[cb];
+
+				int luma = rows[0][x];
+				dst[0] = l[luma + r];
+				dst[1] = l[luma + g];
+				dst[2] = l[luma + b];
+
+				if (x + 1 == j->width)
+					break;
+
+				luma = rows[0][x + 1];
+				dst[3] = l[luma + r];
+				dst[4] = l[luma + g];
+				dst[5] = l[luma + b];
+			}
+			continue;
+		}
+
+		if (j->chromaShift == 0)
+		{
+			for (int x = 0; x < j->width; x++, dst += 3)
+			{
+				int luma = rows[0][x];
+				int cb = rows[1][x];
+				int cr = rows[2][x];
+
+				dst[0] = l[luma + crR[cr]];
+				dst[1] = l[luma + ((cbG[cb] + crG[cr]) >> 16)];
+				dst[2] = l[luma + cbB[cb]];
+			}
+			continue;
+		}
+
+		const int *const *columns = j->columns;
+		for (int x = 0; x < j->width; x++, dst += 3)
+		{
+			int luma = rows[0][columns[0][x]];
+			int cb = rows[1][columns[1][x]];
+			int cr = rows[2][columns[2][x]];
+
+			dst[0] = l[luma + crR[cr]];
+			dst[1] = l[luma + ((cbG[cb] + crG[cr]) >> 16)];
+			dst[2] = l[luma + cbB[cb]];
+		}
+	}
+
+	if (last > j->rowsDone)
+		j->rowsDone = last;
+}
+
+static void JPEGResetScan(JPEGDecoder *j)
+{
+	j->bitBuf = 0;
+	j->bitCount = 0;
+	j->marker = 0;
+	for (int i = 0; i < j->numComponents; i++)
+		j->comp[i].dcPred = 0;
+}
+
+// Called between restart intervals to skip over the RSTn marker
+static bool JPEGRestart(JPEGDecoder *j)
+{
+	if (j->marker == 0)
+	{
+		// Look for the marker in case the stream had padding
+		while (j->pos + 1 < j->size && !(j->data[j->pos] == 0xFF && j->data[j->pos + 1] != 0))
+			j->pos++;
+		if (j->pos + 1 >= j->size)
+			return false;
+		j->marker = j->data[j->pos + 1];
+	}
+
+	if (j->marker < 0xD0 || j->marker > 0xD7)
+		return false;
+
+	j->pos += 2;
+	JPEGResetScan(j);
+	return true;
+}
+
+static bool JPEGDecodeScan(JPEGDecoder *j)
+{
+	JPEGComponent *scan[3];
+	int block[64];
+
+	int length = ReadBE16(j);
+	int count = ReadByte(j);
+	if (j->error || count < 1 || count > j->numComponents || length != 6 + 2 * count)
+		return false;
+
+	for (int i = 0; i < count; i++)
+	{
+		int id = ReadByte(j);
+		int tables = ReadByte(j);
+
+		scan[i] = NULL;
+		for (int c = 0; c < j->numComponents; c++)
+			if (j->comp[c].id == id)
+				scan[i] = &j->comp[c];
+
+		if (scan[i] == NULL || (tables >> 4) > 3 || (tables & 15) > 3)
+			return false;
+
+		scan[i]->hd = tables >> 4;
+		scan[i]->ha = tables & 15;
+	}
+
+	// Spectral selection and successive approximation, which baseline doesn't use
+	j->pos += 3;
+	if (j->error || j->pos > j->size)
+		return false;
+
+	JPEGResetScan(j);
+	int todo = j->restartInterval ? j->restartInterval : 0x7FFFFFFF;
+
+	if (count == 1)
+	{
+		// Non interleaved, the blocks cover just this component
+		JPEGComponent *c = scan[0];
+		int blocksX = ((j->width * c->h + j->hMax - 1) / j->hMax + 7) / 8;
+		int blocksY = ((j->height * c->v + j->vMax - 1) / j->vMax + 7) / 8;
+
+		for (int by = 0; by < blocksY; by++)
+			for (int bx = 0; bx < blocksX; bx++)
+			{
+				unsigned char *out = c->plane + by * 8 * c->planeWidth + bx * 8;
+				if (JPEGDecodeBlock(j, c, block))
+					JPEGInverseDCT(block, out, c->planeWidth);
+				else
+					JPEGFlatBlock(block[0], out, c->planeWidth);
+
+				if (j->error)
+					return false;
+
+				if (--todo == 0)
+				{
+					todo = j->restartInterval;
+					if (!(by == blocksY - 1 && bx == blocksX - 1) && !JPEGRestart(j))
+						return false;
+				}
+			}
+	}
+	else
+	{
+		// Interleaved, each MCU holds h * v blocks of every component
+		for (int my = 0; my < j->mcusY; my++)
+		{
+			for (int mx = 0; mx < j->mcusX; mx++)
+			{
+				for (int i = 0; i < count; i++)
+				{
+					JPEGComponent *c = scan[i];
+					for (int y = 0; y < c->v; y++)
+						for (int x = 0; x < c->h; x++)
+						{
+							int px = (mx * c->h + x) * 8;
+							int py = (my * c->v + y) * 8;
+							unsigned char *out = c->plane + py * c->planeWidth + px;
+							if (JPEGDecodeBlock(j, c, block))
+								JPEGInverseDCT(block, out, c->planeWidth);
+							else
+								JPEGFlatBlock(block[0], out, c->planeWidth);
+						}
+				}
+
+				if (j->error)
+					return false;
+
+				if (--todo == 0)
+				{
+					todo = j->restartInterval;
+					if (!(my == j->mcusY - 1 && mx == j->mcusX - 1) && !JPEGRestart(j))
+						return false;
+				}
+			}
+
+			// With every component in this scan the row of MCUs is finished
+			if (count == j->numComponents)
+			{
+				int last = (my + 1) * j->vMax * 8;
+				JPEGConvertRows(j, last < j->height ? last : j->height);
+			}
+		}
+	}
+
+	// Find the marker after the scan
+	while (j->pos + 1 < j->size && !(j->data[j->pos] == 0xFF && j->data[j->pos + 1] != 0 &&
+		(j->data[j->pos + 1] < 0xD0 || j->data[j->pos + 1] > 0xD7)))
+		j->pos++;
+
+	return true;
+}
+
+static bool JPEGReadFrame(JPEGDecoder *j, int marker)
+{
+	// Only baseline and extended huffman frames
+	if (marker != 0xC0 && marker != 0xC1)
+		return false;
+
+	int length = ReadBE16(j);
+	int precision = ReadByte(j);
+	j->height = ReadBE16(j);
+	j->width = ReadBE16(j);
+	j->numComponents = ReadByte(j);
+
+	if (j->error || precision != 8 || j->width <= 0 || j->height <= 0 ||
+		(j->numComponents != 1 && j->numComponents != 3) || length != 8 + 3 * j->numComponents)
+		return false;
+
+	j->hMax = 1;
+	j->vMax = 1;
+	for (int i = 0; i < j->numComponents; i++)
+	{
+		JPEGComponent *c = &j->comp[i];
+		c->id = ReadByte(j);
+		int sampling = ReadByte(j);
+		c->h = sampling >> 4;
+		c->v = sampling & 15;
+		c->tq = ReadByte(j);
+		c->plane = NULL;
+
+		if (c->h < 1 || c->h > 4 || c->v < 1 || c->v > 4 || c->tq > 3)
+			return false;
+
+		if (c->h > j->hMax) j->hMax = c->h;
+		if (c->v > j->vMax) j->vMax = c->v;
+	}
+
+	return !j->error;
+}
+
+// Walks the markers up to the start of the frame, or all the way through if decoding
+static bool JPEGParse(JPEGDecoder *j, bool headerOnly)
+{
+	bool gotFrame = false;
+
+	if (j->size < 4 || j->data[0] != 0xFF || j->data[1] != 0xD8)
+		return false;
+	j->pos = 2;
+
+	while (!j->error)
+	{
+		// Skip any fill bytes in front of the marker
+		if (ReadByte(j) != 0xFF)
+			return false;
+		int marker = ReadByte(j);
+		while (marker == 0xFF)
+			marker = ReadByte(j);
+
+		if (j->error)
+			return false;
+
+		if (marker == 0xD9)
+		{
+			// End of image
+			return gotFrame && !headerOnly;
+		}
+		else if (marker == 0xDB)
+		{
+			// Quantization tables, stored in zigzag order
+			int length = ReadBE16(j) - 2;
+			while (length > 0 && !j->error)
+			{
+				int pq = ReadByte(j);
+				int tq = pq & 15;
+				pq >>= 4;
+				if (tq > 3 || pq > 1)
+					return false;
+				for (int i = 0; i < 64; i++)
+					j->quant[tq][i] = (unsigned short)(pq ? ReadBE16(j) : ReadByte(j));
+				length -= 65 + (pq ? 64 : 0);
+			}
+			if (length != 0)
+				return false;
+		}
+		else if (marker == 0xC4)
+		{
+			// Huffman tables
+			int length = ReadBE16(j) - 2;
+			while (length > 0 && !j->error)
+			{
+				int tc = ReadByte(j);
+				int th = tc & 15;
+				int counts[16];
+				int total = 0;
+				tc >>= 4;
+				if (tc > 1 || th > 3)
+					return false;
+
+				for (int i = 0; i < 16; i++)
+				{
+					counts[i] = ReadByte(j);
+					total += counts[i];
+				}
+				if (total > 256)
+					return false;
+
+				JPEGHuffman *h = tc ? &j->huffAC[th] : &j->huffDC[th];
+				if (!BuildJPEGHuffman(h, counts))
+					return false;
+				for (int i = 0; i < total; i++)
+					h->values[i] = (unsigned char)ReadByte(j);
+
+				length -= 17 + total;
+			}
+			if (length != 0)
+				return false;
+		}
+		else if (marker == 0xDD)
+		{
+			// Restart interval
+			if (ReadBE16(j) != 4)
+				return false;
+			j->restartInterval = ReadBE16(j);
+		}
+		else if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+		{
+			// Start of frame
+			if (gotFrame || !JPEGReadFrame(j, marker))
+				return false;
+			gotFrame = true;
+
+			if (headerOnly)
+				return true;
+
+			// Allocate a plane for each component big enough for whole MCUs
+			j->mcusX = (j->width + j->hMax * 8 - 1) / (j->hMax * 8);
+			j->mcusY = (j->height + j->vMax * 8 - 1) / (j->vMax * 8);
+			for (int i = 0; i < j->numComponents; i++)
+			{
+				JPEGComponent *c = &j->comp[i];
+				c->planeWidth = j->mcusX * c->h * 8;
+				c->planeHeight = j->mcusY * c->v * 8;
+				c->plane = (unsigned char *)malloc((size_t)c->planeWidth * c->planeHeight);
+				if (c->plane == NULL)
+					return false;
+			}
+
+			if (!JPEGStartConvert(j))
+				return false;
+		}
+		else if (marker == 0xDA)
+		{
+			// Start of scan
+			if (!gotFrame || !JPEGDecodeScan(j))
+				return false;
+		}
+		else if ((marker >= 0xE0 && marker <= 0xEF) || marker == 0xFE || marker == 0xDC || marker == 0xDE || marker == 0xDF)
+		{
+			// Application data and comments, which we don't need
+			int length = ReadBE16(j);
+			if (length < 2)
+				return false;
+			j->pos += length - 2;
+			if (j->pos > j->size)
+				return false;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	return false;
+}
+
+static bool DecodeJPEG(const unsigned char *data, size_t size, unsigned char *pixels)
+{
+	JPEGDecoder *j = (JPEGDecoder *)calloc(1, sizeof(JPEGDecoder));
+	if (j == NULL)
+		return false;
+
+	j->data = data;
+	j->size = size;
+	j->pixels = pixels;
+
+	// Interleaved scans have converted their rows already, the rest are done now
+	bool ok = JPEGParse(j, false);
+	if (ok)
+		JPEGConvertRows(j, j->height);
+
+	for (int i = 0; i < 3; i++)
+	{
+		free(j->columns[i]);
+		free(j->comp[i].plane);
+	}
+	free(j);
+
+	return ok;
+}
+
+//////////////////////////////////////////////////////////////////////
+// BMP
+//////////////////////////////////////////////////////////////////////
+
+// The parts of a Windows bitmap's headers we need
+struct BMPHeader {
+	size_t offset;		// Where the pixels start
+	int width;
+	int height;			// Always positive, topDown says which way up it is
+	bool topDown;		// True: the first row in the file is the top one
+	int bytesPerPixel;	// 3 or 4, the fourth byte is ignored
+	size_t stride;		// Bytes in a row of the file, padded to a multiple of four
+};
+
+static unsigned int ReadLE32(const unsigned char *p)
+{
+	return p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static bool IsBMP(const unsigned char *data, size_t size)
+{
+	return size >= 2 && data[0] == 'B' && data[1] == 'M';
+}
+
+static bool ReadBMPHeader(const unsigned char *data, size_t size, BMPHeader *h)
+{
+	// The file header and at least a BITMAPINFOHEADER
+	if (size < 54 || ReadLE32(data + 14) < 40)
+		return false;
+
+	int width = (int)ReadLE32(data + 18);
+	int height = (int)ReadLE32(data + 22);
+	int bits = data[28] | (data[29] << 8);
+
+	// Only uncompressed 24 and 32 bit images, the same as auxDIBImageLoad gets given
+	if (ReadLE32(data + 30) != 0 || (bits != 24 && bits != 32))
+		return false;
+
+	if (width <= 0 || height == 0 || width > 16384 || height > 16384 || height < -16384)
+		return false;
+
+	h->offset = ReadLE32(data + 10);
+	h->width = width;
+	h->height = height < 0 ? -height : height;
+	h->topDown = height < 0;
+	h->bytesPerPixel = bits / 8;
+	h->stride = ((size_t)width * h->bytesPerPixel + 3) & ~(size_t)3;
+
+	// All the rows have to be there
+	return h->offset <= size && (size - h->offset) / h->stride >= (size_t)h->height;
+}
+
+static bool DecodeBMP(const unsigned char *data, size_t size, unsigned char *pixels)
+{
+	BMPHeader h;
+	if (!ReadBMPHeader(data, size, &h))
+		return false;
+
+	// Bitmaps are normally stored bottom row first already, so only
+	// the BGR order needs swapping
+	for (int y = 0; y < h.height; y++)
+	{
+		const unsigned char *src = data + h.offset + (size_t)y * h.stride;
+		unsigned char *dst = pixels + (size_t)(h.topDown ? h.height - 1 - y : y) * h.width * 3;
+
+		for (int x = 0; x < h.width; x++, src += h.bytesPerPixel, dst += 3)
+		{
+			dst[0] = src[2];
+			dst[1] = src[1];
+			dst[2] = src[0];
+		}
+	}
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Interface
+//////////////////////////////////////////////////////////////////////
+
+bool ReadImageInfo(const unsigned char *data, size_t size, ImageInfo *info)
+{
+	info->format = IMAGE_UNKNOWN;
+	info->width = 0;
+	info->height = 0;
+	info->components = 0;
+
+	if (data == NULL)
+		return false;
+
+	if (IsPNG(data, size))
+	{
+		PNGHeader h;
+		if (!ReadPNGHeader(data, size, &h))
+			return false;
+
+		info->format = IMAGE_PNG;
+		info->width = h.width;
+		info->height = h.height;
+		info->components = h.hasAlpha ? 4 : 3;
+		return true;
+	}
+
+	if (size >= 2 && data[0] == 0xFF && data[1] == 0xD8)
+	{
+		JPEGDecoder *j = (JPEGDecoder *)calloc(1, sizeof(JPEGDecoder));
+		if (j == NULL)
+			return false;
+
+		j->data = data;
+		j->size = size;
+		bool ok = JPEGParse(j, true);
+
+		info->format = IMAGE_JPEG;
+		info->width = j->width;
+		info->height = j->height;
+		info->components = 3;
+
+		free(j);
+		return ok;
+	}
+
+	if (IsBMP(data, size))
+	{
+		BMPHeader h;
+		if (!ReadBMPHeader(data, size, &h))
+			return false;
+
+		info->format = IMAGE_BMP;
+		info->width = h.width;
+		info->height = h.height;
+		info->components = 3;
+		return true;
+	}
+
+	return false;
+}
+
+bool DecodeImage(const unsigned char *data, size_t size, const ImageInfo *info, unsigned char *pixels)
+{
+	switch (info->format)
+	{
+		case IMAGE_PNG	:
+			return DecodePNG(data, size, pixels);
+		case IMAGE_JPEG	:
+			return DecodeJPEG(data, size, pixels);
+		case IMAGE_BMP	:
+			return DecodeBMP(data, size, pixels);
+		default			:
+			return false;
+	}
+}
+
+size_t ImageSize(const ImageInfo *info)
+{
+	return (size_t)info->width * info->height * info->components;
+}
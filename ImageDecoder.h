@@ -0,0 +1,73 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Image Decoder
+//
+// ImageDecoder.h: interface for the PNG, JPEG and BMP decoders.
+// These are small self contained decoders so that the
+// textures shipped with the models can be used without
+// converting them to bitmaps first. They don't touch
+// OpenGL at all so they are safe to run on any thread.
+//
+// Decoding is split in two steps. ReadImageInfo() only
+// parses the header so the caller can find (or reuse) a
+// buffer that is big enough, then DecodeImage() fills it.
+//
+// JPEG blocks with only a DC term skip the inverse DCT, and
+// an interleaved scan is turned into RGB a row of MCUs at a
+// time, by table lookups, while its samples are still in the
+// cache. There's no SIMD, so libjpeg-turbo is still faster.
+//
+// The pixels come out tightly packed as RGB or RGBA with
+// the bottom row first. That is the same layout that
+// auxDIBImageLoad gives us for bitmaps, so the models'
+// texture coordinates line up whatever the map's format.
+//
+// Supported:
+// PNG  - grey, grey+alpha, RGB, RGBA and paletted images
+//        with 1 to 16 bits per channel (not interlaced)
+// JPEG - baseline huffman coded grey and YCbCr images
+// BMP  - uncompressed 24 and 32 bit bitmaps, so tools without
+//        auxDIBImageLoad can read the game's own textures
+//
+// Usage:
+// ImageInfo info;
+//
+// if (ReadImageInfo(data, size, &info))
+// {
+//		pixels = new unsigned char[ImageSize(&info)];
+//		DecodeImage(data, size, &info, pixels);
+// }
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef IMAGEDECODER_H
+#define IMAGEDECODER_H
+
+#include <stddef.h>
+
+// The formats we know how to decode
+enum ImageFormat {
+	IMAGE_UNKNOWN,
+	IMAGE_PNG,
+	IMAGE_JPEG,
+	IMAGE_BMP
+};
+
+// What the header told us about the image
+struct ImageInfo {
+	ImageFormat format;	// The file format
+	int width;			// Width in pixels
+	int height;			// Height in pixels
+	int components;		// 3 for RGB, 4 for RGBA
+};
+
+// Works out the format from the file's signature and reads its header
+bool ReadImageInfo(const unsigned char *data, size_t size, ImageInfo *info);
+
+// Decodes the image into pixels, which must hold ImageSize(info) bytes
+bool DecodeImage(const unsigned char *data, size_t size, const ImageInfo *info, unsigned char *pixels);
+
+// The number of bytes the decoded pixels take up
+size_t ImageSize(const ImageInfo *info);
+
+#endif IMAGEDECODER_H
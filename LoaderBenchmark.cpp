@@ -0,0 +1,355 @@
+// Times the game's loaders over every model under models/ and every
+// image under textures/, loading each one many times so a change that
+// slows loading down shows up as a number rather than a feeling:
+//
+//     LoaderBenchmark
+//     LoaderBenchmark -repeat 50 -json results.json
+//     LoaderBenchmark -warm models/tree
+//
+// Each file is run warm (read once first so it's in the page cache)
+// and cold (dropped from the cache before every load, so the read
+// comes off the disk). Models report their parse, weld (the normals),
+// texcoords and other stages separately, images their read and decode.
+// The median of the runs is printed along with the fastest.
+//
+// -json writes the same results in Google Benchmark's JSON layout so
+// the usual comparison scripts can tell two runs apart in CI. The exit
+// code is 1 if any file couldn't be loaded.
+//
+// Getting a file out of the page cache needs help from the system:
+// posix_fadvise on Linux and the BSDs, and on Windows the cold reads
+// are made with FILE_FLAG_NO_BUFFERING so they go round the cache.
+#include "Mesh_3DS.h"
+#include "ImageDecoder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// One stage of one file in one variant, a time for each run
+struct Result {
+    std::string name;             // file/variant/stage
+    std::vector<double> runs;     // Milliseconds
+};
+
+std::vector<Result> results;
+
+double Now() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Adds a run's time to the result with that name, making it if it's new
+void Record(const std::string &file, const char *variant, const char *stage, double ms) {
+    std::string name = file + "/" + variant + "/" + stage;
+
+    for (size_t i = 0; i < results.size(); i++) {
+        if (results[i].name == name) {
+            results[i].runs.push_back(ms);
+            return;
+        }
+    }
+
+    Result r;
+    r.name = name;
+    r.runs.push_back(ms);
+    results.push_back(r);
+}
+
+double Median(std::vector<double> runs) {
+    std::sort(runs.begin(), runs.end());
+    size_t n = runs.size();
+    return n % 2 ? runs[n / 2] : (runs[n / 2 - 1] + runs[n / 2]) / 2.0;
+}
+
+double Fastest(const std::vector<double> &runs) {
+    return *std::min_element(runs.begin(), runs.end());
+}
+
+double Mean(const std::vector<double> &runs) {
+    double sum = 0.0;
+    for (size_t i = 0; i < runs.size(); i++)
+        sum += runs[i];
+    return sum / runs.size();
+}
+
+// Reads the whole file, false if it couldn't. A cold read gets the
+// file out of the page cache first, or goes round it where it can't
+bool ReadWholeFile(const std::string &name, bool cold, std::vector<unsigned char> &bytes) {
+#ifdef _WIN32
+    if (cold) {
+        HANDLE file = CreateFileA(name.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+
+        // Unbuffered reads have to be whole sectors into a sector aligned
+        // buffer, a page is big enough for both
+        LARGE_INTEGER size;
+        GetFileSizeEx(file, &size);
+        DWORD room = (DWORD)((size.QuadPart + 4095) & ~4095LL);
+        void *buffer = VirtualAlloc(NULL, room > 0 ? room : 4096, MEM_COMMIT, PAGE_READWRITE);
+        DWORD got = 0;
+        bool ok = buffer != NULL && ReadFile(file, buffer, room, &got, NULL) && got == (DWORD)size.QuadPart;
+
+        if (ok)
+            bytes.assign((unsigned char *)buffer, (unsigned char *)buffer + got);
+
+        if (buffer != NULL)
+            VirtualFree(buffer, 0, MEM_RELEASE);
+        CloseHandle(file);
+        return ok;
+    }
+#else
+    if (cold) {
+        int fd = open(name.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+#endif
+
+    FILE *f = fopen(name.c_str(), "rb");
+    if (f == NULL)
+        return false;
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    bytes.resize(size > 0 ? size : 0);
+    bool ok = size >= 0 && fread(bytes.data(), 1, bytes.size(), f) == bytes.size();
+
+    fclose(f);
+    return ok;
+}
+
+// Reads the file once so the warm runs find it in the cache
+bool Preload(const std::string &file) {
+    std::vector<unsigned char> bytes;
+    return ReadWholeFile(file, false, bytes);
+}
+
+// Loads the model repeat times, false if it couldn't be loaded
+bool RunModel(const std::string &file, const char *variant, bool cold, int repeat) {
+    std::vector<unsigned char> bytes;
+    std::string name = file;
+    Mesh_3DS mesh;
+
+    for (int r = 0; r < repeat; r++) {
+        double start = Now();
+        if (!ReadWholeFile(file, cold, bytes))
+            return false;
+        double read = Now() - start;
+
+        if (!mesh.LoadFromMemory(&name[0], bytes.data(), (long)bytes.size()))
+            return false;
+
+        const Mesh_3DS::Timings &t = mesh.times;
+        Record(file, variant, "read", read);
+        Record(file, variant, "parse", t.parse);
+        Record(file, variant, "weld", t.weld);
+        Record(file, variant, "texcoords", t.texcoords);
+        Record(file, variant, "bake", t.bake);
+        Record(file, variant, "optimize", t.optimize);
+        Record(file, variant, "merge", t.merge);
+        Record(file, variant, "lods", t.lods);
+        Record(file, variant, "total", read + t.total);
+    }
+
+    return true;
+}
+
+// Decodes the image repeat times, false if it couldn't be decoded
+bool RunImage(const std::string &file, const char *variant, bool cold, int repeat) {
+    std::vector<unsigned char> bytes;
+    std::vector<unsigned char> pixels;
+
+    for (int r = 0; r < repeat; r++) {
+        double start = Now();
+        if (!ReadWholeFile(file, cold, bytes))
+            return false;
+        double read = Now() - start;
+
+        // The buffer is sized outside the timing, the game reuses its own
+        ImageInfo info;
+        if (!ReadImageInfo(bytes.data(), bytes.size(), &info))
+            return false;
+        pixels.resize(ImageSize(&info));
+
+        start = Now();
+        if (!DecodeImage(bytes.data(), bytes.size(), &info, pixels.data()))
+            return false;
+        double decode = Now() - start;
+
+        Record(file, variant, "read", read);
+        Record(file, variant, "decode", decode);
+        Record(file, variant, "total", read + decode);
+    }
+
+    return true;
+}
+
+// True if the file's extension is one of them, whatever its case
+bool HasExtension(const fs::path &file, const char **extensions) {
+    std::string ext = file.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+    for (const char **e = extensions; *e != NULL; e++)
+        if (ext == *e)
+            return true;
+
+    return false;
+}
+
+// Every file under dir with one of the extensions, sorted so runs line
+// up. dir can be a single file too
+std::vector<std::string> FindFiles(const std::string &dir, const char **extensions) {
+    std::vector<std::string> files;
+    std::error_code error;
+
+    if (fs::is_regular_file(dir, error)) {
+        if (HasExtension(dir, extensions))
+            files.push_back(dir);
+        return files;
+    }
+
+    for (fs::recursive_directory_iterator i(dir, error), end; !error && i != end; i.increment(error))
+        if (i->is_regular_file(error) && HasExtension(i->path(), extensions))
+            files.push_back(i->path().generic_string());
+
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+// Escapes the few characters a file name could have that JSON can't
+std::string Quote(const std::string &s) {
+    std::string q = "\"";
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '"' || s[i] == '\\')
+            q += '\\';
+        q += s[i];
+    }
+    return q + "\"";
+}
+
+bool WriteJson(const char *name, int repeat) {
+    FILE *f = fopen(name, "w");
+    if (f == NULL)
+        return false;
+
+    fprintf(f, "{\n  \"context\": {\n    \"executable\": \"LoaderBenchmark\",\n    \"repetitions\": %d\n  },\n", repeat);
+    fprintf(f, "  \"benchmarks\": [\n");
+
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &r = results[i];
+        double median = Median(r.runs);
+
+        fprintf(f, "    {\n      \"name\": %s,\n      \"run_name\": %s,\n      \"run_type\": \"iteration\",\n",
+            Quote(r.name).c_str(), Quote(r.name).c_str());
+        fprintf(f, "      \"iterations\": %d,\n      \"real_time\": %.6f,\n      \"cpu_time\": %.6f,\n      \"time_unit\": \"ms\",\n",
+            (int)r.runs.size(), median, median);
+        fprintf(f, "      \"fastest\": %.6f,\n      \"mean\": %.6f\n    }%s\n",
+            Fastest(r.runs), Mean(r.runs), i + 1 < results.size() ? "," : "");
+    }
+
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+    return true;
+}
+
+void PrintResults() {
+    printf("%-60s %10s %10s\n", "", "median ms", "fastest");
+    for (size_t i = 0; i < results.size(); i++)
+        printf("%-60s %10.3f %10.3f\n", results[i].name.c_str(), Median(results[i].runs), Fastest(results[i].runs));
+}
+
+int main(int argc, char** argv) {
+    static const char *models[] = { ".3ds", ".obj", ".ms3d", NULL };
+    static const char *images[] = { ".bmp", ".png", ".jpg", ".jpeg", NULL };
+
+    int repeat = 20;
+    bool warm = true;
+    bool cold = true;
+    const char *json = NULL;
+    std::vector<std::string> dirs;
+    int failed = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-repeat") == 0 && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+            if (repeat < 1)
+                repeat = 1;
+        }
+        else if (strcmp(argv[i], "-json") == 0 && i + 1 < argc)
+            json = argv[++i];
+        else if (strcmp(argv[i], "-warm") == 0)
+            cold = false;
+        else if (strcmp(argv[i], "-cold") == 0)
+            warm = false;
+        else if (argv[i][0] == '-') {
+            printf("usage: LoaderBenchmark [-repeat n] [-warm | -cold] [-json file] [dir or file ...]\n");
+            return 1;
+        }
+        else
+            dirs.push_back(argv[i]);
+    }
+
+    if (dirs.empty()) {
+        dirs.push_back("models");
+        dirs.push_back("textures");
+    }
+
+    for (size_t d = 0; d < dirs.size(); d++) {
+        std::vector<std::string> files = FindFiles(dirs[d], models);
+        std::vector<std::string> pictures = FindFiles(dirs[d], images);
+
+        if (files.empty() && pictures.empty()) {
+            printf("%s: nothing to load\n", dirs[d].c_str());
+            failed++;
+        }
+
+        for (size_t i = 0; i < files.size(); i++) {
+            bool ok = Preload(files[i]);
+            ok = ok && (!warm || RunModel(files[i], "warm", false, repeat));
+            ok = ok && (!cold || RunModel(files[i], "cold", true, repeat));
+
+            if (!ok) {
+                printf("%s: couldn't be loaded\n", files[i].c_str());
+                failed++;
+            }
+        }
+
+        for (size_t i = 0; i < pictures.size(); i++) {
+            bool ok = Preload(pictures[i]);
+            ok = ok && (!warm || RunImage(pictures[i], "warm", false, repeat));
+            ok = ok && (!cold || RunImage(pictures[i], "cold", true, repeat));
+
+            if (!ok) {
+                printf("%s: couldn't be decoded\n", pictures[i].c_str());
+                failed++;
+            }
+        }
+    }
+
+    PrintResults();
+
+    if (json != NULL && !WriteJson(json, repeat)) {
+        printf("%s: couldn't be written\n", json);
+        failed++;
+    }
+
+    return failed > 0 ? 1 : 0;
+}
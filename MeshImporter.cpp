@@ -0,0 +1,985 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Mesh Importer
+//
+// MeshImporter.cpp: implementation of the MeshImporter class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "MeshImporter.h"
+#include "NameTable.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#define MAX_OBJECT_VERTS	65535	// The faces are 16 bit, so an object can't have more
+
+//////////////////////////////////////////////////////////////////////
+// Building the objects
+//////////////////////////////////////////////////////////////////////
+
+// Adds vertices and faces to the last object of a mesh, both
+// importers make their objects with it
+struct ObjectBuilder {
+	ImportedMesh &mesh;
+	bool textured;			// True: a vertex of the object has texture coordinates
+	bool smoothed;			// True: the faces' smoothing groups are kept
+	int defaultMaterial;	// The plain material, -1 until a face needs it
+
+	ObjectBuilder(ImportedMesh &m) : mesh(m), textured(false), smoothed(false), defaultMaterial(-1) {}
+
+	// Finishes the last object and starts another
+	void Begin(const char *name, int length)
+	{
+		Finish();
+
+		ImportedMesh::Object o;
+
+		if (length > (int)sizeof(o.name) - 1)
+			length = sizeof(o.name) - 1;
+
+		memcpy(o.name, name, length);
+		o.name[length] = 0;
+
+		mesh.objects.push_back(o);
+		textured = false;
+	}
+
+	// Drops what the last object doesn't need, or the object if it has no faces
+	void Finish()
+	{
+		if (mesh.objects.empty())
+			return;
+
+		ImportedMesh::Object &o = mesh.objects.back();
+
+		if (o.faces.empty())
+		{
+			mesh.objects.pop_back();
+			return;
+		}
+
+		if (!textured)
+			o.texCoords.clear();
+		if (!smoothed)
+			o.groups.clear();
+	}
+
+	// True if the last object has room for count more vertices
+	bool Room(int count)
+	{
+		return !mesh.objects.empty() && (int)mesh.objects.back().vertices.size() / 3 + count <= MAX_OBJECT_VERTS;
+	}
+
+	// Adds a vertex to the last object, uv can be NULL
+	int Vertex(const float *xyz, const float *uv)
+	{
+		ImportedMesh::Object &o = mesh.objects.back();
+
+		o.vertices.insert(o.vertices.end(), xyz, xyz + 3);
+
+		if (uv != NULL)
+		{
+			o.texCoords.insert(o.texCoords.end(), uv, uv + 2);
+			textured = true;
+		}
+		else
+		{
+			o.texCoords.push_back(0.0f);
+			o.texCoords.push_back(0.0f);
+		}
+
+		return (int)o.vertices.size() / 3 - 1;
+	}
+
+	void Face(int a, int b, int c, unsigned int groups, int material)
+	{
+		ImportedMesh::Object &o = mesh.objects.back();
+
+		// Faces without a material get a plain white one
+		if (material < 0)
+		{
+			if (defaultMaterial < 0)
+			{
+				Mesh_3DS::Material m;
+				memset(&m, 0, sizeof(m));
+				strcpy(m.name, "default");
+				m.color.r = m.color.g = m.color.b = m.color.a = 255;
+
+				defaultMaterial = (int)mesh.materials.size();
+				mesh.materials.push_back(m);
+			}
+
+			material = defaultMaterial;
+		}
+
+		o.faces.push_back((unsigned short)a);
+		o.faces.push_back((unsigned short)b);
+		o.faces.push_back((unsigned short)c);
+		o.groups.push_back(groups);
+		o.materials.push_back(material);
+	}
+};
+
+// Copies a material's texture to its map, without any folders in
+// front of it because the maps have to be next to the model
+static void SetMap(Mesh_3DS::Material &m, const char *name, int length)
+{
+	for (int i = length - 1; i >= 0; i--)
+	{
+		if (name[i] == '/' || name[i] == '\\')
+		{
+			name += i + 1;
+			length -= i + 1;
+			break;
+		}
+	}
+
+	if (length <= 0)
+		return;
+
+	if (length > (int)sizeof(m.map) - 1)
+		length = sizeof(m.map) - 1;
+
+	memcpy(m.map, name, length);
+	m.map[length] = 0;
+	m.textured = true;
+}
+
+//////////////////////////////////////////////////////////////////////
+// OBJ
+//////////////////////////////////////////////////////////////////////
+
+// Which of a corner's indices are counted back from the last one
+// (negative in the file) and whether it has a texture coordinate
+#define OBJ_RELATIVE_V	1
+#define OBJ_RELATIVE_T	2
+#define OBJ_NO_T		4
+
+// One corner of a face, the indices start at 0. Relative ones are
+// from the start of their piece, the piece before hasn't been counted
+struct ObjCorner {
+	int v;			// The position
+	int t;			// The texture coordinate
+	int flags;		// OBJ_RELATIVE_V, OBJ_RELATIVE_T and OBJ_NO_T
+};
+
+enum ObjEventType {
+	OBJ_OBJECT,		// g or o, a new object
+	OBJ_MATERIAL,	// usemtl
+	OBJ_SMOOTH		// s
+};
+
+// A line that changes the faces after it
+struct ObjEvent {
+	int polygon;			// The number of polygons before it in its piece
+	ObjEventType type;
+	const char *name;		// The rest of the line, in the file
+	int length;
+	unsigned int groups;	// The smoothing group mask for OBJ_SMOOTH
+};
+
+// What one thread reads out of its piece of the file
+struct ObjPiece {
+	const char *start;
+	const char *end;
+	std::vector<float> positions;
+	std::vector<float> texCoords;
+	std::vector<ObjCorner> corners;
+	std::vector<int> polygons;		// The number of corners each polygon has
+	std::vector<ObjEvent> events;
+	const char *mtllib;				// The piece's mtllib, NULL if it hasn't one
+	int mtllibLength;
+	bool bad;						// True: a line in it doesn't make sense
+};
+
+static const char *SkipSpace(const char *p, const char *end)
+{
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+		p++;
+
+	return p;
+}
+
+// True if the line starts with the word and a space
+static bool Keyword(const char *p, const char *end, const char *word)
+{
+	size_t n = strlen(word);
+
+	return (size_t)(end - p) > n && memcmp(p, word, n) == 0 && (p[n] == ' ' || p[n] == '\t');
+}
+
+// The rest of the line after the word, without the spaces round it
+static const char *Rest(const char *p, const char *end, int *length)
+{
+	while (p < end && *p != ' ' && *p != '\t')
+		p++;
+
+	p = SkipSpace(p, end);
+
+	while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+		end--;
+
+	*length = (int)(end - p);
+	return p;
+}
+
+static bool ParseInt(const char *&p, const char *end, int &value)
+{
+	bool negative = false;
+
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = (*p++ == '-');
+
+	if (p >= end || *p < '0' || *p > '9')
+		return false;
+
+	long long v = 0;
+
+	while (p < end && *p >= '0' && *p <= '9')
+	{
+		if (v < 0x7fffffff)
+			v = v * 10 + (*p - '0');
+		p++;
+	}
+
+	value = (int)(negative ? -v : v);
+	return true;
+}
+
+// Reads a number without going through the locale like strtof does
+static bool ParseFloat(const char *&p, const char *end, float &value)
+{
+	static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+		1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	p = SkipSpace(p, end);
+
+	bool negative = false;
+
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = (*p++ == '-');
+
+	unsigned long long mantissa = 0;
+	int exponent = 0;
+	int digits = 0;
+
+	for (; p < end && *p >= '0' && *p <= '9'; p++, digits++)
+	{
+		// Past 18 digits a float can't tell the difference
+		if (mantissa < 100000000000000000ULL)
+			mantissa = mantissa * 10 + (*p - '0');
+		else
+			exponent++;
+	}
+
+	if (p < end && *p == '.')
+	{
+		for (p++; p < end && *p >= '0' && *p <= '9'; p++, digits++)
+		{
+			if (mantissa < 100000000000000000ULL)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				exponent--;
+			}
+		}
+	}
+
+	if (digits == 0)
+		return false;
+
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		p++;
+
+		int e;
+		if (!ParseInt(p, end, e))
+			return false;
+
+		exponent += e;
+	}
+
+	double v = (double)mantissa;
+
+	// Far enough either way to be zero or infinite as a float
+	if (exponent > 400)
+		exponent = 400;
+	if (exponent < -400)
+		exponent = -400;
+
+	while (exponent > 22)
+	{
+		v *= 1e22;
+		exponent -= 22;
+	}
+
+	while (exponent < -22)
+	{
+		v /= 1e22;
+		exponent += 22;
+	}
+
+	v = exponent < 0 ? v / powers[-exponent] : v * powers[exponent];
+
+	value = (float)(negative ? -v : v);
+	return true;
+}
+
+// Reads a face's corners, v, v/t, v//n or v/t/n
+static bool ParseFace(ObjPiece &piece, const char *p, const char *end)
+{
+	int count = 0;
+	int numPositions = (int)piece.positions.size() / 3;
+	int numTexCoords = (int)piece.texCoords.size() / 2;
+
+	for (p = SkipSpace(p, end); p < end; p = SkipSpace(p, end))
+	{
+		ObjCorner c;
+		int v;
+		int t;
+		int n;
+
+		c.flags = OBJ_NO_T;
+		c.t = 0;
+
+		if (!ParseInt(p, end, v) || v == 0)
+			return false;
+
+		c.v = v > 0 ? v - 1 : numPositions + v;
+		if (v < 0)
+			c.flags |= OBJ_RELATIVE_V;
+
+		if (p < end && *p == '/')
+		{
+			p++;
+
+			if (p < end && *p != '/')
+			{
+				if (!ParseInt(p, end, t) || t == 0)
+					return false;
+
+				c.t = t > 0 ? t - 1 : numTexCoords + t;
+				c.flags &= ~OBJ_NO_T;
+				if (t < 0)
+					c.flags |= OBJ_RELATIVE_T;
+			}
+
+			// The normal, they're worked out again
+			if (p < end && *p == '/')
+			{
+				p++;
+				if (!ParseInt(p, end, n))
+					return false;
+			}
+		}
+
+		if (p < end && *p != ' ' && *p != '\t' && *p != '\r')
+			return false;
+
+		piece.corners.push_back(c);
+		count++;
+	}
+
+	// Anything less than a triangle can't be drawn
+	if (count < 3)
+	{
+		piece.corners.resize(piece.corners.size() - count);
+		return true;
+	}
+
+	piece.polygons.push_back(count);
+	return true;
+}
+
+static void AddEvent(ObjPiece &piece, ObjEventType type, const char *p, const char *end)
+{
+	ObjEvent e;
+
+	e.polygon = (int)piece.polygons.size();
+	e.type = type;
+	e.name = Rest(p, end, &e.length);
+	e.groups = 0;
+
+	if (type == OBJ_SMOOTH)
+	{
+		// Groups 1 to 32 are bits, "off" and 0 are flat
+		const char *q = e.name;
+		int group;
+
+		if (ParseInt(q, e.name + e.length, group) && group > 0)
+			e.groups = 1u << ((group - 1) & 31);
+	}
+
+	piece.events.push_back(e);
+}
+
+// Goes through the lines of a piece of the file
+static void ReadPiece(ObjPiece *piece)
+{
+	const char *p = piece->start;
+
+	while (p < piece->end && !piece->bad)
+	{
+		const char *end = (const char *)memchr(p, '\n', piece->end - p);
+		if (end == NULL)
+			end = piece->end;
+
+		const char *q = SkipSpace(p, end);
+		const char *r = q + 2;
+		float f[3];
+
+		if (Keyword(q, end, "v"))
+		{
+			piece->bad = !ParseFloat(r, end, f[0]) || !ParseFloat(r, end, f[1]) || !ParseFloat(r, end, f[2]);
+			piece->positions.insert(piece->positions.end(), f, f + 3);
+		}
+		else if (Keyword(q, end, "vt"))
+		{
+			r = q + 3;
+			piece->bad = !ParseFloat(r, end, f[0]);
+
+			// The second one is optional and the third isn't wanted
+			if (!ParseFloat(r, end, f[1]))
+				f[1] = 0.0f;
+
+			piece->texCoords.insert(piece->texCoords.end(), f, f + 2);
+		}
+		else if (Keyword(q, end, "f"))
+			piece->bad = !ParseFace(*piece, q + 2, end);
+		else if (Keyword(q, end, "g") || Keyword(q, end, "o"))
+			AddEvent(*piece, OBJ_OBJECT, q, end);
+		else if (Keyword(q, end, "usemtl"))
+			AddEvent(*piece, OBJ_MATERIAL, q, end);
+		else if (Keyword(q, end, "s"))
+			AddEvent(*piece, OBJ_SMOOTH, q, end);
+		else if (Keyword(q, end, "mtllib") && piece->mtllib == NULL)
+			piece->mtllib = Rest(q, end, &piece->mtllibLength);
+
+		// Anything else (comments, normals, lines and curves) is skipped
+		p = end + 1;
+	}
+}
+
+bool MeshImporter::IsOBJ(const char *name)
+{
+	size_t n = strlen(name);
+
+	return n >= 4 && name[n-4] == '.' && (name[n-3] | 0x20) == 'o' && (name[n-2] | 0x20) == 'b' && (name[n-1] | 0x20) == 'j';
+}
+
+bool MeshImporter::ImportOBJ(const unsigned char *data, size_t size, const char *path, ImportedMesh &mesh)
+{
+	const char *text = (const char *)data;
+
+	mesh.materials.clear();
+	mesh.objects.clear();
+
+	if (data == NULL)
+		return false;
+
+	// One piece for each OBJ_THREAD_BYTES, but no more than there are cores
+	int count = 1 + (int)(size / OBJ_THREAD_BYTES);
+	int cores = (int)std::thread::hardware_concurrency();
+
+	if (count > cores && cores > 0)
+		count = cores;
+
+	std::vector<ObjPiece> pieces(count);
+	const char *start = text;
+
+	for (int i = 0; i < count; i++)
+	{
+		// Each piece ends after the line it would have cut in half
+		const char *end = text + size;
+
+		if (i + 1 < count)
+		{
+			end = text + size * (i + 1) / count;
+
+			if (end < start)
+				end = start;
+
+			const char *line = (const char *)memchr(end, '\n', text + size - end);
+			end = line != NULL ? line + 1 : text + size;
+		}
+
+		pieces[i].start = start;
+		pieces[i].end = end;
+		pieces[i].mtllib = NULL;
+		pieces[i].mtllibLength = 0;
+		pieces[i].bad = false;
+		start = end;
+	}
+
+	// The first piece is read on this thread
+	std::vector<std::thread> workers;
+
+	for (int i = 1; i < count; i++)
+		workers.push_back(std::thread(ReadPiece, &pieces[i]));
+
+	ReadPiece(&pieces[0]);
+
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+
+	// Put the pieces' positions and texture coordinates back together
+	std::vector<int> positionBase(count);
+	std::vector<int> texCoordBase(count);
+	size_t numPositions = 0;
+	size_t numTexCoords = 0;
+	size_t numEvents = 0;
+
+	for (int i = 0; i < count; i++)
+	{
+		if (pieces[i].bad)
+			return false;
+
+		positionBase[i] = (int)(numPositions / 3);
+		texCoordBase[i] = (int)(numTexCoords / 2);
+		numPositions += pieces[i].positions.size();
+		numTexCoords += pieces[i].texCoords.size();
+		numEvents += pieces[i].events.size();
+	}
+
+	std::vector<float> positions;
+	std::vector<float> texCoords;
+	positions.reserve(numPositions);
+	texCoords.reserve(numTexCoords);
+
+	for (int i = 0; i < count; i++)
+	{
+		positions.insert(positions.end(), pieces[i].positions.begin(), pieces[i].positions.end());
+		texCoords.insert(texCoords.end(), pieces[i].texCoords.begin(), pieces[i].texCoords.end());
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		if (pieces[i].mtllib != NULL)
+		{
+			ImportMTL((std::string(path) + std::string(pieces[i].mtllib, pieces[i].mtllibLength)).c_str(), mesh);
+			break;
+		}
+	}
+
+	// usemtl can name materials the mtllib hasn't got, there's room for
+	// all of them so the table's names don't move
+	mesh.materials.reserve(mesh.materials.size() + numEvents + 1);
+
+	NameTable materialNames;
+	materialNames.Create((int)mesh.materials.capacity());
+
+	for (size_t m = 0; m < mesh.materials.size(); m++)
+		materialNames.Add(mesh.materials[m].name, (int)m);
+
+	ObjectBuilder builder(mesh);
+	std::unordered_map<unsigned long long, int> vertices;	// The object's vertex for each position and texture coordinate
+	int material = -1;
+	unsigned int groups = 0;
+	const char *name = "default";
+	int nameLength = 7;
+
+	for (int i = 0; i < count; i++)
+	{
+		ObjPiece &piece = pieces[i];
+		size_t e = 0;
+		size_t c = 0;
+
+		for (size_t f = 0; f <= piece.polygons.size(); f++)
+		{
+			// The lines in front of the polygon
+			for (; e < piece.events.size() && piece.events[e].polygon == (int)f; e++)
+			{
+				ObjEvent &ev = piece.events[e];
+
+				switch (ev.type)
+				{
+					case OBJ_OBJECT		:
+						name = ev.name;
+						nameLength = ev.length;
+						builder.Begin(name, nameLength);
+						vertices.clear();
+						break;
+					case OBJ_MATERIAL	:
+					{
+						char n[80];
+						int length = ev.length < (int)sizeof(n) - 1 ? ev.length : sizeof(n) - 1;
+
+						memcpy(n, ev.name, length);
+						n[length] = 0;
+
+						material = materialNames.Find(n);
+
+						if (material < 0)
+						{
+							// Not in the mtllib, it's drawn plain white
+							Mesh_3DS::Material m;
+							memset(&m, 0, sizeof(m));
+							strcpy(m.name, n);
+							m.color.r = m.color.g = m.color.b = m.color.a = 255;
+
+							material = (int)mesh.materials.size();
+							mesh.materials.push_back(m);
+							materialNames.Add(mesh.materials.back().name, material);
+						}
+						break;
+					}
+					case OBJ_SMOOTH		:
+						groups = ev.groups;
+						builder.smoothed = true;
+						break;
+				}
+			}
+
+			if (f == piece.polygons.size())
+				break;
+
+			int corners = piece.polygons[f];
+
+			// A big object carries on in another one with the same name
+			if (!builder.Room(corners))
+			{
+				builder.Begin(name, nameLength);
+				vertices.clear();
+			}
+
+			int first = 0;
+			int last = 0;
+
+			for (int k = 0; k < corners; k++, c++)
+			{
+				const ObjCorner &corner = piece.corners[c];
+				int v = corner.v + (corner.flags & OBJ_RELATIVE_V ? positionBase[i] : 0);
+				int t = corner.t + (corner.flags & OBJ_RELATIVE_T ? texCoordBase[i] : 0);
+				bool hasT = !(corner.flags & OBJ_NO_T);
+
+				if (v < 0 || (size_t)v >= numPositions / 3 || (hasT && (t < 0 || (size_t)t >= numTexCoords / 2)))
+				{
+					mesh.objects.clear();
+					return false;
+				}
+
+				unsigned long long key = ((unsigned long long)v << 32) | (unsigned int)(hasT ? t + 1 : 0);
+				std::unordered_map<unsigned long long, int>::iterator found = vertices.find(key);
+				int index;
+
+				if (found != vertices.end())
+					index = found->second;
+				else
+				{
+					index = builder.Vertex(&positions[v * 3], hasT ? &texCoords[t * 2] : NULL);
+					vertices[key] = index;
+				}
+
+				// Polygons are split into a fan of triangles
+				if (k == 0)
+					first = index;
+				else if (k >= 2)
+					builder.Face(first, last, index, groups, material);
+
+				last = index;
+			}
+		}
+	}
+
+	builder.Finish();
+
+	return true;
+}
+
+void MeshImporter::ImportMTL(const char *name, ImportedMesh &mesh)
+{
+	// The name comes from the model, it can be a directory or a device.
+	// Without a file the materials are plain white
+	struct stat info;
+	if (stat(name, &info) != 0 || (info.st_mode & S_IFMT) != S_IFREG)
+		return;
+
+	FILE *file = fopen(name, "rb");
+	if (file == NULL)
+		return;
+
+	// Read in pieces, only what fread hands back counts
+	std::vector<char> text;
+	char buffer[4096];
+	size_t n;
+	while (text.size() < (size_t)MTL_MAX_BYTES && (n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		text.insert(text.end(), buffer, buffer + n);
+	fclose(file);
+
+	if (text.empty())
+		return;
+
+	const char *p = &text[0];
+	const char *stop = p + text.size();
+
+	while (p < stop)
+	{
+		const char *end = (const char *)memchr(p, '\n', stop - p);
+		if (end == NULL)
+			end = stop;
+
+		const char *q = SkipSpace(p, end);
+		int length;
+
+		if (Keyword(q, end, "newmtl"))
+		{
+			Mesh_3DS::Material m;
+			memset(&m, 0, sizeof(m));
+
+			const char *n = Rest(q, end, &length);
+			if (length > (int)sizeof(m.name) - 1)
+				length = sizeof(m.name) - 1;
+			memcpy(m.name, n, length);
+
+			m.color.r = m.color.g = m.color.b = m.color.a = 255;
+			mesh.materials.push_back(m);
+		}
+		else if (!mesh.materials.empty() && Keyword(q, end, "Kd"))
+		{
+			const char *r = q + 3;
+			float c[3];
+			Mesh_3DS::Color4i &color = mesh.materials.back().color;
+
+			if (ParseFloat(r, end, c[0]) && ParseFloat(r, end, c[1]) && ParseFloat(r, end, c[2]))
+			{
+				color.r = (unsigned char)(c[0] < 0.0f ? 0 : c[0] > 1.0f ? 255 : c[0] * 255.0f);
+				color.g = (unsigned char)(c[1] < 0.0f ? 0 : c[1] > 1.0f ? 255 : c[1] * 255.0f);
+				color.b = (unsigned char)(c[2] < 0.0f ? 0 : c[2] > 1.0f ? 255 : c[2] * 255.0f);
+			}
+		}
+		else if (!mesh.materials.empty() && Keyword(q, end, "map_Kd"))
+		{
+			// The file name is last, any options come before it
+			const char *n = Rest(q, end, &length);
+			const char *last = n;
+
+			for (const char *s = n; s < n + length; s++)
+			{
+				if (*s == ' ' || *s == '\t')
+					last = s + 1;
+			}
+
+			SetMap(mesh.materials.back(), last, (int)(n + length - last));
+		}
+
+		p = end + 1;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+// MS3D
+//////////////////////////////////////////////////////////////////////
+
+#define MS3D_HEADER		14		// "MS3D000000" and the version
+#define MS3D_VERTEX		15		// Flags, position, joint and reference count
+#define MS3D_TRIANGLE	70		// Flags, vertices, normals, s, t, smoothing group and group
+#define MS3D_MATERIAL	361		// Name, colors, shininess, transparency, mode, texture and alpha map
+
+// Reads the little endian numbers, the file isn't aligned for them
+static unsigned short ReadShort(const unsigned char *p)
+{
+	return (unsigned short)(p[0] | (p[1] << 8));
+}
+
+static float ReadFloat(const unsigned char *p)
+{
+	float f;
+	memcpy(&f, p, sizeof(f));
+	return f;
+}
+
+bool MeshImporter::IsMS3D(const unsigned char *data, size_t size)
+{
+	return data != NULL && size >= MS3D_HEADER && memcmp(data, "MS3D000000", 10) == 0;
+}
+
+bool MeshImporter::ImportMS3D(const unsigned char *data, size_t size, ImportedMesh &mesh)
+{
+	mesh.materials.clear();
+	mesh.objects.clear();
+
+	if (!IsMS3D(data, size))
+		return false;
+
+	int version = data[10] | (data[11] << 8) | (data[12] << 16) | (data[13] << 24);
+	if (version < 3 || version > 4)
+		return false;
+
+	size_t pos = MS3D_HEADER;
+
+	// The vertices
+	if (size - pos < 2)
+		return false;
+
+	int numVerts = ReadShort(data + pos);
+	const unsigned char *verts = data + pos + 2;
+	pos += 2;
+
+	if ((size - pos) / MS3D_VERTEX < (size_t)numVerts)
+		return false;
+	pos += numVerts * MS3D_VERTEX;
+
+	// The triangles
+	if (size - pos < 2)
+		return false;
+
+	int numTriangles = ReadShort(data + pos);
+	const unsigned char *triangles = data + pos + 2;
+	pos += 2;
+
+	if ((size - pos) / MS3D_TRIANGLE < (size_t)numTriangles)
+		return false;
+	pos += numTriangles * MS3D_TRIANGLE;
+
+	for (int i = 0; i < numTriangles; i++)
+	{
+		const unsigned char *t = triangles + i * MS3D_TRIANGLE;
+
+		for (int k = 0; k < 3; k++)
+		{
+			if (ReadShort(t + 2 + k * 2) >= numVerts)
+				return false;
+		}
+	}
+
+	// The groups, which are the objects. Their materials come after
+	// them so they're found first and read once we have those
+	if (size - pos < 2)
+		return false;
+
+	int numGroups = ReadShort(data + pos);
+	std::vector<size_t> groupStart(numGroups);
+	pos += 2;
+
+	for (int g = 0; g < numGroups; g++)
+	{
+		// Flags, name and the number of triangles
+		if (size - pos < 35)
+			return false;
+
+		groupStart[g] = pos;
+
+		int count = ReadShort(data + pos + 33);
+		pos += 35;
+
+		// The triangles and the material
+		if (size - pos < 1 || (size - pos - 1) / 2 < (size_t)count)
+			return false;
+
+		pos += count * 2 + 1;
+	}
+
+	// The materials
+	if (size - pos < 2)
+		return false;
+
+	int numMaterials = ReadShort(data + pos);
+	pos += 2;
+
+	if ((size - pos) / MS3D_MATERIAL < (size_t)numMaterials)
+		return false;
+
+	for (int m = 0; m < numMaterials; m++, pos += MS3D_MATERIAL)
+	{
+		const unsigned char *p = data + pos;
+		Mesh_3DS::Material material;
+		memset(&material, 0, sizeof(material));
+
+		// The names are 32 bytes and don't have to end in a zero
+		memcpy(material.name, p, 32);
+		material.name[32] = 0;
+
+		material.color.r = (unsigned char)(ReadFloat(p + 48) * 255.0f);
+		material.color.g = (unsigned char)(ReadFloat(p + 52) * 255.0f);
+		material.color.b = (unsigned char)(ReadFloat(p + 56) * 255.0f);
+		material.color.a = 255;
+
+		const char *texture = (const char *)p + 105;
+		SetMap(material, texture, (int)strnlen(texture, 128));
+
+		mesh.materials.push_back(material);
+	}
+
+	ObjectBuilder builder(mesh);
+	builder.smoothed = true;
+
+	// Each of the file's vertices can become several of the object's,
+	// one for each different texture coordinate, kept in a list
+	std::vector<int> first(numVerts);
+	std::vector<int> next;
+
+	for (int g = 0; g < numGroups; g++)
+	{
+		const unsigned char *group = data + groupStart[g];
+		int count = ReadShort(group + 33);
+		int material = (signed char)group[35 + count * 2];
+		char name[33];
+
+		memcpy(name, group + 1, 32);
+		name[32] = 0;
+
+		if (material >= numMaterials)
+			material = -1;
+
+		builder.Begin(name, (int)strlen(name));
+		std::fill(first.begin(), first.end(), -1);
+		next.clear();
+
+		for (int i = 0; i < count; i++)
+		{
+			int triangle = ReadShort(group + 35 + i * 2);
+			if (triangle >= numTriangles)
+			{
+				mesh.objects.clear();
+				return false;
+			}
+
+			const unsigned char *t = triangles + triangle * MS3D_TRIANGLE;
+			int corners[3];
+
+			if (!builder.Room(3))
+			{
+				builder.Begin(name, (int)strlen(name));
+				std::fill(first.begin(), first.end(), -1);
+				next.clear();
+			}
+
+			for (int k = 0; k < 3; k++)
+			{
+				int v = ReadShort(t + 2 + k * 2);
+
+				// MilkShape's t runs down the texture
+				float uv[2] = { ReadFloat(t + 44 + k * 4), 1.0f - ReadFloat(t + 56 + k * 4) };
+				const float *vt = mesh.objects.back().texCoords.data();
+				int index = first[v];
+
+				while (index >= 0 && (vt[index * 2] != uv[0] || vt[index * 2 + 1] != uv[1]))
+					index = next[index];
+
+				if (index < 0)
+				{
+					float xyz[3] = { ReadFloat(verts + v * MS3D_VERTEX + 1), ReadFloat(verts + v * MS3D_VERTEX + 5), ReadFloat(verts + v * MS3D_VERTEX + 9) };
+
+					index = builder.Vertex(xyz, uv);
+					next.push_back(first[v]);
+					first[v] = index;
+				}
+
+				corners[k] = index;
+			}
+
+			// Groups 1 to 32 are bits, 0 is flat
+			int smoothing = t[68];
+			builder.Face(corners[0], corners[1], corners[2], smoothing > 0 ? 1u << ((smoothing - 1) & 31) : 0, material);
+		}
+	}
+
+	builder.Finish();
+
+	return true;
+}
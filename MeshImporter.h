@@ -0,0 +1,81 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Mesh Importer
+//
+// MeshImporter.h: interface for the MeshImporter class.
+// Reads the other formats MilkShape 3D exports, Wavefront (.obj)
+// and MilkShape's own (.ms3d), into a plain list of objects that
+// Mesh_3DS turns into the same mesh it makes from a 3ds file. So
+// a model loads and draws the same whichever of them it's in.
+//
+// Each object comes out with its own vertices (at most 65535, a
+// bigger one is split), three per face, one smoothing group mask
+// per face if the file has them and each face's material. Normals
+// aren't kept, Mesh_3DS works them out from the smoothing groups
+// like it does for a 3ds file, and faces without a material share
+// a plain white one.
+//
+// OBJ files are read straight from the bytes with no line copied
+// and nothing but the numbers converted. A big file is cut into
+// pieces at line ends and the pieces are read on their own threads,
+// then put back together in order. The materials come from the
+// file's mtllib, looked for next to the model.
+//
+// MS3D files are checked against their length the same as 3ds
+// files. Their joints and keyframes are skipped.
+//
+// Usage:
+// ImportedMesh m;
+//
+// if (MeshImporter::IsMS3D(data, size))
+//     ok = MeshImporter::ImportMS3D(data, size, m);
+// else if (MeshImporter::IsOBJ(name))
+//     ok = MeshImporter::ImportOBJ(data, size, "models/house/", m);
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef MESHIMPORTER_H
+#define MESHIMPORTER_H
+
+#include "Mesh_3DS.h"
+
+#include <stddef.h>
+#include <vector>
+
+#define OBJ_THREAD_BYTES	(1 << 20)	// An OBJ file gets another thread for each this many bytes
+#define MTL_MAX_BYTES		(16 << 20)	// More of an mtllib than this is left unread
+
+// A model read from a file, before Mesh_3DS makes it into a mesh
+struct ImportedMesh {
+	struct Object {
+		char name[80];						// The object's name
+		std::vector<float> vertices;		// x, y and z of each vertex, y up
+		std::vector<float> texCoords;		// u and v of each vertex, empty if it has none
+		std::vector<unsigned short> faces;	// Three vertices for each face
+		std::vector<unsigned int> groups;	// Each face's smoothing groups, empty to smooth by angle
+		std::vector<int> materials;			// Each face's material
+	};
+
+	std::vector<Mesh_3DS::Material> materials;
+	std::vector<Object> objects;
+};
+
+class MeshImporter
+{
+public:
+	// True if the name ends in .obj, OBJ files don't have a signature
+	static bool IsOBJ(const char *name);
+	// True if the file starts with MilkShape's signature
+	static bool IsMS3D(const unsigned char *data, size_t size);
+
+	// Reads an OBJ file, path is where to look for its mtllib. False if it doesn't make sense
+	static bool ImportOBJ(const unsigned char *data, size_t size, const char *path, ImportedMesh &mesh);
+	// Reads an MS3D file, false if it's cut short or doesn't add up
+	static bool ImportMS3D(const unsigned char *data, size_t size, ImportedMesh &mesh);
+
+private:
+	// Reads the materials of an mtllib into the mesh
+	static void ImportMTL(const char *name, ImportedMesh &mesh);
+};
+
+#endif MESHIMPORTER_H
@@ -0,0 +1,226 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Mesh Optimizer
+//
+// MeshOptimizer.cpp: implementation of the MeshOptimizer class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "MeshOptimizer.h"
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+// The cache the faces are ordered for, and how much a vertex in
+// it is worth. These are the numbers from Forsyth's article.
+#define SCORE_CACHE_SIZE		32
+#define CACHE_DECAY_POWER		1.5f
+#define LAST_FACE_SCORE			0.75f
+#define VALENCE_BOOST_SCALE		2.0f
+#define VALENCE_BOOST_POWER		0.5f
+
+// How much we want to use a vertex next. Vertices in the cache are
+// worth more the more recently they went in, except for the last
+// face's which would leave it looking the same as before. Vertices
+// with few faces left get a boost so they get finished off.
+static float VertexScore(int cachePos, int faces)
+{
+	if (faces == 0)
+		return -1.0f;
+
+	float score = 0.0f;
+
+	if (cachePos >= 0)
+	{
+		if (cachePos < 3)
+			score = LAST_FACE_SCORE;
+		else
+			score = powf(1.0f - (cachePos - 3) * (1.0f / (SCORE_CACHE_SIZE - 3)), CACHE_DECAY_POWER);
+	}
+
+	return score + VALENCE_BOOST_SCALE * powf((float)faces, -VALENCE_BOOST_POWER);
+}
+
+int MeshOptimizer::CacheMisses(const unsigned short *indices, int count, int numVerts)
+{
+	// A vertex is in the cache if it was one of the last
+	// MESH_FIFO_SIZE vertices to miss
+	std::vector<int> missed(numVerts, -MESH_FIFO_SIZE - 1);
+	int misses = 0;
+
+	for (int i = 0; i < count; i++)
+	{
+		int v = indices[i];
+
+		if (v >= numVerts)
+			continue;
+
+		if (missed[v] < misses - MESH_FIFO_SIZE)
+			missed[v] = misses++;
+	}
+
+	return misses;
+}
+
+float MeshOptimizer::ACMR(const unsigned short *indices, int count, int numVerts)
+{
+	if (count < 3)
+		return 0.0f;
+
+	return (float)CacheMisses(indices, count, numVerts) / (count / 3);
+}
+
+void MeshOptimizer::OptimizeFaces(unsigned short *indices, int count, int numVerts)
+{
+	int numFaces = count / 3;
+
+	if (numFaces < 2)
+		return;
+
+	// Leave a list that uses vertices we don't have alone
+	for (int i = 0; i < numFaces * 3; i++)
+	{
+		if (indices[i] >= numVerts)
+			return;
+	}
+
+	// The faces that still haven't been drawn for each vertex
+	std::vector<int> faceCount(numVerts, 0);
+	std::vector<int> firstFace(numVerts + 1, 0);
+	std::vector<int> faceList(numFaces * 3);
+
+	for (int i = 0; i < numFaces * 3; i++)
+		faceCount[indices[i]]++;
+
+	for (int v = 0; v < numVerts; v++)
+		firstFace[v + 1] = firstFace[v] + faceCount[v];
+
+	std::vector<int> filled(firstFace.begin(), firstFace.end() - 1);
+
+	for (int i = 0; i < numFaces * 3; i++)
+		faceList[filled[indices[i]]++] = i / 3;
+
+	std::vector<int> cachePos(numVerts, -1);
+	std::vector<float> vertexScore(numVerts);
+	std::vector<float> faceScore(numFaces);
+	std::vector<bool> drawn(numFaces, false);
+
+	for (int v = 0; v < numVerts; v++)
+		vertexScore[v] = VertexScore(-1, faceCount[v]);
+
+	int best = 0;
+
+	for (int f = 0; f < numFaces; f++)
+	{
+		faceScore[f] = vertexScore[indices[f*3]] + vertexScore[indices[f*3+1]] + vertexScore[indices[f*3+2]];
+
+		if (faceScore[f] > faceScore[best])
+			best = f;
+	}
+
+	std::vector<unsigned short> sorted(numFaces * 3);
+	int cache[SCORE_CACHE_SIZE + 3];
+	int cached = 0;
+	int next = 0;	// The first face that might not be drawn yet
+
+	for (int n = 0; n < numFaces; n++)
+	{
+		// Nothing in the cache has faces left, start somewhere new
+		if (best < 0)
+		{
+			while (drawn[next])
+				next++;
+
+			best = next;
+		}
+
+		const unsigned short *face = &indices[best * 3];
+
+		sorted[n*3]   = face[0];
+		sorted[n*3+1] = face[1];
+		sorted[n*3+2] = face[2];
+		drawn[best] = true;
+
+		// Take the face off its vertices' lists
+		for (int k = 0; k < 3; k++)
+		{
+			int v = face[k];
+			int *list = &faceList[firstFace[v]];
+
+			for (int i = 0; i < faceCount[v]; i++)
+			{
+				if (list[i] == best)
+				{
+					list[i] = list[--faceCount[v]];
+					break;
+				}
+			}
+		}
+
+		// The face's vertices go in the front of the cache and
+		// push everything else back
+		int newCache[SCORE_CACHE_SIZE + 3];
+		int newCached = 0;
+
+		for (int k = 0; k < 3; k++)
+			newCache[newCached++] = face[k];
+
+		for (int i = 0; i < cached; i++)
+		{
+			if (cache[i] != face[0] && cache[i] != face[1] && cache[i] != face[2])
+				newCache[newCached++] = cache[i];
+		}
+
+		// Rescore the vertices that moved, including the ones
+		// that just fell out of the cache
+		for (int i = 0; i < newCached; i++)
+		{
+			int v = newCache[i];
+
+			cachePos[v] = i < SCORE_CACHE_SIZE ? i : -1;
+			vertexScore[v] = VertexScore(cachePos[v], faceCount[v]);
+		}
+
+		// And the faces that use them, the best of which is next
+		best = -1;
+		float bestScore = -1.0f;
+
+		for (int i = 0; i < newCached; i++)
+		{
+			int v = newCache[i];
+			int *list = &faceList[firstFace[v]];
+
+			for (int j = 0; j < faceCount[v]; j++)
+			{
+				int f = list[j];
+
+				faceScore[f] = vertexScore[indices[f*3]] + vertexScore[indices[f*3+1]] + vertexScore[indices[f*3+2]];
+
+				if (faceScore[f] > bestScore)
+				{
+					best = f;
+					bestScore = faceScore[f];
+				}
+			}
+		}
+
+		cached = newCached < SCORE_CACHE_SIZE ? newCached : SCORE_CACHE_SIZE;
+		memcpy(cache, newCache, cached * sizeof(int));
+	}
+
+	memcpy(indices, &sorted[0], numFaces * 3 * sizeof(unsigned short));
+}
+
+int MeshOptimizer::Remap(unsigned short *remap, int next, unsigned short *indices, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (remap[indices[i]] == MESH_UNUSED)
+			remap[indices[i]] = (unsigned short)next++;
+
+		indices[i] = remap[indices[i]];
+	}
+
+	return next;
+}
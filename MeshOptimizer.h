@@ -0,0 +1,52 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Mesh Optimizer
+//
+// MeshOptimizer.h: interface for the MeshOptimizer class.
+// The faces in a 3ds file come out in whatever order they were
+// modelled in, which jumps all over the mesh. The card keeps the
+// last few vertices it transformed in a small cache, so a face
+// that uses vertices the faces just before it used is nearly
+// free and one that doesn't has to transform all three again.
+//
+// OptimizeFaces() puts a list of faces in an order that keeps
+// reusing the cache (Tom Forsyth's linear speed vertex cache
+// optimisation). Remap() then numbers the vertices in the order
+// the faces first use them, so the vertex arrays are read from
+// start to end instead of at random.
+//
+// ACMR() is the average number of vertices transformed per face,
+// for a simple first-in first-out cache. 3 is as bad as it gets
+// and a well ordered mesh gets down to about 0.7.
+//
+// Usage:
+// float before = MeshOptimizer::ACMR(indices, count, numVerts);
+// MeshOptimizer::OptimizeFaces(indices, count, numVerts);
+// float after = MeshOptimizer::ACMR(indices, count, numVerts);
+//
+// memset(remap, 0xff, numVerts * sizeof(unsigned short));
+// int used = MeshOptimizer::Remap(remap, 0, indices, count);
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#define MESH_FIFO_SIZE	16		// The cache ACMR measures with
+#define MESH_UNUSED		0xFFFF	// A remap entry for a vertex no face has used yet
+
+class MeshOptimizer
+{
+public:
+	// Cache misses drawing the faces, over the number of faces
+	static float ACMR(const unsigned short *indices, int count, int numVerts);
+	// The vertices drawing the faces would transform
+	static int CacheMisses(const unsigned short *indices, int count, int numVerts);
+	// Reorders the faces for the vertex cache, the faces themselves don't change
+	static void OptimizeFaces(unsigned short *indices, int count, int numVerts);
+	// Numbers each unused vertex from next on as the faces use it and
+	// changes the faces to the new numbers. Returns the next number free.
+	static int Remap(unsigned short *remap, int next, unsigned short *indices, int count);
+};
+
+#endif MESHOPTIMIZER_H
@@ -0,0 +1,418 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Mesh Simplifier
+//
+// MeshSimplifier.cpp: implementation of the MeshSimplifier class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "MeshSimplifier.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+// How much more moving a vertex off the border of the mesh costs
+// than moving it off the surface
+#define BORDER_WEIGHT	10.0
+
+// Sorts vertices by position so the ones in the same place end up together
+struct PositionOrder {
+	const float *v;
+	bool operator()(int a, int b) const
+	{
+		if (v[a*3] != v[b*3])
+			return v[a*3] < v[b*3];
+		if (v[a*3+1] != v[b*3+1])
+			return v[a*3+1] < v[b*3+1];
+		return v[a*3+2] < v[b*3+2];
+	}
+};
+
+// An edge of a face, used to find the ones only one face has
+struct FaceEdge {
+	int a;
+	int b;
+	int face;
+	bool operator<(const FaceEdge &e) const { return a != e.a ? a < e.a : b < e.b; }
+};
+
+static void Normal(const float *a, const float *b, const float *c, double *n)
+{
+	double u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+	double v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+
+	n[0] = u[1]*v[2] - u[2]*v[1];
+	n[1] = u[2]*v[0] - u[0]*v[2];
+	n[2] = u[0]*v[1] - u[1]*v[0];
+}
+
+void MeshSimplifier::Create(const float *vertexes, int numVerts, const unsigned int *indices, const int *tags, int numFaces)
+{
+	this->vertexes = vertexes;
+
+	// Give vertices in the same place the same position
+	std::vector<int> order(numVerts);
+	for (int i = 0; i < numVerts; i++)
+		order[i] = i;
+
+	PositionOrder byPosition;
+	byPosition.v = vertexes;
+	std::sort(order.begin(), order.end(), byPosition);
+
+	position.assign(numVerts, 0);
+	firstVertex.clear();
+
+	for (int i = 0; i < numVerts; i++)
+	{
+		if (i == 0 || byPosition(order[i-1], order[i]))
+			firstVertex.push_back(order[i]);
+
+		position[order[i]] = (int)firstVertex.size() - 1;
+	}
+
+	int numPositions = (int)firstVertex.size();
+
+	corners.assign(indices, indices + numFaces * 3);
+	this->tags.assign(tags, tags + numFaces);
+	faces.assign(numFaces * 3, 0);
+	faceAlive.assign(numFaces, false);
+	around.assign(numPositions, std::vector<int>());
+	quadrics.assign(numPositions, Quadric());
+	version.assign(numPositions, 0);
+	alive.assign(numPositions, true);
+	moved.assign(numPositions, 0.0f);
+	heap.clear();
+	faceCount = 0;
+	error = 0.0f;
+
+	for (int p = 0; p < numPositions; p++)
+	{
+		memset(quadrics[p].a, 0, sizeof(quadrics[p].a));
+		quadrics[p].weight = 0.0;
+	}
+
+	std::vector<FaceEdge> edges;
+
+	for (int t = 0; t < numFaces; t++)
+	{
+		int *f = &faces[t*3];
+		bool valid = true;
+
+		for (int k = 0; k < 3; k++)
+		{
+			if (corners[t*3+k] >= (unsigned int)numVerts)
+				valid = false;
+			else
+				f[k] = position[corners[t*3+k]];
+		}
+
+		// Faces that are already a line or a point aren't kept
+		if (!valid || f[0] == f[1] || f[1] == f[2] || f[0] == f[2])
+			continue;
+
+		faceAlive[t] = true;
+		faceCount++;
+
+		double n[3];
+		Normal(Position(f[0]), Position(f[1]), Position(f[2]), n);
+		double length = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+
+		for (int k = 0; k < 3; k++)
+		{
+			around[f[k]].push_back(t);
+
+			FaceEdge e;
+			e.a = std::min(f[k], f[(k+1)%3]);
+			e.b = std::max(f[k], f[(k+1)%3]);
+			e.face = t;
+			edges.push_back(e);
+		}
+
+		// Each vertex starts off wanting to stay on its faces' planes
+		if (length > 0.0)
+		{
+			n[0] /= length;
+			n[1] /= length;
+			n[2] /= length;
+
+			const float *a = Position(f[0]);
+			double d = -(n[0]*a[0] + n[1]*a[1] + n[2]*a[2]);
+
+			for (int k = 0; k < 3; k++)
+				AddPlane(quadrics[f[k]], n, d, 1.0);
+		}
+	}
+
+	// An edge only one face has is on the border, so put a plane
+	// through it square to the face to keep it where it is
+	std::sort(edges.begin(), edges.end());
+
+	for (size_t i = 0; i < edges.size(); i++)
+	{
+		bool shared = (i > 0 && edges[i-1].a == edges[i].a && edges[i-1].b == edges[i].b) ||
+			(i + 1 < edges.size() && edges[i+1].a == edges[i].a && edges[i+1].b == edges[i].b);
+
+		if (shared)
+			continue;
+
+		int *f = &faces[edges[i].face * 3];
+		const float *a = Position(edges[i].a);
+		const float *b = Position(edges[i].b);
+
+		double n[3];
+		Normal(Position(f[0]), Position(f[1]), Position(f[2]), n);
+
+		double e[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		double m[3] = { e[1]*n[2] - e[2]*n[1], e[2]*n[0] - e[0]*n[2], e[0]*n[1] - e[1]*n[0] };
+		double length = sqrt(m[0]*m[0] + m[1]*m[1] + m[2]*m[2]);
+
+		if (length == 0.0)
+			continue;
+
+		m[0] /= length;
+		m[1] /= length;
+		m[2] /= length;
+
+		double d = -(m[0]*a[0] + m[1]*a[1] + m[2]*a[2]);
+
+		AddPlane(quadrics[edges[i].a], m, d, BORDER_WEIGHT);
+		AddPlane(quadrics[edges[i].b], m, d, BORDER_WEIGHT);
+	}
+
+	for (size_t i = 0; i < edges.size(); i++)
+	{
+		if (i == 0 || edges[i-1].a != edges[i].a || edges[i-1].b != edges[i].b)
+			Push(edges[i].a, edges[i].b);
+	}
+}
+
+void MeshSimplifier::Simplify(int targetFaces)
+{
+	// How far this level ends up from the one before
+	float levelError = 0.0f;
+	std::fill(moved.begin(), moved.end(), 0.0f);
+
+	while (faceCount > targetFaces && !heap.empty())
+	{
+		std::pop_heap(heap.begin(), heap.end());
+		Collapse c = heap.back();
+		heap.pop_back();
+
+		// Something around it has collapsed since, it'll have been pushed again
+		if (!alive[c.from] || !alive[c.to] || version[c.from] != c.fromVersion || version[c.to] != c.toVersion)
+			continue;
+
+		if (Flips(c.from, c.to))
+			continue;
+
+		// The vertices already on either end move again with this one
+		float total = std::max(moved[c.from], moved[c.to]) + c.error;
+		moved[c.to] = total;
+
+		if (total > levelError)
+			levelError = total;
+
+		CollapseEdge(c.from, c.to);
+	}
+
+	error += levelError;
+}
+
+int MeshSimplifier::Faces(unsigned int *indices, int *tags)
+{
+	int count = 0;
+
+	for (size_t t = 0; t < faceAlive.size(); t++)
+	{
+		if (!faceAlive[t])
+			continue;
+
+		for (int k = 0; k < 3; k++)
+		{
+			// Keep the face's own vertex while it hasn't moved so
+			// its texture coordinates and normal stay the same
+			unsigned int v = corners[t*3+k];
+			int p = faces[t*3+k];
+
+			indices[count*3+k] = position[v] == p ? v : firstVertex[p];
+		}
+
+		tags[count] = this->tags[t];
+		count++;
+	}
+
+	return count;
+}
+
+int MeshSimplifier::FaceCount()
+{
+	return faceCount;
+}
+
+float MeshSimplifier::Error()
+{
+	return error;
+}
+
+const float *MeshSimplifier::Position(int p)
+{
+	return &vertexes[firstVertex[p] * 3];
+}
+
+void MeshSimplifier::AddPlane(Quadric &q, const double *n, double d, double weight)
+{
+	double p[4] = { n[0], n[1], n[2], d };
+	int k = 0;
+
+	for (int i = 0; i < 4; i++)
+	{
+		for (int j = i; j < 4; j++)
+			q.a[k++] += weight * p[i] * p[j];
+	}
+
+	q.weight += weight;
+}
+
+float MeshSimplifier::Cost(const Quadric &q, int p)
+{
+	const float *v = Position(p);
+	double x = v[0];
+	double y = v[1];
+	double z = v[2];
+	const double *a = q.a;
+
+	double cost = a[0]*x*x + 2*a[1]*x*y + 2*a[2]*x*z + 2*a[3]*x
+		+ a[4]*y*y + 2*a[5]*y*z + 2*a[6]*y
+		+ a[7]*z*z + 2*a[8]*z
+		+ a[9];
+
+	return cost > 0.0 ? (float)cost : 0.0f;
+}
+
+void MeshSimplifier::Push(int p, int q)
+{
+	Quadric sum;
+
+	for (int i = 0; i < 10; i++)
+		sum.a[i] = quadrics[p].a[i] + quadrics[q].a[i];
+
+	sum.weight = quadrics[p].weight + quadrics[q].weight;
+
+	// Move whichever end is cheaper onto the other
+	float toQ = Cost(sum, q);
+	float toP = Cost(sum, p);
+
+	Collapse c;
+	c.cost = toQ <= toP ? toQ : toP;
+	c.error = sum.weight > 0.0 ? (float)sqrt(c.cost / sum.weight) : 0.0f;
+	c.from = toQ <= toP ? p : q;
+	c.to = toQ <= toP ? q : p;
+	c.fromVersion = version[c.from];
+	c.toVersion = version[c.to];
+
+	heap.push_back(c);
+	std::push_heap(heap.begin(), heap.end());
+}
+
+bool MeshSimplifier::Flips(int from, int to)
+{
+	const std::vector<int> &list = around[from];
+
+	for (size_t i = 0; i < list.size(); i++)
+	{
+		int t = list[i];
+		int *f = &faces[t*3];
+
+		// The faces on the edge go away, so it doesn't matter what they'd do
+		if (!faceAlive[t] || f[0] == to || f[1] == to || f[2] == to)
+			continue;
+
+		const float *p[3];
+		const float *moved[3];
+
+		for (int k = 0; k < 3; k++)
+		{
+			p[k] = Position(f[k]);
+			moved[k] = f[k] == from ? Position(to) : p[k];
+		}
+
+		double before[3];
+		double after[3];
+		Normal(p[0], p[1], p[2], before);
+		Normal(moved[0], moved[1], moved[2], after);
+
+		double dot = before[0]*after[0] + before[1]*after[1] + before[2]*after[2];
+		bool flat = before[0] == 0.0 && before[1] == 0.0 && before[2] == 0.0;
+
+		if (!flat && dot <= 0.0)
+			return true;
+	}
+
+	return false;
+}
+
+void MeshSimplifier::CollapseEdge(int from, int to)
+{
+	for (int i = 0; i < 10; i++)
+		quadrics[to].a[i] += quadrics[from].a[i];
+
+	quadrics[to].weight += quadrics[from].weight;
+
+	alive[from] = false;
+
+	std::vector<int> &list = around[from];
+
+	for (size_t i = 0; i < list.size(); i++)
+	{
+		int t = list[i];
+		int *f = &faces[t*3];
+
+		if (!faceAlive[t])
+			continue;
+
+		// The faces on the edge get squashed flat
+		if (f[0] == to || f[1] == to || f[2] == to)
+		{
+			faceAlive[t] = false;
+			faceCount--;
+			continue;
+		}
+
+		for (int k = 0; k < 3; k++)
+		{
+			if (f[k] == from)
+				f[k] = to;
+		}
+
+		around[to].push_back(t);
+	}
+
+	std::vector<int>().swap(list);
+
+	// Drop the dead faces so the list doesn't keep growing
+	std::vector<int> &kept = around[to];
+	size_t n = 0;
+
+	for (size_t i = 0; i < kept.size(); i++)
+	{
+		if (faceAlive[kept[i]])
+			kept[n++] = kept[i];
+	}
+
+	kept.resize(n);
+
+	// Everything next to us costs something different now
+	version[to]++;
+
+	for (size_t i = 0; i < kept.size(); i++)
+	{
+		int *f = &faces[kept[i]*3];
+
+		for (int k = 0; k < 3; k++)
+		{
+			if (f[k] != to)
+				Push(to, f[k]);
+		}
+	}
+}
@@ -0,0 +1,104 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Mesh Simplifier
+//
+// MeshSimplifier.h: interface for the MeshSimplifier class.
+// Makes lower detail versions of a mesh for drawing it far away,
+// by collapsing edges one at a time, the cheapest first (Garland
+// and Heckbert's quadric error metric). Every vertex remembers
+// the planes of the faces around it and the cost of moving it is
+// how far that would put it from them. Edges along the border of
+// the mesh get an extra plane across them so holes don't grow.
+//
+// A vertex is always collapsed onto the other end of its edge, so
+// the lower levels only use vertices the mesh already has and can
+// share its arrays. Faces keep whatever tag (material) they had.
+//
+// Vertices at the same position are treated as one while the
+// mesh is simplified, so a mesh split at its texture seams (or
+// one where every face has its own vertices) holds together.
+//
+// Simplify() can be called again with a smaller target to carry
+// on from where it left off, which is how a whole chain of
+// levels comes out of one run.
+//
+// Usage:
+// MeshSimplifier s;
+//
+// s.Create(vertexes, numVerts, indices, tags, numFaces);
+// s.Simplify(numFaces / 4);
+// int faces = s.Faces(indices, tags);	// The faces that are left
+// float error = s.Error();				// How far the surface has moved
+//
+// Each collapse is measured as the root mean square distance from
+// the planes of the faces that were there. In one Simplify() a
+// vertex adds up the collapses that moved it and the ones it took
+// over, since each can move the surface a bit further, and the
+// most any vertex added up is how far this level is from the one
+// before. Error() adds that on to the error the level before had,
+// so each level is measured against the original mesh and a
+// coarser one always has a bigger error unless nothing moved.
+// It's a guide to how far off the level looks, not a hard limit.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <vector>
+
+class MeshSimplifier
+{
+public:
+	// Takes a copy of the faces, vertexes has to stay around until we're done
+	void Create(const float *vertexes, int numVerts, const unsigned int *indices, const int *tags, int numFaces);
+	// Collapses edges until there are no more than this many faces, or nothing is left to collapse
+	void Simplify(int targetFaces);
+	// Copies the faces that are left, three indices and a tag each, returns how many there are
+	int Faces(unsigned int *indices, int *tags);
+	int FaceCount();				// The faces that are left
+	float Error();					// The most the collapses so far moved the surface, on average
+
+private:
+	// A symmetric 4x4 matrix, the sum of the squared distances to some planes
+	struct Quadric {
+		double a[10];
+		double weight;				// How many planes went into it
+	};
+
+	// A collapse waiting to happen
+	struct Collapse {
+		float cost;
+		float error;				// The average distance off the planes, the cost doesn't care how many there are
+		int from;
+		int to;
+		int fromVersion;
+		int toVersion;
+		bool operator<(const Collapse &c) const { return cost > c.cost; }
+	};
+
+	const float *vertexes;
+	std::vector<int> position;		// Each vertex's position, vertices in the same place share one
+	std::vector<int> firstVertex;	// A vertex for each position
+	std::vector<unsigned int> corners;	// The original vertices of each face
+	std::vector<int> faces;			// The positions of each face as it is now
+	std::vector<int> tags;
+	std::vector<bool> faceAlive;
+	std::vector<std::vector<int> > around;	// The faces around each position
+	std::vector<Quadric> quadrics;
+	std::vector<int> version;		// Goes up whenever a position's collapses change
+	std::vector<bool> alive;
+	std::vector<float> moved;		// What this Simplify()'s collapses onto each position add up to
+	std::vector<Collapse> heap;
+	int faceCount;
+	float error;
+
+	const float *Position(int p);
+	void AddPlane(Quadric &q, const double *n, double d, double weight);
+	float Cost(const Quadric &q, int p);
+	void Push(int p, int q);
+	bool Flips(int from, int to);
+	void CollapseEdge(int from, int to);
+};
+
+#endif MESHSIMPLIFIER_H
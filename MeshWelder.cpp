@@ -0,0 +1,436 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Mesh Welder
+//
+// MeshWelder.cpp: implementation of the MeshWelder class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "MeshWelder.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+// Every x86 compiler we build with has SSE, anything else gets the plain loops
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#define WELDER_SSE
+#include <xmmintrin.h>
+#endif
+
+#define WELD_MAX_VERTS		65535	// Faces are 16 bit and 0xFFFF is kept for MESH_UNUSED
+#define WELD_CREASE_ANGLE	45.0	// Without smoothing groups, faces meeting at more than this (in degrees) stay sharp
+
+// What a corner of a face is made of, its position, normal and texture coordinates
+#define CORNER_FLOATS	8
+
+// Where faces that use a vertex we don't have get their corners from
+static const float noVertex[3] = { 0.0f, 0.0f, 0.0f };
+
+static const float *Corner(const float *vertexes, int numVerts, unsigned short index)
+{
+	return index < numVerts ? &vertexes[index * 3] : noVertex;
+}
+
+// The same sum the loader has always used, (b - c) x (b - a)
+static void FaceNormal(const float *a, const float *b, const float *c, float *n)
+{
+	float u[3] = { b[0] - c[0], b[1] - c[1], b[2] - c[2] };
+	float v[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+
+	n[0] = u[1]*v[2] - u[2]*v[1];
+	n[1] = u[2]*v[0] - u[0]*v[2];
+	n[2] = u[0]*v[1] - u[1]*v[0];
+}
+
+// Sorts vertices by position so the ones in the same place end up together
+struct PlaceOrder {
+	const float *v;
+	bool operator()(int a, int b) const
+	{
+		if (v[a*3] != v[b*3])
+			return v[a*3] < v[b*3];
+		if (v[a*3+1] != v[b*3+1])
+			return v[a*3+1] < v[b*3+1];
+		return v[a*3+2] < v[b*3+2];
+	}
+};
+
+// Sorts corners so the identical ones end up together, the first one first
+struct CornerOrder {
+	const float *keys;
+	bool operator()(int a, int b) const
+	{
+		int c = memcmp(&keys[a * CORNER_FLOATS], &keys[b * CORNER_FLOATS], CORNER_FLOATS * sizeof(float));
+		return c != 0 ? c < 0 : a < b;
+	}
+};
+
+int MeshWelder::MaxVertices(const unsigned short *faces, const unsigned int *groups, int numFaces, int numVerts)
+{
+	if (groups == NULL)
+		return numVerts;
+
+	// Corners of the same vertex in the same groups always come out
+	// the same, and a face in no group has its own
+	std::vector<unsigned long long> split;
+	int flat = 0;
+
+	for (int i = 0; i < numFaces * 3; i++)
+	{
+		if (groups[i/3] == 0)
+			flat++;
+		else
+			split.push_back(((unsigned long long)faces[i] << 32) | groups[i/3]);
+	}
+
+	std::sort(split.begin(), split.end());
+	int most = flat + (int)(std::unique(split.begin(), split.end()) - split.begin());
+
+	// Weld() gives up on the groups rather than go past this
+	if (most > WELD_MAX_VERTS)
+		most = WELD_MAX_VERTS;
+
+	return most > numVerts ? most : numVerts;
+}
+
+int MeshWelder::Weld(float *vertexes, float *normals, float *texCoords, int numVerts, unsigned short *faces, const unsigned int *groups, int numFaces)
+{
+	int numCorners = numFaces * 3;
+	bool valid = true;
+
+	for (int i = 0; i < numCorners && valid; i++)
+		valid = faces[i] < numVerts;
+
+	std::vector<float> faceNormals(numCorners + 3);
+	FaceNormals(vertexes, numVerts, faces, numFaces, &faceNormals[0]);
+
+	// Without all of its vertices there's no telling where a face is,
+	// so only smooth the faces that share a vertex and don't weld
+	if (!valid || numFaces == 0)
+	{
+		for (int i = 0; i < numVerts * 3; i++)
+			normals[i] = 0.0f;
+
+		for (int c = 0; c < numCorners; c++)
+		{
+			int v = faces[c];
+
+			if (v >= numVerts)
+				continue;
+
+			normals[v*3]   += faceNormals[(c/3)*3];
+			normals[v*3+1] += faceNormals[(c/3)*3+1];
+			normals[v*3+2] += faceNormals[(c/3)*3+2];
+		}
+
+		Normalize(normals, numVerts);
+		return numVerts;
+	}
+
+	// Smoothing groups only go as far as the vertices the file shares,
+	// the same as 3ds Max, so the two sides of a leaf don't cancel out.
+	// Without them the positions are numbered, the file may have
+	// split a vertex without meaning to split its normal.
+	std::vector<int> place(numVerts);
+	int numPlaces = numVerts;
+
+	for (int v = 0; v < numVerts; v++)
+		place[v] = v;
+
+	if (groups == NULL)
+	{
+		std::vector<int> order(place);
+
+		PlaceOrder byPlace;
+		byPlace.v = vertexes;
+		std::sort(order.begin(), order.end(), byPlace);
+
+		numPlaces = 0;
+
+		for (int i = 0; i < numVerts; i++)
+		{
+			if (i > 0 && byPlace(order[i-1], order[i]))
+				numPlaces++;
+
+			place[order[i]] = numPlaces;
+		}
+
+		numPlaces++;
+	}
+
+	// The corners at each vertex, or each position
+	std::vector<int> firstCorner(numPlaces + 1, 0);
+	std::vector<int> corners(numCorners);
+
+	for (int c = 0; c < numCorners; c++)
+		firstCorner[place[faces[c]] + 1]++;
+
+	for (int p = 0; p < numPlaces; p++)
+		firstCorner[p + 1] += firstCorner[p];
+
+	std::vector<int> filled(firstCorner.begin(), firstCorner.end() - 1);
+
+	for (int c = 0; c < numCorners; c++)
+		corners[filled[place[faces[c]]]++] = c;
+
+	std::vector<float> cornerNormals(numCorners * 3, 0.0f);
+
+	if (groups != NULL)
+	{
+		// Add up the faces on each corner's vertex that are in one of its groups
+		for (int p = 0; p < numPlaces; p++)
+		{
+			for (int i = firstCorner[p]; i < firstCorner[p + 1]; i++)
+			{
+				int c = corners[i];
+				unsigned int mask = groups[c/3];
+				float *n = &cornerNormals[c*3];
+
+				if (mask == 0)
+				{
+					memcpy(n, &faceNormals[(c/3)*3], 3 * sizeof(float));
+					continue;
+				}
+
+				for (int j = firstCorner[p]; j < firstCorner[p + 1]; j++)
+				{
+					int f = corners[j] / 3;
+
+					if (groups[f] & mask)
+					{
+						n[0] += faceNormals[f*3];
+						n[1] += faceNormals[f*3+1];
+						n[2] += faceNormals[f*3+2];
+					}
+				}
+			}
+		}
+	}
+	else
+	{
+		// The faces that share a vertex are smoothed together, and so are
+		// the ones around it that don't bend away from them too sharply
+		std::vector<float> faceUnits(faceNormals);
+		Normalize(&faceUnits[0], numFaces);
+
+		std::vector<float> shared(numVerts * 3, 0.0f);
+
+		for (int c = 0; c < numCorners; c++)
+		{
+			shared[faces[c]*3]   += faceNormals[(c/3)*3];
+			shared[faces[c]*3+1] += faceNormals[(c/3)*3+1];
+			shared[faces[c]*3+2] += faceNormals[(c/3)*3+2];
+		}
+
+		Normalize(&shared[0], numVerts);
+
+		float crease = (float)cos(WELD_CREASE_ANGLE * 3.14159265358979 / 180.0);
+
+		for (int v = 0; v < numVerts; v++)
+		{
+			float *n = &normals[v*3];
+			const float *s = &shared[v*3];
+			int p = place[v];
+
+			n[0] = n[1] = n[2] = 0.0f;
+
+			// Always in the order the corners are listed, so vertices that
+			// take in the same faces come out exactly the same
+			for (int j = firstCorner[p]; j < firstCorner[p + 1]; j++)
+			{
+				int f = corners[j] / 3;
+				const float *u = &faceUnits[f*3];
+
+				if (faces[corners[j]] == v || u[0]*s[0] + u[1]*s[1] + u[2]*s[2] >= crease)
+				{
+					n[0] += faceNormals[f*3];
+					n[1] += faceNormals[f*3+1];
+					n[2] += faceNormals[f*3+2];
+				}
+			}
+		}
+
+		// Every corner of a vertex gets the same normal, so there can't
+		// be more vertices than before
+		for (int c = 0; c < numCorners; c++)
+			memcpy(&cornerNormals[c*3], &normals[faces[c]*3], 3 * sizeof(float));
+	}
+
+	Normalize(&cornerNormals[0], numCorners);
+
+	int welded = WeldCorners(vertexes, normals, texCoords, faces, numFaces, &cornerNormals[0]);
+
+	// Too many splits for 16 bit faces, forget the groups
+	if (welded < 0)
+		return Weld(vertexes, normals, texCoords, numVerts, faces, NULL, numFaces);
+
+	return welded;
+}
+
+int MeshWelder::WeldCorners(float *vertexes, float *normals, float *texCoords, unsigned short *faces, int numFaces, const float *cornerNormals)
+{
+	int numCorners = numFaces * 3;
+	std::vector<float> keys(numCorners * CORNER_FLOATS);
+
+	for (int c = 0; c < numCorners; c++)
+	{
+		float *key = &keys[c * CORNER_FLOATS];
+
+		memcpy(key, &vertexes[faces[c]*3], 3 * sizeof(float));
+		memcpy(key + 3, &cornerNormals[c*3], 3 * sizeof(float));
+		memcpy(key + 6, &texCoords[faces[c]*2], 2 * sizeof(float));
+	}
+
+	std::vector<int> order(numCorners);
+	for (int c = 0; c < numCorners; c++)
+		order[c] = c;
+
+	CornerOrder byKey;
+	byKey.keys = &keys[0];
+	std::sort(order.begin(), order.end(), byKey);
+
+	// Every corner points at the first corner that's the same as it
+	std::vector<int> same(numCorners);
+
+	for (int i = 0; i < numCorners; i++)
+	{
+		bool repeat = i > 0 && memcmp(&keys[order[i-1] * CORNER_FLOATS], &keys[order[i] * CORNER_FLOATS], CORNER_FLOATS * sizeof(float)) == 0;
+
+		same[order[i]] = repeat ? same[order[i-1]] : order[i];
+	}
+
+	// Number the vertices in the order the faces first use them
+	std::vector<int> index(numCorners);
+	int next = 0;
+
+	for (int c = 0; c < numCorners; c++)
+		index[c] = same[c] == c ? next++ : index[same[c]];
+
+	if (next > WELD_MAX_VERTS)
+		return -1;
+
+	for (int c = 0; c < numCorners; c++)
+	{
+		if (same[c] == c)
+		{
+			const float *key = &keys[c * CORNER_FLOATS];
+
+			memcpy(&vertexes[index[c]*3], key, 3 * sizeof(float));
+			memcpy(&normals[index[c]*3], key + 3, 3 * sizeof(float));
+			memcpy(&texCoords[index[c]*2], key + 6, 2 * sizeof(float));
+		}
+
+		faces[c] = (unsigned short)index[c];
+	}
+
+	return next;
+}
+
+void MeshWelder::FaceNormals(const float *vertexes, int numVerts, const unsigned short *faces, int numFaces, float *normals)
+{
+	int f = 0;
+
+#ifdef WELDER_SSE
+	// Four faces at a time, one in each lane
+	for (; f + 4 <= numFaces; f += 4)
+	{
+		const float *p[4][3];
+
+		for (int i = 0; i < 4; i++)
+		{
+			for (int k = 0; k < 3; k++)
+				p[i][k] = Corner(vertexes, numVerts, faces[(f+i)*3+k]);
+		}
+
+		__m128 a[3];
+		__m128 b[3];
+		__m128 c[3];
+
+		for (int j = 0; j < 3; j++)
+		{
+			a[j] = _mm_set_ps(p[3][0][j], p[2][0][j], p[1][0][j], p[0][0][j]);
+			b[j] = _mm_set_ps(p[3][1][j], p[2][1][j], p[1][1][j], p[0][1][j]);
+			c[j] = _mm_set_ps(p[3][2][j], p[2][2][j], p[1][2][j], p[0][2][j]);
+		}
+
+		__m128 u[3];
+		__m128 v[3];
+
+		for (int j = 0; j < 3; j++)
+		{
+			u[j] = _mm_sub_ps(b[j], c[j]);
+			v[j] = _mm_sub_ps(b[j], a[j]);
+		}
+
+		float n[3][4];
+
+		_mm_storeu_ps(n[0], _mm_sub_ps(_mm_mul_ps(u[1], v[2]), _mm_mul_ps(u[2], v[1])));
+		_mm_storeu_ps(n[1], _mm_sub_ps(_mm_mul_ps(u[2], v[0]), _mm_mul_ps(u[0], v[2])));
+		_mm_storeu_ps(n[2], _mm_sub_ps(_mm_mul_ps(u[0], v[1]), _mm_mul_ps(u[1], v[0])));
+
+		for (int i = 0; i < 4; i++)
+		{
+			normals[(f+i)*3]   = n[0][i];
+			normals[(f+i)*3+1] = n[1][i];
+			normals[(f+i)*3+2] = n[2][i];
+		}
+	}
+#endif
+
+	for (; f < numFaces; f++)
+	{
+		FaceNormal(Corner(vertexes, numVerts, faces[f*3]),
+			Corner(vertexes, numVerts, faces[f*3+1]),
+			Corner(vertexes, numVerts, faces[f*3+2]), &normals[f*3]);
+	}
+}
+
+void MeshWelder::Normalize(float *normals, int count)
+{
+	int i = 0;
+
+#ifdef WELDER_SSE
+	for (; i + 4 <= count; i += 4)
+	{
+		float *n = &normals[i*3];
+
+		__m128 x = _mm_set_ps(n[9], n[6], n[3], n[0]);
+		__m128 y = _mm_set_ps(n[10], n[7], n[4], n[1]);
+		__m128 z = _mm_set_ps(n[11], n[8], n[5], n[2]);
+
+		__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+
+		// Divide the zero ones by one instead
+		__m128 zero = _mm_cmpeq_ps(length, _mm_setzero_ps());
+		length = _mm_or_ps(_mm_andnot_ps(zero, length), _mm_and_ps(zero, _mm_set1_ps(1.0f)));
+
+		float unit[3][4];
+
+		_mm_storeu_ps(unit[0], _mm_div_ps(x, length));
+		_mm_storeu_ps(unit[1], _mm_div_ps(y, length));
+		_mm_storeu_ps(unit[2], _mm_div_ps(z, length));
+
+		for (int j = 0; j < 4; j++)
+		{
+			n[j*3]   = unit[0][j];
+			n[j*3+1] = unit[1][j];
+			n[j*3+2] = unit[2][j];
+		}
+	}
+#endif
+
+	for (; i < count; i++)
+	{
+		float *n = &normals[i*3];
+		float length = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+
+		if (length == 0.0f)
+			length = 1.0f;
+
+		n[0] /= length;
+		n[1] /= length;
+		n[2] /= length;
+	}
+}
@@ -0,0 +1,61 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Mesh Welder
+//
+// MeshWelder.h: interface for the MeshWelder class.
+// Works out the normals of a mesh and gets rid of the vertices it
+// doesn't need. A 3ds file often gives every face its own three
+// vertices, or splits a mesh wherever its texture does, so the
+// same vertex gets transformed over and over.
+//
+// Weld() gives each corner of each face a normal and then makes
+// one vertex for every different position, normal and texture
+// coordinate the corners have, numbered in the order the faces
+// first use them. Vertices no face uses are dropped.
+//
+// If the file has smoothing groups (one bit mask per face) a
+// corner's normal is the sum of the normals of the faces on its
+// vertex that share a group with its face, and a face in no group
+// is flat. Without them the faces that share a vertex are smoothed
+// together, along with the faces at the same place that are less
+// than 45 degrees from them, which is how 3ds Max smooths a mesh
+// automatically. That's what welds a mesh where every face has
+// its own vertices.
+//
+// Smoothing groups can split a vertex in two, so the arrays need
+// room for MaxVertices() of them, not just the ones in the file.
+//
+// The face normals are worked out four at a time with SSE when
+// the compiler has it.
+//
+// Usage:
+// int room = MeshWelder::MaxVertices(faces, groups, numFaces, numVerts);
+// ... make the arrays room vertices long and fill in numVerts ...
+// numVerts = MeshWelder::Weld(vertexes, normals, texCoords, numVerts, faces, groups, numFaces);
+//
+// groups can be NULL. If a face uses a vertex that isn't there
+// nothing is welded and only the normals are worked out.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef MESHWELDER_H
+#define MESHWELDER_H
+
+class MeshWelder
+{
+public:
+	// The most vertices Weld() can leave, never more than 16 bit indices can reach
+	static int MaxVertices(const unsigned short *faces, const unsigned int *groups, int numFaces, int numVerts);
+	// Works out the normals, welds the vertices and renumbers the faces. Returns how many vertices are left.
+	static int Weld(float *vertexes, float *normals, float *texCoords, int numVerts, unsigned short *faces, const unsigned int *groups, int numFaces);
+	// Each face's normal, as long as twice its area. Faces using vertices we don't have get none.
+	static void FaceNormals(const float *vertexes, int numVerts, const unsigned short *faces, int numFaces, float *normals);
+	// Makes the normals one long, ones that are zero stay that way
+	static void Normalize(float *normals, int count);
+
+private:
+	// Makes one vertex for each different corner
+	static int WeldCorners(float *vertexes, float *normals, float *texCoords, unsigned short *faces, int numFaces, const float *cornerNormals);
+};
+
+#endif MESHWELDER_H
@@ -0,0 +1,1896 @@
+//////////////////////////////////////////////////////////////////////
+//
+// 3D Studio Mesh Class
+//
+// Mesh_3DS.cpp: implementation of the Mesh_3DS class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "Mesh_3DS.h"
+#include "MeshImporter.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "MeshWelder.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+// The chunk's id numbers
+#define MAIN3DS				0x4D4D
+ #define MAIN_VERS			0x0002
+ #define EDIT3DS			0x3D3D
+  #define MESH_VERS			0x3D3E
+  #define OBJECT			0x4000
+   #define TRIG_MESH		0x4100
+    #define VERT_LIST		0x4110
+    #define FACE_DESC		0x4120
+     #define FACE_MAT		0x4130
+     #define SMOOTH_GROUP	0x4150
+    #define TEX_VERTS		0x4140
+    #define LOCAL_COORDS	0x4160
+  #define MATERIAL			0xAFFF
+   #define MAT_NAME			0xA000
+   #define MAT_AMBIENT		0xA010
+   #define MAT_DIFFUSE		0xA020
+   #define MAT_SPECULAR		0xA030
+   #define SHINY_PERC		0xA040
+   #define SHINY_STR_PERC	0xA041
+   #define TRANS_PERC		0xA050
+   #define TRANS_FOFF_PERC	0xA052
+   #define REF_BLUR_PERC	0xA053
+   #define RENDER_TYPE		0xA100
+   #define SELF_ILLUM		0xA084
+   #define MAT_SELF_ILPCT	0xA08A
+   #define WIRE_THICKNESS	0xA087
+   #define MAT_TEXMAP		0xA200
+    #define MAT_MAPNAME		0xA300
+  #define ONE_UNIT			0x0100
+ #define KEYF3DS			0xB000
+  #define FRAMES			0xB008
+  #define MESH_INFO			0xB002
+   #define HIER_POS			0xB030
+   #define HIER_FATHER		0xB010
+   #define PIVOT_PT			0xB013
+   #define TRACK00			0xB020
+   #define TRACK01			0xB021
+   #define TRACK02			0xB022
+#define	COLOR_RGB			0x0010
+#define COLOR_TRU			0x0011
+#define COLOR_TRUG			0x0012
+#define COLOR_RGBG			0x0013
+#define PERC_INT			0x0030
+#define PERC_FLOAT			0x0031
+
+// Milliseconds from some fixed point, for timing the load
+static double Now()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+Mesh_3DS::Mesh_3DS()
+{
+	// Nothing loaded yet
+	modelname = NULL;
+	path = NULL;
+	Materials = NULL;
+	Objects = NULL;
+	data = NULL;
+	dataSize = 0;
+	cursor = 0;
+	corrupt = false;
+	arena = NULL;
+	arenaSize = 0;
+	arenaUsed = 0;
+	sizing = false;
+	MeshVertexes = NULL;
+	MeshNormals = NULL;
+	MeshTexCoords = NULL;
+	MeshIndices = NULL;
+	indexType = MODEL_INDEX_16;
+	numMeshIndices = 0;
+	Batches = NULL;
+	numBatches = 0;
+
+	// Zero out our counters for MFC
+	numObjects = 0;
+	numMaterials = 0;
+	totalVerts = 0;
+	fileVerts = 0;
+	totalFaces = 0;
+	acmrBefore = 0.0f;
+	acmrAfter = 0.0f;
+	numLods = 0;
+	lodBlock = NULL;
+	memset(Lods, 0, sizeof(Lods));
+	memset(&times, 0, sizeof(times));
+}
+
+Mesh_3DS::~Mesh_3DS()
+{
+	Unload();
+}
+
+void Mesh_3DS::Unload()
+{
+	// The objects and all their arrays live in the arena
+	delete [] arena;
+	delete [] lodBlock;
+
+	delete [] Materials;
+	delete [] modelname;
+	delete [] path;
+
+	modelname = NULL;
+	path = NULL;
+	Materials = NULL;
+	Objects = NULL;
+	arena = NULL;
+	arenaSize = 0;
+	arenaUsed = 0;
+	MeshVertexes = NULL;
+	MeshNormals = NULL;
+	MeshTexCoords = NULL;
+	MeshIndices = NULL;
+	Batches = NULL;
+
+	numMeshIndices = 0;
+	numBatches = 0;
+	numObjects = 0;
+	numMaterials = 0;
+	totalVerts = 0;
+	fileVerts = 0;
+	totalFaces = 0;
+	acmrBefore = 0.0f;
+	acmrAfter = 0.0f;
+	numLods = 0;
+	lodBlock = NULL;
+	memset(Lods, 0, sizeof(Lods));
+
+	materialNames.Clear();
+	objectNames.Clear();
+
+	// And the poses the keyframes were baked into
+	anim.Clear();
+}
+
+bool Mesh_3DS::Load(char *name)
+{
+	// strip "'s
+	if (strstr(name, "\""))
+		name = strtok(name, "\"");
+
+	double start = Now();
+
+	// Read the whole file, the chunks are found in memory
+	FILE *bin3ds = fopen(name,"rb");
+
+	if (bin3ds == NULL)
+	{
+		Unload();
+		return false;
+	}
+
+	fseek(bin3ds, 0, SEEK_END);
+	long size = ftell(bin3ds);
+	fseek(bin3ds, 0, SEEK_SET);
+
+	std::vector<unsigned char> file(size > 0 ? size : 1);
+	size = (long)fread(&file[0], 1, size > 0 ? size : 0, bin3ds);
+
+	// Don't need the file anymore so close it
+	fclose(bin3ds);
+
+	float read = (float)(Now() - start);
+
+	if (!LoadFromMemory(name, &file[0], size))
+		return false;
+
+	times.read = read;
+	times.total += read;
+
+	return true;
+}
+
+bool Mesh_3DS::LoadFromMemory(char *name, const unsigned char *bytes, long size)
+{
+	// Loading over an old model replaces it
+	Unload();
+
+	double start = Now();
+	memset(&times, 0, sizeof(times));
+
+	// Find the path
+	if (strstr(name, "/") || strstr(name, "\\"))
+	{
+		// Holds the name of the model minus the path
+		char *temp;
+
+		// Find the name without the path
+		if (strstr(name, "/"))
+			temp = strrchr(name, '/');
+		else
+			temp = strrchr(name, '\\');
+
+		// Allocate space for the path, its trailing slash and the terminator
+		path = new char[strlen(name)-strlen(temp)+2];
+
+		// Get a pointer to the end of the path and name
+		char *src = name + strlen(name) - 1;
+
+		// Back up until a \ or the start
+		while (src != name && !((*(src-1)) == '\\' || (*(src-1)) == '/'))
+			src--;
+
+		// Copy the path into path
+		memcpy (path, name, src-name);
+		path[src-name] = 0;
+	}
+	else
+	{
+		// No path, the textures are next to us
+		path = new char[1];
+		path[0] = 0;
+	}
+
+	data = bytes;
+	dataSize = size > 0 && bytes != NULL ? size : 0;
+	corrupt = false;
+
+	// MilkShape's files have a signature, OBJ files only have a name
+	if (MeshImporter::IsMS3D(data, dataSize))
+	{
+		ImportedMesh imported;
+
+		if (MeshImporter::ImportMS3D(data, dataSize, imported))
+			BuildImported(imported);
+		else
+			corrupt = true;
+	}
+	else if (MeshImporter::IsOBJ(name))
+	{
+		ImportedMesh imported;
+
+		if (MeshImporter::ImportOBJ(data, dataSize, path, imported))
+			BuildImported(imported);
+		else
+			corrupt = true;
+	}
+	else
+		Parse3DS();
+
+	// The welding, texture coordinates and baking were timed on their own
+	times.parse = (float)(Now() - start) - times.weld - times.texcoords - times.bake;
+
+	// Don't need the data or the names anymore, everything has been found
+	data = NULL;
+	dataSize = 0;
+	materialNames.Clear();
+	objectNames.Clear();
+
+	if (corrupt)
+	{
+		Unload();
+		return false;
+	}
+
+	// Welding left gaps after some of the objects' vertices
+	PackMesh();
+
+	// For future reference, name might not be around for long
+	modelname = new char[strlen(name) + 1];
+	strcpy(modelname, name);
+
+	// Find the total number of faces, PackMesh counted the vertices
+	totalFaces = 0;
+
+	for (int i = 0; i < numObjects; i ++)
+		totalFaces += Objects[i].numFaces/3;
+
+	// Put the faces in an order that suits the vertex cache
+	double step = Now();
+	OptimizeMesh();
+	times.optimize = (float)(Now() - step);
+
+	// Put all the objects' faces together by material
+	step = Now();
+	BuildMesh();
+	times.merge = (float)(Now() - step);
+
+	// And make the versions for drawing it far away
+	step = Now();
+	BuildLods();
+	times.lods = (float)(Now() - step);
+
+	times.total = (float)(Now() - start);
+
+	return true;
+}
+
+void Mesh_3DS::Parse3DS()
+{
+	// holds the main chunk header
+	ChunkHeader main;
+
+	// Go through the file twice, the first time only adds up how
+	// much room the objects and their arrays need so they can all
+	// go in one block
+	for (int pass = 0; pass < 2; pass++)
+	{
+		sizing = (pass == 0);
+
+		if (!sizing)
+		{
+			arena = new char[arenaSize];
+			arenaUsed = 0;
+
+			// The merged mesh goes first, it's what gets drawn
+			CarveMesh(totalVerts, sizedIndices, sizedLists);
+
+			// The counts start again with the real thing
+			numObjects = 0;
+			numMaterials = 0;
+		}
+
+		totalVerts = 0;
+		fileVerts = 0;
+		sizedIndices = 0;
+		sizedLists = 0;
+
+		// Make sure we are at the beginning
+		Seek(0);
+
+		// Load the Main Chunk's header, it has to be the whole file
+		if (ReadChunk(main, dataSize) && main.id == MAIN3DS)
+			MainChunkProcessor(main.len, Tell());
+		else
+			corrupt = true;
+
+		// Anything wrong with the file and nothing of it is kept
+		if (corrupt)
+			break;
+
+		// Now we know how big the merged mesh is
+		if (sizing)
+			CarveMesh(totalVerts, sizedIndices, sizedLists);
+	}
+
+	sizing = false;
+}
+
+void Mesh_3DS::BuildImported(ImportedMesh &mesh)
+{
+	numMaterials = (int)mesh.materials.size();
+
+	if (numMaterials > 0)
+	{
+		Materials = new Material[numMaterials];
+		memcpy(Materials, &mesh.materials[0], numMaterials * sizeof(Material));
+	}
+
+	// The same two passes as a 3ds file, sizing the arena and then
+	// filling it in the same order
+	for (int pass = 0; pass < 2; pass++)
+	{
+		sizing = (pass == 0);
+
+		if (!sizing)
+		{
+			arena = new char[arenaSize];
+			arenaUsed = 0;
+
+			CarveMesh(totalVerts, sizedIndices, sizedLists);
+		}
+
+		totalVerts = 0;
+		fileVerts = 0;
+		sizedIndices = 0;
+		sizedLists = 0;
+
+		numObjects = (int)mesh.objects.size();
+		Objects = (Object *)Carve(numObjects * sizeof(Object));
+
+		if (!sizing)
+			memset(Objects, 0, numObjects * sizeof(Object));
+
+		for (int i = 0; i < numObjects; i++)
+		{
+			ImportedMesh::Object &from = mesh.objects[i];
+			int numVerts = (int)from.vertices.size() / 3;
+			int numFaces = (int)from.faces.size() / 3;
+			unsigned int *faceGroups = from.groups.empty() ? NULL : &from.groups[0];
+
+			// The faces' materials in the order they're first used, one list each
+			std::vector<int> lists;
+			std::vector<int> counts(numMaterials, 0);
+
+			for (int f = 0; f < numFaces; f++)
+			{
+				if (counts[from.materials[f]]++ == 0)
+					lists.push_back(from.materials[f]);
+			}
+
+			unsigned short *faces = (unsigned short *)Carve(numFaces * 3 * sizeof(unsigned short));
+			MaterialFaces *matFaces = (MaterialFaces *)Carve(lists.size() * sizeof(MaterialFaces));
+
+			if (!sizing)
+			{
+				Object &o = Objects[i];
+
+				strcpy(o.name, from.name);
+				o.Vertexes = MeshVertexes + totalVerts * 3;
+				o.Normals = MeshNormals + totalVerts * 3;
+				o.TexCoords = MeshTexCoords + totalVerts * 2;
+				o.numVerts = numVerts;
+				o.Faces = faces;
+				o.numFaces = numFaces * 3;
+				o.MatFaces = matFaces;
+				o.numMatFaces = (int)lists.size();
+
+				memcpy(o.Vertexes, &from.vertices[0], numVerts * 3 * sizeof(float));
+				memset(o.Normals, 0, numVerts * 3 * sizeof(float));
+				memcpy(o.Faces, &from.faces[0], numFaces * 3 * sizeof(unsigned short));
+
+				if (!from.texCoords.empty())
+				{
+					memcpy(o.TexCoords, &from.texCoords[0], numVerts * 2 * sizeof(float));
+					o.textured = true;
+				}
+				else
+				{
+					// Make some texture coords the same way as for a 3ds object
+					double start = Now();
+
+					for (int m = 0; m < numVerts; m++)
+					{
+						o.TexCoords[2*m] = o.Vertexes[3*m];
+						o.TexCoords[2*m+1] = o.Vertexes[3*m+1];
+					}
+
+					times.texcoords += (float)(Now() - start);
+				}
+
+				o.numTexCoords = numVerts;
+			}
+
+			// Smoothing groups can split the vertices, so make room for
+			// the most they could be split into
+			totalVerts += MeshWelder::MaxVertices(&from.faces[0], faceGroups, numFaces, numVerts);
+			fileVerts += numVerts;
+
+			if (!sizing)
+			{
+				Object &o = Objects[i];
+
+				double start = Now();
+				o.numVerts = MeshWelder::Weld(o.Vertexes, o.Normals, o.TexCoords, o.numVerts, o.Faces, faceGroups, numFaces);
+				times.weld += (float)(Now() - start);
+
+				o.numTexCoords = o.numVerts;
+			}
+
+			// Split the faces up according to their materials
+			for (size_t j = 0; j < lists.size(); j++)
+			{
+				int count = counts[lists[j]];
+				unsigned short *subFaces = (unsigned short *)Carve(count * 3 * sizeof(unsigned short));
+
+				sizedIndices += count * 3;
+				sizedLists++;
+
+				if (sizing)
+					continue;
+
+				Object &o = Objects[i];
+				MaterialFaces &list = o.MatFaces[j];
+
+				list.MatIndex = lists[j];
+				list.subFaces = subFaces;
+				list.numSubFaces = 0;
+
+				for (int f = 0; f < numFaces; f++)
+				{
+					if (from.materials[f] != lists[j])
+						continue;
+
+					subFaces[list.numSubFaces++] = o.Faces[f*3];
+					subFaces[list.numSubFaces++] = o.Faces[f*3+1];
+					subFaces[list.numSubFaces++] = o.Faces[f*3+2];
+				}
+			}
+		}
+
+		// Now we know how big the merged mesh is
+		if (sizing)
+			CarveMesh(totalVerts, sizedIndices, sizedLists);
+	}
+
+	sizing = false;
+}
+
+void Mesh_3DS::BuildLods()
+{
+	// The first level is the model itself
+	numLods = 1;
+	Lods[0].indices = MeshIndices;
+	Lods[0].batches = Batches;
+	Lods[0].numBatches = numBatches;
+	Lods[0].numFaces = numMeshIndices / 3;
+	Lods[0].error = 0.0f;
+
+	int numFaces = numMeshIndices / 3;
+
+	if (numFaces < MODEL_LOD_MIN_FACES)
+		return;
+
+	// The simplifier wants 32 bit indices and each face's material
+	std::vector<unsigned int> indices(numFaces * 3);
+	std::vector<int> tags(numFaces);
+
+	for (int b = 0; b < numBatches; b++)
+	{
+		for (int k = Batches[b].first; k < Batches[b].first + Batches[b].count; k++)
+		{
+			if (indexType == MODEL_INDEX_32)
+				indices[k] = ((unsigned int *)MeshIndices)[k];
+			else
+				indices[k] = ((unsigned short *)MeshIndices)[k];
+
+			tags[k / 3] = Batches[b].MatIndex;
+		}
+	}
+
+	MeshSimplifier simplifier;
+	simplifier.Create(MeshVertexes, totalVerts, &indices[0], &tags[0], numFaces);
+
+	// Each level has a quarter of the faces of the one before
+	int counts[MODEL_MAX_LODS];
+	std::vector<unsigned int> levels[MODEL_MAX_LODS];
+	std::vector<int> levelTags[MODEL_MAX_LODS];
+	int previous = numFaces;
+
+	for (int i = 1; i < MODEL_MAX_LODS; i++)
+	{
+		simplifier.Simplify(previous / 4);
+
+		// Not worth a level if it couldn't get rid of much
+		int count = simplifier.FaceCount();
+		if (count == 0 || count > previous * 3 / 4)
+			break;
+
+		levels[i].resize(count * 3);
+		levelTags[i].resize(count);
+		simplifier.Faces(&levels[i][0], &levelTags[i][0]);
+
+		counts[numLods] = count;
+		Lods[numLods].error = simplifier.Error();
+		numLods++;
+		previous = count;
+	}
+
+	if (numLods == 1)
+		return;
+
+	// All the levels go in one block, batches then indices, with
+	// the indices rounded up so the next level's batches line up
+	size_t indexSize = indexType == MODEL_INDEX_32 ? sizeof(unsigned int) : sizeof(unsigned short);
+	size_t size = 0;
+
+	for (int i = 1; i < numLods; i++)
+		size += numMaterials * sizeof(Batch) + ((counts[i] * 3 * indexSize + 3) & ~(size_t)3);
+
+	lodBlock = new char[size];
+	char *next = lodBlock;
+
+	for (int i = 1; i < numLods; i++)
+	{
+		Lod &lod = Lods[i];
+
+		lod.batches = (Batch *)next;
+		next += numMaterials * sizeof(Batch);
+		lod.indices = next;
+		next += (counts[i] * 3 * indexSize + 3) & ~(size_t)3;
+		lod.numBatches = 0;
+		lod.numFaces = counts[i];
+
+		// Sort the faces back out by material
+		int written = 0;
+
+		for (int m = 0; m < numMaterials; m++)
+		{
+			Batch b;
+			b.MatIndex = m;
+			b.first = written;
+			b.count = 0;
+
+			for (int f = 0; f < counts[i]; f++)
+			{
+				if (levelTags[i][f] != m)
+					continue;
+
+				for (int k = 0; k < 3; k++)
+				{
+					if (indexType == MODEL_INDEX_32)
+						((unsigned int *)lod.indices)[written + k] = levels[i][f*3+k];
+					else
+						((unsigned short *)lod.indices)[written + k] = (unsigned short)levels[i][f*3+k];
+				}
+
+				written += 3;
+				b.count += 3;
+			}
+
+			if (b.count > 0)
+				lod.batches[lod.numBatches++] = b;
+		}
+	}
+}
+
+void Mesh_3DS::OptimizeMesh()
+{
+	int missesBefore = 0;
+	int missesAfter = 0;
+	int faces = 0;
+
+	for (int i = 0; i < numObjects; i++)
+	{
+		Object &o = Objects[i];
+
+		// The faces can't be moved around if they use vertices we don't have
+		bool valid = true;
+
+		for (int k = 0; k < o.numFaces && valid; k++)
+			valid = o.Faces[k] < o.numVerts;
+
+		for (int j = 0; j < o.numMatFaces && valid; j++)
+		{
+			for (int k = 0; k < o.MatFaces[j].numSubFaces && valid; k++)
+				valid = o.MatFaces[j].subFaces[k] < o.numVerts;
+		}
+
+		for (int j = 0; j < o.numMatFaces; j++)
+		{
+			MaterialFaces &f = o.MatFaces[j];
+
+			missesBefore += MeshOptimizer::CacheMisses(f.subFaces, f.numSubFaces, o.numVerts);
+			faces += f.numSubFaces / 3;
+
+			if (valid)
+				MeshOptimizer::OptimizeFaces(f.subFaces, f.numSubFaces, o.numVerts);
+		}
+
+		if (valid && o.numVerts > 0)
+		{
+			// Number the vertices in the order the faces use them
+			unsigned short *remap = new unsigned short[o.numVerts];
+			memset(remap, 0xff, o.numVerts * sizeof(unsigned short));
+
+			int next = 0;
+
+			for (int j = 0; j < o.numMatFaces; j++)
+				next = MeshOptimizer::Remap(remap, next, o.MatFaces[j].subFaces, o.MatFaces[j].numSubFaces);
+
+			// Any that aren't used go on the end
+			for (int v = 0; v < o.numVerts; v++)
+			{
+				if (remap[v] == MESH_UNUSED)
+					remap[v] = (unsigned short)next++;
+			}
+
+			for (int k = 0; k < o.numFaces; k++)
+				o.Faces[k] = remap[o.Faces[k]];
+
+			// Move the vertices, normals and texture coordinates to match
+			float *moved = new float[o.numVerts * 3];
+
+			for (int v = 0; v < o.numVerts; v++)
+				memcpy(&moved[remap[v]*3], &o.Vertexes[v*3], 3 * sizeof(float));
+			memcpy(o.Vertexes, moved, o.numVerts * 3 * sizeof(float));
+
+			for (int v = 0; v < o.numVerts; v++)
+				memcpy(&moved[remap[v]*3], &o.Normals[v*3], 3 * sizeof(float));
+			memcpy(o.Normals, moved, o.numVerts * 3 * sizeof(float));
+
+			for (int v = 0; v < o.numVerts; v++)
+				memcpy(&moved[remap[v]*2], &o.TexCoords[v*2], 2 * sizeof(float));
+			memcpy(o.TexCoords, moved, o.numVerts * 2 * sizeof(float));
+
+			delete [] moved;
+			delete [] remap;
+		}
+
+		for (int j = 0; j < o.numMatFaces; j++)
+			missesAfter += MeshOptimizer::CacheMisses(o.MatFaces[j].subFaces, o.MatFaces[j].numSubFaces, o.numVerts);
+	}
+
+	acmrBefore = faces > 0 ? (float)missesBefore / faces : 0.0f;
+	acmrAfter = faces > 0 ? (float)missesAfter / faces : 0.0f;
+}
+
+void Mesh_3DS::CarveMesh(int verts, int indices, int lists)
+{
+	// Welding can leave fewer vertices than there's room for, BuildMesh
+	// picks the size once it knows, this is the most it could need
+	size_t indexSize = verts > 65536 ? sizeof(unsigned int) : sizeof(unsigned short);
+
+	// There can't be more batches than lists of faces
+	Batches = (Batch *)Carve(lists * sizeof(Batch));
+
+	MeshVertexes = (float *)Carve(verts * 3 * sizeof(float));
+	MeshNormals = (float *)Carve(verts * 3 * sizeof(float));
+	MeshTexCoords = (float *)Carve(verts * 2 * sizeof(float));
+	MeshIndices = Carve(indices * indexSize);
+}
+
+void Mesh_3DS::PackMesh()
+{
+	totalVerts = 0;
+
+	for (int i = 0; i < numObjects; i++)
+	{
+		Object &o = Objects[i];
+
+		if (o.numVerts == 0)
+			continue;
+
+		// Move the object's vertices down to the end of the last one's
+		if (o.Vertexes != MeshVertexes + totalVerts * 3)
+		{
+			memmove(MeshVertexes + totalVerts * 3, o.Vertexes, o.numVerts * 3 * sizeof(float));
+			memmove(MeshNormals + totalVerts * 3, o.Normals, o.numVerts * 3 * sizeof(float));
+			memmove(MeshTexCoords + totalVerts * 2, o.TexCoords, o.numVerts * 2 * sizeof(float));
+
+			o.Vertexes = MeshVertexes + totalVerts * 3;
+			o.Normals = MeshNormals + totalVerts * 3;
+			o.TexCoords = MeshTexCoords + totalVerts * 2;
+		}
+
+		totalVerts += o.numVerts;
+	}
+}
+
+void Mesh_3DS::BuildMesh()
+{
+	numBatches = 0;
+	numMeshIndices = 0;
+
+	// 16 bit indices are half the size, so only go to 32 bits
+	// when the model has too many vertices for them
+	indexType = totalVerts > 65536 ? MODEL_INDEX_32 : MODEL_INDEX_16;
+
+	for (int m = 0; m < numMaterials; m++)
+	{
+		Batch b;
+
+		b.MatIndex = m;
+		b.first = numMeshIndices;
+		b.count = 0;
+
+		// Gather this material's faces from every object
+		for (int i = 0; i < numObjects; i++)
+		{
+			// Where the object's vertices start in the merged mesh
+			int base = (int)((Objects[i].Vertexes - MeshVertexes) / 3);
+
+			for (int j = 0; j < Objects[i].numMatFaces; j++)
+			{
+				MaterialFaces &f = Objects[i].MatFaces[j];
+
+				if (f.MatIndex != m)
+					continue;
+
+				if (indexType == MODEL_INDEX_32)
+				{
+					unsigned int *indices = (unsigned int *)MeshIndices + numMeshIndices;
+
+					for (int k = 0; k < f.numSubFaces; k++)
+						indices[k] = base + f.subFaces[k];
+				}
+				else
+				{
+					unsigned short *indices = (unsigned short *)MeshIndices + numMeshIndices;
+
+					for (int k = 0; k < f.numSubFaces; k++)
+						indices[k] = (unsigned short)(base + f.subFaces[k]);
+				}
+
+				numMeshIndices += f.numSubFaces;
+				b.count += f.numSubFaces;
+			}
+		}
+
+		// Materials nobody uses don't get a batch
+		if (b.count > 0)
+			Batches[numBatches++] = b;
+	}
+}
+
+void Mesh_3DS::ReadName(char *name, int size, long end)
+{
+	int length = 0;
+
+	if (end > dataSize)
+		end = dataSize;
+
+	// Keep what fits and skip the rest, the name stops at a zero
+	// or the end of its chunk, whichever comes first
+	while (cursor >= 0 && cursor < end && data[cursor] != 0)
+	{
+		if (length < size - 1)
+			name[length++] = data[cursor];
+
+		cursor++;
+	}
+
+	// Step over the zero
+	if (cursor >= 0 && cursor < end)
+		cursor++;
+
+	if (size > 0)
+		name[length] = 0;
+}
+
+bool Mesh_3DS::ReadChunk(ChunkHeader &h, long end)
+{
+	long start = cursor;
+
+	// A bad chunk stops the reading everywhere
+	if (corrupt || end - start < 6)
+		return false;
+
+	Read(&h.id,sizeof(h.id),end);
+	Read(&h.len,sizeof(h.len),end);
+
+	// It has to have room for its header and fit in its parent
+	if (h.len < 6 || h.len > (unsigned long)(end - start))
+	{
+		corrupt = true;
+		return false;
+	}
+
+	return true;
+}
+
+bool Mesh_3DS::Read(void *to, long bytes, long end)
+{
+	if (end > dataSize)
+		end = dataSize;
+
+	if (corrupt || cursor < 0 || bytes < 0 || bytes > end - cursor)
+	{
+		// Whatever wanted it gets zeros, and the model gets thrown away
+		memset(to, 0, bytes > 0 ? bytes : 0);
+		corrupt = true;
+		return false;
+	}
+
+	memcpy(to, data + cursor, bytes);
+	cursor += bytes;
+
+	return true;
+}
+
+bool Mesh_3DS::Skip(long bytes, long end)
+{
+	if (end > dataSize)
+		end = dataSize;
+
+	if (corrupt || cursor < 0 || bytes < 0 || bytes > end - cursor)
+	{
+		corrupt = true;
+		return false;
+	}
+
+	cursor += bytes;
+
+	return true;
+}
+
+void Mesh_3DS::Seek(long offset)
+{
+	cursor = offset;
+}
+
+long Mesh_3DS::Tell()
+{
+	return cursor;
+}
+
+void *Mesh_3DS::Carve(size_t bytes)
+{
+	// Keep every array on an 8 byte boundary like new would
+	bytes = (bytes + 7) & ~(size_t)7;
+
+	// The first pass only wants to know how big the arena is
+	if (sizing)
+	{
+		arenaSize += bytes;
+		return NULL;
+	}
+
+	void *p = arena + arenaUsed;
+	arenaUsed += bytes;
+
+	return p;
+}
+
+void Mesh_3DS::MainChunkProcessor(long length, long findex)
+{
+	ChunkHeader h;
+	bool edited = false;
+
+	// move the file pointer to the beginning of the main
+	// chunk's data findex + the size of the header
+	Seek(findex);
+
+	while (ReadChunk(h, findex + length - 6))
+	{
+		switch (h.id)
+		{
+			// This is the mesh information like vertices, faces, and materials,
+			// a file only has one
+			case EDIT3DS	:
+				if (!edited)
+					EditChunkProcessor(h.len, Tell());
+				edited = true;
+				break;
+			// How the objects move, it comes after the objects
+			case KEYF3DS	:
+				if (!sizing)
+					KeyFrameChunkProcessor(h.len, Tell());
+				break;
+			default			:
+				break;
+		}
+
+		Skip(h.len - 6, findex + length - 6);
+	}
+
+	// move the file pointer back to where we got it so
+	// that the ProcessChunk() which we interrupted will read
+	// from the right place
+	Seek(findex);
+}
+
+void Mesh_3DS::KeyFrameChunkProcessor(long length, long findex)
+{
+	ChunkHeader h;
+	std::vector<AnimationClip::Node> nodes;
+	int firstFrame = 0;		// The frames the animation runs between
+	int lastFrame = 0;
+
+	// move the file pointer to the beginning of the main
+	// chunk's data findex + the size of the header
+	Seek(findex);
+
+	while (ReadChunk(h, findex + length - 6))
+	{
+		long data = Tell();
+
+		switch (h.id)
+		{
+			case FRAMES		:
+				Read(&firstFrame,sizeof(firstFrame),data + h.len - 6);
+				Read(&lastFrame,sizeof(lastFrame),data + h.len - 6);
+				break;
+			case MESH_INFO	:
+			{
+				AnimationClip::Node node;
+
+				// Nodes without an id go by their place in the list
+				node.id = (int)nodes.size();
+				node.parent = -1;
+				node.object = -1;
+
+				MeshInfoChunkProcessor(h.len, data, node);
+				nodes.push_back(node);
+				break;
+			}
+			default			:
+				break;
+		}
+
+		Seek(data + (h.len - 6));
+	}
+
+	// Work out where everything is at a steady rate from the start
+	double start = Now();
+	anim.Bake(nodes, numObjects, firstFrame, lastFrame, MODEL_KEY_RATE, MODEL_POSE_RATE);
+	times.bake += (float)(Now() - start);
+
+	// move the file pointer back to where we got it so
+	// that the ProcessChunk() which we interrupted will read
+	// from the right place
+	Seek(findex);
+}
+
+void Mesh_3DS::MeshInfoChunkProcessor(long length, long findex, AnimationClip::Node &node)
+{
+	ChunkHeader h;
+
+	// move the file pointer to the beginning of the main
+	// chunk's data findex + the size of the header
+	Seek(findex);
+
+	while (ReadChunk(h, findex + length - 6))
+	{
+		long data = Tell();
+
+		switch (h.id)
+		{
+			case HIER_POS	:
+			{
+				// The number the other nodes use for this one
+				short id;
+				Read(&id,sizeof(id),data + h.len - 6);
+				node.id = id;
+				break;
+			}
+			case HIER_FATHER	:
+			{
+				char name[80];
+				unsigned short flags[2];
+				short parent;
+
+				// The name of the object this node moves
+				ReadName(name, sizeof(name), data + h.len - 6);
+
+				Read(flags,sizeof(unsigned short) * 2,data + h.len - 6);
+				Read(&parent,sizeof(parent),data + h.len - 6);
+				node.parent = parent;
+				node.object = objectNames.Find(name);
+				break;
+			}
+			case TRACK00	:
+				TrackChunkProcessor(h.len, data, node.pos, 3);
+				break;
+			case TRACK01	:
+				TrackChunkProcessor(h.len, data, node.rot, 4);
+				break;
+			case TRACK02	:
+				TrackChunkProcessor(h.len, data, node.scale, 3);
+				break;
+			// The pivot (PIVOT_PT) would only cancel out, the poses start
+			// from where the first frame has the object
+			default			:
+				break;
+		}
+
+		Seek(data + (h.len - 6));
+	}
+
+	// move the file pointer back to where we got it so
+	// that the ProcessChunk() which we interrupted will read
+	// from the right place
+	Seek(findex);
+}
+
+void Mesh_3DS::TrackChunkProcessor(long length, long findex, std::vector<AnimationClip::Key> &keys, int values)
+{
+	unsigned short flags;		// How the track loops, the poses always do
+	unsigned int numKeys;		// The number of keys in the track
+	long end = findex + length - 6;
+
+	// move the file pointer to the beginning of the main
+	// chunk's data findex + the size of the header
+	Seek(findex);
+
+	Read(&flags,sizeof(flags),end);
+	// Skip two numbers nothing uses
+	Skip(8, end);
+	Read(&numKeys,sizeof(numKeys),end);
+
+	for (unsigned int k = 0; k < numKeys && !corrupt; k++)
+	{
+		AnimationClip::Key key;
+		unsigned short spline;	// Which of the spline's settings the key has
+
+		Read(&key.frame,sizeof(key.frame),end);
+		Read(&spline,sizeof(spline),end);
+
+		// Skip the tension, continuity, bias and easing, the
+		// poses are close enough together to go straight between
+		for (int bit = 0; bit < 5; bit++)
+		{
+			if (spline & (1 << bit))
+				Skip(sizeof(float), end);
+		}
+
+		// A track that stops short throws the whole file out
+		if (Read(key.v,sizeof(float) * values,end))
+			keys.push_back(key);
+	}
+
+	// move the file pointer back to where we got it so
+	// that the ProcessChunk() which we interrupted will read
+	// from the right place
+	Seek(findex);
+}
+
+void Mesh_3DS::EditChunkProcessor(long length, long findex)
+{
+	ChunkHeader h;
+
+	// move the file pointer to the beginning of the main
+	// chunk's data findex + the size of the header
+	Seek(findex);
+
+	// First count the number of Objects and Materials
+	while (ReadChunk(h, findex + length - 6))
+	{
+		switch (h.id)
+		{
+			case OBJECT	:
+				numObjects++;
+				break;
+			case MATERIAL	:
+				numMaterials++;
+				break;
+			default			:
+				break;
+		}
+
+		Skip(h.len - 6, findex + length - 6);
+	}
+
+	// Now load the materials, they hold textures so they get their
+	// own array instead of going in the arena
+	if (numMaterials > 0 && !sizing)
+	{
+		Materials = new Material[numMaterials];
+
+		// No name, no map and black until we find otherwise
+		memset(Materials, 0, numMaterials * sizeof(Material));
+
+		// The names go in the table as they're read
+		materialNames.Create(numMaterials);
+
+		Seek(findex);
+
+		int i = 0;
+
+		while (ReadChunk(h, findex + length - 6))
+		{
+			switch (h.id)
+			{
+				case MATERIAL	:
+					MaterialChunkProcessor(h.len, Tell(), i);
+					i++;
+					break;
+				default			:
+					break;
+			}
+
+			Skip(h.len - 6, findex + length - 6);
+		}
+	}
+
+	// Load the Objects (individual meshes in the whole model)
+	if (numObjects > 0)
+	{
+		Objects = (Object *)Carve(numObjects * sizeof(Object));
+
+		if (!sizing)
+		{
+			// No arrays until the chunks for them turn up
+			memset(Objects, 0, numObjects * sizeof(Object));
+
+			objectNames.Create(numObjects);
+
+			// Set the textured variable to false until we find a texture
+			for (int k = 0; k < numObjects; k++)
+				Objects[k].textured = false;
+
+			// Zero the objects position and rotation
+			for (int m = 0; m < numObjects; m++)
+			{
+				Objects[m].pos.x = 0.0f;
+				Objects[m].pos.y = 0.0f;
+				Objects[m].pos.z = 0.0f;
+
+				Objects[m].rot.x = 0.0f;
+				Objects[m].rot.y = 0.0f;
+				Objects[m].rot.z = 0.0f;
+			}
+
+			// Zero out the number of texture coords
+			for (int n = 0; n < numObjects; n++)
+				Objects[n].numTexCoords = 0;
+		}
+
+		Seek(findex);
+
+		int j = 0;
+
+		while (ReadChunk(h, findex + length - 6))
+		{
+			switch (h.id)
+			{
+				case OBJECT	:
+					ObjectChunkProcessor(h.len, Tell(), j);
+					j++;
+					break;
+				default			:
+					break;
+			}
+
+			Skip(h.len - 6, findex + length - 6);
+		}
+	}
+
+	// move the file pointer back to where we got it so
+	// that the ProcessChunk() which we interrupted will read
+	// from the right place
+	Seek(findex);
+}
+
+void Mesh_3DS::MaterialChunkProcessor(long length, long findex, int matindex)
+{
+	ChunkHeader h;
+
+	// move the file pointer to the beginning of the main
+	// chunk's data findex + the size of the header
+	Seek(findex);
+
+	while (ReadChunk(h, findex + length - 6))
+	{
+		switch (h.id)
+		{
+			case MAT_NAME	:
+				// Loads the material's names
+				MaterialNameChunkProcessor(h.len, Tell(), matindex);
+				break;
+			case MAT_AMBIENT	:
+				//ColorChunkProcessor(h.len, Tell());
+				break;
+			case MAT_DIFFUSE	:
+				DiffuseColorChunkProcessor(h.len, Tell(), matindex);
+				break;
+			case MAT_SPECULAR	:
+				//ColorChunkProcessor(h.len, Tell());
+			case MAT_TEXMAP	:
+				// Finds the names of the textures of the material and loads them
+				TextureMapChunkProcessor(h.len, Tell(), matindex);
+				break;
+			default			:
+				break;
+		}
+
+		Skip(h.len - 6, findex + length - 6);
+	}
+
+	// move the file pointer back to where we got it so
+	// that the ProcessChunk() which we interrupted will read
+	// from the right place
+	Seek(findex);
+}
+
+void Mesh_3DS::MaterialNameChunkProcessor(long length, long findex, int matindex)
+{
+	// move the file pointer to the beginning of the main
+	// chunk's data findex + the size of the header
+	Seek(findex);
+
+	// Read the material's name, the faces find it by that
+	ReadName(Materials[matindex].name, sizeof(Materials[matindex].name), findex + length - 6);
+	materialNames.Add(Materials[matindex].name, matindex);
+
+	// move the file pointer back to where we got it so
+	// that the ProcessChunk() which we interrupted will read
+	// from the right place
+	Seek(findex);
+}
+
+void Mesh_3DS::DiffuseColorChunkProcessor(long length, long findex, int matindex)
+{
+	ChunkHeader h;
+
+	// move the file pointer to the beginning of the main
+	// chunk's data findex + the size of the header
+	Seek(findex);
+
+	while (ReadChunk(h, findex + length - 6))
+	{
+		// Determine the format of the color and load it
+		switch (h.id)
+		{
+			case COLOR_RGB	:
+				// A rgb float color chunk
+				FloatColorChunkProcessor(h.len, Tell(), matindex);
+				break;
+			case COLOR_TRU	:
+				// A rgb int color chunk
+				IntColorChunkProcessor(h.len, Tell(), matindex);
+				break;
+			case COLOR_RGBG	:
+				// A rgb gamma corrected float color chunk
+				FloatColorChunkProcessor(h.len, Tell(), matindex);
+				break;
+			case COLOR_TRUG	:
+				// A rgb gamma corrected int color chunk
+				IntColorChunkProcessor(h.len, Tell(), matindex);
+				break;
+			default			:
+				break;
+		}
+
+		Skip(h.len - 6, findex + length - 6);
+	}
+
+	// move the file pointer back to where we got it so
+	// that the ProcessChunk() which we interrupted will read
+	// from the right place
+	Seek(findex);
+}
+
+void Mesh_3DS::FloatColorChunkProcessor(long length, long findex, int matindex)
+{
+	float r;
+	float g;
+	float b;
+
+	// move the file pointer to the beginning of the main
+	// chunk's data findex + the size of the header
+	Seek(findex);
+
+	Read(&r,sizeof(r),findex + length - 6);
+	Read(&g,sizeof(g),findex + length - 6);
+	Read(&b,sizeof(b),findex + length - 6);
+
+	Materials[matindex].color.r = (unsigned char)(r*255.0f);
+	Materials[matindex].color.g = (unsigned char)(r*255.0f);
+	Materials[matindex].color.b = (unsigned char)(r*255.0f);
+	Materials[matindex].color.a = 255;
+
+	// move the file pointer back to where we got it so
+	// that the ProcessChunk() which we interrupted will read
+	// from the right place
+	Seek(findex);
+}
+
+void Mesh_3DS::IntColorChunkProcessor(long length, long findex, int matindex)
+{
+	unsigned char r;
+	unsigned char g;
+	unsigned char b;
+
+	// move the file pointer to the beginning of the main
+	// chunk's data findex + the size of the header
+	Seek(findex);
+
+	Read(&r,sizeof(r),findex + length - 6);
+	Read(&g,sizeof(g),findex + length - 6);
+	Read(&b,sizeof(b),findex + length - 6);
+
+	Materials[matindex].color.r = r;
+	Materials[matindex].color.g = g;
+	Materials[matindex].color.b = b;
+	Materials[matindex].color.a = 255;
+
+	// move the file pointer back to where we got it so
+	// that the ProcessChunk() which we interrupted will read
+	// from the right place
+	Seek(findex);
+}
+
+void Mesh_3DS::TextureMapChunkProcessor(long length, long findex, int matindex)
+{
+	ChunkHeader h;
+
+	// move the file pointer to the beginning of the main
+	// chunk's data findex + the size of the header
+	Seek(findex);
+
+	while (ReadChunk(h, findex + length - 6))
+	{
+		switch (h.id)
+		{
+			case MAT_MAPNAME:
+				// Read the name of texture in the Diffuse Color map
+				MapNameChunkProcessor(h.len, Tell(), matindex);
+				break;
+			default			:
+				break;
+		}
+
+		Skip(h.len - 6, findex + length - 6);
+	}
+
+	// move the file pointer back to where we got it so
+	// that the ProcessChunk() which we interrupted will read
+	// from the right place
+	Seek(findex);
+}
+
+void Mesh_3DS::MapNameChunkProcessor(long length, long findex, int matindex)
+{
+	// move the file pointer to the beginning of the main
+	// chunk's data findex + the size of the header
+	Seek(findex);
+
+	// Read the name of the texture and indicate that the material has one,
+	// whatever draws the model loads it
+	ReadName(Materials[matindex].map, sizeof(Materials[matindex].map), findex + length - 6);
+	Materials[matindex].textured = true;
+
+	// move the file pointer back to where we got it so
+	// that the ProcessChunk() which we interrupted will read
+	// from the right place
+	Seek(findex);
+}
+
+void Mesh_3DS::ObjectChunkProcessor(long length, long findex, int objindex)
+{
+	ChunkHeader h;
+
+	// move the file pointer to the beginning of the main
+	// chunk's data findex + the size of the header
+	Seek(findex);
+
+	// Load the object's name
+	char name[80];
+	ReadName(name, sizeof(name), findex + length - 6);
+
+	if (!sizing)
+	{
+		strcpy(Objects[objindex].name, name);
+		objectNames.Add(Objects[objindex].name, objindex);
+	}
+
+	while (ReadChunk(h, findex + length - 6))
+	{
+		switch (h.id)
+		{
+			case TRIG_MESH	:
+				// Process the triangles of the object
+				TriangularMeshChunkProcessor(h.len, Tell(), objindex);
+				break;
+			default			:
+				break;
+		}
+
+		Skip(h.len - 6, findex + length - 6);
+	}
+
+	// If the object doesn't have any texcoords generate some
+	if (!sizing && Objects[objindex].numTexCoords == 0)
+	{
+		Object &o = Objects[objindex];
+		double start = Now();
+
+		// Set the number of texture coords
+		o.numTexCoords = o.numVerts;
+
+		// Make some texture coords
+		for (int m = 0; m < o.numTexCoords; m++)
+		{
+			o.TexCoords[2*m] = o.Vertexes[3*m];
+			o.TexCoords[2*m+1] = o.Vertexes[3*m+1];
+		}
+
+		times.texcoords += (float)(Now() - start);
+	}
+
+	// move the file pointer back to where we got it so
+	// that the ProcessChunk() which we interrupted will read
+	// from the right place
+	Seek(findex);
+}
+
+void Mesh_3DS::TriangularMeshChunkProcessor(long length, long findex, int objindex)
+{
+	ChunkHeader h;
+
+	// No vertices until we find some
+	readVerts = 0;
+
+	// move the file pointer to the beginning of the main
+	// chunk's data findex + the size of the header
+	Seek(findex);
+
+	while (ReadChunk(h, findex + length - 6))
+	{
+		switch (h.id)
+		{
+			case VERT_LIST	:
+				// Load the vertices of the onject
+				VertexListChunkProcessor(h.len, Tell(), objindex);
+				break;
+			case LOCAL_COORDS	:
+				//LocalCoordinatesChunkProcessor(h.len, Tell());
+				break;
+			default			:
+				break;
+		}
+
+		Skip(h.len - 6, findex + length - 6);
+	}
+
+	// After we have loaded the vertices we can load the texture coordinates
+	Seek(findex);
+
+	while (ReadChunk(h, findex + length - 6))
+	{
+		switch (h.id)
+		{
+			case TEX_VERTS	:
+				// Load the texture coordinates for the vertices
+				TexCoordsChunkProcessor(h.len, Tell(), objindex);
+				if (!sizing)
+					Objects[objindex].textured = true;
+				break;
+			default			:
+				break;
+		}
+
+		Skip(h.len - 6, findex + length - 6);
+	}
+
+	// And then the faces, which weld the vertices they use
+	Seek(findex);
+
+	while (ReadChunk(h, findex + length - 6))
+	{
+		switch (h.id)
+		{
+			case FACE_DESC	:
+				// Load the faces of the object
+				FacesDescriptionChunkProcessor(h.len, Tell(), objindex);
+				break;
+			default			:
+				break;
+		}
+
+		Skip(h.len - 6, findex + length - 6);
+	}
+
+	// move the file pointer back to where we got it so
+	// that the ProcessChunk() which we interrupted will read
+	// from the right place
+	Seek(findex);
+}
+
+void Mesh_3DS::VertexListChunkProcessor(long length, long findex, int objindex)
+{
+	unsigned short numVerts;
+
+	// move the file pointer to the beginning of the main
+	// chunk's data findex + the size of the header
+	Seek(findex);
+
+	// Read the number of vertices of the object
+	Read(&numVerts,sizeof(numVerts),findex + length - 6);
+
+	// They all have to be in the chunk
+	if (numVerts * 3 * (long)sizeof(float) > findex + length - 6 - Tell())
+	{
+		corrupt = true;
+		numVerts = 0;
+	}
+
+	if (!sizing)
+	{
+		// The object's vertices, normals and texture coordinates go
+		// right after the last object's in the merged mesh
+		Objects[objindex].Vertexes = MeshVertexes + totalVerts * 3;
+		Objects[objindex].Normals = MeshNormals + totalVerts * 3;
+		Objects[objindex].TexCoords = MeshTexCoords + totalVerts * 2;
+
+		// Assign the number of vertices for future use
+		Objects[objindex].numVerts = numVerts;
+
+		// Zero out the normals array, and the texture coordinates
+		// in case the object doesn't have any
+		for (int j = 0; j < numVerts * 3; j++)
+			Objects[objindex].Normals[j] = 0.0f;
+
+		for (int j = 0; j < numVerts * 2; j++)
+			Objects[objindex].TexCoords[j] = 0.0f;
+
+		// Read the vertices, switching the y and z coordinates and changing the sign of the z coordinate
+		for (int i = 0; i < numVerts * 3; i+=3)
+		{
+			Read(&Objects[objindex].Vertexes[i],sizeof(float),findex + length - 6);
+			Read(&Objects[objindex].Vertexes[i+2],sizeof(float),findex + length - 6);
+			Read(&Objects[objindex].Vertexes[i+1],sizeof(float),findex + length - 6);
+
+			// Change the sign of the z coordinate
+			Objects[objindex].Vertexes[i+2] = -Objects[objindex].Vertexes[i+2];
+		}
+	}
+
+	// The faces may need more room than this once they've been
+	// smoothed, they add it on when they know
+	totalVerts += numVerts;
+	fileVerts += numVerts;
+	readVerts = numVerts;
+
+	// move the file pointer back to where we got it so
+	// that the ProcessChunk() which we interrupted will read
+	// from the right place
+	Seek(findex);
+}
+
+void Mesh_3DS::TexCoordsChunkProcessor(long length, long findex, int objindex)
+{
+	// The number of texture coordinates
+	unsigned short numCoords;
+
+	// move the file pointer to the beginning of the main
+	// chunk's data findex + the size of the header
+	Seek(findex);
+
+	// Read the number of coordinates
+	Read(&numCoords,sizeof(numCoords),findex + length - 6);
+
+	if (!sizing)
+	{
+		Object &o = Objects[objindex];
+
+		// The merged mesh has one pair for each vertex, any extras
+		// are skipped and any missing are zero
+		for (int i = 0; i < o.numVerts * 2; i++)
+			o.TexCoords[i] = 0.0f;
+
+		// Read teh texture coordiantes into the array
+		for (int i = 0; i < numCoords; i++)
+		{
+			float uv[2];
+			Read(uv,sizeof(float) * 2,findex + length - 6);
+
+			if (i < o.numVerts)
+			{
+				o.TexCoords[i*2]   = uv[0];
+				o.TexCoords[i*2+1] = uv[1];
+			}
+		}
+
+		// Set the number of texture coords
+		if (numCoords > 0)
+			o.numTexCoords = o.numVerts;
+	}
+
+	// move the file pointer back to where we got it so
+	// that the ProcessChunk() which we interrupted will read
+	// from the right place
+	Seek(findex);
+}
+
+void Mesh_3DS::FacesDescriptionChunkProcessor(long length, long findex, int objindex)
+{
+	ChunkHeader h;
+	unsigned short numFaces;	// The number of faces in the object
+	unsigned short vertA;		// The first vertex of the face
+	unsigned short vertB;		// The second vertex of the face
+	unsigned short vertC;		// The third vertex of the face
+	unsigned short flags;		// The winding order flags
+	long subs;					// Holds our place in the file
+	int numMatFaces = 0;		// The number of different materials
+	std::vector<unsigned int> groups;	// The smoothing groups of the faces, if the file has them
+
+	// move the file pointer to the beginning of the main
+	// chunk's data findex + the size of the header
+	Seek(findex);
+
+	// Read the number of faces
+	Read(&numFaces,sizeof(numFaces),findex + length - 6);
+
+	// Make room for the faces
+	unsigned short *faces = (unsigned short *)Carve(numFaces * 3 * sizeof(unsigned short));
+
+	if (sizing)
+	{
+		// Skip them, each face is three vertices and the flags
+		Skip(numFaces * 4 * sizeof(unsigned short), findex + length - 6);
+	}
+	else
+	{
+		Objects[objindex].Faces = faces;
+		// Store the number of faces
+		Objects[objindex].numFaces = numFaces * 3;
+
+		// Read the faces into the array
+		for (int i = 0; i < numFaces * 3; i+=3)
+		{
+			// Read the vertices of the face
+			Read(&vertA,sizeof(vertA),findex + length - 6);
+			Read(&vertB,sizeof(vertB),findex + length - 6);
+			Read(&vertC,sizeof(vertC),findex + length - 6);
+			Read(&flags,sizeof(flags),findex + length - 6);
+
+			// Every face has to use vertices the object has
+			if (vertA >= readVerts || vertB >= readVerts || vertC >= readVerts)
+				corrupt = true;
+
+			// Place them in the array
+			Objects[objindex].Faces[i]   = vertA;
+			Objects[objindex].Faces[i+1] = vertB;
+			Objects[objindex].Faces[i+2] = vertC;
+		}
+	}
+
+	// Store our current file position
+	subs = Tell();
+
+	// Check to see how many materials the faces are split into,
+	// and which smoothing groups they're in
+	while (ReadChunk(h, findex + length - 6))
+	{
+		long data = Tell();
+
+		switch (h.id)
+		{
+			case FACE_MAT	:
+				//FacesMaterialsListChunkProcessor(h.len, Tell(), objindex);
+				numMatFaces++;
+				break;
+			case SMOOTH_GROUP	:
+				// One mask of groups for each face
+				if (h.len - 6 >= numFaces * sizeof(unsigned int) && numFaces > 0)
+				{
+					groups.resize(numFaces);
+					Read(&groups[0],sizeof(unsigned int) * numFaces,data + h.len - 6);
+				}
+				break;
+			default			:
+				break;
+		}
+
+		Seek(data + (h.len - 6));
+	}
+
+	unsigned int *faceGroups = groups.empty() ? NULL : &groups[0];
+
+	if (sizing)
+	{
+		// Smoothing groups can split the vertices, so make room for
+		// the most they could be split into
+		if (faceGroups != NULL)
+		{
+			std::vector<unsigned short> read(numFaces * 4);
+
+			Seek(findex + sizeof(numFaces));
+			Read(&read[0],sizeof(unsigned short) * numFaces * 4,findex + length - 6);
+
+			// Drop the flags
+			for (int i = 0; i < numFaces; i++)
+			{
+				read[i*3]   = read[i*4];
+				read[i*3+1] = read[i*4+1];
+				read[i*3+2] = read[i*4+2];
+			}
+
+			totalVerts += MeshWelder::MaxVertices(&read[0], faceGroups, numFaces, readVerts) - readVerts;
+		}
+	}
+	else
+	{
+		Object &o = Objects[objindex];
+
+		// The room was sized with what the file said the object had
+		if (faceGroups != NULL)
+			totalVerts += MeshWelder::MaxVertices(o.Faces, faceGroups, numFaces, readVerts) - readVerts;
+
+		// Work out the normals and weld the vertices the faces use
+		// before the faces are copied into their material lists
+		double start = Now();
+
+		if (!corrupt)
+			o.numVerts = MeshWelder::Weld(o.Vertexes, o.Normals, o.TexCoords, o.numVerts, o.Faces, faceGroups, numFaces);
+
+		times.weld += (float)(Now() - start);
+
+		if (o.numTexCoords > 0)
+			o.numTexCoords = o.numVerts;
+	}
+
+	// Split the faces up according to their materials
+	if (numMatFaces > 0)
+	{
+		// Make room for the lists of faces divided by material
+		MaterialFaces *matFaces = (MaterialFaces *)Carve(numMatFaces * sizeof(MaterialFaces));
+
+		if (!sizing)
+		{
+			Objects[objindex].MatFaces = matFaces;
+			// Store the number of material faces
+			Objects[objindex].numMatFaces = numMatFaces;
+		}
+
+		Seek(subs);
+
+		int j = 0;
+
+		// Split the faces up
+		while (ReadChunk(h, findex + length - 6))
+		{
+			switch (h.id)
+			{
+				case FACE_MAT	:
+					// Process the faces and split them up
+					FacesMaterialsListChunkProcessor(h.len, Tell(), objindex, j);
+					j++;
+					break;
+				default			:
+					break;
+			}
+
+			Skip(h.len - 6, findex + length - 6);
+		}
+	}
+
+	// move the file pointer back to where we got it so
+	// that the ProcessChunk() which we interrupted will read
+	// from the right place
+	Seek(findex);
+}
+
+void Mesh_3DS::FacesMaterialsListChunkProcessor(long length, long findex, int objindex, int subfacesindex)
+{
+	char name[80];				// The material's name
+	unsigned short numEntries;	// The number of faces associated with this material
+	unsigned short Face;		// Holds the faces as they are read
+	int material;				// An index to the Materials array for this material
+
+	// move the file pointer to the beginning of the main
+	// chunk's data findex + the size of the header
+	Seek(findex);
+
+	// Read the material's name
+	ReadName(name, sizeof(name), findex + length - 6);
+
+	// Read the number of faces associated with this material
+	Read(&numEntries,sizeof(numEntries),findex + length - 6);
+
+	// Make room for the list of faces associated with this material
+	unsigned short *subFaces = (unsigned short *)Carve(numEntries * 3 * sizeof(unsigned short));
+
+	// The merged mesh needs room for them too
+	sizedIndices += numEntries * 3;
+	sizedLists++;
+
+	if (!sizing)
+	{
+		// Find the material's index in the Materials array, one past
+		// the end if there isn't one by that name
+		material = materialNames.Find(name);
+
+		if (material < 0)
+			material = numMaterials;
+
+		// Store this value for later so that we can find the material
+		Objects[objindex].MatFaces[subfacesindex].MatIndex = material;
+
+		Objects[objindex].MatFaces[subfacesindex].subFaces = subFaces;
+		// Store this number for later use
+		Objects[objindex].MatFaces[subfacesindex].numSubFaces = numEntries * 3;
+
+		// Read the faces into the array
+		for (int i = 0; i < numEntries * 3; i+=3)
+		{
+			// read the face
+			Read(&Face,sizeof(Face),findex + length - 6);
+
+			// It has to be one of the object's
+			if (Face >= Objects[objindex].numFaces / 3)
+			{
+				corrupt = true;
+				break;
+			}
+			// Add the face's vertices to the list
+			Objects[objindex].MatFaces[subfacesindex].subFaces[i] = Objects[objindex].Faces[Face * 3];
+			Objects[objindex].MatFaces[subfacesindex].subFaces[i+1] = Objects[objindex].Faces[Face * 3 + 1];
+			Objects[objindex].MatFaces[subfacesindex].subFaces[i+2] = Objects[objindex].Faces[Face * 3 + 2];
+		}
+	}
+	
+	// move the file pointer back to where we got it so
+	// that the ProcessChunk() which we interrupted will read
+	// from the right place
+	Seek(findex);
+}
@@ -0,0 +1,302 @@
+//////////////////////////////////////////////////////////////////////
+//
+// 3D Studio Mesh Class
+//
+// Mesh_3DS.h: interface for the Mesh_3DS class.
+// The part of Model_3DS that reads a 3D Studio file (.3ds) and
+// gets its geometry ready to draw, without anything to do with
+// OpenGL or textures. Model_3DS is built on top of it and adds
+// the drawing. On its own it builds anywhere with a C++ compiler
+// (the ModelLoader library), so the loader can be looked at and
+// timed on a machine with no window (see ModelInspector.cpp).
+//
+// Usage:
+// Mesh_3DS m;
+//
+// if (!m.Load("model.3ds"))	// False if the file isn't there or is bad
+//     return;
+//
+// m.numObjects, m.Objects		// The objects as the file has them
+// m.MeshVertexes, m.Batches	// All of them merged, one batch per material
+// m.Materials[i].map			// The file name of a material's texture
+// m.times.parse				// How long the parts of the load took
+//
+// m.Unload();					// Frees it early, the destructor does it too
+//
+// The whole file is read in and then taken apart in memory, and
+// every count and chunk length in it is checked against the bytes
+// that are really there. If anything doesn't add up (a chunk that
+// runs past its parent, a face using a vertex the object doesn't
+// have) nothing is kept and Load returns false, so a broken or
+// made up file can't take the game down with it. A file that's
+// already in memory can be loaded straight from there:
+//
+// m.LoadFromMemory("maps/map.3ds", bytes, size);	// The name is only for the path
+//
+// The objects and all of their vertex, normal, texture coordinate
+// and face arrays are kept in one block, m.arenaSize bytes long.
+// Load goes through the file once to size it and again to fill it.
+//
+// The objects' vertices are put one after another in MeshVertexes
+// (each object's Vertexes points into it) and their faces are
+// gathered by material into MeshIndices, so a model can be drawn
+// with one call per material. A 3ds object can't have more than
+// 65535 vertices but a model with several of them can, so
+// MeshIndices is 16 bit when the vertices fit and 32 bit when
+// they don't.
+//
+// Each object's normals are worked out from its smoothing groups
+// when it has them, then any of its vertices with the same
+// position, normal and texture coordinates are welded into one
+// (see MeshWelder.h). fileVerts is how many the file had.
+//
+// Each object's faces are reordered for the vertex cache when it
+// loads and its vertices are renumbered in the order the faces
+// use them (see MeshOptimizer.h). acmrBefore and acmrAfter say
+// how much it helped.
+//
+// Models with enough faces also get up to three simpler levels
+// of detail, each with about a quarter of the faces of the last
+// (see MeshSimplifier.h). They share the model's vertices.
+//
+// If the objects move in the file's keyframes they're baked into
+// m.anim when it loads (see AnimationClip.h).
+//
+// Wavefront (.obj) and MilkShape 3D (.ms3d) files load too, into
+// the same objects, materials and merged mesh (see MeshImporter.h).
+// An OBJ file is known by its name, an MS3D file by its signature,
+// anything else is taken to be a 3ds file.
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef MESH_3DS_H
+#define MESH_3DS_H
+
+#include "AnimationClip.h"
+#include "NameTable.h"
+
+#include <stddef.h>
+
+struct ImportedMesh;
+
+#define MODEL_MAX_LODS		4		// The model and up to three simpler versions of it
+#define MODEL_LOD_MIN_FACES	256		// Models with fewer faces than this don't get any
+#define MODEL_KEY_RATE		30.0f	// Frames a second 3D Studio plays the keyframes at
+#define MODEL_POSE_RATE		30.0f	// Poses a second to bake them into
+#define MODEL_INDEX_16		0x1403	// indexType for 16 bit indices, the same as GL_UNSIGNED_SHORT
+#define MODEL_INDEX_32		0x1405	// And for 32 bit ones, the same as GL_UNSIGNED_INT
+
+class Mesh_3DS
+{
+public:
+	// A VERY simple vector struct
+	// I could have included a complex class but I wanted the model class to stand alone
+	struct Vector {
+		float x;
+		float y;
+		float z;
+	};
+
+	// Vertex struct to make code easier to read in places
+	struct Vertex {
+		float x;
+		float y;
+		float z;
+	};
+
+	// Color struct holds the diffuse color of the material
+	struct Color4i {
+		unsigned char r;
+		unsigned char g;
+		unsigned char b;
+		unsigned char a;
+	};
+
+	// Holds the material info
+	struct Material {
+		char name[80];	// The material's name
+		char map[80];	// The file name of its diffuse map, next to the model
+		bool textured;	// True: it has a map
+		Color4i color;	// The diffuse color, for when it doesn't
+	};
+
+	// Every chunk in the 3ds file starts with this struct
+	struct ChunkHeader {
+		unsigned short id;	// The chunk's id
+		unsigned int len;	// The lenght of the chunk
+	};
+
+	// I sort the mesh by material so that I won't have to switch textures a great deal
+	struct MaterialFaces {
+		unsigned short *subFaces;	// Index to our vertex array of all the faces that use this material
+		int numSubFaces;			// The number of faces
+		int MatIndex;				// An index to our materials
+	};
+
+	// A run of the merged mesh's indices that use the same material
+	struct Batch {
+		int MatIndex;				// An index to our materials
+		int first;					// The first index in MeshIndices
+		int count;					// The number of indices
+	};
+
+	// One level of detail, its own faces sorted into batches by material
+	struct Lod {
+		void *indices;				// The faces, the same type as MeshIndices
+		Batch *batches;				// One run of the indices per material
+		int numBatches;				// The number of batches
+		int numFaces;				// The number of faces
+		float error;				// How far the surface can be from the real one, in model units
+	};
+
+	// The 3ds file can be made up of several objects
+	struct Object {
+		char name[80];				// The object name
+		float *Vertexes;			// The array of vertices
+		float *Normals;				// The array of the normals for the vertices
+		float *TexCoords;			// The array of texture coordinates for the vertices
+		unsigned short *Faces;		// The array of face indices
+		int numFaces;				// The number of faces
+		int numMatFaces;			// The number of differnet material faces
+		int numVerts;				// The number of vertices
+		int numTexCoords;			// The number of vertices
+		bool textured;				// True: the object has textures
+		MaterialFaces *MatFaces;	// The faces are divided by materials
+		Vector pos;					// The position to move the object to
+		Vector rot;					// The angles to rotate the object
+	};
+
+	// How long each part of the last load took, in milliseconds
+	struct Timings {
+		float read;					// Reading the file in
+		float parse;				// Going through the chunks, both passes
+		float weld;					// Working out the normals and welding
+		float texcoords;			// Making texture coordinates for objects without any
+		float bake;					// Baking the keyframes
+		float optimize;				// Reordering for the vertex cache
+		float merge;				// Gathering the faces by material
+		float lods;					// Making the levels of detail
+		float total;				// All of it
+	};
+
+	char *modelname;		// The name of the model
+	char *path;				// The path of the model
+	int numObjects;			// Total number of objects in the model
+	int numMaterials;		// Total number of materials in the model
+	int totalVerts;			// Total number of vertices in the model
+	int fileVerts;			// The vertices the file had before they were welded
+	int totalFaces;			// Total number of faces in the model
+	float acmrBefore;		// Vertices transformed per face in the order the file had them
+	float acmrAfter;		// The same once they've been reordered for the cache
+	Material *Materials;	// The array of materials
+	Object *Objects;		// The array of objects in the model
+	float *MeshVertexes;	// Every object's vertices one after the other
+	float *MeshNormals;		// Every object's normals
+	float *MeshTexCoords;	// Every object's texture coordinates, one pair per vertex
+	void *MeshIndices;		// The faces of all the objects sorted by material
+	unsigned int indexType;	// MODEL_INDEX_16 if the vertices fit, otherwise MODEL_INDEX_32
+	int numMeshIndices;		// The number of indices in MeshIndices
+	Batch *Batches;			// One run of MeshIndices per material
+	int numBatches;			// The number of batches
+	Lod Lods[MODEL_MAX_LODS];	// Lods[0] is the merged mesh, the others are simpler
+	int numLods;			// The number of levels
+	AnimationClip anim;		// The objects' keyframes baked into poses, no frames if nothing moves
+	size_t arenaSize;		// The bytes the objects and their arrays take up
+	Timings times;			// How long the last load took
+	bool Load(char *name);	// Loads a model, false if the file isn't there or is bad
+	bool LoadFromMemory(char *name, const unsigned char *bytes, long size);	// Loads a model from a copy of its file, name says where it came from
+	virtual void Unload();	// Frees the model
+	Mesh_3DS();				// Constructor
+	virtual ~Mesh_3DS();	// Destructor
+
+private:
+	// A mesh owns its arrays, so it can't be copied
+	Mesh_3DS(const Mesh_3DS &);
+	Mesh_3DS &operator=(const Mesh_3DS &);
+
+	char *arena;			// One block holding the objects and all their arrays
+	size_t arenaUsed;		// How much of the arena has been handed out
+	bool sizing;			// True: the first pass, only adding up the arena's size
+	int sizedIndices;		// The faces' indices in all the objects, counted as they load
+	int sizedLists;			// The lists of faces by material in all the objects
+	int readVerts;			// The vertices the file gives the object being read
+
+	// Hands out the next piece of the arena in the order the file
+	// is read, which puts each object's arrays next to each other
+	void *Carve(size_t bytes);
+	// Goes through a 3ds file's chunks twice, sizing the arena then filling it
+	void Parse3DS();
+	// Makes the objects of a model another format was read into, the same way
+	void BuildImported(ImportedMesh &mesh);
+	// Makes room for the merged mesh, the indices are as big as they might need to be
+	void CarveMesh(int verts, int indices, int lists);
+	// Closes up the room welding left between the objects' vertices
+	void PackMesh();
+	// Gathers every object's faces into one list per material
+	void BuildMesh();
+	// Reorders each object's faces for the vertex cache and its vertices to match
+	void OptimizeMesh();
+	// Makes the simpler levels of detail
+	void BuildLods();
+
+	char *lodBlock;			// The simpler levels' batches and indices
+
+	NameTable materialNames;	// The materials by name, while the model loads
+	NameTable objectNames;		// And the objects
+
+	const unsigned char *data;	// The file being loaded
+	long dataSize;			// How long it is
+	long cursor;			// Where in it we're reading
+	bool corrupt;			// True: something in the file doesn't add up
+
+	// Reads a name that ends in a zero, keeping as much as fits in size
+	// and never going past end
+	void ReadName(char *name, int size, long end);
+	// Reads a chunk's header, false if there isn't one before end or it doesn't fit
+	bool ReadChunk(ChunkHeader &h, long end);
+	// Copies bytes from the file, false (and zeros) if that goes past end
+	bool Read(void *to, long bytes, long end);
+	// Moves on over bytes, false if that goes past end
+	bool Skip(long bytes, long end);
+	void Seek(long offset);	// Moves to offset bytes into the file
+	long Tell();			// How far into the file we are
+
+	void IntColorChunkProcessor(long length, long findex, int matindex);
+	void FloatColorChunkProcessor(long length, long findex, int matindex);
+	// Processes the Main Chunk that all the other chunks exist is
+	void MainChunkProcessor(long length, long findex);
+		// Processes the keyframes and bakes them
+		void KeyFrameChunkProcessor(long length, long findex);
+			// Processes one node of the hierarchy and its tracks
+			void MeshInfoChunkProcessor(long length, long findex, AnimationClip::Node &node);
+				// Processes the keys of one track, values numbers each
+				void TrackChunkProcessor(long length, long findex, std::vector<AnimationClip::Key> &keys, int values);
+		// Processes the model's info
+		void EditChunkProcessor(long length, long findex);
+
+			// Processes the model's materials
+			void MaterialChunkProcessor(long length, long findex, int matindex);
+				// Processes the names of the materials
+				void MaterialNameChunkProcessor(long length, long findex, int matindex);
+				// Processes the material's diffuse color
+				void DiffuseColorChunkProcessor(long length, long findex, int matindex);
+				// Processes the material's texture maps
+				void TextureMapChunkProcessor(long length, long findex, int matindex);
+					// Processes the names of the textures
+					void MapNameChunkProcessor(long length, long findex, int matindex);
+
+			// Processes the model's geometry
+			void ObjectChunkProcessor(long length, long findex, int objindex);
+				// Processes the triangles of the model
+				void TriangularMeshChunkProcessor(long length, long findex, int objindex);
+					// Processes the vertices of the model and loads them
+					void VertexListChunkProcessor(long length, long findex, int objindex);
+					// Processes the texture cordiantes of the vertices and loads them
+					void TexCoordsChunkProcessor(long length, long findex, int objindex);
+					// Processes the faces of the model and loads the faces
+					void FacesDescriptionChunkProcessor(long length, long findex, int objindex);
+						// Processes the materials of the faces and splits them up by material
+						void FacesMaterialsListChunkProcessor(long length, long findex, int objindex, int subfacesindex);
+};
+
+#endif MESH_3DS_H
@@ -0,0 +1,69 @@
+// Feeds whatever bytes the fuzzer makes up to the model parsers (3ds,
+// OBJ with its mtllib, MS3D), which have to turn down a broken file
+// without reading or writing outside it. Built with libFuzzer and
+// AddressSanitizer, any read past the end, bad index or leak stops
+// the run with the input that did it:
+//
+//     ModelFuzzer -max_len=1048576 fuzz_out models
+//     ModelFuzzer -max_total_time=600 -max_len=1048576 fuzz_out models
+//
+// The models the game ships are the seeds, so mutations start from
+// real chunk layouts and lines instead of random noise. What it finds
+// goes in fuzz_out, a scratch directory, and models is only read.
+//
+// Built with MODELFUZZER_MAIN it has its own main instead, which loads
+// the files it's given once each. That replays a crash the fuzzer
+// saved with any compiler, and lets AFL run it on its own files:
+//
+//     afl-fuzz -i fuzz_in -o findings -- ./ModelFuzzer @@
+//
+// with fuzz_in a copy of the model files, AFL doesn't look in folders.
+#include "Mesh_3DS.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    // OBJ files are only told apart by their name, so the first byte
+    // picks it: a 3ds file starts with its main chunk's 0x4D, anything
+    // else is read as an OBJ and its mtllib looked for. MS3D files are
+    // found by their signature either way. The files in models/ are
+    // read as what they are, so they seed both parsers as they ship
+    char name3ds[] = "fuzz.3ds";
+    char nameObj[] = "fuzz.obj";
+    char *name = size > 0 && data[0] == 0x4D ? name3ds : nameObj;
+
+    Mesh_3DS mesh;
+    mesh.LoadFromMemory(name, data, (long)size);
+
+    return 0;
+}
+
+#ifdef MODELFUZZER_MAIN
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        printf("usage: ModelFuzzer file ...\n");
+        return 1;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        FILE *f = fopen(argv[i], "rb");
+        if (f == NULL) {
+            printf("%s: couldn't be opened\n", argv[i]);
+            return 1;
+        }
+
+        std::vector<uint8_t> bytes;
+        uint8_t buffer[65536];
+        size_t n;
+        while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+            bytes.insert(bytes.end(), buffer, buffer + n);
+        fclose(f);
+
+        LLVMFuzzerTestOneInput(bytes.empty() ? NULL : &bytes[0], bytes.size());
+    }
+
+    return 0;
+}
+#endif
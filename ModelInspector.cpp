@@ -0,0 +1,105 @@
+// Loads .3ds files with the game's loader and prints what came out
+// of them and how long each part of the load took. Nothing here uses
+// OpenGL, so it runs anywhere the ModelLoader library builds:
+//
+//     ModelInspector models/rock/rock.3ds models/tree/Tree1.3ds
+//     ModelInspector -repeat 20 models/tree/Tree1.3ds
+//
+// -repeat loads each file that many times and prints the fastest,
+// which is steadier than one load for comparing changes. The exit
+// code is 1 if any file couldn't be loaded.
+#include "Mesh_3DS.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+
+// The times of a load, kept if it's the fastest so far
+void KeepFastest(Mesh_3DS::Timings &best, const Mesh_3DS::Timings &t, bool first) {
+    if (first || t.total < best.total)
+        best = t;
+}
+
+void PrintModel(Mesh_3DS &mesh, const Mesh_3DS::Timings &t, int loads) {
+    printf("%s\n", mesh.modelname);
+    printf("  %d objects, %d materials, %d -> %d vertices, %d faces\n",
+        mesh.numObjects, mesh.numMaterials, mesh.fileVerts, mesh.totalVerts, mesh.totalFaces);
+
+    // The box around every vertex, in the loader's y up space
+    float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+    for (int v = 0; v < mesh.totalVerts; v++) {
+        for (int k = 0; k < 3; k++) {
+            float x = mesh.MeshVertexes[v * 3 + k];
+            if (x < lo[k]) lo[k] = x;
+            if (x > hi[k]) hi[k] = x;
+        }
+    }
+
+    if (mesh.totalVerts > 0)
+        printf("  bounds (%.3f, %.3f, %.3f) to (%.3f, %.3f, %.3f)\n", lo[0], lo[1], lo[2], hi[0], hi[1], hi[2]);
+
+    printf("  %d bit indices, %d batches, ACMR %.3f -> %.3f, %u bytes\n",
+        mesh.indexType == MODEL_INDEX_32 ? 32 : 16, mesh.numBatches, mesh.acmrBefore, mesh.acmrAfter,
+        (unsigned int)mesh.arenaSize);
+
+    printf("  levels:");
+    for (int l = 0; l < mesh.numLods; l++)
+        printf(" %d faces (%.4f)", mesh.Lods[l].numFaces, mesh.Lods[l].error);
+    printf("\n");
+
+    if (mesh.anim.numFrames > 0)
+        printf("  animation: %d frames, %.2f seconds\n", mesh.anim.numFrames, mesh.anim.length);
+
+    for (int i = 0; i < mesh.numObjects; i++) {
+        Mesh_3DS::Object &o = mesh.Objects[i];
+        printf("  object %-20s %6d vertices %6d faces %2d materials\n", o.name, o.numVerts, o.numFaces / 3, o.numMatFaces);
+    }
+
+    for (int j = 0; j < mesh.numMaterials; j++) {
+        Mesh_3DS::Material &m = mesh.Materials[j];
+        printf("  material %-18s %s\n", m.name, m.textured ? m.map : "(color)");
+    }
+
+    printf("  load %.2f ms%s: read %.2f, parse %.2f, weld %.2f, texcoords %.2f, bake %.2f, optimize %.2f, merge %.2f, lods %.2f\n",
+        t.total, loads > 1 ? " (fastest)" : "", t.read, t.parse, t.weld, t.texcoords, t.bake, t.optimize, t.merge, t.lods);
+}
+
+int main(int argc, char** argv) {
+    int repeat = 1;
+    int failed = 0;
+
+    if (argc < 2) {
+        printf("usage: ModelInspector [-repeat n] model.3ds ...\n");
+        return 1;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-repeat") == 0 && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+            if (repeat < 1)
+                repeat = 1;
+            continue;
+        }
+
+        Mesh_3DS mesh;
+        Mesh_3DS::Timings best;
+        bool loaded = true;
+
+        for (int r = 0; r < repeat && loaded; r++) {
+            loaded = mesh.Load(argv[i]);
+            KeepFastest(best, mesh.times, r == 0);
+        }
+
+        if (!loaded) {
+            printf("%s: couldn't be loaded\n", argv[i]);
+            failed++;
+            continue;
+        }
+
+        PrintModel(mesh, best, repeat);
+    }
+
+    return failed > 0 ? 1 : 0;
+}
@@ -7,17 +7,18 @@
 // This is a simple class for loading and viewing
 // 3D Studio model files (.3ds). It supports models
 // with multiple objects. It also supports multiple
-// textures per object. It does not support the animation
-// for 3D Studio models b/c there are simply too many
-// ways for an artist to animate a 3D Studio model and
-// I didn't want to impose huge limitations on the artists.
-// However, I have imposed a limitation on how the models are
+// textures per object. It plays the keyframes the objects
+// have for moving, turning and scaling (see AnimationClip.h),
+// but not the ones for bending the meshes themselves.
+// I have imposed a limitation on how the models are
 // textured:
 // 1) Every faces must be assigned a material
 // 2) If you want the face to be textured assign the
 //    texture to the Diffuse Color map
 // 3) The texture must be supported by the GLTexture class
-//    which only supports bitmap and targa right now
+//    which supports bitmap, targa, png and jpeg. Png and
+//    jpeg maps are decoded in the background, if the file
+//    isn't there a bitmap with the same name is used
 // 4) The texture must be located in the same directory as
 //    the model
 //
@@ -36,7 +37,34 @@
 // Model_3DS m;
 //
 // m.Load("model.3ds"); // Load the model
+// m.Load("model.obj"); // OBJ and MS3D files load the same way (see MeshImporter.h)
 // m.Draw();			// Renders the model to the screen
+// m.Unload();			// Frees it early, the destructor does it too
+//
+// Reading the file and getting the geometry ready is done by
+// Mesh_3DS, which has no OpenGL in it (see Mesh_3DS.h for what it
+// does to the file and the checks it makes). Model_3DS loads the
+// materials' textures once it's done and draws the result. A file
+// that's already in memory can be loaded straight from there:
+//
+// m.LoadFromMemory("maps/map.3ds", bytes, size);	// The name is only for finding the textures
+//
+// The merged mesh lets Draw make one call per material. Moving
+// an object on its own goes back to drawing them one by one.
+//
+// Models with enough faces also get simpler levels of detail. To
+// pick one, work out how many pixels one unit covers where the
+// model is being drawn:
+//
+// int lod = m.SelectLod(pixelsPerUnit);
+// m.Draw(lod);
+//
+// If the objects move in the file's keyframes they're baked into
+// m.anim when it loads, and drawing with a time poses the model.
+// Each copy of the model on screen can have its own time. A posed
+// model draws its objects one at a time with all their faces.
+//
+// m.Draw(lod, seconds);
 //
 // // If you want to show the model's normals
 // m.shownormals = true;
@@ -75,129 +103,40 @@
 // Would have greatly bloated the model class's code
 // Just replace this with your favorite texture class
 #include "GLTexture.h"
+#include "Mesh_3DS.h"
 
 #include <stdio.h>
 
-class Model_3DS  
+#define MODEL_LOD_PIXELS	2.0f	// How far off (in pixels) a level can look and still be used
+
+class Model_3DS : public Mesh_3DS
 {
 public:
-	// A VERY simple vector struct
-	// I could have included a complex class but I wanted the model class to stand alone
-	struct Vector {
-		float x;
-		float y;
-		float z;
-	};
-
-	// Vertex struct to make code easier to read in places
-	struct Vertex {
-		float x;
-		float y;
-		float z;
-	};
-
-	// Color struct holds the diffuse color of the material
-	struct Color4i {
-		unsigned char r;
-		unsigned char g;
-		unsigned char b;
-		unsigned char a;
-	};
-
-	// Holds the material info
-	// TODO: add color support for non textured polys
-	struct Material {
-		char name[80];	// The material's name
-		GLTexture tex;	// The texture (this is the only outside reference in this class)
-		bool textured;	// whether or not it is textured
-		Color4i color;
-	};
-
-	// Every chunk in the 3ds file starts with this struct
-	struct ChunkHeader {
-		unsigned short id;	// The chunk's id
-		unsigned long  len;	// The lenght of the chunk
-	};
-
-	// I sort the mesh by material so that I won't have to switch textures a great deal
-	struct MaterialFaces {
-		unsigned short *subFaces;	// Index to our vertex array of all the faces that use this material
-		int numSubFaces;			// The number of faces
-		int MatIndex;				// An index to our materials
-	};
-
-	// The 3ds file can be made up of several objects
-	struct Object {
-		char name[80];				// The object name
-		float *Vertexes;			// The array of vertices
-		float *Normals;				// The array of the normals for the vertices
-		float *TexCoords;			// The array of texture coordinates for the vertices
-		unsigned short *Faces;		// The array of face indices
-		int numFaces;				// The number of faces
-		int numMatFaces;			// The number of differnet material faces
-		int numVerts;				// The number of vertices
-		int numTexCoords;			// The number of vertices
-		bool textured;				// True: the object has textures
-		MaterialFaces *MatFaces;	// The faces are divided by materials
-		Vector pos;					// The position to move the object to
-		Vector rot;					// The angles to rotate the object
-	};
-
-	char *modelname;		// The name of the model
-	char *path;				// The path of the model
-	int numObjects;			// Total number of objects in the model
-	int numMaterials;		// Total number of materials in the model
-	int totalVerts;			// Total number of vertices in the model
-	int totalFaces;			// Total number of faces in the model
-	bool shownormals;		// True: show the normals
-	Material *Materials;	// The array of materials
-	Object *Objects;		// The array of objects in the model
+	GLTexture *Textures;	// One for each material, its map or a plain color (this is the only outside reference in this class)
 	Vector pos;				// The position to move the model to
 	Vector rot;				// The angles to rotate the model
 	float scale;			// The size you want the model scaled to
+	bool shownormals;		// True: show the normals
 	bool lit;				// True: the model is lit
 	bool visible;			// True: the model gets rendered
-	void Load(char *name);	// Loads a model
+	bool Load(char *name);	// Loads a model and its textures, false if the file isn't there or is bad
+	bool LoadFromMemory(char *name, const unsigned char *bytes, long size);	// Loads a model from a copy of its file, name says where its textures are
+	void Unload();			// Frees the model and its textures
 	void Draw();			// Draws the model
-	FILE *bin3ds;			// The binary 3ds file
+	void Draw(int lod);		// Draws one of the model's levels of detail
+	void Draw(int lod, float time);	// Draws the model posed time seconds into its animation
+	int SelectLod(float pixelsPerUnit);	// The simplest level that looks right this big on screen
+	bool Merged();			// True: no object has been moved on its own, so the merged mesh can be drawn
 	Model_3DS();			// Constructor
 	virtual ~Model_3DS();	// Destructor
 
 private:
-	void IntColorChunkProcessor(long length, long findex, int matindex);
-	void FloatColorChunkProcessor(long length, long findex, int matindex);
-	// Processes the Main Chunk that all the other chunks exist is
-	void MainChunkProcessor(long length, long findex);
-		// Processes the model's info
-		void EditChunkProcessor(long length, long findex);
-			
-			// Processes the model's materials
-			void MaterialChunkProcessor(long length, long findex, int matindex);
-				// Processes the names of the materials
-				void MaterialNameChunkProcessor(long length, long findex, int matindex);
-				// Processes the material's diffuse color
-				void DiffuseColorChunkProcessor(long length, long findex, int matindex);
-				// Processes the material's texture maps
-				void TextureMapChunkProcessor(long length, long findex, int matindex);
-					// Processes the names of the textures and load the textures
-					void MapNameChunkProcessor(long length, long findex, int matindex);
-			
-			// Processes the model's geometry
-			void ObjectChunkProcessor(long length, long findex, int objindex);
-				// Processes the triangles of the model
-				void TriangularMeshChunkProcessor(long length, long findex, int objindex);
-					// Processes the vertices of the model and loads them
-					void VertexListChunkProcessor(long length, long findex, int objindex);
-					// Processes the texture cordiantes of the vertices and loads them
-					void TexCoordsChunkProcessor(long length, long findex, int objindex);
-					// Processes the faces of the model and loads the faces
-					void FacesDescriptionChunkProcessor(long length, long findex, int objindex);
-						// Processes the materials of the faces and splits them up by material
-						void FacesMaterialsListChunkProcessor(long length, long findex, int objindex, int subfacesindex);
+	// A model owns its textures, so it can't be copied
+	Model_3DS(const Model_3DS &);
+	Model_3DS &operator=(const Model_3DS &);
 
-	// Calculates the normals of the vertices by averaging
-	// the normals of the faces that use that vertex
-	void CalculateNormals();
+	// Loads the materials' maps, or makes a plain texture of their color
+	void LoadTextures();
 };
 
-#endif MODEL_3DS_H
\ No newline at end of file
+#endif MODEL_3DS_H
@@ -0,0 +1,105 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Name Table
+//
+// NameTable.cpp: implementation of the NameTable class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "NameTable.h"
+
+#include <string.h>
+
+NameTable::NameTable()
+{
+	slots = NULL;
+	mask = 0;
+}
+
+NameTable::~NameTable()
+{
+	Clear();
+}
+
+void NameTable::Create(int count)
+{
+	Clear();
+
+	// At least half the slots stay empty so a search soon stops
+	unsigned int size = 8;
+
+	while (count > 0 && size < (unsigned int)count * 2)
+		size *= 2;
+
+	slots = new Slot[size];
+	mask = size - 1;
+
+	memset(slots, 0, size * sizeof(Slot));
+}
+
+void NameTable::Add(const char *name, int index)
+{
+	if (slots == NULL || name == NULL)
+		return;
+
+	unsigned int hash = Hash(name);
+	unsigned int used = 0;
+
+	// Go along from where it hashes to until there's a space
+	for (unsigned int i = hash & mask; used <= mask; i = (i + 1) & mask, used++)
+	{
+		if (slots[i].name == NULL)
+		{
+			slots[i].name = name;
+			slots[i].hash = hash;
+			slots[i].index = index;
+			return;
+		}
+
+		// Keep the first one, the same as searching a list would find
+		if (slots[i].hash == hash && strcmp(slots[i].name, name) == 0)
+			return;
+	}
+}
+
+int NameTable::Find(const char *name)
+{
+	if (slots == NULL || name == NULL)
+		return -1;
+
+	unsigned int hash = Hash(name);
+	unsigned int used = 0;
+
+	for (unsigned int i = hash & mask; used <= mask; i = (i + 1) & mask, used++)
+	{
+		if (slots[i].name == NULL)
+			return -1;
+
+		if (slots[i].hash == hash && strcmp(slots[i].name, name) == 0)
+			return slots[i].index;
+	}
+
+	return -1;
+}
+
+void NameTable::Clear()
+{
+	delete [] slots;
+
+	slots = NULL;
+	mask = 0;
+}
+
+unsigned int NameTable::Hash(const char *name)
+{
+	// FNV-1a
+	unsigned int hash = 2166136261u;
+
+	for (const unsigned char *c = (const unsigned char *)name; *c != 0; c++)
+	{
+		hash ^= *c;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
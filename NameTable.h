@@ -0,0 +1,55 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Name Table
+//
+// NameTable.h: interface for the NameTable class.
+// Finds things by name without comparing against every one of
+// them. The names are hashed into a table twice as big as the
+// number of them, so a lookup nearly always lands on the right
+// one straight away.
+//
+// The table only points at the names, they have to stay around
+// (and not change) for as long as it's used.
+//
+// Usage:
+// NameTable t;
+//
+// t.Create(numMaterials);
+// t.Add(Materials[i].name, i);		// The first of a name is the one kept
+// int i = t.Find("Wood");			// -1 if it isn't there
+// t.Clear();
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef NAMETABLE_H
+#define NAMETABLE_H
+
+class NameTable
+{
+public:
+	NameTable();
+	virtual ~NameTable();
+
+	void Create(int count);						// Makes room for count names, emptying the table
+	void Add(const char *name, int index);		// Remembers the index for the name
+	int Find(const char *name);					// The index added with the name, or -1
+	void Clear();								// Frees the table
+
+private:
+	// A table owns its slots, so it can't be copied
+	NameTable(const NameTable &);
+	NameTable &operator=(const NameTable &);
+
+	struct Slot {
+		const char *name;		// NULL if the slot is empty
+		unsigned int hash;		// The name's hash, compared before the name
+		int index;
+	};
+
+	Slot *slots;
+	unsigned int mask;			// The number of slots less one, always a power of two less one
+
+	static unsigned int Hash(const char *name);
+};
+
+#endif NAMETABLE_H
@@ -1,11 +1,21 @@
 #include "TextureBuilder.h"
+#include "ShaderRenderer.h"
+#include "RenderQueue.h"
+#include "StaticMesh.h"
+#include "GLState.h"
 #include "Model_3DS.h"
 #include "GLTexture.h"
+#include "TextureStreamer.h"
+#include "TextureAtlas.h"
+#include "GlyphFont.h"
+#include "HudModel.h"
+#include "AllocationCounter.h"
+#include "TextureManager.h"
+#include "SoundBank.h"
+#include "AudioMixer.h"
 #include <glut.h>
 #include <vector>
 #include <cmath>
-#include <string>
-#include <sstream>
 #include <windows.h>
 #include <mmsystem.h>
 #pragma comment(lib, "winmm.lib")
@@ -15,8 +25,13 @@ int WIDTH = 1280;
 int HEIGHT = 720;
 GLuint tex;
 GLuint tex1;
+int tex_slot = -1;   // TextureManager slots for the skies
+int tex1_slot = -1;
 char title[] = "3D Game";
 
+// Texture memory we try to stay under, both levels share it
+#define TEXTURE_BUDGET_MB 48
+
 // Camera settings
 GLdouble fovy = 45.0;
 GLdouble aspectRatio = (GLdouble)WIDTH / (GLdouble)HEIGHT;
@@ -27,18 +42,54 @@ GLdouble zFar = 200;
 class SimpleSound {
 private:
     bool soundEnabled;
+    SoundBank bank;
+    AudioMixer mixer;
 
 public:
-    SimpleSound() : soundEnabled(true) {}
+    SimpleSound(const char* captureFile = nullptr) : soundEnabled(true) {
+        // Decode everything up front so playing a sound never hits the disk
+        bank.Load(SOUND_SHOOT, "Sounds/shoot.wav");
+        bank.Load(SOUND_HIT, "Sounds/hit.wav");
+        bank.Load(SOUND_RELOAD, "Sounds/reload.wav");
+        bank.Load(SOUND_JUMP, "Sounds/jump.wav");
+        bank.Load(SOUND_DAMAGE, "Sounds/hurt.wav");
+
+        // Mix on our own thread so sounds can overlap, writing to a file
+        // instead of the sound card if we were asked to
+        bool started = false;
+        if (captureFile) {
+            started = mixer.Start(new WaveFileBackend(captureFile, true));
+        }
+        else {
+            started = mixer.Start(new WaveOutBackend());
+        }
+        if (!started) {
+            mixer.Start(new NullBackend());
+        }
+    }
+
+    void playSound(SoundId sound) {
+        if (soundEnabled) {
+            mixer.Play(bank.Samples(sound), bank.Frames(sound), 1.0f, 0.0f);
+        }
+    }
 
-    void playSound(const char* soundFile) {
+    // Sounds that happen somewhere in the world get quieter with distance
+    void playSoundAt(SoundId sound, float x, float y, float z) {
         if (soundEnabled) {
-            PlaySound(soundFile, NULL, SND_ASYNC | SND_FILENAME);
+            mixer.PlayAt(bank.Samples(sound), bank.Frames(sound), 1.0f, x, y, z);
         }
     }
 
+    void setListener(float x, float y, float z, float atX, float atY, float atZ) {
+        mixer.SetListener(x, y, z, atX, atY, atZ);
+    }
+
     void enableSound() { soundEnabled = true; }
-    void disableSound() { soundEnabled = false; }
+    void disableSound() {
+        soundEnabled = false;
+        mixer.StopAll();
+    }
 };
 
 // Global sound system instance
@@ -80,16 +131,18 @@ struct AmmoBox {
     float respawnTimer;
 };
 
+const int PARTICLES_PER_EXPLOSION = 30;
+const int MAX_EXPLOSIONS = 16;  // Past this the oldest explosion is reused
+
 struct Explosion {
     float x, y, z;              // Explosion center
-    std::vector<Particle> particles;
+    Particle particles[PARTICLES_PER_EXPLOSION];
     float lifetime;             // Current lifetime
     float maxLifetime;          // Maximum lifetime
     bool active;                // Whether explosion is active
 };
 
 std::vector<Explosion> explosions;
-const int PARTICLES_PER_EXPLOSION = 30;
 const float EXPLOSION_LIFETIME = 0.5f;  // Half a second
 const float PARTICLE_SIZE = 0.05f;
 
@@ -144,6 +197,7 @@ const float MAX_SUN_HEIGHT = 100.0f;
 const float MIN_SUN_HEIGHT = 5.0f;
 const float SUN_DISTANCE = 100.0f;
 GLUquadricObj* sunQuadric = nullptr;  // For rendering the sun sphere
+GLUquadricObj* skyQuadric = nullptr;  // The textured sky sphere
 const float SUN_VISUAL_SIZE = 10.0f;   // Size of the sun sphere
 float currentSunPosition[4] = { 0.0f, MAX_SUN_HEIGHT, -SUN_DISTANCE, 1.0f };
 //Light 
@@ -175,6 +229,8 @@ Model_3DS Chair;
 
 std::vector<Target> targets;
 const int NUM_TARGETS = 7;
+const int NUM_TARGET_SPOTS = 15;     // Trees in level 1, walls in level 2
+std::vector<int> freeSpots;          // SpawnTargets' list of the ones without a target yet
 
 
 
@@ -233,6 +289,9 @@ const float DAMAGE_COOLDOWN = 1.0f;
 float lastDamageTime = 0.0f;
 
 
+// Seconds of game time, moved on by every updateScene tick
+float simulationTime = 0.0f;
+
 // Timer and game state variables
 const float GAME_TIME_LIMIT = 120.0f;  // 2 minutes in seconds
 float gameTimer = GAME_TIME_LIMIT;
@@ -269,6 +328,7 @@ bool levelCompleted = false;
 
 // Bullet variables
 std::vector<Bullet> bullets;
+const int MAX_BULLETS = 32;  // Past this the oldest bullet is reused
 const float BULLET_SPEED = 12.0f;
 const float BULLET_SCALE = 0.01f;
 const float BULLET_MAX_LIFETIME = 3.5f;
@@ -289,10 +349,71 @@ GLTexture tex_rock;
 GLTexture tex_sniper;
 GLTexture tex_map2ground;
 GLTexture tex_map2sky;
-GLTexture tex_target;  // Add this with other texture declarations
-GLTexture tex_mtarget;
+// Targets, ammo boxes and the HUD share one texture
+TextureAtlas atlas;
+AtlasBatch worldBatch;
+AtlasBatch uiBatch;
+int atlas_white;
+int atlas_target;
+int atlas_mtarget;
+// HUD text is drawn from its own page of glyphs
+TextureAtlas fontAtlas;
+AtlasBatch textBatch;
+GlyphFont hudFont;      // Stands in for GLUT_BITMAP_HELVETICA_18
+GlyphFont titleFont;    // Stands in for GLUT_BITMAP_TIMES_ROMAN_24
+int font_white;
+HudModel hud;
+TextLayout gameOverLayout;
+TextLayout exitLayout;
 GLTexture tex_wall;  // Add with other GLTexture declarations
 
+// "-shaders" draws the same scene with the OpenGL 3.3 renderer (see
+// ShaderRenderer.h) when the driver has it
+ShaderRenderer shaders;
+bool useShaders = false;
+int gpu_tree = -1;       // The models once they're uploaded
+int gpu_rock = -1;
+int gpu_player = -1;
+int gpu_bullet = -1;
+int gpu_chair = -1;
+int shape_wall = -1;     // And the shapes built from the corner tables
+int shape_door = -1;
+int shape_glow = -1;
+int shape_ground = -1;
+int shape_sky = -1;
+int shape_sun = -1;
+std::vector<ShaderInstance> shadedInstances;   // Reused every frame so drawing doesn't allocate
+std::vector<ShaderParticle> shadedParticles;
+TextLayout explosiveLabel;   // glutBitmapCharacter has no shader version, so the
+TextLayout fastFireLabel;    // ammo box labels go in the HUD text
+
+// The fixed function path draws the same shapes from static meshes (see
+// StaticMesh.h), built once instead of sent with glBegin every frame
+StaticMesh mesh_walls;       // All of level 2's walls in one, rebuilt when they change
+bool wallsChanged = true;
+StaticMesh mesh_door;
+StaticMesh mesh_glow;
+StaticMesh mesh_ground;
+StaticMesh mesh_target[2];   // Level 1's, and level 2's with its metal frame
+
+// The ammo box colors, each one a mesh of its own
+enum AmmoBoxKind {
+    AMMO_HIGH_DAMAGE,
+    AMMO_NORMAL,
+    AMMO_EXPLOSIVE,
+    AMMO_FAST_FIRE,
+    AMMO_KIND_COUNT
+};
+StaticMesh mesh_ammoBox[AMMO_KIND_COUNT];
+
+// The fixed function path submits everything it draws to the queue (see
+// RenderQueue.h), "-renderstats" prints what it set and skipped
+RenderQueue renderQueue;
+bool showRenderStats = false;
+int renderFrames = 0;
+int renderAllocs = 0;      // Heap allocations the drawing made since the last report
+int renderAllocsPeak = 0;  // The most one frame made
+
 
 // Function declarations
 void updateCamera();
@@ -302,27 +423,21 @@ void ShootBullet();
 void RenderBullets();
 void RenderGround();
 void RenderUI();
-void RenderCrosshair();
+float EyeDistance(float x, float y, float z);
+float PixelsPerUnit(float x, float y, float z);
 void LoadAssets();
+void BuildScene();
 
 //sound
-void playGameSounds(const char* soundType) {
+void playGameSounds(SoundId sound) {
     if (soundSystem) {
-        if (strcmp(soundType, "shoot") == 0) {
-            soundSystem->playSound("Sounds/shoot.wav");
-        }
-        else if (strcmp(soundType, "hit") == 0) {
-            soundSystem->playSound("Sounds/hit.wav");
-        }
-        else if (strcmp(soundType, "reload") == 0) {
-            soundSystem->playSound("Sounds/reload.wav");
-        }
-        else if (strcmp(soundType, "jump") == 0) {
-            soundSystem->playSound("Sounds/jump.wav");
-        }
-        else if (strcmp(soundType, "damage") == 0) {
-            soundSystem->playSound("Sounds/hurt.wav");
-        }
+        soundSystem->playSound(sound);
+    }
+}
+
+void playGameSoundsAt(SoundId sound, float x, float y, float z) {
+    if (soundSystem) {
+        soundSystem->playSoundAt(sound, x, y, z);
     }
 }
 
@@ -471,7 +586,7 @@ void UpdateBullets() {
 
 void ShootBullet() {
     if (gameOver) return;
-    float currentTime = glutGet(GLUT_ELAPSED_TIME) / 1000.0f;
+    float currentTime = simulationTime;
 
     if (currentTime - lastShotTime < shootingCooldown) {
         return;
@@ -514,44 +629,46 @@ void ShootBullet() {
         spawnZ = playerZ + dz * spawnDistance;
     }
 
-    // Find an inactive bullet or create a new one
-    bool bulletFound = false;
+    // Find an inactive bullet, or add one while there's room in the
+    // pool, or else take over the one that has been flying longest
+    Bullet* slot = nullptr;
     for (auto& bullet : bullets) {
         if (!bullet.active) {
-            bullet.active = true;
-            bullet.lifetime = 0.0f;
-            bullet.x = spawnX;
-            bullet.y = spawnY;
-            bullet.z = spawnZ;
-            bullet.dx = dx;
-            bullet.dy = dy;
-            bullet.dz = dz;
-            bullet.speed = BULLET_SPEED;
-            bullet.maxLifetime = BULLET_MAX_LIFETIME;
-            bullet.scale = BULLET_SCALE;
-            bullet.rotation = playerRotation;
-            bulletFound = true;
+            slot = &bullet;
             break;
         }
     }
 
-    if (!bulletFound) {
-        Bullet newBullet;
-        newBullet.active = true;
-        newBullet.lifetime = 0.0f;
-        newBullet.x = spawnX;
-        newBullet.y = spawnY;
-        newBullet.z = spawnZ;
-        newBullet.dx = dx;
-        newBullet.dy = dy;
-        newBullet.dz = dz;
-        newBullet.speed = BULLET_SPEED;
-        newBullet.maxLifetime = BULLET_MAX_LIFETIME;
-        newBullet.scale = BULLET_SCALE;
-        newBullet.rotation = playerRotation;
-        bullets.push_back(newBullet);
-    }
-    playGameSounds("shoot");
+    if (slot == nullptr) {
+        if (bullets.size() < MAX_BULLETS) {
+            bullets.push_back(Bullet());  // Inside the capacity BuildScene reserved
+            slot = &bullets.back();
+        }
+        else {
+            slot = &bullets[0];
+            for (auto& bullet : bullets) {
+                if (bullet.lifetime > slot->lifetime) {
+                    slot = &bullet;
+                }
+            }
+        }
+    }
+
+    Bullet& bullet = *slot;
+    bullet.active = true;
+    bullet.lifetime = 0.0f;
+    bullet.x = spawnX;
+    bullet.y = spawnY;
+    bullet.z = spawnZ;
+    bullet.dx = dx;
+    bullet.dy = dy;
+    bullet.dz = dz;
+    bullet.speed = BULLET_SPEED;
+    bullet.maxLifetime = BULLET_MAX_LIFETIME;
+    bullet.scale = BULLET_SCALE;
+    bullet.rotation = playerRotation;
+
+    playGameSoundsAt(SOUND_SHOOT, spawnX, spawnY, spawnZ);
     currentAmmo--;
     lastShotTime = currentTime;
 }
@@ -561,7 +678,7 @@ void StartReload() {
     if (!isReloading && currentAmmo < MAX_AMMO && ammoReserves > 0) {
         isReloading = true;
         currentReloadTime = 0.0f;
-        playGameSounds("reload");
+        playGameSounds(SOUND_RELOAD);
 
     }
 }
@@ -586,7 +703,31 @@ void UpdateReload() {
 }
 
 void CreateExplosion(float x, float y, float z) {
-    Explosion explosion;
+    // Reuse a finished explosion the same way bullets are reused
+    Explosion* slot = nullptr;
+    for (auto& e : explosions) {
+        if (!e.active) {
+            slot = &e;
+            break;
+        }
+    }
+
+    if (slot == nullptr) {
+        if (explosions.size() < MAX_EXPLOSIONS) {
+            explosions.push_back(Explosion());  // Inside the capacity BuildScene reserved
+            slot = &explosions.back();
+        }
+        else {
+            slot = &explosions[0];
+            for (auto& e : explosions) {
+                if (e.lifetime > slot->lifetime) {
+                    slot = &e;
+                }
+            }
+        }
+    }
+
+    Explosion& explosion = *slot;
     explosion.x = x;
     explosion.y = y;
     explosion.z = z;
@@ -596,7 +737,7 @@ void CreateExplosion(float x, float y, float z) {
 
     // Create particles
     for (int i = 0; i < PARTICLES_PER_EXPLOSION; i++) {
-        Particle particle;
+        Particle& particle = explosion.particles[i];
         particle.x = x;
         particle.y = y;
         particle.z = z;
@@ -619,11 +760,7 @@ void CreateExplosion(float x, float y, float z) {
         particle.r = 1.0f;
         particle.g = 0.5f + (rand() % 50) / 100.0f;  // Random orange variation
         particle.b = 0.0f;
-
-        explosion.particles.push_back(particle);
     }
-
-    explosions.push_back(explosion);
 }
 void UpdateAmmoBoxRotations() {
     float deltaTime = TIMER_INTERVAL / 1000.0f;
@@ -674,298 +811,215 @@ void SpawnAmmoBoxes() {
     }
 }
 
-void RenderSun() {
-    if (currentLevel != 1) return;  // Only render sun in first map
-
+// The sun's outer glow when the packet's detail is 1, its body when it's 0
+void DrawSun(const RenderPacket& packet) {
     glPushMatrix();
-    glDisable(GL_LIGHTING);  // Disable lighting for the sun
-    glDisable(GL_DEPTH_TEST);  // Make sure sun is always visible
-
-    // Use current sun position
     glTranslatef(currentSunPosition[0], currentSunPosition[1], currentSunPosition[2]);
+    gluSphere(sunQuadric, packet.detail ? SUN_VISUAL_SIZE * 1.2f : SUN_VISUAL_SIZE, 32, 32);
+    glPopMatrix();
+}
+
+void RenderSun() {
+    if (currentLevel != 1) return;  // Only render sun in first map
 
     // Calculate sun color based on sunset progress
     float redComponent = 1.0f;
     float greenComponent = 1.0f - (sunsetProgress * 0.5f);
     float blueComponent = 1.0f - (sunsetProgress * 0.8f);
 
-    // Make the sun glow
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-
-    // Draw outer glow
-    float glowSize = SUN_VISUAL_SIZE * 1.2f;
-    glColor4f(redComponent, greenComponent * 0.7f, blueComponent * 0.3f, 0.2f);
-    gluSphere(sunQuadric, glowSize, 32, 32);
-
-    // Draw main sun body
-    glColor3f(redComponent, greenComponent, blueComponent);
-    gluSphere(sunQuadric, SUN_VISUAL_SIZE, 32, 32);
-
-    glDisable(GL_BLEND);
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_LIGHTING);
-    glPopMatrix();
-}
-void RenderWall(const SceneObject& wall) {
-    glPushMatrix();
-    glTranslatef(wall.x, 0, wall.z);
-    glRotatef(wall.rotation, 0, 1, 0);
-    glScalef(wall.scale, wall.scale * 3.0f, wall.scale); // Scale y to make walls taller
-
-    glEnable(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, tex_wall.texture[0]);
-
-    glBegin(GL_QUADS);
-    // Front face
-    glTexCoord2f(0.0f, 0.0f); glVertex3f(-4.0f, 0.0f, 0.5f);
-    glTexCoord2f(2.0f, 0.0f); glVertex3f(4.0f, 0.0f, 0.5f);
-    glTexCoord2f(2.0f, 2.0f); glVertex3f(4.0f, 4.0f, 0.5f);
-    glTexCoord2f(0.0f, 2.0f); glVertex3f(-4.0f, 4.0f, 0.5f);
-
-    // Back face
-    glTexCoord2f(2.0f, 0.0f); glVertex3f(-4.0f, 0.0f, -0.5f);
-    glTexCoord2f(2.0f, 2.0f); glVertex3f(-4.0f, 4.0f, -0.5f);
-    glTexCoord2f(0.0f, 2.0f); glVertex3f(4.0f, 4.0f, -0.5f);
-    glTexCoord2f(0.0f, 0.0f); glVertex3f(4.0f, 0.0f, -0.5f);
-
-    // Top face
-    glTexCoord2f(0.0f, 0.0f); glVertex3f(-4.0f, 4.0f, -0.5f);
-    glTexCoord2f(0.0f, 1.0f); glVertex3f(-4.0f, 4.0f, 0.5f);
-    glTexCoord2f(2.0f, 1.0f); glVertex3f(4.0f, 4.0f, 0.5f);
-    glTexCoord2f(2.0f, 0.0f); glVertex3f(4.0f, 4.0f, -0.5f);
-
-    // Right face
-    glTexCoord2f(0.0f, 0.0f); glVertex3f(4.0f, 0.0f, -0.5f);
-    glTexCoord2f(0.0f, 2.0f); glVertex3f(4.0f, 4.0f, -0.5f);
-    glTexCoord2f(1.0f, 2.0f); glVertex3f(4.0f, 4.0f, 0.5f);
-    glTexCoord2f(1.0f, 0.0f); glVertex3f(4.0f, 0.0f, 0.5f);
-
-    // Left face
-    glTexCoord2f(0.0f, 0.0f); glVertex3f(-4.0f, 0.0f, -0.5f);
-    glTexCoord2f(1.0f, 0.0f); glVertex3f(-4.0f, 0.0f, 0.5f);
-    glTexCoord2f(1.0f, 2.0f); glVertex3f(-4.0f, 4.0f, 0.5f);
-    glTexCoord2f(0.0f, 2.0f); glVertex3f(-4.0f, 4.0f, -0.5f);
-    glEnd();
-
-    glDisable(GL_TEXTURE_2D);
-    glPopMatrix();
+    // Make the sun glow, always visible so it doesn't test depth
+    float distance = EyeDistance(currentSunPosition[0], currentSunPosition[1], currentSunPosition[2]);
+    RenderState glow = RenderState::Unlit(0).NoDepth().Blend(BLEND_ADD);
+    renderQueue.Submit(PASS_BLENDED, glow.Color(redComponent, greenComponent * 0.7f, blueComponent * 0.3f, 0.2f),
+        DrawSun, nullptr, nullptr, 1, distance);
+    renderQueue.Submit(PASS_BLENDED, glow.Color(redComponent, greenComponent, blueComponent),
+        DrawSun, nullptr, nullptr, 0, distance);
 }
 
+// Adds the game over screen to the HUD text, which is already in 2D
 void RenderGameOverScreen() {
-    // Switch to orthographic projection for 2D rendering
-    glMatrixMode(GL_PROJECTION);
-    glPushMatrix();
-    glLoadIdentity();
-    glOrtho(0, WIDTH, HEIGHT, 0, -1, 1);
-    glMatrixMode(GL_MODELVIEW);
-    glPushMatrix();
-    glLoadIdentity();
-
-    glDisable(GL_LIGHTING);
-    glDisable(GL_DEPTH_TEST);
-
-    // Draw darkened overlay
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-    // Semi-transparent black overlay
-    glColor4f(0.0f, 0.0f, 0.0f, 0.7f);
-    glBegin(GL_QUADS);
-    glVertex2f(0, 0);
-    glVertex2f(WIDTH, 0);
-    glVertex2f(WIDTH, HEIGHT);
-    glVertex2f(0, HEIGHT);
-    glEnd();
+    // Semi-transparent black overlay, drawn over the text before it
+    textBatch.Region(fontAtlas.Region(font_white));
+    textBatch.TexCoord(0.5f, 0.5f);
+    textBatch.Color(0.0f, 0.0f, 0.0f, 0.7f);
+    textBatch.QuadVertex(0, 0, 0);
+    textBatch.QuadVertex(WIDTH, 0, 0);
+    textBatch.QuadVertex(WIDTH, HEIGHT, 0);
+    textBatch.QuadVertex(0, HEIGHT, 0);
 
     // Draw game over message
-    std::string gameOverText;
     if (playerWon) {
-        glColor3f(0.0f, 1.0f, 0.0f);  // Green for win
-        gameOverText = "YOU WON!";
+        textBatch.Color(0.0f, 1.0f, 0.0f);  // Green for win
+        gameOverLayout.Set(&titleFont, "YOU WON!");
     }
     else {
-        glColor3f(1.0f, 0.0f, 0.0f);  // Red for loss
-        gameOverText = "YOU LOST!";
+        textBatch.Color(1.0f, 0.0f, 0.0f);  // Red for loss
+        gameOverLayout.Set(&titleFont, "YOU LOST!");
     }
 
-    // Calculate center position for text
-    void* font = GLUT_BITMAP_TIMES_ROMAN_24;
-    float textWidth = 0;
-    for (char c : gameOverText) {
-        textWidth += glutBitmapWidth(font, c);
-    }
-    float textX = (WIDTH - textWidth) / 2;
-    float textY = HEIGHT / 2;
+    // Centered on the screen
+    float textX = (float)((WIDTH - gameOverLayout.Width()) / 2);
+    float textY = (float)(HEIGHT / 2);
+    gameOverLayout.Add(&textBatch, textX, textY);
 
-    // Draw main message
-    glRasterPos2f(textX, textY);
-    for (char c : gameOverText) {
-        glutBitmapCharacter(font, c);
-    }
+    // Draw "Press ESC to exit" message below it
+    exitLayout.Set(&hudFont, "Press ESC to exit");
+    float exitTextX = (float)((WIDTH - exitLayout.Width()) / 2);
 
-    // Draw "Press ESC to exit" message
-    std::string exitText = "Press ESC to exit";
-    void* smallFont = GLUT_BITMAP_HELVETICA_18;
-    float exitTextWidth = 0;
-    for (char c : exitText) {
-        exitTextWidth += glutBitmapWidth(smallFont, c);
-    }
-    float exitTextX = (WIDTH - exitTextWidth) / 2;
+    textBatch.Color(1.0f, 1.0f, 1.0f);  // White color for exit message
+    exitLayout.Add(&textBatch, exitTextX, textY + 40);
+}
 
-    glColor3f(1.0f, 1.0f, 1.0f);  // White color for exit message
-    glRasterPos2f(exitTextX, textY + 40);  // Position below main message
-    for (char c : exitText) {
-        glutBitmapCharacter(smallFont, c);
+// Which color the box is, based on level and ammo type
+int AmmoBoxKindOf(const AmmoBox& box) {
+    if (currentLevel == 2) {
+        return box.isExplosive ? AMMO_EXPLOSIVE : AMMO_FAST_FIRE;
     }
-
-    glDisable(GL_BLEND);
-    glEnable(GL_LIGHTING);
-    glEnable(GL_DEPTH_TEST);
-
-    glMatrixMode(GL_PROJECTION);
-    glPopMatrix();
-    glMatrixMode(GL_MODELVIEW);
-    glPopMatrix();
+    return box.isHighDamage ? AMMO_HIGH_DAMAGE : AMMO_NORMAL;
 }
 
-void RenderAmmoBox(const AmmoBox& box) {
-    if (!box.active) return;
-
-    glPushMatrix();
-    glTranslatef(box.x, box.y, box.z);
-    glRotatef(box.rotation, 0, 1, 0);
-    glScalef(box.scale, box.scale, box.scale);
+// An ammo box around the origin, where the batch's transform puts it
+void AddAmmoBoxShape(AtlasBatch& batch, int kind) {
+    // Ammo boxes are untextured so they use the white part of the atlas
+    batch.Region(atlas.Region(atlas_white));
+    batch.TexCoord(0.5f, 0.5f);
 
-    // Set color based on level and ammo type
-    if (currentLevel == 2) {
-        if (box.isExplosive) {
-            glColor3f(1.0f, 1.0f, 0.0f);  // Yellow for explosive ammo
-        }
-        else {
-            glColor3f(0.0f, 0.8f, 0.0f);  // Green for fast fire ammo
-        }
+    if (kind == AMMO_EXPLOSIVE) {
+        batch.Color(1.0f, 1.0f, 0.0f);  // Yellow for explosive ammo
+    }
+    else if (kind == AMMO_FAST_FIRE) {
+        batch.Color(0.0f, 0.8f, 0.0f);  // Green for fast fire ammo
+    }
+    else if (kind == AMMO_HIGH_DAMAGE) {
+        batch.Color(0.45f, 0.05f, 0.05f);  // Darker rusty red
     }
     else {
-        if (box.isHighDamage) {
-            glColor3f(0.45f, 0.05f, 0.05f);  // Darker rusty red
-        }
-        else {
-            glColor3f(0.05f, 0.05f, 0.35f);  // Darker rusty blue
-        }
+        batch.Color(0.05f, 0.05f, 0.35f);  // Darker rusty blue
     }
 
     // Draw main box body
-    glBegin(GL_QUADS);
     // Front face
-    glVertex3f(-1.0f, -1.0f, 1.0f);
-    glVertex3f(1.0f, -1.0f, 1.0f);
-    glVertex3f(1.0f, 1.0f, 1.0f);
-    glVertex3f(-1.0f, 1.0f, 1.0f);
+    batch.QuadVertex(-1.0f, -1.0f, 1.0f);
+    batch.QuadVertex(1.0f, -1.0f, 1.0f);
+    batch.QuadVertex(1.0f, 1.0f, 1.0f);
+    batch.QuadVertex(-1.0f, 1.0f, 1.0f);
 
     // Back face
-    glVertex3f(-1.0f, -1.0f, -1.0f);
-    glVertex3f(-1.0f, 1.0f, -1.0f);
-    glVertex3f(1.0f, 1.0f, -1.0f);
-    glVertex3f(1.0f, -1.0f, -1.0f);
+    batch.QuadVertex(-1.0f, -1.0f, -1.0f);
+    batch.QuadVertex(-1.0f, 1.0f, -1.0f);
+    batch.QuadVertex(1.0f, 1.0f, -1.0f);
+    batch.QuadVertex(1.0f, -1.0f, -1.0f);
 
     // Top face
-    glVertex3f(-1.0f, 1.0f, -1.0f);
-    glVertex3f(-1.0f, 1.0f, 1.0f);
-    glVertex3f(1.0f, 1.0f, 1.0f);
-    glVertex3f(1.0f, 1.0f, -1.0f);
+    batch.QuadVertex(-1.0f, 1.0f, -1.0f);
+    batch.QuadVertex(-1.0f, 1.0f, 1.0f);
+    batch.QuadVertex(1.0f, 1.0f, 1.0f);
+    batch.QuadVertex(1.0f, 1.0f, -1.0f);
 
     // Bottom face
-    glVertex3f(-1.0f, -1.0f, -1.0f);
-    glVertex3f(1.0f, -1.0f, -1.0f);
-    glVertex3f(1.0f, -1.0f, 1.0f);
-    glVertex3f(-1.0f, -1.0f, 1.0f);
+    batch.QuadVertex(-1.0f, -1.0f, -1.0f);
+    batch.QuadVertex(1.0f, -1.0f, -1.0f);
+    batch.QuadVertex(1.0f, -1.0f, 1.0f);
+    batch.QuadVertex(-1.0f, -1.0f, 1.0f);
 
     // Right face
-    glVertex3f(1.0f, -1.0f, -1.0f);
-    glVertex3f(1.0f, 1.0f, -1.0f);
-    glVertex3f(1.0f, 1.0f, 1.0f);
-    glVertex3f(1.0f, -1.0f, 1.0f);
+    batch.QuadVertex(1.0f, -1.0f, -1.0f);
+    batch.QuadVertex(1.0f, 1.0f, -1.0f);
+    batch.QuadVertex(1.0f, 1.0f, 1.0f);
+    batch.QuadVertex(1.0f, -1.0f, 1.0f);
 
     // Left face
-    glVertex3f(-1.0f, -1.0f, -1.0f);
-    glVertex3f(-1.0f, -1.0f, 1.0f);
-    glVertex3f(-1.0f, 1.0f, 1.0f);
-    glVertex3f(-1.0f, 1.0f, -1.0f);
-    glEnd();
+    batch.QuadVertex(-1.0f, -1.0f, -1.0f);
+    batch.QuadVertex(-1.0f, -1.0f, 1.0f);
+    batch.QuadVertex(-1.0f, 1.0f, 1.0f);
+    batch.QuadVertex(-1.0f, 1.0f, -1.0f);
 
     // Draw metallic edges/trim with darker, rustier color
-    glColor3f(0.4f, 0.4f, 0.4f);  // Darker metallic color for rusty look
+    batch.Color(0.4f, 0.4f, 0.4f);  // Darker metallic color for rusty look
     float trim = 0.1f;
 
-    glBegin(GL_QUADS);
     // Front trim
-    glVertex3f(-1.0f - trim, -1.0f - trim, 1.0f + trim);
-    glVertex3f(1.0f + trim, -1.0f - trim, 1.0f + trim);
-    glVertex3f(1.0f + trim, -1.0f, 1.0f + trim);
-    glVertex3f(-1.0f - trim, -1.0f, 1.0f + trim);
+    batch.QuadVertex(-1.0f - trim, -1.0f - trim, 1.0f + trim);
+    batch.QuadVertex(1.0f + trim, -1.0f - trim, 1.0f + trim);
+    batch.QuadVertex(1.0f + trim, -1.0f, 1.0f + trim);
+    batch.QuadVertex(-1.0f - trim, -1.0f, 1.0f + trim);
 
     // Top trim
-    glVertex3f(-1.0f - trim, 1.0f, 1.0f + trim);
-    glVertex3f(1.0f + trim, 1.0f, 1.0f + trim);
-    glVertex3f(1.0f + trim, 1.0f + trim, 1.0f + trim);
-    glVertex3f(-1.0f - trim, 1.0f + trim, 1.0f + trim);
-    glEnd();
-
-    // Draw text for ammo type
-    if (currentLevel == 2) {
-        if (box.isExplosive) {
-            // Draw "EXPLOSIVE" text
-            glRasterPos3f(-0.8f, 0.0f, 1.02f);
-            std::string text = "EXPLOSIVE";
-            for (char c : text) {
-                glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, c);
-            }
-        }
-        else {
-            // Draw "FAST FIRE" text
-            glRasterPos3f(-0.6f, 0.0f, 1.02f);
-            std::string text = "FAST FIRE";
-            for (char c : text) {
-                glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, c);
-            }
-        }
-    }
+    batch.QuadVertex(-1.0f - trim, 1.0f, 1.0f + trim);
+    batch.QuadVertex(1.0f + trim, 1.0f, 1.0f + trim);
+    batch.QuadVertex(1.0f + trim, 1.0f + trim, 1.0f + trim);
+    batch.QuadVertex(-1.0f - trim, 1.0f + trim, 1.0f + trim);
 
     // Draw bullet symbol
-    glBegin(GL_QUADS);
     float symbolSize = 0.3f;
-    glVertex3f(-symbolSize, -0.5f, 1.01f);
-    glVertex3f(symbolSize, -0.5f, 1.01f);
-    glVertex3f(symbolSize, 0.5f, 1.01f);
-    glVertex3f(-symbolSize, 0.5f, 1.01f);
+    batch.QuadVertex(-symbolSize, -0.5f, 1.01f);
+    batch.QuadVertex(symbolSize, -0.5f, 1.01f);
+    batch.QuadVertex(symbolSize, 0.5f, 1.01f);
+    batch.QuadVertex(-symbolSize, 0.5f, 1.01f);
 
     // Draw bullet tip
-    glVertex3f(-symbolSize * 0.7f, 0.5f, 1.01f);
-    glVertex3f(symbolSize * 0.7f, 0.5f, 1.01f);
-    glVertex3f(0.0f, 0.8f, 1.01f);
-    glVertex3f(0.0f, 0.8f, 1.01f);
-    glEnd();
+    batch.QuadVertex(-symbolSize * 0.7f, 0.5f, 1.01f);
+    batch.QuadVertex(symbolSize * 0.7f, 0.5f, 1.01f);
+    batch.QuadVertex(0.0f, 0.8f, 1.01f);
+    batch.QuadVertex(0.0f, 0.8f, 1.01f);
 
     // Add highlights with darker color for rusty appearance
-    glColor3f(0.7f, 0.7f, 0.7f);  // Darker highlights
-    glBegin(GL_LINES);
-    glVertex3f(-1.0f, -1.0f, 1.01f);
-    glVertex3f(-1.0f, 1.0f, 1.01f);
+    batch.Color(0.7f, 0.7f, 0.7f);  // Darker highlights
+    batch.LineVertex(-1.0f, -1.0f, 1.01f);
+    batch.LineVertex(-1.0f, 1.0f, 1.01f);
 
-    glVertex3f(1.0f, -1.0f, 1.01f);
-    glVertex3f(1.0f, 1.0f, 1.01f);
+    batch.LineVertex(1.0f, -1.0f, 1.01f);
+    batch.LineVertex(1.0f, 1.0f, 1.01f);
 
-    glVertex3f(-1.0f, 1.0f, 1.01f);
-    glVertex3f(1.0f, 1.0f, 1.01f);
+    batch.LineVertex(-1.0f, 1.0f, 1.01f);
+    batch.LineVertex(1.0f, 1.0f, 1.01f);
 
-    glVertex3f(-1.0f, -1.0f, 1.01f);
-    glVertex3f(1.0f, -1.0f, 1.01f);
-    glEnd();
+    batch.LineVertex(-1.0f, -1.0f, 1.01f);
+    batch.LineVertex(1.0f, -1.0f, 1.01f);
+}
+
+void RenderAmmoBox(const AmmoBox& box) {
+    if (!box.active) return;
+
+    worldBatch.Transform(box.x, box.y, box.z, box.rotation, box.scale);
+    AddAmmoBoxShape(worldBatch, AmmoBoxKindOf(box));
+}
+
+// The ammo type text is a bitmap font so it can't go in the batch
+void DrawAmmoBoxLabel(const RenderPacket& packet) {
+    const AmmoBox& box = *(const AmmoBox*)packet.object;
+
+    glPushMatrix();
+    glTranslatef(box.x, box.y, box.z);
+    glRotatef(box.rotation, 0, 1, 0);
+    glScalef(box.scale, box.scale, box.scale);
+
+    if (box.isExplosive) {
+        // Draw "EXPLOSIVE" text
+        glRasterPos3f(-0.8f, 0.0f, 1.02f);
+        for (const char* c = "EXPLOSIVE"; *c; c++) {
+            glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, *c);
+        }
+    }
+    else {
+        // Draw "FAST FIRE" text
+        glRasterPos3f(-0.6f, 0.0f, 1.02f);
+        for (const char* c = "FAST FIRE"; *c; c++) {
+            glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, *c);
+        }
+    }
 
     glPopMatrix();
 }
 
+void RenderAmmoBoxLabel(const AmmoBox& box) {
+    if (!box.active || currentLevel != 2) return;
+
+    // Same color as the trim, which the text has always picked up
+    renderQueue.Submit(PASS_OPAQUE, RenderState::Lit(0).Color(0.4f, 0.4f, 0.4f), DrawAmmoBoxLabel, &box, nullptr, 0,
+        EyeDistance(box.x, box.y, box.z));
+}
+
 void CheckGameState() {
     if (gameOver) return;
 
@@ -1014,76 +1068,31 @@ void CheckGameState() {
         playerWon = false;
     }
 }
-void RenderDoor() {
-    if (!doorSpawned || !levelDoor.active) return;
-
+// The frame, the door and its handle, each with its own color
+void DrawDoor(const RenderPacket& packet) {
     glPushMatrix();
     glTranslatef(levelDoor.x, levelDoor.y, levelDoor.z);
     glRotatef(levelDoor.rotation, 0, 1, 0);
     glScalef(levelDoor.scale, levelDoor.scale, levelDoor.scale);
+    ((StaticMesh*)packet.resource)->Draw();
+    glPopMatrix();
+}
 
-    // Door frame
-    glColor3f(0.5f, 0.3f, 0.1f);  // Brown color for wooden frame
-    glBegin(GL_QUADS);
-    // Left post
-    glVertex3f(-1.2f, -1.0f, 0.0f);
-    glVertex3f(-1.0f, -1.0f, 0.0f);
-    glVertex3f(-1.0f, 2.0f, 0.0f);
-    glVertex3f(-1.2f, 2.0f, 0.0f);
-
-    // Right post
-    glVertex3f(1.0f, -1.0f, 0.0f);
-    glVertex3f(1.2f, -1.0f, 0.0f);
-    glVertex3f(1.2f, 2.0f, 0.0f);
-    glVertex3f(1.0f, 2.0f, 0.0f);
-
-    // Top beam
-    glVertex3f(-1.2f, 2.0f, 0.0f);
-    glVertex3f(1.2f, 2.0f, 0.0f);
-    glVertex3f(1.2f, 2.2f, 0.0f);
-    glVertex3f(-1.2f, 2.2f, 0.0f);
-    glEnd();
-
-    // Door itself
-    glColor3f(0.3f, 0.2f, 0.1f);  // Darker brown for the door
-    glBegin(GL_QUADS);
-    glVertex3f(-1.0f, -1.0f, 0.0f);
-    glVertex3f(1.0f, -1.0f, 0.0f);
-    glVertex3f(1.0f, 2.0f, 0.0f);
-    glVertex3f(-1.0f, 2.0f, 0.0f);
-    glEnd();
+void RenderDoor() {
+    if (!doorSpawned || !levelDoor.active) return;
 
-    // Door handle
-    glColor3f(0.8f, 0.8f, 0.8f);  // Metallic color
-    glPushMatrix();
-    glTranslatef(0.7f, 0.0f, 0.1f);
-    glBegin(GL_QUADS);
-    glVertex3f(-0.1f, -0.1f, 0.0f);
-    glVertex3f(0.1f, -0.1f, 0.0f);
-    glVertex3f(0.1f, 0.1f, 0.0f);
-    glVertex3f(-0.1f, 0.1f, 0.0f);
-    glEnd();
-    glPopMatrix();
+    float distance = EyeDistance(levelDoor.x, levelDoor.y, levelDoor.z);
+    renderQueue.Submit(PASS_OPAQUE, RenderState::Lit(0), DrawDoor, &levelDoor, &mesh_door, 0, distance);
 
     // Add a glowing effect when player is near
     float dx = playerX - levelDoor.x;
     float dz = playerZ - levelDoor.z;
     float distanceSquared = dx * dx + dz * dz;
     if (distanceSquared < (levelDoor.INTERACTION_RADIUS * 2) * (levelDoor.INTERACTION_RADIUS * 2)) {
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE);
         float alpha = 0.3f * (1.0f - (sqrt(distanceSquared) / (levelDoor.INTERACTION_RADIUS * 2)));
-        glColor4f(0.0f, 1.0f, 1.0f, alpha);  // Cyan glow
-        glBegin(GL_QUADS);
-        glVertex3f(-1.5f, -1.5f, 0.0f);
-        glVertex3f(1.5f, -1.5f, 0.0f);
-        glVertex3f(1.5f, 2.5f, 0.0f);
-        glVertex3f(-1.5f, 2.5f, 0.0f);
-        glEnd();
-        glDisable(GL_BLEND);
+        RenderState glow = RenderState::Lit(0).Blend(BLEND_ADD).Color(0.0f, 1.0f, 1.0f, alpha);  // Cyan glow
+        renderQueue.Submit(PASS_BLENDED, glow, DrawDoor, &levelDoor, &mesh_glow, 0, distance);
     }
-
-    glPopMatrix();
 }
 
 void CheckAmmoBoxCollection() {
@@ -1128,15 +1137,15 @@ void SpawnTargets() {
 
     if (currentLevel == 1) {
         // Original Level 1 tree-based target spawning
-        std::vector<int> availableTrees;
+        freeSpots.clear();
         for (int i = 0; i < treePositions.size(); i++) {
-            availableTrees.push_back(i);
+            freeSpots.push_back(i);
         }
 
-        for (int i = 0; i < NUM_TARGETS && !availableTrees.empty(); i++) {
-            int randomIndex = rand() % availableTrees.size();
-            int treeIndex = availableTrees[randomIndex];
-            availableTrees.erase(availableTrees.begin() + randomIndex);
+        for (int i = 0; i < NUM_TARGETS && !freeSpots.empty(); i++) {
+            int randomIndex = rand() % freeSpots.size();
+            int treeIndex = freeSpots[randomIndex];
+            freeSpots.erase(freeSpots.begin() + randomIndex);
 
             Target target;
             const SceneObject& tree = treePositions[treeIndex];
@@ -1157,15 +1166,15 @@ void SpawnTargets() {
     }
     else {
         // Level 2: Wall-mounted targets
-        std::vector<int> availableWalls;
+        freeSpots.clear();
         for (int i = 0; i < treePositions.size(); i++) {
-            availableWalls.push_back(i);
+            freeSpots.push_back(i);
         }
 
-        for (int i = 0; i < NUM_TARGETS && !availableWalls.empty(); i++) {
-            int randomIndex = rand() % availableWalls.size();
-            int wallIndex = availableWalls[randomIndex];
-            availableWalls.erase(availableWalls.begin() + randomIndex);
+        for (int i = 0; i < NUM_TARGETS && !freeSpots.empty(); i++) {
+            int randomIndex = rand() % freeSpots.size();
+            int wallIndex = freeSpots[randomIndex];
+            freeSpots.erase(freeSpots.begin() + randomIndex);
 
             Target target;
             const SceneObject& wall = treePositions[wallIndex];
@@ -1198,70 +1207,74 @@ void SpawnTargets() {
     }
 }
 
-void RenderTarget(const Target& target) {
-    if (!target.active) return;
-
-    glPushMatrix();
-    glTranslatef(target.x, target.y, target.z);
-    glRotatef(target.rotation, 0, 1, 0);
-
-    glEnable(GL_TEXTURE_2D);
+// A target facing down z around the origin, where the batch's transform puts it
+void AddTargetShape(AtlasBatch& batch, int level) {
+    batch.Color(1.0f, 1.0f, 1.0f);
 
     // Use different textures based on level
-    if (currentLevel == 1) {
-        glBindTexture(GL_TEXTURE_2D, tex_target.texture[0]);
+    if (level == 1) {
+        batch.Region(atlas.Region(atlas_target));
     }
     else {
-        glBindTexture(GL_TEXTURE_2D, tex_mtarget.texture[0]);
+        batch.Region(atlas.Region(atlas_mtarget));
     }
 
     // Draw target with adjusted size based on level
-    float size = (currentLevel == 1) ? 0.5f : 0.4f;
+    float size = (level == 1) ? 0.5f : 0.4f;
 
-    glBegin(GL_QUADS);
-    glTexCoord2f(0.0f, 0.0f); glVertex3f(-size, -size, 0.0f);
-    glTexCoord2f(1.0f, 0.0f); glVertex3f(size, -size, 0.0f);
-    glTexCoord2f(1.0f, 1.0f); glVertex3f(size, size, 0.0f);
-    glTexCoord2f(0.0f, 1.0f); glVertex3f(-size, size, 0.0f);
-    glEnd();
+    batch.Rect(-size, -size, size, size, 0.0f);
 
     // Add metallic frame for level 2 targets
-    if (currentLevel == 2) {
-        glDisable(GL_TEXTURE_2D);
-        glColor3f(0.7f, 0.7f, 0.7f); // Metallic color
+    if (level == 2) {
+        batch.Region(atlas.Region(atlas_white));
+        batch.TexCoord(0.5f, 0.5f);
+        batch.Color(0.7f, 0.7f, 0.7f); // Metallic color
 
         float frameWidth = 0.05f;
-        glBegin(GL_QUADS);
         // Top frame
-        glVertex3f(-size - frameWidth, size, 0.0f);
-        glVertex3f(size + frameWidth, size, 0.0f);
-        glVertex3f(size + frameWidth, size + frameWidth, 0.0f);
-        glVertex3f(-size - frameWidth, size + frameWidth, 0.0f);
+        batch.QuadVertex(-size - frameWidth, size, 0.0f);
+        batch.QuadVertex(size + frameWidth, size, 0.0f);
+        batch.QuadVertex(size + frameWidth, size + frameWidth, 0.0f);
+        batch.QuadVertex(-size - frameWidth, size + frameWidth, 0.0f);
 
         // Bottom frame
-        glVertex3f(-size - frameWidth, -size - frameWidth, 0.0f);
-        glVertex3f(size + frameWidth, -size - frameWidth, 0.0f);
-        glVertex3f(size + frameWidth, -size, 0.0f);
-        glVertex3f(-size - frameWidth, -size, 0.0f);
+        batch.QuadVertex(-size - frameWidth, -size - frameWidth, 0.0f);
+        batch.QuadVertex(size + frameWidth, -size - frameWidth, 0.0f);
+        batch.QuadVertex(size + frameWidth, -size, 0.0f);
+        batch.QuadVertex(-size - frameWidth, -size, 0.0f);
 
         // Left frame
-        glVertex3f(-size - frameWidth, -size - frameWidth, 0.0f);
-        glVertex3f(-size, -size - frameWidth, 0.0f);
-        glVertex3f(-size, size + frameWidth, 0.0f);
-        glVertex3f(-size - frameWidth, size + frameWidth, 0.0f);
+        batch.QuadVertex(-size - frameWidth, -size - frameWidth, 0.0f);
+        batch.QuadVertex(-size, -size - frameWidth, 0.0f);
+        batch.QuadVertex(-size, size + frameWidth, 0.0f);
+        batch.QuadVertex(-size - frameWidth, size + frameWidth, 0.0f);
 
         // Right frame
-        glVertex3f(size, -size - frameWidth, 0.0f);
-        glVertex3f(size + frameWidth, -size - frameWidth, 0.0f);
-        glVertex3f(size + frameWidth, size + frameWidth, 0.0f);
-        glVertex3f(size, size + frameWidth, 0.0f);
-        glEnd();
+        batch.QuadVertex(size, -size - frameWidth, 0.0f);
+        batch.QuadVertex(size + frameWidth, -size - frameWidth, 0.0f);
+        batch.QuadVertex(size + frameWidth, size + frameWidth, 0.0f);
+        batch.QuadVertex(size, size + frameWidth, 0.0f);
+    }
+}
+
+void RenderTarget(const Target& target) {
+    if (!target.active) return;
 
-        glColor3f(1.0f, 1.0f, 1.0f); // Reset color
+    worldBatch.Transform(target.x, target.y, target.z, target.rotation, 1.0f);
+    AddTargetShape(worldBatch, currentLevel);
+}
+
+// Targets and ammo boxes all come from the atlas so they're one batch
+void FillWorldBatch() {
+    worldBatch.Begin();
+    for (const auto& target : targets) {
+        RenderTarget(target);
     }
 
-    glDisable(GL_TEXTURE_2D);
-    glPopMatrix();
+    // Draw ammo boxes
+    for (const auto& box : ammoBoxes) {
+        RenderAmmoBox(box);
+    }
 }
 
 bool checkCollision(float newX, float newZ) {
@@ -1285,7 +1298,7 @@ bool checkCollision(float newX, float newZ) {
             float localX = dx * cos(wallRotation) + dz * sin(wallRotation);
             float localZ = -dx * sin(wallRotation) + dz * cos(wallRotation);
 
-            // Use exact same dimensions as in RenderWall
+            // Use exact same dimensions as wallCorners
             float wallHalfLength = 4.0f * obj.scale;  // Half of wall length (+-4.0f in render)
             float wallHalfThickness = 0.5f * obj.scale;  // Half of wall thickness (+-0.5f in render)
 
@@ -1303,7 +1316,7 @@ bool checkCollision(float newX, float newZ) {
 }
 
 void checkRockDamage() {
-    float currentTime = glutGet(GLUT_ELAPSED_TIME) / 1000.0f;
+    float currentTime = simulationTime;
 
     // Only check for damage if enough time has passed since last damage
     if (currentTime - lastDamageTime < DAMAGE_COOLDOWN) {
@@ -1318,7 +1331,7 @@ void checkRockDamage() {
         float minDistance = ROCK_COLLISION_RADIUS * rock.scale;
 
         if (distanceSquared < minDistance * minDistance && playerY <= 0.1f) {
-            playGameSounds("damage");  // Move this up, before changing health
+            playGameSounds(SOUND_DAMAGE);  // Move this up, before changing health
             playerHealth -= ROCK_DAMAGE;
             if (playerHealth < 0) {
                 playerHealth = 0;
@@ -1351,7 +1364,7 @@ void CheckBulletTargetCollisions() {
                 target.active = false;
                 bullet.active = false;
                 playerScore++;
-                playGameSounds("hit");
+                playGameSoundsAt(SOUND_HIT, target.x, target.y, target.z);
 
                 bool allTargetsHit = true;
                 for (const auto& t : targets) {
@@ -1425,13 +1438,31 @@ void UpdateExplosions() {
     }
 }
 
+void DrawParticle(const RenderPacket& packet) {
+    const Particle& particle = *(const Particle*)packet.object;
+
+    glPushMatrix();
+    glTranslatef(particle.x, particle.y, particle.z);
+
+    // Make particles always face the camera
+    float dx = particle.x - Eye.x;
+    float dz = particle.z - Eye.z;
+    float angle = atan2(dx, dz) * 180.0f / 3.14159f;
+    glRotatef(angle, 0, 1, 0);
+
+    // Draw particle as a quad
+    glBegin(GL_QUADS);
+    glVertex3f(-particle.size, -particle.size, 0);
+    glVertex3f(particle.size, -particle.size, 0);
+    glVertex3f(particle.size, particle.size, 0);
+    glVertex3f(-particle.size, particle.size, 0);
+    glEnd();
+
+    glPopMatrix();
+}
+
 // Add this function to render explosions
 void RenderExplosions() {
-    glDisable(GL_LIGHTING);
-    glDisable(GL_TEXTURE_2D);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
     for (const auto& explosion : explosions) {
         if (!explosion.active) continue;
 
@@ -1441,201 +1472,246 @@ void RenderExplosions() {
             // Calculate alpha based on lifetime
             float alpha = 1.0f - (particle.lifetime / particle.maxLifetime);
 
-            glPushMatrix();
-            glTranslatef(particle.x, particle.y, particle.z);
-
-            // Make particles always face the camera
-            float dx = particle.x - Eye.x;
-            float dy = particle.y - Eye.y;
-            float dz = particle.z - Eye.z;
-            float angle = atan2(dx, dz) * 180.0f / 3.14159f;
-            glRotatef(angle, 0, 1, 0);
-
-            glColor4f(particle.r, particle.g, particle.b, alpha);
-
-            // Draw particle as a quad
-            glBegin(GL_QUADS);
-            glVertex3f(-particle.size, -particle.size, 0);
-            glVertex3f(particle.size, -particle.size, 0);
-            glVertex3f(particle.size, particle.size, 0);
-            glVertex3f(-particle.size, particle.size, 0);
-            glEnd();
-
-            glPopMatrix();
+            RenderState state = RenderState::Unlit(0).Blend(BLEND_ALPHA).Color(particle.r, particle.g, particle.b, alpha);
+            renderQueue.Submit(PASS_BLENDED, state, DrawParticle, &particle, nullptr, 0,
+                EyeDistance(particle.x, particle.y, particle.z));
         }
     }
-
-    glEnable(GL_LIGHTING);
-    glDisable(GL_BLEND);
 }
-void RenderUI() {
-    glMatrixMode(GL_PROJECTION);
-    glPushMatrix();
-    glLoadIdentity();
-    glOrtho(0, WIDTH, HEIGHT, 0, -1, 1);
-    glMatrixMode(GL_MODELVIEW);
-    glPushMatrix();
-    glLoadIdentity();
-
-    glDisable(GL_LIGHTING);
-    glDisable(GL_DEPTH_TEST);
+// Fills the HUD batches: the bars and crosshair from the atlas, and all
+// the text. Nothing here touches OpenGL so both paths can draw them
+void FillHud() {
+    // The bars go in the atlas batch with the crosshair
+    uiBatch.Begin();
+    uiBatch.Region(atlas.Region(atlas_white));
+    uiBatch.TexCoord(0.5f, 0.5f);
 
     // Health bar background
-    glColor3f(0.0f, 0.0f, 0.0f);
-    glBegin(GL_QUADS);
-    glVertex2f(20, 20);
-    glVertex2f(220, 20);
-    glVertex2f(220, 40);
-    glVertex2f(20, 40);
-    glEnd();
+    uiBatch.Color(0.0f, 0.0f, 0.0f);
+    uiBatch.QuadVertex(20, 20, 0);
+    uiBatch.QuadVertex(220, 20, 0);
+    uiBatch.QuadVertex(220, 40, 0);
+    uiBatch.QuadVertex(20, 40, 0);
 
     // Health bar
     float healthWidth = playerHealth * 2;
     if (playerHealth >= 75) {
-        glColor3f(0.0f, 1.0f, 0.0f);
+        uiBatch.Color(0.0f, 1.0f, 0.0f);
     }
     else if (playerHealth >= 30) {
-        glColor3f(1.0f, 1.0f, 0.0f);
+        uiBatch.Color(1.0f, 1.0f, 0.0f);
     }
     else {
-        glColor3f(1.0f, 0.0f, 0.0f);
+        uiBatch.Color(1.0f, 0.0f, 0.0f);
     }
 
-    glBegin(GL_QUADS);
-    glVertex2f(20, 20);
-    glVertex2f(20 + healthWidth, 20);
-    glVertex2f(20 + healthWidth, 40);
-    glVertex2f(20, 40);
-    glEnd();
-
-    // Score
-    glColor3f(1.0f, 1.0f, 1.0f);
-    glRasterPos2f(20, 60);
-    std::string scoreText = "Score: " + std::to_string(playerScore) + "/" + std::to_string(WINNING_SCORE);
-    for (char c : scoreText) {
-        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, c);
-    }
-
-    glColor3f(1.0f, 1.0f, 1.0f);
-    glRasterPos2f(20, 120);
-    std::string levelText = "Level: " + std::to_string(currentLevel);
-    for (char c : levelText) {
-        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, c);
-    }
-
-    // Level completion message
-    if (levelCompleted) {
-        std::string completionText = "Level " + std::to_string(currentLevel - 1) +
-            " Complete! Starting Level " + std::to_string(currentLevel);
-
-        // Calculate text position to center it
-        float textWidth = completionText.length() * 9.0f;
-        float textX = (WIDTH - textWidth) / 2;
-        float textY = HEIGHT / 2;
-
-        glColor3f(0.0f, 1.0f, 0.0f);
-        glRasterPos2f(textX, textY);
-        for (char c : completionText) {
-            glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, c);
-        }
-
-        // Reset level completion flag after a short delay
-        if (glutGet(GLUT_ELAPSED_TIME) % 3000 > 2000) {  // Show message for 2 seconds
-            levelCompleted = false;
-        }
-    }
+    uiBatch.QuadVertex(20, 20, 0);
+    uiBatch.QuadVertex(20 + healthWidth, 20, 0);
+    uiBatch.QuadVertex(20 + healthWidth, 40, 0);
+    uiBatch.QuadVertex(20, 40, 0);
 
-    // Ammo display
-    glColor3f(1.0f, 1.0f, 1.0f);
-    glRasterPos2f(20, 80);
-    std::string ammoText = "Ammo: " + std::to_string(currentAmmo) + "/" + std::to_string(MAX_AMMO);
-    ammoText += " (Reserves: " + std::to_string(ammoReserves) + ")";
+    // Crosshair
+    if (isAiming) {
+        uiBatch.Color(1.0f, 1.0f, 1.0f);
+
+        int centerX = WIDTH / 2;
+        int centerY = HEIGHT / 2;
+        int size = 10;
+        int thickness = 2;
+
+        // Horizontal line
+        uiBatch.QuadVertex(centerX - size, centerY - thickness / 2, 0);
+        uiBatch.QuadVertex(centerX + size, centerY - thickness / 2, 0);
+        uiBatch.QuadVertex(centerX + size, centerY + thickness / 2, 0);
+        uiBatch.QuadVertex(centerX - size, centerY + thickness / 2, 0);
+
+        // Vertical line
+        uiBatch.QuadVertex(centerX - thickness / 2, centerY - size, 0);
+        uiBatch.QuadVertex(centerX + thickness / 2, centerY - size, 0);
+        uiBatch.QuadVertex(centerX + thickness / 2, centerY + size, 0);
+        uiBatch.QuadVertex(centerX - thickness / 2, centerY + size, 0);
+    }
+
+    // All the text goes in one batch. The layouts only do any work
+    // when what they say has changed since the last frame
+    textBatch.Begin();
+    textBatch.Color(1.0f, 1.0f, 1.0f);
+
+    // Only the lines whose numbers changed get formatted again
+    HudState state;
+    state.score = playerScore;
+    state.winningScore = WINNING_SCORE;
+    state.level = currentLevel;
+    state.ammo = currentAmmo;
+    state.maxAmmo = MAX_AMMO;
+    state.reserves = ammoReserves;
+    state.reloading = isReloading;
+    state.seconds = static_cast<int>(gameTimer);
 
     // Add ammo type indicator
     if (currentLevel == 2) {
         if (currentBulletDamage == EXPLOSIVE_DAMAGE) {
-            ammoText += " [EXPLOSIVE]";
+            state.ammoType = HUD_AMMO_EXPLOSIVE;
         }
         else if (shootingCooldown == FAST_FIRE_COOLDOWN) {
-            ammoText += " [FAST FIRE]";
+            state.ammoType = HUD_AMMO_FAST_FIRE;
         }
         else {
-            ammoText += " [NORMAL]";
+            state.ammoType = HUD_AMMO_NORMAL;
         }
     }
     else {
-        ammoText += (currentBulletDamage == HIGH_DAMAGE) ? " [High Damage]" : " [Regular]";
+        state.ammoType = (currentBulletDamage == HIGH_DAMAGE) ? HUD_AMMO_HIGH_DAMAGE : HUD_AMMO_REGULAR;
     }
 
-    if (isReloading) {
-        ammoText += " (Reloading...)";
-    }
+    hud.Update(state);
 
-    for (char c : ammoText) {
-        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, c);
-    }
+    hud.score.Add(&textBatch, 20, 60);
+    hud.ammo.Add(&textBatch, 20, 80);
+    hud.timer.Add(&textBatch, 20, 100);
+    hud.level.Add(&textBatch, 20, 120);
+
+    // Level completion message
+    if (levelCompleted) {
+        // Calculate text position to center it
+        float textX = (float)((WIDTH - hud.completion.Width()) / 2);
+        float textY = (float)(HEIGHT / 2);
 
+        textBatch.Color(0.0f, 1.0f, 0.0f);
+        hud.completion.Add(&textBatch, textX, textY);
+        textBatch.Color(1.0f, 1.0f, 1.0f);
 
-    // Timer display
-    glColor3f(1.0f, 1.0f, 1.0f);
-    glRasterPos2f(20, 100);
-    int minutes = static_cast<int>(gameTimer) / 60;
-    int seconds = static_cast<int>(gameTimer) % 60;
-    std::string timerText = "Time: " + std::to_string(minutes) + ":" +
-        (seconds < 10 ? "0" : "") + std::to_string(seconds);
-    for (char c : timerText) {
-        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, c);
+        // Reset level completion flag after a short delay
+        if (glutGet(GLUT_ELAPSED_TIME) % 3000 > 2000) {  // Show message for 2 seconds
+            levelCompleted = false;
+        }
     }
 
     // Game over message (centered on screen)
     if (gameOver) {
         RenderGameOverScreen();
     }
+}
 
-    glEnable(GL_LIGHTING);
-    glEnable(GL_DEPTH_TEST);
+// The UI pass draws in pixels
+void BeginUIPass() {
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glOrtho(0, WIDTH, HEIGHT, 0, -1, 1);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+}
+
+void EndUIPass() {
     glMatrixMode(GL_PROJECTION);
     glPopMatrix();
     glMatrixMode(GL_MODELVIEW);
     glPopMatrix();
 }
 
-void RenderGround() {
-    glDisable(GL_LIGHTING);
-    glColor3f(0.6, 0.6, 0.6);
-    glEnable(GL_TEXTURE_2D);
+// The batches bind their own atlas
+void DrawHudBatch(const RenderPacket& packet) {
+    uiBatch.Draw(&atlas);
+}
 
-    if (currentLevel == 1) {
-        glBindTexture(GL_TEXTURE_2D, tex_ground.texture[0]);
-    }
-    else {
-        glBindTexture(GL_TEXTURE_2D, tex_map2ground.texture[0]);
+void DrawHudText(const RenderPacket& packet) {
+    textBatch.Draw(&fontAtlas);
+}
+
+void RenderUI() {
+    FillHud();
+
+    renderQueue.Submit(PASS_UI, RenderState::Unlit(atlas.texture[0]).NoDepth(), DrawHudBatch, &uiBatch, nullptr, 0, 0);
+    renderQueue.Submit(PASS_UI, RenderState::Unlit(fontAtlas.texture[0]).NoDepth().Blend(BLEND_ALPHA), DrawHudText, &textBatch, nullptr, 0, 0);
+}
+
+// How far a point is from the camera, what the render queue sorts on
+float EyeDistance(float x, float y, float z) {
+    float dx = x - (float)Eye.x;
+    float dy = y - (float)Eye.y;
+    float dz = z - (float)Eye.z;
+    return sqrtf(dx * dx + dy * dy + dz * dz);
+}
+
+// How many pixels tall one unit looks at this point, for picking a model's level of detail
+float PixelsPerUnit(float x, float y, float z) {
+    float distance = EyeDistance(x, y, z);
+
+    if (distance < zNear) {
+        distance = (float)zNear;
     }
 
+    return (HEIGHT * 0.5f) / (tanf(currentFOV * 0.5f * 3.14159f / 180.0f) * distance);
+}
+
+// The texture a model's first material uses, what its packets sort on
+unsigned int ModelTexture(Model_3DS& model) {
+    return model.numMaterials > 0 ? model.Textures[0].texture[0] : 0;
+}
+
+// Trees and rocks, the packet's object is where and its resource what
+void DrawSceneModel(const RenderPacket& packet) {
+    const SceneObject& obj = *(const SceneObject*)packet.object;
+
     glPushMatrix();
-    glBegin(GL_QUADS);
-    glNormal3f(0, 1, 0);
-    glTexCoord2f(0, 0);
-    glVertex3f(-50, 0, -50);
-    glTexCoord2f(10, 0);
-    glVertex3f(50, 0, -50);
-    glTexCoord2f(10, 10);
-    glVertex3f(50, 0, 50);
-    glTexCoord2f(0, 10);
-    glVertex3f(-50, 0, 50);
-    glEnd();
+    glTranslatef(obj.x, 0, obj.z);
+    glRotatef(obj.rotation, 0, 1, 0);
+    glScalef(obj.scale, obj.scale, obj.scale);
+    ((Model_3DS*)packet.resource)->Draw(packet.detail);
     glPopMatrix();
+}
+
+void DrawChair(const RenderPacket& packet) {
+    const SceneObject& obj = *(const SceneObject*)packet.object;
 
-    glEnable(GL_LIGHTING);
-    glColor3f(1, 1, 1);
+    glPushMatrix();
+    glTranslatef(obj.x, 0.1f, obj.z);  // Lowered y position slightly
+    glRotatef(obj.rotation, 0, 1, 0);
+    glScalef(obj.scale * 0.15f, obj.scale * 0.15f, obj.scale * 0.15f);  // Much smaller scale for chairs
+    Chair.Draw(packet.detail);
+    glPopMatrix();
+}
+
+// The ground and the walls are already where they go
+void DrawStaticMesh(const RenderPacket& packet) {
+    ((StaticMesh*)packet.resource)->Draw();
+}
+
+// Targets and ammo boxes are one mesh for each look, drawn wherever each one is
+void DrawTarget(const RenderPacket& packet) {
+    const Target& target = *(const Target*)packet.object;
+
+    glPushMatrix();
+    glTranslatef(target.x, target.y, target.z);
+    glRotatef(target.rotation, 0, 1, 0);
+    ((StaticMesh*)packet.resource)->Draw();
+    glPopMatrix();
+}
+
+void DrawAmmoBox(const RenderPacket& packet) {
+    const AmmoBox& box = *(const AmmoBox*)packet.object;
+
+    glPushMatrix();
+    glTranslatef(box.x, box.y, box.z);
+    glRotatef(box.rotation, 0, 1, 0);
+    glScalef(box.scale, box.scale, box.scale);
+    ((StaticMesh*)packet.resource)->Draw();
+    glPopMatrix();
+}
+
+void RenderGround() {
+    RenderState state = RenderState::Unlit(currentLevel == 1 ? tex_ground.Touch() : tex_map2ground.Touch());
+    renderQueue.Submit(PASS_OPAQUE, state.Color(0.6f, 0.6f, 0.6f), DrawStaticMesh, nullptr, &mesh_ground, 0, 0);
 }
 
 void InitLightSource() {
-    glEnable(GL_LIGHTING);
-    glEnable(GL_LIGHT0);  // Main light (Sun/Moon)
-    glEnable(GL_LIGHT1);  // Flashlight
-    glEnable(GL_LIGHT2);  // Additional light for map 2
-    glEnable(GL_LIGHT3);  // Additional light for map 2
+    GLState::Get()->Enable(GL_LIGHTING);
+    GLState::Get()->Enable(GL_LIGHT0);  // Main light (Sun/Moon)
+    GLState::Get()->Enable(GL_LIGHT1);  // Flashlight
+    GLState::Get()->Enable(GL_LIGHT2);  // Additional light for map 2
+    GLState::Get()->Enable(GL_LIGHT3);  // Additional light for map 2
 
     if (currentLevel == 1) {
         // Initial sun setup - will be updated by UpdateSunPosition
@@ -1650,8 +1726,8 @@ void InitLightSource() {
         glLightfv(GL_LIGHT0, GL_POSITION, sunPosition);
 
         // Disable night-specific lights
-        glDisable(GL_LIGHT2);
-        glDisable(GL_LIGHT3);
+        GLState::Get()->Disable(GL_LIGHT2);
+        GLState::Get()->Disable(GL_LIGHT3);
     }
     else {
 
@@ -1677,8 +1753,8 @@ void InitLightSource() {
         glLightfv(GL_LIGHT0, GL_POSITION, moonPosition);
 
         // Enable and set up rotating spotlights
-        glEnable(GL_LIGHT2);
-        glEnable(GL_LIGHT3);
+        GLState::Get()->Enable(GL_LIGHT2);
+        GLState::Get()->Enable(GL_LIGHT3);
 
         // Light 2: Warm spotlight with color pulsing
         float warmFactor = 0.7f + 0.3f * sin(lightAnimationTime * 2.0f);
@@ -1746,7 +1822,7 @@ void InitLightSource() {
 }
 
 void InitMaterial() {
-    glEnable(GL_COLOR_MATERIAL);
+    GLState::Get()->Enable(GL_COLOR_MATERIAL);
     glColorMaterial(GL_FRONT, GL_AMBIENT_AND_DIFFUSE);
 
     GLfloat specular[] = { 1.0f, 1.0f, 1.0f, 1.0f };
@@ -1766,8 +1842,9 @@ void myInit(void) {
 
     InitLightSource();
     InitMaterial();
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_NORMALIZE);
+    renderQueue.PassFunctions(PASS_UI, BeginUIPass, EndUIPass);
+    GLState::Get()->Enable(GL_DEPTH_TEST);
+    GLState::Get()->Enable(GL_NORMALIZE);
 }
 bool isWithinMapBounds(float x, float z) {
     const float MAP_BOUNDS = 45.0f;  
@@ -1838,7 +1915,7 @@ void myKeyboard(unsigned char button, int x, int y) {
         if (!isJumping && playerY <= 0.0f) {
             isJumping = true;
             jumpVelocity = jumpForce;
-            playGameSounds("jump");
+            playGameSounds(SOUND_JUMP);
 
         }
         isSpacePressed = true;
@@ -1900,73 +1977,33 @@ void myReshape(int w, int h) {
     glLoadIdentity();
 }
 
-void RenderBullets() {
-    // Set copper/dark yellow color
-    glColor3f(0.85f, 0.65f, 0.13f);  // RGB values for copper/dark yellow
-
-    for (const auto& bullet : bullets) {
-        if (!bullet.active) continue;
-
-        glPushMatrix();
-        glTranslatef(bullet.x, bullet.y, bullet.z);
-
-        float angle = atan2(bullet.dx, bullet.dz) * 180.0f / 3.14159f;
-        glRotatef(angle, 0, 1, 0);
-        glRotatef(90, 1, 0, 0);
-        glRotatef(90, 0, 0, 1);
-
-        glScalef(bullet.scale, bullet.scale, bullet.scale);
-        bullet_model.Draw();
-        glPopMatrix();
-    }
+void DrawBullet(const RenderPacket& packet) {
+    const Bullet& bullet = *(const Bullet*)packet.object;
 
-    // Reset color back to default
-    glColor3f(1.0f, 1.0f, 1.0f);
-}
-
-void RenderCrosshair() {
-    if (!isAiming) return;
-
-    glMatrixMode(GL_PROJECTION);
-    glPushMatrix();
-    glLoadIdentity();
-    glOrtho(0, WIDTH, HEIGHT, 0, -1, 1);
-    glMatrixMode(GL_MODELVIEW);
     glPushMatrix();
-    glLoadIdentity();
-
-    glDisable(GL_LIGHTING);
-    glDisable(GL_DEPTH_TEST);
+    glTranslatef(bullet.x, bullet.y, bullet.z);
 
-    glColor3f(1.0f, 1.0f, 1.0f);
+    float angle = atan2(bullet.dx, bullet.dz) * 180.0f / 3.14159f;
+    glRotatef(angle, 0, 1, 0);
+    glRotatef(90, 1, 0, 0);
+    glRotatef(90, 0, 0, 1);
 
-    int centerX = WIDTH / 2;
-    int centerY = HEIGHT / 2;
-    int size = 10;
-    int thickness = 2;
+    glScalef(bullet.scale, bullet.scale, bullet.scale);
+    bullet_model.Draw(packet.detail);
+    glPopMatrix();
+}
 
-    // Horizontal line
-    glBegin(GL_QUADS);
-    glVertex2f(centerX - size, centerY - thickness / 2);
-    glVertex2f(centerX + size, centerY - thickness / 2);
-    glVertex2f(centerX + size, centerY + thickness / 2);
-    glVertex2f(centerX - size, centerY + thickness / 2);
-    glEnd();
+void RenderBullets() {
+    // Set copper/dark yellow color
+    RenderState copper = RenderState::Lit(ModelTexture(bullet_model)).Color(0.85f, 0.65f, 0.13f);
 
-    // Vertical line
-    glBegin(GL_QUADS);
-    glVertex2f(centerX - thickness / 2, centerY - size);
-    glVertex2f(centerX + thickness / 2, centerY - size);
-    glVertex2f(centerX + thickness / 2, centerY + size);
-    glVertex2f(centerX - thickness / 2, centerY + size);
-    glEnd();
+    for (const auto& bullet : bullets) {
+        if (!bullet.active) continue;
 
-    glEnable(GL_LIGHTING);
-    glEnable(GL_DEPTH_TEST);
-    glMatrixMode(GL_PROJECTION);
-    glPopMatrix();
-    glMatrixMode(GL_MODELVIEW);
-    glPopMatrix();
+        int lod = bullet_model.SelectLod(bullet.scale * PixelsPerUnit(bullet.x, bullet.y, bullet.z));
+        renderQueue.Submit(PASS_OPAQUE, copper, DrawBullet, &bullet, &bullet_model, lod,
+            EyeDistance(bullet.x, bullet.y, bullet.z));
+    }
 }
 
 void updateCamera() {
@@ -2023,12 +2060,17 @@ void updateCamera() {
     At.y += shakeOffsetY;
 }
 
-void updateScene(int value) {
+// One tick of the game itself. It doesn't draw anything, so the soak
+// test can run it without a window
+void SimulateTick() {
+    AllocationScope scope(ALLOC_SIMULATION);
+
+    float deltaTime = TIMER_INTERVAL / 1000.0f;
+    simulationTime += deltaTime;
+
     if (!gameOver) {
-        float deltaTime = TIMER_INTERVAL / 1000.0f;
         
         UpdateLightEffects(deltaTime); 
-        UpdateSunPosition(deltaTime);// Add this line
         UpdateAmmoBoxRotations();  // Add this line
 
         gameTimer -= deltaTime;
@@ -2074,6 +2116,15 @@ void updateScene(int value) {
             }
         }
     }
+}
+
+void updateScene(int value) {
+    // The sun sets the GL lights, so it stays out of SimulateTick
+    if (!gameOver) {
+        UpdateSunPosition(TIMER_INTERVAL / 1000.0f);
+    }
+
+    SimulateTick();
 
     // Camera and FOV updates (continue even if game is over)
     if (isAiming) {
@@ -2083,11 +2134,13 @@ void updateScene(int value) {
         currentFOV += (normalFOV - currentFOV) * zoomSpeed;
     }
 
-    // Update perspective
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    gluPerspective(currentFOV, (GLdouble)WIDTH / (GLdouble)HEIGHT, zNear, zFar);
-    glMatrixMode(GL_MODELVIEW);
+    // Update perspective, the shader path makes its own each frame
+    if (!useShaders) {
+        glMatrixMode(GL_PROJECTION);
+        glLoadIdentity();
+        gluPerspective(currentFOV, (GLdouble)WIDTH / (GLdouble)HEIGHT, zNear, zFar);
+        glMatrixMode(GL_MODELVIEW);
+    }
 
     // Update camera position and view
     updateCamera();
@@ -2097,9 +2150,511 @@ void updateScene(int value) {
     glutTimerFunc(TIMER_INTERVAL, updateScene, 0);
 }
 
+// The shapes walls, the door and the ground are made of, as quads with x, y,
+// z, s and t for each corner
+const float wallCorners[] = {
+    -4.0f, 0.0f, 0.5f, 0.0f, 0.0f,    4.0f, 0.0f, 0.5f, 2.0f, 0.0f,    4.0f, 4.0f, 0.5f, 2.0f, 2.0f,    -4.0f, 4.0f, 0.5f, 0.0f, 2.0f,
+    -4.0f, 0.0f, -0.5f, 2.0f, 0.0f,   -4.0f, 4.0f, -0.5f, 2.0f, 2.0f,  4.0f, 4.0f, -0.5f, 0.0f, 2.0f,   4.0f, 0.0f, -0.5f, 0.0f, 0.0f,
+    -4.0f, 4.0f, -0.5f, 0.0f, 0.0f,   -4.0f, 4.0f, 0.5f, 0.0f, 1.0f,   4.0f, 4.0f, 0.5f, 2.0f, 1.0f,    4.0f, 4.0f, -0.5f, 2.0f, 0.0f,
+    4.0f, 0.0f, -0.5f, 0.0f, 0.0f,    4.0f, 4.0f, -0.5f, 0.0f, 2.0f,   4.0f, 4.0f, 0.5f, 1.0f, 2.0f,    4.0f, 0.0f, 0.5f, 1.0f, 0.0f,
+    -4.0f, 0.0f, -0.5f, 0.0f, 0.0f,   -4.0f, 0.0f, 0.5f, 1.0f, 0.0f,   -4.0f, 4.0f, 0.5f, 1.0f, 2.0f,   -4.0f, 4.0f, -0.5f, 0.0f, 2.0f,
+};
+
+const float doorCorners[] = {
+    -1.2f, -1.0f, 0.0f, 0.0f, 0.0f,   -1.0f, -1.0f, 0.0f, 0.0f, 0.0f,  -1.0f, 2.0f, 0.0f, 0.0f, 0.0f,   -1.2f, 2.0f, 0.0f, 0.0f, 0.0f,
+    1.0f, -1.0f, 0.0f, 0.0f, 0.0f,    1.2f, -1.0f, 0.0f, 0.0f, 0.0f,   1.2f, 2.0f, 0.0f, 0.0f, 0.0f,    1.0f, 2.0f, 0.0f, 0.0f, 0.0f,
+    -1.2f, 2.0f, 0.0f, 0.0f, 0.0f,    1.2f, 2.0f, 0.0f, 0.0f, 0.0f,    1.2f, 2.2f, 0.0f, 0.0f, 0.0f,    -1.2f, 2.2f, 0.0f, 0.0f, 0.0f,
+    -1.0f, -1.0f, 0.0f, 0.0f, 0.0f,   1.0f, -1.0f, 0.0f, 0.0f, 0.0f,   1.0f, 2.0f, 0.0f, 0.0f, 0.0f,    -1.0f, 2.0f, 0.0f, 0.0f, 0.0f,
+    0.6f, -0.1f, 0.1f, 0.0f, 0.0f,    0.8f, -0.1f, 0.1f, 0.0f, 0.0f,   0.8f, 0.1f, 0.1f, 0.0f, 0.0f,    0.6f, 0.1f, 0.1f, 0.0f, 0.0f,
+};
+
+// The frame's three pieces, the door and its handle
+const float doorColors[] = {
+    0.5f, 0.3f, 0.1f,   0.5f, 0.3f, 0.1f,   0.5f, 0.3f, 0.1f,   0.3f, 0.2f, 0.1f,   0.8f, 0.8f, 0.8f,
+};
+
+const float glowCorners[] = {
+    -1.5f, -1.5f, 0.0f, 0.0f, 0.0f,   1.5f, -1.5f, 0.0f, 0.0f, 0.0f,   1.5f, 2.5f, 0.0f, 0.0f, 0.0f,    -1.5f, 2.5f, 0.0f, 0.0f, 0.0f,
+};
+
+const float groundCorners[] = {
+    -50.0f, 0.0f, -50.0f, 0.0f, 0.0f,   50.0f, 0.0f, -50.0f, 10.0f, 0.0f,   50.0f, 0.0f, 50.0f, 10.0f, 10.0f,   -50.0f, 0.0f, 50.0f, 0.0f, 10.0f,
+};
+
+// Adds quads to a mesh, each one a single color (white if there are no
+// colors). Each one faces the way its corners go round
+void MakeShape(const float* corners, const float* colors, int numQuads,
+    std::vector<ShaderVertex>& vertices, std::vector<unsigned short>& indices) {
+    for (int q = 0; q < numQuads; q++) {
+        const float* quad = corners + q * 20;
+        float ax = quad[5] - quad[0], ay = quad[6] - quad[1], az = quad[7] - quad[2];
+        float bx = quad[15] - quad[0], by = quad[16] - quad[1], bz = quad[17] - quad[2];
+        float nx = ay * bz - az * by;
+        float ny = az * bx - ax * bz;
+        float nz = ax * by - ay * bx;
+        float length = sqrt(nx * nx + ny * ny + nz * nz);
+
+        for (int c = 0; c < 4; c++) {
+            const float* p = quad + c * 5;
+            ShaderVertex v;
+            v.x = p[0];
+            v.y = p[1];
+            v.z = p[2];
+            v.nx = nx / length;
+            v.ny = ny / length;
+            v.nz = nz / length;
+            v.u = p[3];
+            v.v = p[4];
+            v.r = colors ? (unsigned char)(colors[q * 3] * 255.0f + 0.5f) : 255;
+            v.g = colors ? (unsigned char)(colors[q * 3 + 1] * 255.0f + 0.5f) : 255;
+            v.b = colors ? (unsigned char)(colors[q * 3 + 2] * 255.0f + 0.5f) : 255;
+            v.a = 255;
+            vertices.push_back(v);
+        }
+
+        unsigned short first = (unsigned short)(vertices.size() - 4);
+        unsigned short triangles[] = { first, (unsigned short)(first + 1), (unsigned short)(first + 2),
+            first, (unsigned short)(first + 2), (unsigned short)(first + 3) };
+        indices.insert(indices.end(), triangles, triangles + 6);
+    }
+}
+
+int BuildShape(const float* corners, const float* colors, int numQuads) {
+    std::vector<ShaderVertex> vertices;
+    std::vector<unsigned short> indices;
+    MakeShape(corners, colors, numQuads, vertices, indices);
+
+    return shaders.AddMesh(&vertices[0], (int)vertices.size(), &indices[0], (int)indices.size());
+}
+
+// The same for the fixed function path, uncolored shapes take the current color
+void BuildShapeMesh(StaticMesh& mesh, const float* corners, const float* colors, int numQuads) {
+    std::vector<ShaderVertex> vertices;
+    std::vector<unsigned short> indices;
+    MakeShape(corners, colors, numQuads, vertices, indices);
+
+    mesh.Create(&vertices[0], (int)vertices.size(), &indices[0], (int)indices.size(), 0, colors != NULL);
+}
+
+// Puts every wall where it stands in one mesh, the walls never move
+void BuildWallMesh() {
+    std::vector<ShaderVertex> vertices;
+    std::vector<unsigned short> indices;
+
+    for (const auto& wall : treePositions) {
+        size_t first = vertices.size();
+        MakeShape(wallCorners, NULL, 5, vertices, indices);
+
+        float m[16];
+        MatrixIdentity(m);
+        MatrixTranslate(m, wall.x, 0, wall.z);
+        MatrixRotate(m, wall.rotation, 0, 1, 0);
+        MatrixScale(m, wall.scale, wall.scale * 3.0f, wall.scale); // Scale y to make walls taller
+        TransformVertices(&vertices[first], (int)(vertices.size() - first), m);
+    }
+
+    if (vertices.empty()) {
+        mesh_walls.Destroy();
+    }
+    else {
+        mesh_walls.Create(&vertices[0], (int)vertices.size(), &indices[0], (int)indices.size(), 0, false);
+    }
+    wallsChanged = false;
+}
+
+// Builds the shapes the fixed function path draws, once. Targets and ammo
+// boxes are filled in the way the shader path's batch is, without moving them
+void LoadStaticMeshes() {
+    BuildShapeMesh(mesh_door, doorCorners, doorColors, 5);
+    BuildShapeMesh(mesh_glow, glowCorners, NULL, 1);
+    BuildShapeMesh(mesh_ground, groundCorners, NULL, 1);
+
+    AtlasBatch batch;
+    for (int level = 1; level <= 2; level++) {
+        batch.Begin();
+        AddTargetShape(batch, level);
+        mesh_target[level - 1].Create(&batch);
+    }
+    for (int kind = 0; kind < AMMO_KIND_COUNT; kind++) {
+        batch.Begin();
+        AddAmmoBoxShape(batch, kind);
+        mesh_ammoBox[kind].Create(&batch);
+    }
+}
+
+// Uploads everything the shader path draws, once
+void LoadShaderScene() {
+    gpu_tree = shaders.AddModel(&model_tree);
+    gpu_rock = shaders.AddModel(&model_rock);
+    gpu_player = shaders.AddModel(&player_model);
+    gpu_bullet = shaders.AddModel(&bullet_model);
+    gpu_chair = shaders.AddModel(&Chair);
+
+    shape_wall = BuildShape(wallCorners, NULL, 5);
+    shape_door = BuildShape(doorCorners, doorColors, 5);
+    shape_glow = BuildShape(glowCorners, NULL, 1);
+    shape_ground = BuildShape(groundCorners, NULL, 1);
+    shape_sky = shaders.AddSphere(100, 100);
+    shape_sun = shaders.AddSphere(32, 32);
+
+    shadedInstances.reserve(SHADER_MAX_INSTANCES);
+    shadedParticles.reserve(MAX_EXPLOSIONS * PARTICLES_PER_EXPLOSION);
+    explosiveLabel.Set(&hudFont, "EXPLOSIVE");
+    fastFireLabel.Set(&hudFont, "FAST FIRE");
+}
+
+// glTranslatef, glRotatef about y and glScalef, and the glColor
+void PlaceInstance(ShaderInstance& instance, float x, float y, float z, float angle, float scale,
+    float r, float g, float b, float a = 1.0f) {
+    MatrixIdentity(instance.model);
+    MatrixTranslate(instance.model, x, y, z);
+    MatrixRotate(instance.model, angle, 0, 1, 0);
+    MatrixScale(instance.model, scale, scale, scale);
+    instance.color[0] = r;
+    instance.color[1] = g;
+    instance.color[2] = b;
+    instance.color[3] = a;
+}
+
+// Draws the model at every object, each level of detail in one go
+void DrawShadedObjects(Model_3DS& model, int gpu, const std::vector<SceneObject>& objects,
+    float y, float scale, float r, float g, float b) {
+    for (int lod = 0; lod < model.numLods; lod++) {
+        shadedInstances.clear();
+        for (const auto& obj : objects) {
+            if (model.SelectLod(obj.scale * scale * PixelsPerUnit(obj.x, y, obj.z)) != lod) continue;
+            shadedInstances.push_back(ShaderInstance());
+            PlaceInstance(shadedInstances.back(), obj.x, y, obj.z, obj.rotation, obj.scale * scale, r, g, b);
+        }
+        if (!shadedInstances.empty()) {
+            shaders.DrawModel(gpu, lod, &shadedInstances[0], (int)shadedInstances.size());
+        }
+    }
+}
+
+// The lights the fixed function path ends up with each frame: GL_LIGHT0
+// straight overhead with the sun's colors (they stop changing once level
+// 1 is over) and the flashlight on level 2. Returns how many there are
+int GatherLights(ShaderLight* lights, float* ambient) {
+    memset(lights, 0, sizeof(ShaderLight) * SHADER_MAX_LIGHTS);
+
+    // The same colors UpdateSunPosition works out
+    float intensity = 1.0f - (sunsetProgress * 0.7f);
+    float green = 1.0f - (sunsetProgress * 0.5f);
+    float blue = 1.0f - (sunsetProgress * 0.8f);
+
+    ambient[0] = 0.2f * intensity;
+    ambient[1] = 0.2f * intensity * green;
+    ambient[2] = 0.2f * intensity * blue;
+    ambient[3] = 1.0f;
+
+    ShaderLight& sun = lights[0];
+    sun.position[1] = 1.0f;
+    sun.direction[2] = -1.0f;
+    sun.direction[3] = -2.0f;
+    sun.ambient[0] = sun.ambient[1] = sun.ambient[2] = 0.7f;
+    sun.diffuse[0] = intensity;
+    sun.diffuse[1] = intensity * green;
+    sun.diffuse[2] = intensity * blue;
+    sun.specular[0] = 0.7f * intensity;
+    sun.specular[1] = 0.7f * intensity * green;
+    sun.specular[2] = 0.7f * intensity * blue;
+    sun.spot[1] = 1.0f;
+
+    if (currentLevel != 2) {
+        return 1;
+    }
+
+    // InitLightSource's flashlight, where UpdateFlashlight put it
+    float pulse = 0.9f + 0.1f * sin(lightAnimationTime * 4.0f);
+    ShaderLight& flashlight = lights[1];
+    for (int i = 0; i < 3; i++) {
+        flashlight.position[i] = flashlightPosition[i];
+        flashlight.direction[i] = flashlightDirection[i];
+        flashlight.specular[i] = pulse;
+    }
+    flashlight.position[3] = 1.0f;
+    flashlight.direction[3] = cos(FLASHLIGHT_CUTOFF * 3.14159f / 180.0f);
+    flashlight.diffuse[0] = pulse;
+    flashlight.diffuse[1] = pulse;
+    flashlight.diffuse[2] = 0.9f * pulse;
+    flashlight.spot[0] = 20.0f;
+    flashlight.spot[1] = 1.0f;
+    flashlight.spot[2] = 0.05f;
+    return 2;
+}
+
+// Puts a label over each level 2 ammo box, where glRasterPos would have
+void AddAmmoBoxLabels(const ShaderFrame& frame) {
+    if (currentLevel != 2) return;
+
+    float viewProjection[16];
+    memcpy(viewProjection, frame.projection, sizeof(viewProjection));
+    MatrixMultiply(viewProjection, frame.view);
+
+    textBatch.Color(0.4f, 0.4f, 0.4f);
+    for (const auto& box : ammoBoxes) {
+        if (!box.active) continue;
+
+        ShaderInstance at;
+        PlaceInstance(at, box.x, box.y, box.z, box.rotation, box.scale, 1, 1, 1);
+        float toScreen[16];
+        memcpy(toScreen, viewProjection, sizeof(toScreen));
+        MatrixMultiply(toScreen, at.model);
+
+        float x = box.isExplosive ? -0.8f : -0.6f;
+        float clip[4];
+        for (int i = 0; i < 4; i++) {
+            clip[i] = toScreen[i] * x + toScreen[8 + i] * 1.02f + toScreen[12 + i];
+        }
+
+        // Behind the camera, glRasterPos would have dropped it too
+        if (clip[3] <= 0.0f) continue;
+
+        TextLayout& label = box.isExplosive ? explosiveLabel : fastFireLabel;
+        label.Add(&textBatch, (clip[0] / clip[3] * 0.5f + 0.5f) * WIDTH, (0.5f - clip[1] / clip[3] * 0.5f) * HEIGHT);
+    }
+    textBatch.Color(1.0f, 1.0f, 1.0f);
+}
+
+// myDisplay with the shader renderer: the same scene in the same order
+void RenderShaded() {
+    ShaderFrame frame;
+    MatrixIdentity(frame.view);
+    MatrixLookAt(frame.view, Eye.x, Eye.y, Eye.z, At.x, At.y, At.z, Up.x, Up.y, Up.z);
+    MatrixIdentity(frame.projection);
+    MatrixPerspective(frame.projection, currentFOV, (float)WIDTH / (float)HEIGHT, zNear, zFar);
+    MatrixIdentity(frame.ui);
+    MatrixOrtho(frame.ui, 0, WIDTH, HEIGHT, 0, -1, 1);
+    frame.eye[0] = Eye.x;
+    frame.eye[1] = Eye.y;
+    frame.eye[2] = Eye.z;
+    frame.eye[3] = 1.0f;
+    // InitMaterial's
+    frame.specular[0] = frame.specular[1] = frame.specular[2] = 1.0f;
+    frame.specular[3] = 96.0f;
+
+    if (currentLevel == 2) {
+        UpdateFlashlight();
+    }
+
+    ShaderLight lights[SHADER_MAX_LIGHTS];
+    int numLights = GatherLights(lights, frame.ambient);
+    shaders.BeginFrame(frame, lights, numLights);
+
+    GLState::Get()->Enable(GL_DEPTH_TEST);
+    GLState::Get()->Disable(GL_BLEND);
+
+    ShaderInstance one;
+    PlaceInstance(one, 0, 0, 0, 0, 1, 0.6f, 0.6f, 0.6f);
+    shaders.DrawMesh(shape_ground, SHADER_UNLIT, currentLevel == 1 ? tex_ground.Touch() : tex_map2ground.Touch(), &one, 1);
+
+    // Trees or walls
+    if (currentLevel == 1) {
+        DrawShadedObjects(model_tree, gpu_tree, treePositions, 0, 1, 1, 1, 1);
+    }
+    else {
+        shadedInstances.clear();
+        for (const auto& wall : treePositions) {
+            shadedInstances.push_back(ShaderInstance());
+            PlaceInstance(shadedInstances.back(), wall.x, 0, wall.z, wall.rotation, wall.scale, 1, 1, 1);
+            MatrixScale(shadedInstances.back().model, 1, 3, 1);
+        }
+        if (!shadedInstances.empty()) {
+            shaders.DrawMesh(shape_wall, SHADER_LIT, tex_wall.Touch(), &shadedInstances[0], (int)shadedInstances.size());
+        }
+    }
+
+    // Rocks or chairs
+    if (currentLevel == 1) {
+        DrawShadedObjects(model_rock, gpu_rock, rockPositions, 0, 1, 0.25f, 0.25f, 0.25f);
+    }
+    else {
+        DrawShadedObjects(Chair, gpu_chair, rockPositions, 0.1f, 0.15f, 0.6f, 0.4f, 0.2f);
+    }
+
+    FillWorldBatch();
+    shaders.DrawBatch(&worldBatch, &atlas, SHADER_LIT);
+
+    if (!isFirstPerson) {
+        PlaceInstance(one, playerX, playerY, playerZ, playerRotation, playerScale, 1, 1, 1);
+        int lod = player_model.SelectLod(playerScale * PixelsPerUnit(playerX, playerY, playerZ));
+        shaders.DrawModelPosed(gpu_player, lod, one, simulationTime);
+    }
+
+    // The sky, gluSphere's own shape
+    MatrixIdentity(one.model);
+    MatrixTranslate(one.model, 50, 0, 0);
+    MatrixRotate(one.model, 90, 1, 0, 1);
+    MatrixScale(one.model, 150, 150, 150);
+    one.color[0] = one.color[1] = one.color[2] = one.color[3] = 1.0f;
+    if (currentLevel == 1) {
+        TextureManager::Get()->Touch(tex_slot);
+    }
+    else {
+        TextureManager::Get()->Touch(tex1_slot);
+    }
+    shaders.DrawMesh(shape_sky, SHADER_LIT, currentLevel == 1 ? tex : tex1, &one, 1);
+
+    // The sun's glow and then its body, both added on top of everything
+    if (currentLevel == 1) {
+        float green = 1.0f - (sunsetProgress * 0.5f);
+        float blue = 1.0f - (sunsetProgress * 0.8f);
+        ShaderInstance sun[2];
+        PlaceInstance(sun[0], currentSunPosition[0], currentSunPosition[1], currentSunPosition[2], 0,
+            SUN_VISUAL_SIZE * 1.2f, 1.0f, green * 0.7f, blue * 0.3f, 0.2f);
+        PlaceInstance(sun[1], currentSunPosition[0], currentSunPosition[1], currentSunPosition[2], 0,
+            SUN_VISUAL_SIZE, 1.0f, green, blue);
+
+        GLState::Get()->Disable(GL_DEPTH_TEST);
+        GLState::Get()->Enable(GL_BLEND);
+        GLState::Get()->BlendFunc(GL_SRC_ALPHA, GL_ONE);
+        shaders.DrawMesh(shape_sun, SHADER_UNLIT, 0, sun, 2);
+        GLState::Get()->Disable(GL_BLEND);
+        GLState::Get()->Enable(GL_DEPTH_TEST);
+    }
+
+    if (doorSpawned && levelDoor.active) {
+        PlaceInstance(one, levelDoor.x, levelDoor.y, levelDoor.z, levelDoor.rotation, levelDoor.scale, 1, 1, 1);
+        shaders.DrawMesh(shape_door, SHADER_LIT, 0, &one, 1);
+
+        // Glows when the player is near
+        float dx = playerX - levelDoor.x;
+        float dz = playerZ - levelDoor.z;
+        float distanceSquared = dx * dx + dz * dz;
+        float radius = levelDoor.INTERACTION_RADIUS * 2;
+        if (distanceSquared < radius * radius) {
+            one.color[0] = 0.0f;
+            one.color[3] = 0.3f * (1.0f - (sqrt(distanceSquared) / radius));
+            GLState::Get()->Enable(GL_BLEND);
+            GLState::Get()->BlendFunc(GL_SRC_ALPHA, GL_ONE);
+            shaders.DrawMesh(shape_glow, SHADER_LIT, 0, &one, 1);
+            GLState::Get()->Disable(GL_BLEND);
+        }
+    }
+
+    // Bullets, each level of detail in one go
+    for (int lod = 0; lod < bullet_model.numLods; lod++) {
+        shadedInstances.clear();
+        for (const auto& bullet : bullets) {
+            if (!bullet.active) continue;
+            if (bullet_model.SelectLod(bullet.scale * PixelsPerUnit(bullet.x, bullet.y, bullet.z)) != lod) continue;
+
+            shadedInstances.push_back(ShaderInstance());
+            ShaderInstance& b = shadedInstances.back();
+            PlaceInstance(b, bullet.x, bullet.y, bullet.z, atan2(bullet.dx, bullet.dz) * 180.0f / 3.14159f, 1, 0.85f, 0.65f, 0.13f);
+            MatrixRotate(b.model, 90, 1, 0, 0);
+            MatrixRotate(b.model, 90, 0, 0, 1);
+            MatrixScale(b.model, bullet.scale, bullet.scale, bullet.scale);
+        }
+        if (!shadedInstances.empty()) {
+            shaders.DrawModel(gpu_bullet, lod, &shadedInstances[0], (int)shadedInstances.size());
+        }
+    }
+
+    // Every explosion's particles in one draw
+    shadedParticles.clear();
+    for (const auto& explosion : explosions) {
+        if (!explosion.active) continue;
+        for (const auto& particle : explosion.particles) {
+            if (!particle.active) continue;
+            ShaderParticle p = { particle.x, particle.y, particle.z, particle.size,
+                { particle.r, particle.g, particle.b, 1.0f - (particle.lifetime / particle.maxLifetime) } };
+            shadedParticles.push_back(p);
+        }
+    }
+    if (!shadedParticles.empty()) {
+        GLState::Get()->Enable(GL_BLEND);
+        GLState::Get()->BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        shaders.DrawParticles(&shadedParticles[0], (int)shadedParticles.size());
+        GLState::Get()->Disable(GL_BLEND);
+    }
+
+    // The HUD on top
+    GLState::Get()->Disable(GL_DEPTH_TEST);
+    FillHud();
+    AddAmmoBoxLabels(frame);
+    shaders.DrawBatch(&uiBatch, &atlas, SHADER_UI);
+
+    GLState::Get()->Enable(GL_BLEND);
+    GLState::Get()->BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    shaders.DrawBatch(&textBatch, &fontAtlas, SHADER_UI);
+    GLState::Get()->Disable(GL_BLEND);
+    GLState::Get()->Enable(GL_DEPTH_TEST);
+}
+
+void DrawPlayer(const RenderPacket& packet) {
+    glPushMatrix();
+    glTranslatef(playerX, playerY, playerZ);
+    glRotatef(playerRotation, 0, 1, 0);
+    glScalef(playerScale, playerScale, playerScale);
+    // Plays the model's own animation if it has one
+    player_model.Draw(packet.detail, simulationTime);
+    glPopMatrix();
+}
+
+void DrawSky(const RenderPacket& packet) {
+    glPushMatrix();
+    glTranslated(50, 0, 0);
+    glRotated(90, 1, 0, 1);
+    gluSphere(skyQuadric, 150, 100, 100);
+    glPopMatrix();
+}
+
+// "-renderstats": every 100 frames, the state calls the last one made
+// and the ones it didn't have to, and how often drawing used the heap
+void ReportRenderStats() {
+    if (!showRenderStats) return;
+
+    // Called once the frame is drawn, so this is all of its drawing
+    int allocs = AllocationCounter::ThisFrame(ALLOC_RENDERING);
+    renderAllocs += allocs;
+    if (allocs > renderAllocsPeak) renderAllocsPeak = allocs;
+
+    if (++renderFrames % 100 != 0) return;
+
+    printf("render: %d allocations in 100 frames, at most %d in one\n", renderAllocs, renderAllocsPeak);
+    renderAllocs = 0;
+    renderAllocsPeak = 0;
+
+    if (useShaders) {
+        const ShaderStats& s = shaders.stats;
+        printf("render: %d draws, %d instances, %d program binds, %d texture binds, %d skipped, %d toggles (%d skipped)\n",
+            s.draws, s.instances, s.programBinds, s.textureBinds, s.skippedBinds,
+            GLState::Get()->stats.toggles, GLState::Get()->stats.skippedToggles);
+        return;
+    }
+
+    const GLStateStats& s = GLState::Get()->stats;
+    printf("render: %d packets, %d texture binds (%d skipped), %d buffer binds (%d skipped), %d toggles (%d skipped), %d arrays (%d skipped), %d colors (%d skipped), %d blend funcs (%d skipped)\n",
+        renderQueue.NumPackets(), s.textureBinds, s.skippedBinds, s.bufferBinds, s.skippedBufferBinds, s.toggles, s.skippedToggles,
+        s.arrays, s.skippedArrays, s.colors, s.skippedColors, s.blendFuncs, s.skippedBlendFuncs);
+}
+
 void myDisplay(void) {
+    // Once the game is running a frame shouldn't need the heap at all
+    AllocationCounter::NewFrame();
+    AllocationScope scope(ALLOC_RENDERING);
+    GLState::Get()->NewFrame();
+
+    // Upload a couple of textures the loader threads have finished
+    TextureStreamer::Get()->Pump(2);
+
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    // We hear from wherever the camera is
+    if (soundSystem) {
+        soundSystem->setListener(Eye.x, Eye.y, Eye.z, At.x, At.y, At.z);
+    }
+
+    if (useShaders) {
+        RenderShaded();
+        ReportRenderStats();
+        TextureManager::Get()->Update();
+        glutSwapBuffers();
+        return;
+    }
+
     glLoadIdentity();
     gluLookAt(Eye.x, Eye.y, Eye.z, At.x, At.y, At.z, Up.x, Up.y, Up.z);
 
@@ -2111,95 +2666,99 @@ void myDisplay(void) {
 
     // Update and enable/disable flashlight based on level
     if (currentLevel == 2) {
-        glEnable(GL_LIGHT1);
+        GLState::Get()->Enable(GL_LIGHT1);
         UpdateFlashlight();
         glLightfv(GL_LIGHT1, GL_POSITION, flashlightPosition);
         glLightfv(GL_LIGHT1, GL_SPOT_DIRECTION, flashlightDirection);
     }
     else {
-        glDisable(GL_LIGHT1);
+        GLState::Get()->Disable(GL_LIGHT1);
     }
 
+    // Everything below only says what it draws, the queue sorts it and draws it
+    renderQueue.Begin((float)zFar);
+
     RenderGround();
 
     // Draw trees/walls based on level
-    for (const auto& obj : treePositions) {
-        if (currentLevel == 1) {
-            glPushMatrix();
-            glTranslatef(obj.x, 0, obj.z);
-            glRotatef(obj.rotation, 0, 1, 0);
-            glScalef(obj.scale, obj.scale, obj.scale);
-            model_tree.Draw();
-            glPopMatrix();
+    if (currentLevel == 1) {
+        RenderState treeState = RenderState::Lit(ModelTexture(model_tree));
+        for (const auto& obj : treePositions) {
+            int lod = model_tree.SelectLod(obj.scale * PixelsPerUnit(obj.x, 0, obj.z));
+            renderQueue.Submit(PASS_OPAQUE, treeState, DrawSceneModel, &obj, &model_tree, lod,
+                EyeDistance(obj.x, 0, obj.z));
         }
-        else {
-            RenderWall(obj);
+    }
+    else {
+        // The walls never move, so they're all one mesh
+        if (wallsChanged) {
+            BuildWallMesh();
         }
+        renderQueue.Submit(PASS_OPAQUE, RenderState::Lit(tex_wall.Touch()), DrawStaticMesh, nullptr, &mesh_walls, 0, 0);
     }
 
     // Draw rocks
+    RenderState rockState = RenderState::Lit(ModelTexture(model_rock)).Color(0.25f, 0.25f, 0.25f);  // Dark grey color for rocks
+    RenderState chairState = RenderState::Lit(ModelTexture(Chair)).Color(0.6f, 0.4f, 0.2f);  // Brown color for chairs
     for (const auto& obj : rockPositions) {
-        glPushMatrix();
         if (currentLevel == 1) {
-            glColor3f(0.25f, 0.25f, 0.25f);  // Dark grey color for rocks
-            glTranslatef(obj.x, 0, obj.z);
-            glRotatef(obj.rotation, 0, 1, 0);
-            glScalef(obj.scale, obj.scale, obj.scale);
-            model_rock.Draw();
+            int lod = model_rock.SelectLod(obj.scale * PixelsPerUnit(obj.x, 0, obj.z));
+            renderQueue.Submit(PASS_OPAQUE, rockState, DrawSceneModel, &obj, &model_rock, lod,
+                EyeDistance(obj.x, 0, obj.z));
         }
         else {
-            glColor3f(0.6f, 0.4f, 0.2f);  // Brown color for chairs
-            glTranslatef(obj.x, 0.1f, obj.z);  // Lowered y position slightly
-            glRotatef(obj.rotation, 0, 1, 0);
-            glScalef(obj.scale * 0.15f, obj.scale * 0.15f, obj.scale * 0.15f);  // Much smaller scale for chairs
-            Chair.Draw();
+            int lod = Chair.SelectLod(obj.scale * 0.15f * PixelsPerUnit(obj.x, 0.1f, obj.z));
+            renderQueue.Submit(PASS_OPAQUE, chairState, DrawChair, &obj, &Chair, lod,
+                EyeDistance(obj.x, 0.1f, obj.z));
         }
-        glPopMatrix();
     }
 
+    // Targets and ammo boxes all come from the atlas
+    RenderState atlasState = RenderState::Lit(atlas.texture[0]);
+    StaticMesh* targetMesh = &mesh_target[currentLevel == 1 ? 0 : 1];
     for (const auto& target : targets) {
-        RenderTarget(target);
+        if (target.active) {
+            renderQueue.Submit(PASS_OPAQUE, atlasState, DrawTarget, &target, targetMesh, 0,
+                EyeDistance(target.x, target.y, target.z));
+        }
     }
 
-    // Draw ammo boxes
     for (const auto& box : ammoBoxes) {
-        RenderAmmoBox(box);
+        if (box.active) {
+            renderQueue.Submit(PASS_OPAQUE, atlasState, DrawAmmoBox, &box, &mesh_ammoBox[AmmoBoxKindOf(box)], 0,
+                EyeDistance(box.x, box.y, box.z));
+        }
+        RenderAmmoBoxLabel(box);
     }
 
     // Only draw player model if not in first-person view
     if (!isFirstPerson) {
-        glPushMatrix();
-        glTranslatef(playerX, playerY, playerZ);
-        glRotatef(playerRotation, 0, 1, 0);
-        glScalef(playerScale, playerScale, playerScale);
-        player_model.Draw();
-        glPopMatrix();
+        int lod = player_model.SelectLod(playerScale * PixelsPerUnit(playerX, playerY, playerZ));
+        renderQueue.Submit(PASS_OPAQUE, RenderState::Lit(ModelTexture(player_model)), DrawPlayer, nullptr, &player_model, lod,
+            EyeDistance(playerX, playerY, playerZ));
     }
 
-    // Draw skybox
-    glPushMatrix();
-    GLUquadricObj* qobj = gluNewQuadric();
-    glTranslated(50, 0, 0);
-    glRotated(90, 1, 0, 1);
+    // Draw skybox, after everything it could be behind
     if (currentLevel == 1) {
-        glBindTexture(GL_TEXTURE_2D, tex);
+        TextureManager::Get()->Touch(tex_slot);
     }
     else {
-        glBindTexture(GL_TEXTURE_2D, tex1);
+        TextureManager::Get()->Touch(tex1_slot);
     }
-    gluQuadricTexture(qobj, true);
-    gluQuadricNormals(qobj, GL_SMOOTH);
-    gluSphere(qobj, 150, 100, 100);
-    gluDeleteQuadric(qobj);
-    glPopMatrix();
-    RenderSun();  // Render the sun after skybox
+    renderQueue.Submit(PASS_SKY, RenderState::Lit(currentLevel == 1 ? tex : tex1), DrawSky, nullptr, nullptr, 0, 0);
+    RenderSun();
 
     // Render remaining game elements
     RenderDoor();
     RenderBullets();
     RenderExplosions();
     RenderUI();
-    RenderCrosshair();
+
+    renderQueue.Execute();
+    ReportRenderStats();
+
+    // Shrink textures we haven't drawn in a while if we're over budget
+    TextureManager::Get()->Update();
 
     glutSwapBuffers();
 }
@@ -2229,30 +2788,97 @@ void myMouse(int button, int state, int x, int y) {
     glutPostRedisplay();
 }
 
+// Prints how much reordering a model's faces helped the vertex cache
+void ReportModel(Model_3DS &model) {
+    if (model.modelname == NULL)
+        return;
+
+    printf("%s: %d -> %d vertices, %d faces, ACMR %.2f -> %.2f\n", model.modelname,
+        model.fileVerts, model.totalVerts, model.totalFaces, model.acmrBefore, model.acmrAfter);
+}
+
 void LoadAssets() {
+    TextureManager::Get()->SetBudget(TEXTURE_BUDGET_MB * 1024 * 1024);
+
+    AllocationScope scope(ALLOC_MODELS);
     model_tree.Load("Models/tree/Tree1.3ds");
     model_rock.Load("Models/rock/rock.3ds");
+    // rock.3ds has no map name, so give its material the jpeg by hand
+    if (model_rock.numMaterials > 0)
+        model_rock.Textures[0].LoadAsync("Models/rock/7NVD901GRSYZM8C705GUZDDPI.jpg");
     model_wall.Load("Models/wall/wall.3ds");  // Load wall model
     player_model.Load("Models/sniper/sniper.3ds");
+    // sniper.3ds gives the balaclava the face's map too, so give it its own
+    if (player_model.numMaterials > 3)
+        player_model.Textures[3].Load("Models/sniper/facemask.bmp");
     bullet_model.Load("Models/bullet/f715b0fef46a4629b2ddc35614cc727c.3ds");
     tex_rock.Load("textures/rock.bmp");
-    tex_target.Load("Textures/target.bmp");
     Chair.Load("Models/chair/chair.3ds");
-    tex_mtarget.Load("Textures/metal-target.bmp");
+    ReportModel(model_tree);
+    ReportModel(model_rock);
+    ReportModel(model_wall);
+    ReportModel(player_model);
+    ReportModel(bullet_model);
+    ReportModel(Chair);
+
+    // Pack the small textures, the white block is for untextured quads
+    atlas.Create(512);
+    atlas_white = atlas.AddColor("white", 255, 255, 255);
+    atlas_target = atlas.AddFile("Textures/target.bmp");
+    atlas_mtarget = atlas.AddFile("Textures/metal-target.bmp");
+    if (atlas_mtarget < 0) {
+        atlas_mtarget = atlas_white;
+    }
+    atlas.Build();
+    TextureManager::Get()->TrackId(atlas.texture[0]);
+
+    // Draw the HUD fonts once, the white block is for the game over overlay
+    fontAtlas.Create(512);
+    font_white = fontAtlas.AddColor("white", 255, 255, 255);
+    hudFont.Create(&fontAtlas, "Arial", 18, false);
+    titleFont.Create(&fontAtlas, "Times New Roman", 24, false);
+    fontAtlas.Build();
+    hud.Create(&hudFont);
+    TextureManager::Get()->TrackId(fontAtlas.texture[0]);
     sunQuadric = gluNewQuadric();
+    skyQuadric = gluNewQuadric();
+    gluQuadricTexture(skyQuadric, true);
+    gluQuadricNormals(skyQuadric, GL_SMOOTH);
  
     tex_wall.Load("Textures/wall.bmp");  // Make sure you have a wall texture file
 
     //map1
     tex_ground.Load("Textures/ground.bmp");
     loadBMP(&tex, "Textures/blu-sky-3.bmp", true);
+    tex_slot = TextureManager::Get()->TrackId(tex);
     //map2
     tex_map2ground.Load("Textures/floor.bmp");
     loadBMP(&tex1, "Textures/nightSky.bmp", true);
+    tex1_slot = TextureManager::Get()->TrackId(tex1);
+
+    if (useShaders) {
+        LoadShaderScene();
+    }
+    else {
+        LoadStaticMeshes();
+    }
+
+    BuildScene();
+}
+
+// Places everything in the level. Needs no textures or models, so
+// the soak test can use it too
+void BuildScene() {
+    // The pools never grow past these, so gameplay never reallocates them
+    bullets.reserve(MAX_BULLETS);
+    explosions.reserve(MAX_EXPLOSIONS);
+    targets.reserve(NUM_TARGETS);
+    freeSpots.reserve(NUM_TARGET_SPOTS);
+    wallsChanged = true;
 
     if (currentLevel == 1) {
         // Generate random trees for level 1
-        for (int i = 0; i < 15; i++) {
+        for (int i = 0; i < NUM_TARGET_SPOTS; i++) {
             SceneObject tree;
             tree.x = (rand() % 80) - 40;
             tree.z = (rand() % 80) - 40;
@@ -2266,7 +2892,7 @@ void LoadAssets() {
         treePositions.clear();
 
         // Create a maze-like pattern with walls
-        for (int i = 0; i < 15; i++) {
+        for (int i = 0; i < NUM_TARGET_SPOTS; i++) {
             SceneObject wall;
             wall.x = (rand() % 80) - 40;
             wall.z = (rand() % 80) - 40;
@@ -2329,7 +2955,144 @@ void LoadAssets() {
     SpawnAmmoBoxes();
 }
 
+// "-soak minutes" plays the game by script, as fast as it can and with
+// no window, and checks that once it has warmed up a tick never goes
+// to the heap and the memory in use stops growing
+const float SOAK_WARMUP = 30.0f;  // Seconds for the pools to fill up
+
+// Hunts targets, walks through the door when it opens and never runs
+// out of time, health or ammo so the round goes on forever
+void SoakInput(int tick) {
+    gameTimer = GAME_TIME_LIMIT;
+    playerHealth = 100.0f;
+    if (ammoReserves < MAX_AMMO) {
+        ammoReserves = MAX_AMMO_RESERVES;
+    }
+    if (currentAmmo == 0) {
+        StartReload();
+    }
+
+    // Jump every couple of seconds
+    if (tick % 120 == 0) {
+        myKeyboard(' ', 0, 0);
+        myKeyboardUp(' ', 0, 0);
+    }
+
+    bool toDoor = doorSpawned && levelDoor.active;
+    float goalX = levelDoor.x;
+    float goalY = playerY + 1.7f;
+    float goalZ = levelDoor.z;
+
+    if (!toDoor) {
+        const Target* nearest = nullptr;
+        float nearestDistance = 0.0f;
+        for (const auto& target : targets) {
+            if (!target.active) continue;
+            float dx = target.x - playerX;
+            float dz = target.z - playerZ;
+            float distance = dx * dx + dz * dz;
+            if (nearest == nullptr || distance < nearestDistance) {
+                nearest = &target;
+                nearestDistance = distance;
+            }
+        }
+        if (nearest == nullptr) {
+            isShooting = false;
+            return;
+        }
+        goalX = nearest->x;
+        goalY = nearest->y;
+        goalZ = nearest->z;
+    }
+
+    float dx = goalX - playerX;
+    float dz = goalZ - playerZ;
+    float distance = sqrt(dx * dx + dz * dz);
+
+    playerRotation = atan2(dx, dz) * 180.0f / 3.14159f;
+    if (playerRotation < 0.0f) playerRotation += 360.0f;
+    verticalAngle = atan2(goalY - (playerY + 1.7f), distance) * 180.0f / 3.14159f;
+
+    isShooting = !toDoor && distance < 30.0f;
+    if (!isShooting) {
+        myKeyboard('w', 0, 0);
+    }
+}
+
+int RunSoak(float minutes) {
+    // Without the CRT's hook only operator new is seen
+    if (!AllocationCounter::CountsMalloc()) {
+        printf("soak: warning: this build doesn't count malloc, calloc or realloc, only new (use a debug build)\n");
+    }
+
+    srand(1);
+    BuildScene();
+
+    int ticks = (int)(minutes * 60.0f * 1000.0f / TIMER_INTERVAL);
+    int warmupTicks = (int)(SOAK_WARMUP * 1000.0f / TIMER_INTERVAL);
+    long long warmPeak = 0;
+    int badTicks = 0;
+    int worstTick = 0;
+    int rounds = 0;
+    int tagTotals[ALLOC_TAG_COUNT] = { 0 };
+
+    for (int tick = 0; tick < ticks; tick++) {
+        // Start another round once this one has been won
+        if (gameOver) {
+            gameOver = false;
+            currentLevel = 1;
+            playerScore = 0;
+            SpawnTargets();
+            SpawnAmmoBoxes();
+            rounds++;
+        }
+
+        SoakInput(tick);
+
+        AllocationCounter::NewFrame();
+        SimulateTick();
+
+        if (tick < warmupTicks) {
+            warmPeak = AllocationCounter::PeakBytes();
+            continue;
+        }
+
+        int allocs = AllocationCounter::ThisFrame();
+        if (allocs > 0) {
+            badTicks++;
+            if (allocs > worstTick) worstTick = allocs;
+            for (int i = 0; i < ALLOC_TAG_COUNT; i++) {
+                tagTotals[i] += AllocationCounter::ThisFrame(i);
+            }
+        }
+    }
+
+    long long growth = AllocationCounter::PeakBytes() - warmPeak;
+
+    printf("soak: %d ticks (%.1f minutes), %d rounds won, score %d, level %d\n",
+        ticks, minutes, rounds, playerScore, currentLevel);
+    printf("soak: %d ticks allocated after warm-up, at most %d in one tick\n", badTicks, worstTick);
+    for (int i = 0; i < ALLOC_TAG_COUNT; i++) {
+        if (tagTotals[i] > 0) {
+            printf("soak:   %s: %d\n", AllocationCounter::TagName(i), tagTotals[i]);
+        }
+    }
+    printf("soak: peak %lld bytes, grew %lld after warm-up\n", AllocationCounter::PeakBytes(), growth);
+
+    bool passed = badTicks == 0 && growth == 0;
+    printf("soak: %s\n", passed ? "PASSED" : "FAILED");
+    return passed ? 0 : 1;
+}
+
 int main(int argc, char** argv) {
+    AllocationCounter::HookMalloc();
+
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "-soak") == 0) {
+            return RunSoak((float)atof(argv[i + 1]));
+        }
+    }
+
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
     glutInitWindowSize(WIDTH, HEIGHT);
@@ -2343,15 +3106,43 @@ int main(int argc, char** argv) {
     glutMouseFunc(myMouse);
     glutReshapeFunc(myReshape);
 
-    soundSystem = new SimpleSound();
+    // "-wavout file.wav" records the game's audio instead of playing it
+    const char* captureFile = nullptr;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "-wavout") == 0) {
+            captureFile = argv[i + 1];
+        }
+    }
+
+    soundSystem = new SimpleSound(captureFile);
     myInit();
+
+    // "-shaders" draws with OpenGL 3.3 if the driver has it
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-shaders") == 0) {
+            useShaders = shaders.Create();
+            if (!useShaders) {
+                printf("shaders: no OpenGL 3.3, using the fixed function pipeline\n");
+            }
+        }
+        else if (strcmp(argv[i], "-renderstats") == 0) {
+            showRenderStats = true;
+        }
+    }
+
+    // The fixed function path keeps its static meshes in buffers if the
+    // driver has them
+    if (!useShaders) {
+        glewInit();
+    }
+
     LoadAssets();
 
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_LIGHTING);
-    glEnable(GL_LIGHT0);
-    glEnable(GL_NORMALIZE);
-    glEnable(GL_COLOR_MATERIAL);
+    GLState::Get()->Enable(GL_DEPTH_TEST);
+    GLState::Get()->Enable(GL_LIGHTING);
+    GLState::Get()->Enable(GL_LIGHT0);
+    GLState::Get()->Enable(GL_NORMALIZE);
+    GLState::Get()->Enable(GL_COLOR_MATERIAL);
     glShadeModel(GL_SMOOTH);
 
     glutTimerFunc(TIMER_INTERVAL, updateScene, 0);
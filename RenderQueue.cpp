@@ -0,0 +1,204 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Render Queue
+//
+// RenderQueue.cpp: implementation of the RenderQueue class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "RenderQueue.h"
+#include "GLState.h"
+
+#include <windows.h>		// Header File For Windows
+#include <gl\gl.h>			// Header File For The OpenGL32 Library
+
+#include <algorithm>
+
+// The most packets a frame is expected to have, more just grows the queue
+#define RENDER_RESERVE		1024
+
+// Bits of the depth in the key
+#define DEPTH_BITS			24
+#define DEPTH_MAX			((1 << DEPTH_BITS) - 1)
+
+//////////////////////////////////////////////////////////////////////
+// RenderState
+//////////////////////////////////////////////////////////////////////
+
+RenderState RenderState::Lit(unsigned int texture)
+{
+	RenderState s;
+	s.lighting = true;
+	s.depthTest = true;
+	s.blend = BLEND_NONE;
+	s.texture = texture;
+	s.color[0] = s.color[1] = s.color[2] = s.color[3] = 1.0f;
+	return s;
+}
+
+RenderState RenderState::Unlit(unsigned int texture)
+{
+	RenderState s = Lit(texture);
+	s.lighting = false;
+	return s;
+}
+
+RenderState &RenderState::Color(float r, float g, float b, float a)
+{
+	color[0] = r;
+	color[1] = g;
+	color[2] = b;
+	color[3] = a;
+	return *this;
+}
+
+RenderState &RenderState::Blend(RenderBlend mode)
+{
+	blend = mode;
+	return *this;
+}
+
+RenderState &RenderState::NoDepth()
+{
+	depthTest = false;
+	return *this;
+}
+
+// Packets are sorted on their keys alone
+static bool KeyOrder(const RenderPacket &a, const RenderPacket &b)
+{
+	return a.key < b.key;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+RenderQueue::RenderQueue()
+{
+	for (int i = 0; i < PASS_COUNT; i++)
+	{
+		passBegin[i] = NULL;
+		passEnd[i] = NULL;
+	}
+
+	depthScale = 0.0f;
+	sequence = 0;
+}
+
+void RenderQueue::Begin(float farDistance)
+{
+	// Kept between frames so adding packets doesn't allocate
+	if (packets.capacity() < RENDER_RESERVE)
+		packets.reserve(RENDER_RESERVE);
+
+	packets.clear();
+	depthScale = farDistance > 0.0f ? DEPTH_MAX / farDistance : 0.0f;
+	sequence = 0;
+}
+
+void RenderQueue::Submit(RenderPass pass, const RenderState &state, RenderFunc draw,
+	const void *object, void *resource, int detail, float depth)
+{
+	RenderPacket p;
+	p.state = state;
+	p.draw = draw;
+	p.object = object;
+	p.resource = resource;
+	p.detail = detail;
+
+	// The state bits, one number for each way of drawing
+	unsigned long long bits = (state.lighting ? 1 : 0) | (state.depthTest ? 2 : 0) |
+		(state.blend << 2) | (state.texture != 0 ? 16 : 0);
+
+	unsigned long long texture = state.texture & 0xFFFF;
+
+	// The color, 3 bits a channel
+	unsigned long long material = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		float c = state.color[i] < 0.0f ? 0.0f : state.color[i] > 1.0f ? 1.0f : state.color[i];
+		material = (material << 3) | (unsigned long long)(c * 7.0f + 0.5f);
+	}
+
+	// Opaque from the front, blended from the back, the UI in order
+	unsigned long long d;
+	if (pass == PASS_UI)
+		d = sequence++ & DEPTH_MAX;
+	else
+	{
+		float scaled = depth * depthScale;
+		d = scaled <= 0.0f ? 0 : scaled >= DEPTH_MAX ? DEPTH_MAX : (unsigned long long)scaled;
+		if (pass == PASS_BLENDED)
+			d = DEPTH_MAX - d;
+	}
+
+	unsigned long long key = (unsigned long long)pass << 60;
+	if (pass == PASS_BLENDED || pass == PASS_UI)
+		key |= d << 36 | bits << 28 | texture << 12 | material;
+	else
+		key |= bits << 52 | texture << 36 | material << 24 | d;
+	p.key = key;
+
+	packets.push_back(p);
+}
+
+void RenderQueue::PassFunctions(RenderPass pass, void (*begin)(void), void (*end)(void))
+{
+	passBegin[pass] = begin;
+	passEnd[pass] = end;
+}
+
+int RenderQueue::NumPackets()
+{
+	return (int)packets.size();
+}
+
+//////////////////////////////////////////////////////////////////////
+// Drawing
+//////////////////////////////////////////////////////////////////////
+
+void RenderQueue::Apply(const RenderState &s)
+{
+	GLState *gl = GLState::Get();
+
+	gl->Set(GL_LIGHTING, s.lighting);
+	gl->Set(GL_DEPTH_TEST, s.depthTest);
+
+	gl->Set(GL_BLEND, s.blend != BLEND_NONE);
+	if (s.blend != BLEND_NONE)
+		gl->BlendFunc(GL_SRC_ALPHA, s.blend == BLEND_ADD ? GL_ONE : GL_ONE_MINUS_SRC_ALPHA);
+
+	gl->Set(GL_TEXTURE_2D, s.texture != 0);
+	if (s.texture != 0)
+		gl->BindTexture(s.texture);
+
+	gl->Color(s.color);
+}
+
+void RenderQueue::Execute()
+{
+	std::sort(packets.begin(), packets.end(), KeyOrder);
+
+	int pass = -1;
+	for (size_t i = 0; i < packets.size(); i++)
+	{
+		const RenderPacket &p = packets[i];
+
+		int next = (int)(p.key >> 60);
+		if (next != pass)
+		{
+			if (pass >= 0 && passEnd[pass] != NULL)
+				passEnd[pass]();
+			pass = next;
+			if (passBegin[pass] != NULL)
+				passBegin[pass]();
+		}
+
+		Apply(p.state);
+		p.draw(p);
+	}
+
+	if (pass >= 0 && passEnd[pass] != NULL)
+		passEnd[pass]();
+}
@@ -0,0 +1,111 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Render Queue
+//
+// RenderQueue.h: interface for the RenderQueue class.
+// Collects everything that gets drawn in a frame as packets,
+// sorts them so that draws needing the same state end up next
+// to each other and then draws them. The state goes through
+// GLState, so only the calls that change something are made.
+//
+// A packet says what it needs (lighting, depth testing,
+// blending, a texture and a color) and has a function that
+// draws it. The function only sets up its matrix and sends
+// its vertices, it leaves the state to the queue. If it does
+// change state itself (a model binds its own textures) it has
+// to do it through GLState too.
+//
+// Each packet gets a 64 bit key and the packets are drawn in
+// key order:
+//
+// Opaque and sky	pass 4 | state 8 | texture 16 | material 12 | depth 24
+// Blended and UI	pass 4 | depth 24 | state 8 | texture 16 | material 12
+//
+// The state bits stand in for a shader: every packet with the
+// same lighting, depth test, blending and texturing draws the
+// same way. The material is the color cut down to 3 bits a
+// channel. Opaque packets go front to back so the depth test
+// throws more away, blended ones back to front so they mix
+// right, and the UI in the order it was added.
+//
+// Usage:
+// RenderQueue queue;
+//
+// queue.Begin(zFar);
+// RenderState s = RenderState::Lit(texture);
+// queue.Submit(PASS_OPAQUE, s, DrawTree, &tree, model, lod, distance);
+// queue.Execute();						// Sorts and draws
+// printf("%d binds\n", GLState::Get()->stats.textureBinds);
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <vector>
+
+// Drawn in this order
+enum RenderPass {
+	PASS_OPAQUE,
+	PASS_SKY,			// The sky and the sun, behind everything that's already there
+	PASS_BLENDED,
+	PASS_UI,
+	PASS_COUNT
+};
+
+enum RenderBlend {
+	BLEND_NONE,
+	BLEND_ALPHA,		// GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA
+	BLEND_ADD			// GL_SRC_ALPHA, GL_ONE
+};
+
+// The state a packet needs set before it draws
+struct RenderState {
+	bool lighting;
+	bool depthTest;
+	RenderBlend blend;
+	unsigned int texture;		// 0 for texturing off
+	float color[4];
+
+	static RenderState Lit(unsigned int texture);	// Lighting and depth testing, white, no blending
+	static RenderState Unlit(unsigned int texture);	// The same with lighting off
+	RenderState &Color(float r, float g, float b, float a = 1.0f);
+	RenderState &Blend(RenderBlend mode);
+	RenderState &NoDepth();
+};
+
+struct RenderPacket;
+typedef void (*RenderFunc)(const RenderPacket &packet);
+
+// One thing to draw
+struct RenderPacket {
+	unsigned long long key;
+	RenderState state;
+	RenderFunc draw;
+	const void *object;			// What's drawn and where, for the function
+	void *resource;				// What it's drawn with (a model, a batch)
+	int detail;					// A level of detail, or whatever the function wants
+};
+
+class RenderQueue
+{
+public:
+	void Begin(float farDistance);				// Empties the queue, depths go from 0 to farDistance
+	void Submit(RenderPass pass, const RenderState &state, RenderFunc draw,
+		const void *object, void *resource, int detail, float depth);	// Adds a packet
+	void Execute();								// Sorts the packets and draws them
+	void PassFunctions(RenderPass pass, void (*begin)(void), void (*end)(void));	// Called around a pass, for its matrices
+	int NumPackets();
+	RenderQueue();								// Constructor
+
+private:
+	std::vector<RenderPacket> packets;
+	void (*passBegin[PASS_COUNT])(void);
+	void (*passEnd[PASS_COUNT])(void);
+	float depthScale;							// Depth to the 24 bits it gets in the key
+	unsigned int sequence;						// Submission order, for the UI pass
+
+	void Apply(const RenderState &state);
+};
+
+#endif RENDERQUEUE_H
@@ -0,0 +1,1028 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Shader Renderer
+//
+// ShaderRenderer.cpp: implementation of the ShaderRenderer class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "ShaderRenderer.h"
+#include "TextureManager.h"
+#include "GLState.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+// Where the shaders find each attribute
+#define ATTRIB_POSITION		0
+#define ATTRIB_NORMAL		1
+#define ATTRIB_TEXCOORD		2
+#define ATTRIB_COLOR		3
+#define ATTRIB_MODEL		4		// Takes 4 to 7, a column each
+#define ATTRIB_TINT			8
+
+// And each uniform block
+#define BLOCK_FRAME			0
+#define BLOCK_LIGHTS		1
+
+//////////////////////////////////////////////////////////////////////
+// Shaders
+//////////////////////////////////////////////////////////////////////
+
+// Every program gets the frame's uniforms
+#define SHADER_HEADER \
+	"#version 330 core\n" \
+	"layout(std140) uniform Frame {\n" \
+	"	mat4 view;\n" \
+	"	mat4 projection;\n" \
+	"	mat4 ui;\n" \
+	"	vec4 eye;\n" \
+	"	vec4 ambient;\n" \
+	"	vec4 specular;\n" \
+	"	ivec4 numLights;\n" \
+	"};\n"
+
+// The lit, unlit and UI programs all take meshes and instances
+#define MESH_INPUTS \
+	"layout(location = 0) in vec3 position;\n" \
+	"layout(location = 1) in vec3 normal;\n" \
+	"layout(location = 2) in vec2 texCoord;\n" \
+	"layout(location = 3) in vec4 color;\n" \
+	"layout(location = 4) in mat4 model;\n" \
+	"layout(location = 8) in vec4 tint;\n"
+
+static const char *litVertex =
+	SHADER_HEADER
+	MESH_INPUTS
+	"out vec3 worldPosition;\n"
+	"out vec3 worldNormal;\n"
+	"out vec2 uv;\n"
+	"out vec4 material;\n"
+	"void main() {\n"
+	"	vec4 p = model * vec4(position, 1.0);\n"
+	"	worldPosition = p.xyz;\n"
+	"	worldNormal = mat3(model) * normal;\n"
+	"	uv = texCoord;\n"
+	"	material = color * tint;\n"
+	"	gl_Position = projection * view * p;\n"
+	"}\n";
+
+// glColorMaterial(GL_FRONT, GL_AMBIENT_AND_DIFFUSE) lighting, done for
+// each pixel, and then GL_MODULATE with the texture
+static const char *litFragment =
+	SHADER_HEADER
+	"struct Light {\n"
+	"	vec4 position;\n"
+	"	vec4 direction;\n"
+	"	vec4 ambient;\n"
+	"	vec4 diffuse;\n"
+	"	vec4 specular;\n"
+	"	vec4 spot;\n"
+	"};\n"
+	"layout(std140) uniform Lights {\n"
+	"	Light lights[4];\n"
+	"};\n"
+	"uniform sampler2D image;\n"
+	"in vec3 worldPosition;\n"
+	"in vec3 worldNormal;\n"
+	"in vec2 uv;\n"
+	"in vec4 material;\n"
+	"out vec4 fragColor;\n"
+	"void main() {\n"
+	"	vec3 n = normalize(worldNormal);\n"
+	"	vec3 toEye = normalize(eye.xyz - worldPosition);\n"
+	"	vec3 lit = ambient.rgb * material.rgb;\n"
+	"	for (int i = 0; i < numLights.x; i++) {\n"
+	"		vec3 l = normalize(lights[i].position.xyz);\n"
+	"		float attenuation = 1.0;\n"
+	"		if (lights[i].position.w != 0.0) {\n"
+	"			vec3 d = lights[i].position.xyz - worldPosition;\n"
+	"			float distance = length(d);\n"
+	"			l = d / distance;\n"
+	"			attenuation = 1.0 / dot(lights[i].spot.yzw, vec3(1.0, distance, distance * distance));\n"
+	"			if (lights[i].direction.w > -1.5) {\n"
+	"				float c = dot(-l, normalize(lights[i].direction.xyz));\n"
+	"				attenuation *= c >= lights[i].direction.w ? pow(max(c, 0.0), lights[i].spot.x) : 0.0;\n"
+	"			}\n"
+	"		}\n"
+	"		float diffuse = max(dot(n, l), 0.0);\n"
+	"		float shine = diffuse > 0.0 ? pow(max(dot(n, normalize(l + toEye)), 0.0), specular.w) : 0.0;\n"
+	"		lit += attenuation * (lights[i].ambient.rgb * material.rgb + lights[i].diffuse.rgb * material.rgb * diffuse +\n"
+	"			lights[i].specular.rgb * specular.rgb * shine);\n"
+	"	}\n"
+	"	fragColor = vec4(min(lit, vec3(1.0)), material.a) * texture(image, uv);\n"
+	"}\n";
+
+static const char *unlitVertex =
+	SHADER_HEADER
+	MESH_INPUTS
+	"out vec2 uv;\n"
+	"out vec4 material;\n"
+	"void main() {\n"
+	"	uv = texCoord;\n"
+	"	material = color * tint;\n"
+	"	gl_Position = projection * view * model * vec4(position, 1.0);\n"
+	"}\n";
+
+static const char *unlitFragment =
+	"#version 330 core\n"
+	"uniform sampler2D image;\n"
+	"in vec2 uv;\n"
+	"in vec4 material;\n"
+	"out vec4 fragColor;\n"
+	"void main() {\n"
+	"	fragColor = material * texture(image, uv);\n"
+	"}\n";
+
+// The corners are pushed out along the camera's own right and up
+static const char *particleVertex =
+	SHADER_HEADER
+	"layout(location = 0) in vec2 corner;\n"
+	"layout(location = 4) in vec4 center;\n"
+	"layout(location = 8) in vec4 tint;\n"
+	"out vec4 material;\n"
+	"void main() {\n"
+	"	vec3 right = vec3(view[0][0], view[1][0], view[2][0]);\n"
+	"	vec3 up = vec3(view[0][1], view[1][1], view[2][1]);\n"
+	"	vec3 p = center.xyz + (right * corner.x + up * corner.y) * center.w;\n"
+	"	material = tint;\n"
+	"	gl_Position = projection * view * vec4(p, 1.0);\n"
+	"}\n";
+
+static const char *particleFragment =
+	"#version 330 core\n"
+	"in vec4 material;\n"
+	"out vec4 fragColor;\n"
+	"void main() {\n"
+	"	fragColor = material;\n"
+	"}\n";
+
+static const char *uiVertex =
+	SHADER_HEADER
+	MESH_INPUTS
+	"out vec2 uv;\n"
+	"out vec4 material;\n"
+	"void main() {\n"
+	"	uv = texCoord;\n"
+	"	material = color * tint;\n"
+	"	gl_Position = ui * model * vec4(position, 1.0);\n"
+	"}\n";
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+ShaderRenderer::ShaderRenderer()
+{
+	memset(&stats, 0, sizeof(stats));
+	memset(programs, 0, sizeof(programs));
+	frameBuffer = 0;
+	lightBuffer = 0;
+	instanceBuffer = 0;
+	batchBuffer = 0;
+	quadIndices = 0;
+	batchVao = 0;
+	particleVao = 0;
+	particleCorners = 0;
+	white = 0;
+	boundProgram = 0;
+	ready = false;
+}
+
+ShaderRenderer::~ShaderRenderer()
+{
+	Destroy();
+}
+
+void ShaderRenderer::Destroy()
+{
+	// Without GLEW there are no functions to call
+	if (!ready)
+		return;
+
+	for (int i = 0; i < SHADER_COUNT; i++)
+		glDeleteProgram(programs[i]);
+
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		glDeleteVertexArrays(1, &meshes[i].vao);
+		glDeleteBuffers(1, &meshes[i].vertices);
+		glDeleteBuffers(1, &meshes[i].indices);
+	}
+
+	GLuint buffers[] = { frameBuffer, lightBuffer, instanceBuffer, batchBuffer, quadIndices, particleCorners };
+	glDeleteBuffers(6, buffers);
+
+	GLuint arrays[] = { batchVao, particleVao };
+	glDeleteVertexArrays(2, arrays);
+
+	GLState::Get()->DeleteTexture(white);
+
+	meshes.clear();
+	models.clear();
+	faceOffsets.clear();
+	memset(programs, 0, sizeof(programs));
+	ready = false;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Setting up
+//////////////////////////////////////////////////////////////////////
+
+bool ShaderRenderer::Create()
+{
+	// GLEW only looks for the core functions it was told about unless
+	// it's told to try them all
+	glewExperimental = GL_TRUE;
+	if (glewInit() != GLEW_OK || !GLEW_VERSION_3_3)
+		return false;
+
+	// glewInit asks for the extension string the old way, which a core
+	// context doesn't like
+	while (glGetError() != GL_NO_ERROR)
+		;
+
+	ready = true;
+
+	programs[SHADER_LIT] = Compile(litVertex, litFragment);
+	programs[SHADER_UNLIT] = Compile(unlitVertex, unlitFragment);
+	programs[SHADER_PARTICLE] = Compile(particleVertex, particleFragment);
+	programs[SHADER_UI] = Compile(uiVertex, unlitFragment);
+
+	for (int i = 0; i < SHADER_COUNT; i++)
+	{
+		if (programs[i] == 0)
+		{
+			Destroy();
+			return false;
+		}
+	}
+
+	// The frame and the lights, bound once and for all
+	glGenBuffers(1, &frameBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, frameBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(ShaderFrame), NULL, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, BLOCK_FRAME, frameBuffer);
+
+	glGenBuffers(1, &lightBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, lightBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(ShaderLight) * SHADER_MAX_LIGHTS, NULL, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, BLOCK_LIGHTS, lightBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	glGenBuffers(1, &instanceBuffer);
+	glGenBuffers(1, &batchBuffer);
+
+	// Two triangles for every quad an AtlasBatch can have
+	std::vector<unsigned short> quad(SHADER_MAX_QUADS * 6);
+	for (int q = 0; q < SHADER_MAX_QUADS; q++)
+	{
+		unsigned short v = (unsigned short)(q * 4);
+		unsigned short corners[] = { v, (unsigned short)(v + 1), (unsigned short)(v + 2), v, (unsigned short)(v + 2), (unsigned short)(v + 3) };
+		memcpy(&quad[q * 6], corners, sizeof(corners));
+	}
+
+	glGenBuffers(1, &quadIndices);
+
+	// The batches' vertices are AtlasBatch's own
+	glGenVertexArrays(1, &batchVao);
+	glBindVertexArray(batchVao);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadIndices);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, quad.size() * sizeof(unsigned short), &quad[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, batchBuffer);
+	glEnableVertexAttribArray(ATTRIB_POSITION);
+	glVertexAttribPointer(ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(AtlasBatch::BatchVertex), (void *)offsetof(AtlasBatch::BatchVertex, x));
+	glEnableVertexAttribArray(ATTRIB_TEXCOORD);
+	glVertexAttribPointer(ATTRIB_TEXCOORD, 2, GL_FLOAT, GL_FALSE, sizeof(AtlasBatch::BatchVertex), (void *)offsetof(AtlasBatch::BatchVertex, u));
+	glEnableVertexAttribArray(ATTRIB_COLOR);
+	glVertexAttribPointer(ATTRIB_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(AtlasBatch::BatchVertex), (void *)offsetof(AtlasBatch::BatchVertex, r));
+	InstanceAttributes();
+
+	// A particle is a strip of four corners, the rest is its instance
+	float corners[] = { -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f };
+
+	glGenVertexArrays(1, &particleVao);
+	glBindVertexArray(particleVao);
+	glGenBuffers(1, &particleCorners);
+	glBindBuffer(GL_ARRAY_BUFFER, particleCorners);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(ATTRIB_POSITION);
+	glVertexAttribPointer(ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE, 0, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	glEnableVertexAttribArray(ATTRIB_MODEL);
+	glVertexAttribPointer(ATTRIB_MODEL, 4, GL_FLOAT, GL_FALSE, sizeof(ShaderParticle), (void *)offsetof(ShaderParticle, x));
+	glVertexAttribDivisorARB(ATTRIB_MODEL, 1);
+	glEnableVertexAttribArray(ATTRIB_TINT);
+	glVertexAttribPointer(ATTRIB_TINT, 4, GL_FLOAT, GL_FALSE, sizeof(ShaderParticle), (void *)offsetof(ShaderParticle, color));
+	glVertexAttribDivisorARB(ATTRIB_TINT, 1);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// Untextured things still sample something
+	unsigned char pixel[] = { 255, 255, 255, 255 };
+	glGenTextures(1, &white);
+	GLState::Get()->BindTexture(white);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	GLState::Get()->BindTexture(0);
+
+	scratch.resize(SHADER_MAX_INSTANCES);
+
+	return true;
+}
+
+GLuint ShaderRenderer::Compile(const char *vertex, const char *fragment)
+{
+	const char *sources[] = { vertex, fragment };
+	GLenum types[] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+	GLuint program = glCreateProgram();
+	char log[1024];
+
+	for (int i = 0; i < 2; i++)
+	{
+		GLuint shader = glCreateShader(types[i]);
+		glShaderSource(shader, 1, &sources[i], NULL);
+		glCompileShader(shader);
+
+		GLint compiled = GL_FALSE;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+		if (compiled != GL_TRUE)
+		{
+			glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+			printf("shader: %s\n", log);
+			glDeleteShader(shader);
+			glDeleteProgram(program);
+			return 0;
+		}
+
+		// The program keeps it until it's deleted itself
+		glAttachShader(program, shader);
+		glDeleteShader(shader);
+	}
+
+	glLinkProgram(program);
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (linked != GL_TRUE)
+	{
+		glGetProgramInfoLog(program, sizeof(log), NULL, log);
+		printf("shader: %s\n", log);
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	// Every program reads the same buffers and texture unit
+	GLuint block = glGetUniformBlockIndex(program, "Frame");
+	if (block != GL_INVALID_INDEX)
+		glUniformBlockBinding(program, block, BLOCK_FRAME);
+
+	block = glGetUniformBlockIndex(program, "Lights");
+	if (block != GL_INVALID_INDEX)
+		glUniformBlockBinding(program, block, BLOCK_LIGHTS);
+
+	glUseProgram(program);
+	GLint image = glGetUniformLocation(program, "image");
+	if (image >= 0)
+		glUniform1i(image, 0);
+	glUseProgram(0);
+
+	return program;
+}
+
+void ShaderRenderer::InstanceAttributes()
+{
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+
+	for (int c = 0; c < 4; c++)
+	{
+		glEnableVertexAttribArray(ATTRIB_MODEL + c);
+		glVertexAttribPointer(ATTRIB_MODEL + c, 4, GL_FLOAT, GL_FALSE, sizeof(ShaderInstance), (void *)(offsetof(ShaderInstance, model) + c * 4 * sizeof(float)));
+		glVertexAttribDivisorARB(ATTRIB_MODEL + c, 1);
+	}
+
+	glEnableVertexAttribArray(ATTRIB_TINT);
+	glVertexAttribPointer(ATTRIB_TINT, 4, GL_FLOAT, GL_FALSE, sizeof(ShaderInstance), (void *)offsetof(ShaderInstance, color));
+	glVertexAttribDivisorARB(ATTRIB_TINT, 1);
+}
+
+int ShaderRenderer::NewMesh(bool normals, bool colors)
+{
+	Mesh m;
+	m.numIndices = 0;
+	m.normals = normals;
+	m.colors = colors;
+
+	glGenVertexArrays(1, &m.vao);
+	glGenBuffers(1, &m.vertices);
+	glGenBuffers(1, &m.indices);
+
+	glBindVertexArray(m.vao);
+	InstanceAttributes();
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m.indices);
+	glBindBuffer(GL_ARRAY_BUFFER, m.vertices);
+
+	// The caller points the vertex attributes at the buffer and unbinds
+	meshes.push_back(m);
+	return (int)meshes.size() - 1;
+}
+
+int ShaderRenderer::AddMesh(const ShaderVertex *vertices, int numVertices, const unsigned short *indices, int numIndices)
+{
+	if (!ready || numVertices <= 0 || numIndices <= 0)
+		return -1;
+
+	int handle = NewMesh(true, true);
+	meshes[handle].numIndices = numIndices;
+
+	glBufferData(GL_ARRAY_BUFFER, numVertices * sizeof(ShaderVertex), vertices, GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices * sizeof(unsigned short), indices, GL_STATIC_DRAW);
+
+	glEnableVertexAttribArray(ATTRIB_POSITION);
+	glVertexAttribPointer(ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(ShaderVertex), (void *)offsetof(ShaderVertex, x));
+	glEnableVertexAttribArray(ATTRIB_NORMAL);
+	glVertexAttribPointer(ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(ShaderVertex), (void *)offsetof(ShaderVertex, nx));
+	glEnableVertexAttribArray(ATTRIB_TEXCOORD);
+	glVertexAttribPointer(ATTRIB_TEXCOORD, 2, GL_FLOAT, GL_FALSE, sizeof(ShaderVertex), (void *)offsetof(ShaderVertex, u));
+	glEnableVertexAttribArray(ATTRIB_COLOR);
+	glVertexAttribPointer(ATTRIB_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ShaderVertex), (void *)offsetof(ShaderVertex, r));
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	return handle;
+}
+
+int ShaderRenderer::AddSphere(int slices, int stacks)
+{
+	std::vector<ShaderVertex> vertices;
+	std::vector<unsigned short> indices;
+
+	if (slices < 3 || stacks < 2 || (slices + 1) * (stacks + 1) > 65535)
+		return -1;
+
+	// gluSphere goes down from the +z pole, s around and t from 1 to 0
+	for (int j = 0; j <= stacks; j++)
+	{
+		float rho = 3.14159265f * j / stacks;
+
+		for (int i = 0; i <= slices; i++)
+		{
+			float theta = i == slices ? 0.0f : 2.0f * 3.14159265f * i / slices;
+			ShaderVertex v;
+
+			v.nx = -sinf(theta) * sinf(rho);
+			v.ny = cosf(theta) * sinf(rho);
+			v.nz = cosf(rho);
+			v.x = v.nx;
+			v.y = v.ny;
+			v.z = v.nz;
+			v.u = (float)i / slices;
+			v.v = 1.0f - (float)j / stacks;
+			v.r = v.g = v.b = v.a = 255;
+			vertices.push_back(v);
+		}
+	}
+
+	for (int j = 0; j < stacks; j++)
+	{
+		for (int i = 0; i < slices; i++)
+		{
+			unsigned short a = (unsigned short)(j * (slices + 1) + i);
+			unsigned short b = (unsigned short)(a + slices + 1);
+
+			indices.push_back(a);
+			indices.push_back(b);
+			indices.push_back((unsigned short)(a + 1));
+			indices.push_back((unsigned short)(a + 1));
+			indices.push_back(b);
+			indices.push_back((unsigned short)(b + 1));
+		}
+	}
+
+	return AddMesh(&vertices[0], (int)vertices.size(), &indices[0], (int)indices.size());
+}
+
+int ShaderRenderer::AddModel(Model_3DS *model)
+{
+	if (!ready || model->totalVerts == 0 || model->numLods == 0 || model->MeshVertexes == NULL)
+		return -1;
+
+	int handle = NewMesh(model->MeshNormals != NULL, false);
+	Mesh &m = meshes[handle];
+
+	// The three arrays one after the other
+	size_t positions = model->totalVerts * 3 * sizeof(float);
+	size_t normals = m.normals ? positions : 0;
+	size_t texCoords = model->MeshTexCoords != NULL ? model->totalVerts * 2 * sizeof(float) : 0;
+
+	glBufferData(GL_ARRAY_BUFFER, positions + normals + texCoords, NULL, GL_STATIC_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, positions, model->MeshVertexes);
+
+	glEnableVertexAttribArray(ATTRIB_POSITION);
+	glVertexAttribPointer(ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+	if (normals > 0)
+	{
+		glBufferSubData(GL_ARRAY_BUFFER, positions, normals, model->MeshNormals);
+		glEnableVertexAttribArray(ATTRIB_NORMAL);
+		glVertexAttribPointer(ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, 0, (void *)positions);
+	}
+
+	if (texCoords > 0)
+	{
+		glBufferSubData(GL_ARRAY_BUFFER, positions + normals, texCoords, model->MeshTexCoords);
+		glEnableVertexAttribArray(ATTRIB_TEXCOORD);
+		glVertexAttribPointer(ATTRIB_TEXCOORD, 2, GL_FLOAT, GL_FALSE, 0, (void *)(positions + normals));
+	}
+
+	// Every level's indices, then each object's faces for drawing it
+	// posed. The levels go first so 32 bit ones stay lined up
+	GpuModel g;
+	g.model = model;
+	g.mesh = handle;
+	g.firstFaces = (int)faceOffsets.size();
+
+	size_t indexSize = model->indexType == MODEL_INDEX_32 ? sizeof(GLuint) : sizeof(GLushort);
+	size_t size = 0;
+
+	for (int l = 0; l < model->numLods; l++)
+	{
+		g.lodOffset[l] = size;
+		size += model->Lods[l].numFaces * 3 * indexSize;
+	}
+
+	for (int i = 0; i < model->numObjects; i++)
+	{
+		for (int j = 0; j < model->Objects[i].numMatFaces; j++)
+		{
+			faceOffsets.push_back(size);
+			size += model->Objects[i].MatFaces[j].numSubFaces * sizeof(GLushort);
+		}
+	}
+
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, NULL, GL_STATIC_DRAW);
+
+	for (int l = 0; l < model->numLods; l++)
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, g.lodOffset[l], model->Lods[l].numFaces * 3 * indexSize, model->Lods[l].indices);
+
+	int face = g.firstFaces;
+	for (int i = 0; i < model->numObjects; i++)
+	{
+		for (int j = 0; j < model->Objects[i].numMatFaces; j++, face++)
+		{
+			Mesh_3DS::MaterialFaces &f = model->Objects[i].MatFaces[j];
+			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, faceOffsets[face], f.numSubFaces * sizeof(GLushort), f.subFaces);
+		}
+	}
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	models.push_back(g);
+	return (int)models.size() - 1;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Drawing
+//////////////////////////////////////////////////////////////////////
+
+void ShaderRenderer::BeginFrame(const ShaderFrame &frame, const ShaderLight *lights, int numLights)
+{
+	if (!ready)
+		return;
+
+	memset(&stats, 0, sizeof(stats));
+
+	// Textures go through GLState, so only the program has to be
+	// bound again in case something else used one
+	boundProgram = 0;
+	glActiveTexture(GL_TEXTURE0);
+
+	if (numLights > SHADER_MAX_LIGHTS)
+		numLights = SHADER_MAX_LIGHTS;
+
+	ShaderFrame f = frame;
+	f.numLights[0] = numLights;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, frameBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(f), &f);
+
+	if (numLights > 0)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, lightBuffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, numLights * sizeof(ShaderLight), lights);
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void ShaderRenderer::UseProgram(ShaderProgram program)
+{
+	if (boundProgram == programs[program])
+	{
+		stats.skippedBinds++;
+		return;
+	}
+
+	glUseProgram(programs[program]);
+	boundProgram = programs[program];
+	stats.programBinds++;
+}
+
+void ShaderRenderer::UseTexture(GLuint texture)
+{
+	if (texture == 0)
+		texture = white;
+
+	if (GLState::Get()->BindTexture(texture))
+		stats.textureBinds++;
+	else
+		stats.skippedBinds++;
+}
+
+void ShaderRenderer::UseTexture(GLTexture *texture)
+{
+	UseTexture(texture->texture[0]);
+
+	// Let the manager know we still need it
+	if (texture->residency >= 0)
+		TextureManager::Get()->Touch(texture->residency);
+}
+
+void ShaderRenderer::Upload(GLuint buffer, const void *data, size_t bytes)
+{
+	// A new store each time, so the driver never waits for the last draw
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, bytes, data, GL_STREAM_DRAW);
+	stats.uploads += (int)bytes;
+}
+
+void ShaderRenderer::BindMesh(const Mesh &m)
+{
+	glBindVertexArray(m.vao);
+
+	// An attribute without an array reads these instead
+	if (!m.normals)
+		glVertexAttrib3f(ATTRIB_NORMAL, 0.0f, 1.0f, 0.0f);
+	if (!m.colors)
+		glVertexAttrib4f(ATTRIB_COLOR, 1.0f, 1.0f, 1.0f, 1.0f);
+}
+
+void ShaderRenderer::DrawMesh(int mesh, ShaderProgram program, GLuint texture, const ShaderInstance *instances, int count)
+{
+	if (!ready || mesh < 0 || mesh >= (int)meshes.size())
+		return;
+
+	Mesh &m = meshes[mesh];
+
+	UseProgram(program);
+	UseTexture(texture);
+	BindMesh(m);
+
+	for (int first = 0; first < count; first += SHADER_MAX_INSTANCES)
+	{
+		int n = count - first < SHADER_MAX_INSTANCES ? count - first : SHADER_MAX_INSTANCES;
+
+		Upload(instanceBuffer, instances + first, n * sizeof(ShaderInstance));
+		glDrawElementsInstanced(GL_TRIANGLES, m.numIndices, GL_UNSIGNED_SHORT, 0, n);
+		stats.draws++;
+		stats.instances += n;
+	}
+}
+
+const ShaderInstance *ShaderRenderer::Place(Model_3DS *model, const ShaderInstance *instances, int count)
+{
+	// What Model_3DS::Draw does before it draws anything
+	float own[16];
+	MatrixIdentity(own);
+	MatrixTranslate(own, model->pos.x, model->pos.y, model->pos.z);
+	MatrixRotate(own, model->rot.x, 1.0f, 0.0f, 0.0f);
+	MatrixRotate(own, model->rot.y, 0.0f, 1.0f, 0.0f);
+	MatrixRotate(own, model->rot.z, 0.0f, 0.0f, 1.0f);
+	MatrixScale(own, model->scale, model->scale, model->scale);
+
+	for (int i = 0; i < count; i++)
+	{
+		scratch[i] = instances[i];
+		MatrixMultiply(scratch[i].model, own);
+	}
+
+	return &scratch[0];
+}
+
+void ShaderRenderer::DrawModel(int model, int lod, const ShaderInstance *instances, int count)
+{
+	if (!ready || model < 0 || model >= (int)models.size() || count <= 0)
+		return;
+
+	GpuModel &g = models[model];
+	Model_3DS *m = g.model;
+
+	if (!m->visible)
+		return;
+
+	// An object moved on its own can't use the merged mesh
+	if (!m->Merged())
+	{
+		for (int i = 0; i < count; i++)
+			DrawModelPosed(model, lod, instances[i], -1.0f);
+		return;
+	}
+
+	if (lod < 0 || lod >= m->numLods)
+		lod = 0;
+
+	UseProgram(m->lit ? SHADER_LIT : SHADER_UNLIT);
+	BindMesh(meshes[g.mesh]);
+
+	size_t indexSize = m->indexType == MODEL_INDEX_32 ? sizeof(GLuint) : sizeof(GLushort);
+	Mesh_3DS::Lod &l = m->Lods[lod];
+
+	// Every instance goes up once and each material draws them all
+	for (int first = 0; first < count; first += SHADER_MAX_INSTANCES)
+	{
+		int n = count - first < SHADER_MAX_INSTANCES ? count - first : SHADER_MAX_INSTANCES;
+
+		Upload(instanceBuffer, Place(m, instances + first, n), n * sizeof(ShaderInstance));
+
+		for (int b = 0; b < l.numBatches; b++)
+		{
+			if (m->Textures != NULL)
+				UseTexture(&m->Textures[l.batches[b].MatIndex]);
+			else
+				UseTexture((GLuint)0);
+
+			glDrawElementsInstanced(GL_TRIANGLES, l.batches[b].count, m->indexType, (void *)(g.lodOffset[lod] + l.batches[b].first * indexSize), n);
+			stats.draws++;
+			stats.instances += n;
+		}
+	}
+}
+
+void ShaderRenderer::DrawModelPosed(int model, int lod, const ShaderInstance &instance, float time)
+{
+	if (!ready || model < 0 || model >= (int)models.size())
+		return;
+
+	GpuModel &g = models[model];
+	Model_3DS *m = g.model;
+
+	if (!m->visible)
+		return;
+
+	bool posed = time >= 0.0f && m->anim.numFrames > 0;
+
+	if (!posed && m->Merged())
+	{
+		DrawModel(model, lod, &instance, 1);
+		return;
+	}
+
+	UseProgram(m->lit ? SHADER_LIT : SHADER_UNLIT);
+	BindMesh(meshes[g.mesh]);
+
+	const ShaderInstance *placed = Place(m, &instance, 1);
+	ShaderInstance object = *placed;
+	int face = g.firstFaces;
+
+	// One object at a time, the same as Model_3DS::Draw does it
+	for (int i = 0; i < m->numObjects; i++)
+	{
+		Mesh_3DS::Object &o = m->Objects[i];
+
+		memcpy(object.model, placed->model, sizeof(object.model));
+		MatrixTranslate(object.model, o.pos.x, o.pos.y, o.pos.z);
+		MatrixRotate(object.model, o.rot.z, 0.0f, 0.0f, 1.0f);
+		MatrixRotate(object.model, o.rot.y, 0.0f, 1.0f, 0.0f);
+		MatrixRotate(object.model, o.rot.x, 1.0f, 0.0f, 0.0f);
+
+		if (posed)
+		{
+			float pose[16];
+			m->anim.Sample(time, i, pose);
+			MatrixMultiply(object.model, pose);
+		}
+
+		Upload(instanceBuffer, &object, sizeof(object));
+
+		// The objects' vertices are runs of the merged arrays
+		int baseVertex = (int)((o.Vertexes - m->MeshVertexes) / 3);
+
+		for (int j = 0; j < o.numMatFaces; j++, face++)
+		{
+			if (o.MatFaces[j].MatIndex >= m->numMaterials)
+				continue;
+
+			if (m->Textures != NULL)
+				UseTexture(&m->Textures[o.MatFaces[j].MatIndex]);
+			else
+				UseTexture((GLuint)0);
+
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, o.MatFaces[j].numSubFaces, GL_UNSIGNED_SHORT,
+				(void *)faceOffsets[face], 1, baseVertex);
+			stats.draws++;
+			stats.instances++;
+		}
+	}
+}
+
+void ShaderRenderer::DrawParticles(const ShaderParticle *particles, int count)
+{
+	if (!ready || count <= 0)
+		return;
+
+	UseProgram(SHADER_PARTICLE);
+	glBindVertexArray(particleVao);
+
+	for (int first = 0; first < count; first += SHADER_MAX_INSTANCES)
+	{
+		int n = count - first < SHADER_MAX_INSTANCES ? count - first : SHADER_MAX_INSTANCES;
+
+		Upload(instanceBuffer, particles + first, n * sizeof(ShaderParticle));
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, n);
+		stats.draws++;
+		stats.instances += n;
+	}
+}
+
+void ShaderRenderer::DrawBatch(AtlasBatch *batch, TextureAtlas *atlas, ShaderProgram program)
+{
+	const std::vector<AtlasBatch::BatchVertex> &quads = batch->QuadVertices();
+	const std::vector<AtlasBatch::BatchVertex> &lines = batch->LineVertices();
+
+	if (!ready || (quads.empty() && lines.empty()))
+		return;
+
+	UseProgram(program);
+	UseTexture(atlas->texture[0]);
+	glBindVertexArray(batchVao);
+
+	// The vertices are already where they go, like glNormal3f(0, 1, 0)
+	// the normal is whatever was set last
+	ShaderInstance identity;
+	MatrixIdentity(identity.model);
+	identity.color[0] = identity.color[1] = identity.color[2] = identity.color[3] = 1.0f;
+	glVertexAttrib3f(ATTRIB_NORMAL, 0.0f, 1.0f, 0.0f);
+	Upload(instanceBuffer, &identity, sizeof(identity));
+
+	if (!quads.empty())
+	{
+		Upload(batchBuffer, &quads[0], quads.size() * sizeof(AtlasBatch::BatchVertex));
+
+		int numQuads = (int)quads.size() / 4;
+		for (int first = 0; first < numQuads; first += SHADER_MAX_QUADS)
+		{
+			int n = numQuads - first < SHADER_MAX_QUADS ? numQuads - first : SHADER_MAX_QUADS;
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, n * 6, GL_UNSIGNED_SHORT, 0, 1, first * 4);
+			stats.draws++;
+			stats.instances++;
+		}
+	}
+
+	if (!lines.empty())
+	{
+		Upload(batchBuffer, &lines[0], lines.size() * sizeof(AtlasBatch::BatchVertex));
+		glDrawArraysInstanced(GL_LINES, 0, (GLsizei)lines.size(), 1);
+		stats.draws++;
+		stats.instances++;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+// Matrices
+//////////////////////////////////////////////////////////////////////
+
+void MatrixIdentity(float *m)
+{
+	memset(m, 0, 16 * sizeof(float));
+	m[0] = m[5] = m[10] = m[15] = 1.0f;
+}
+
+void MatrixMultiply(float *m, const float *by)
+{
+	float r[16];
+
+	for (int c = 0; c < 4; c++)
+	{
+		for (int row = 0; row < 4; row++)
+		{
+			r[c * 4 + row] = m[row] * by[c * 4] + m[4 + row] * by[c * 4 + 1] +
+				m[8 + row] * by[c * 4 + 2] + m[12 + row] * by[c * 4 + 3];
+		}
+	}
+
+	memcpy(m, r, sizeof(r));
+}
+
+void MatrixTranslate(float *m, float x, float y, float z)
+{
+	// Only the last column changes
+	for (int row = 0; row < 4; row++)
+		m[12 + row] += m[row] * x + m[4 + row] * y + m[8 + row] * z;
+}
+
+void MatrixRotate(float *m, float angle, float x, float y, float z)
+{
+	if (angle == 0.0f)
+		return;
+
+	float length = sqrtf(x * x + y * y + z * z);
+	if (length == 0.0f)
+		return;
+
+	x /= length;
+	y /= length;
+	z /= length;
+
+	float a = angle * 3.14159265f / 180.0f;
+	float c = cosf(a);
+	float s = sinf(a);
+	float t = 1.0f - c;
+
+	float r[16] = {
+		x * x * t + c,		y * x * t + z * s,	x * z * t - y * s,	0.0f,
+		x * y * t - z * s,	y * y * t + c,		y * z * t + x * s,	0.0f,
+		x * z * t + y * s,	y * z * t - x * s,	z * z * t + c,		0.0f,
+		0.0f,				0.0f,				0.0f,				1.0f
+	};
+
+	MatrixMultiply(m, r);
+}
+
+void MatrixScale(float *m, float x, float y, float z)
+{
+	for (int row = 0; row < 4; row++)
+	{
+		m[row] *= x;
+		m[4 + row] *= y;
+		m[8 + row] *= z;
+	}
+}
+
+void MatrixPerspective(float *m, float fovy, float aspect, float zNear, float zFar)
+{
+	float f = 1.0f / tanf(fovy * 0.5f * 3.14159265f / 180.0f);
+	float r[16];
+
+	memset(r, 0, sizeof(r));
+	r[0] = f / aspect;
+	r[5] = f;
+	r[10] = (zFar + zNear) / (zNear - zFar);
+	r[11] = -1.0f;
+	r[14] = 2.0f * zFar * zNear / (zNear - zFar);
+
+	MatrixMultiply(m, r);
+}
+
+void MatrixLookAt(float *m, float eyeX, float eyeY, float eyeZ, float atX, float atY, float atZ, float upX, float upY, float upZ)
+{
+	float f[3] = { atX - eyeX, atY - eyeY, atZ - eyeZ };
+	float length = sqrtf(f[0] * f[0] + f[1] * f[1] + f[2] * f[2]);
+	if (length == 0.0f)
+		return;
+	f[0] /= length;
+	f[1] /= length;
+	f[2] /= length;
+
+	// Side is forward cross up, and up is made square to them both
+	float s[3] = { f[1] * upZ - f[2] * upY, f[2] * upX - f[0] * upZ, f[0] * upY - f[1] * upX };
+	length = sqrtf(s[0] * s[0] + s[1] * s[1] + s[2] * s[2]);
+	if (length == 0.0f)
+		return;
+	s[0] /= length;
+	s[1] /= length;
+	s[2] /= length;
+
+	float u[3] = { s[1] * f[2] - s[2] * f[1], s[2] * f[0] - s[0] * f[2], s[0] * f[1] - s[1] * f[0] };
+
+	float r[16] = {
+		s[0],	u[0],	-f[0],	0.0f,
+		s[1],	u[1],	-f[1],	0.0f,
+		s[2],	u[2],	-f[2],	0.0f,
+		0.0f,	0.0f,	0.0f,	1.0f
+	};
+
+	MatrixMultiply(m, r);
+	MatrixTranslate(m, -eyeX, -eyeY, -eyeZ);
+}
+
+void MatrixOrtho(float *m, float left, float right, float bottom, float top, float zNear, float zFar)
+{
+	float r[16];
+
+	memset(r, 0, sizeof(r));
+	r[0] = 2.0f / (right - left);
+	r[5] = 2.0f / (top - bottom);
+	r[10] = -2.0f / (zFar - zNear);
+	r[12] = -(right + left) / (right - left);
+	r[13] = -(top + bottom) / (top - bottom);
+	r[14] = -(zFar + zNear) / (zFar - zNear);
+	r[15] = 1.0f;
+
+	MatrixMultiply(m, r);
+}
@@ -0,0 +1,214 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Shader Renderer
+//
+// ShaderRenderer.h: interface for the ShaderRenderer class.
+// A second way of drawing the game that only uses what OpenGL
+// 3.3's core profile has: shaders, vertex arrays in buffers and
+// instancing. No glBegin, no matrix stack, no glLight. The
+// scene itself (the models, the batches, where everything is)
+// stays exactly as the fixed function code has it, this just
+// draws the same things another way.
+//
+// There are four programs:
+// SHADER_LIT		Textured and lit like glLight and glColorMaterial did
+// SHADER_UNLIT		Texture times color, for the ground and the sun
+// SHADER_PARTICLE	Quads that face the camera, one instance each
+// SHADER_UI		Texture times color in pixels, for the HUD
+//
+// What stays the same for a whole frame (the camera and the
+// lights) goes in two uniform buffers that every program shares,
+// filled once in BeginFrame(). What changes from one draw to the
+// next (where it is, its color) goes in an instance buffer, so a
+// model drawn in twenty places is one draw call per material
+// rather than twenty. The renderer remembers the program and
+// texture it last bound and doesn't bind them again, the texture
+// through GLState like everything else.
+//
+// Meshes are uploaded once and drawn by their handle. A model
+// gets its merged arrays and every level of detail's indices
+// uploaded, so drawing it never sends a vertex again. AtlasBatch
+// and text are still built on the CPU and go up each time they're
+// drawn, their quads turned into triangles by a shared index
+// buffer.
+//
+// GLUT can't ask for a core profile, so in the game this runs in
+// the context GLUT gives it. It's written to use nothing the core
+// profile took away, but the repository has no way to start it in
+// a core context or without a window, so that isn't tested here.
+//
+// Matrices are column major like OpenGL's, the Matrix functions
+// below do what glTranslatef and the others did to the one on top
+// of the stack.
+//
+// Usage:
+// ShaderRenderer r;
+//
+// if (!r.Create())							// No 3.3, keep the fixed function path
+//     ...
+// int tree = r.AddModel(&model_tree);		// Uploads it
+//
+// r.BeginFrame(frame, lights, numLights);	// Camera and lights
+// r.DrawModel(tree, lod, instances, count);	// Every tree at this level in one go
+// r.DrawBatch(&uiBatch, &atlas, SHADER_UI);
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef SHADERRENDERER_H
+#define SHADERRENDERER_H
+
+#include "glew.h"
+#include "Model_3DS.h"
+#include "TextureAtlas.h"
+
+#include <vector>
+
+#pragma comment(lib, "glew32.lib")
+
+#define SHADER_MAX_LIGHTS		4		// Lights the uniform buffer has room for
+#define SHADER_MAX_INSTANCES	256		// Instances sent up in one draw, more are split
+#define SHADER_MAX_QUADS		16384	// Quads the shared index buffer covers in one draw
+
+// The programs
+enum ShaderProgram {
+	SHADER_LIT,
+	SHADER_UNLIT,
+	SHADER_PARTICLE,
+	SHADER_UI,
+	SHADER_COUNT
+};
+
+// A vertex of a mesh the game makes itself
+struct ShaderVertex {
+	float x, y, z;
+	float nx, ny, nz;
+	float u, v;
+	unsigned char r, g, b, a;
+};
+
+// One copy of a mesh being drawn
+struct ShaderInstance {
+	float model[16];		// Where it is, column major
+	float color[4];			// Times its texture, and the material color when it's lit
+};
+
+// One particle, the center of its quad and its size
+struct ShaderParticle {
+	float x, y, z;
+	float size;				// Half the width of the quad
+	float color[4];
+};
+
+// A light, laid out like the shaders' uniform block (std140)
+struct ShaderLight {
+	float position[4];		// In the world, w is 0 for a light infinitely far away
+	float direction[4];		// Where a spot points, w is the cosine of its cutoff or -2 if it isn't one
+	float ambient[4];
+	float diffuse[4];
+	float specular[4];
+	float spot[4];			// Spot exponent, then constant, linear and quadratic attenuation
+};
+
+// What's the same for every draw in a frame, laid out like the uniform block
+struct ShaderFrame {
+	float view[16];			// The camera, what gluLookAt made
+	float projection[16];	// What gluPerspective made
+	float ui[16];			// Pixels to the screen for the HUD, what glOrtho made
+	float eye[4];			// Where the camera is
+	float ambient[4];		// Light that comes from nowhere, GL_LIGHT_MODEL_AMBIENT
+	float specular[4];		// The material's specular color, shininess in w
+	int numLights[4];		// Only the first is used
+};
+
+// Calls and binds made in a frame, and the ones that were skipped
+struct ShaderStats {
+	int draws;
+	int instances;
+	int programBinds;
+	int textureBinds;
+	int skippedBinds;		// Programs and textures that were already bound
+	int uploads;			// Bytes sent up for instances and batches
+};
+
+class ShaderRenderer
+{
+public:
+	ShaderStats stats;							// This frame's, reset by BeginFrame()
+
+	bool Create();								// Starts GLEW and builds the programs, false if there's no 3.3
+	void Destroy();								// Deletes everything, the destructor does it too
+	int AddMesh(const ShaderVertex *vertices, int numVertices, const unsigned short *indices, int numIndices);	// A static triangle mesh, returns its handle
+	int AddSphere(int slices, int stacks);		// A unit sphere with gluSphere's normals and texture coordinates
+	int AddModel(Model_3DS *model);				// Uploads a loaded model, returns its handle or -1
+	void BeginFrame(const ShaderFrame &frame, const ShaderLight *lights, int numLights);	// Fills the uniform buffers
+	void DrawMesh(int mesh, ShaderProgram program, GLuint texture, const ShaderInstance *instances, int count);	// Every instance of a mesh, texture 0 for none
+	void DrawModel(int model, int lod, const ShaderInstance *instances, int count);	// Every instance of a model at one level
+	void DrawModelPosed(int model, int lod, const ShaderInstance &instance, float time);	// One copy of a model in its animation, at lod if it has none
+	void DrawParticles(const ShaderParticle *particles, int count);	// Camera facing quads
+	void DrawBatch(AtlasBatch *batch, TextureAtlas *atlas, ShaderProgram program);	// The batch's quads and lines
+	void UseTexture(GLTexture *texture);		// Binds it and tells the TextureManager
+	void UseTexture(GLuint texture);			// Binds it unless it already is
+	ShaderRenderer();							// Constructor
+	virtual ~ShaderRenderer();					// Destructor
+
+private:
+	// A mesh in buffers, ready to draw
+	struct Mesh {
+		GLuint vao;
+		GLuint vertices;
+		GLuint indices;
+		int numIndices;
+		bool normals;							// False: every vertex points up, like glNormal3f(0, 1, 0)
+		bool colors;							// False: every vertex is white
+	};
+
+	// A model's mesh and where each level's indices are
+	struct GpuModel {
+		Model_3DS *model;
+		int mesh;
+		size_t lodOffset[MODEL_MAX_LODS];		// Bytes into the index buffer
+		int firstFaces;							// Its objects' first entry in faceOffsets, for posing
+	};
+
+	GLuint programs[SHADER_COUNT];
+	GLuint frameBuffer;							// The uniform buffers
+	GLuint lightBuffer;
+	GLuint instanceBuffer;						// Sent up again for every draw
+	GLuint batchBuffer;							// The batches' vertices, the same
+	GLuint quadIndices;							// 0 1 2 0 2 3 for every quad
+	GLuint batchVao;
+	GLuint particleVao;
+	GLuint particleCorners;
+	GLuint white;								// A white texture for untextured things
+	GLuint boundProgram;
+	std::vector<Mesh> meshes;
+	std::vector<GpuModel> models;
+	std::vector<ShaderInstance> scratch;		// Instances moved by a model's own transform
+	std::vector<size_t> faceOffsets;			// Where each object's material faces are, for every model
+
+	bool ready;									// True once Create() has worked
+
+	GLuint Compile(const char *vertex, const char *fragment);
+	void UseProgram(ShaderProgram program);
+	void InstanceAttributes();					// Points the bound vertex array at the instance buffer
+	void Upload(GLuint buffer, const void *data, size_t bytes);	// Replaces what's in a stream buffer
+	void BindMesh(const Mesh &m);				// Binds its vertex array and fills in what it doesn't have
+	const ShaderInstance *Place(Model_3DS *model, const ShaderInstance *instances, int count);	// Applies the model's own pos, rot and scale
+	int NewMesh(bool normals, bool colors);		// Makes the vertex array and buffers of a mesh
+
+	// It owns OpenGL objects, so it can't be copied
+	ShaderRenderer(const ShaderRenderer &);
+	ShaderRenderer &operator=(const ShaderRenderer &);
+};
+
+// The same as the matrix calls, m is changed in place
+void MatrixIdentity(float *m);
+void MatrixMultiply(float *m, const float *by);					// glMultMatrixf
+void MatrixTranslate(float *m, float x, float y, float z);		// glTranslatef
+void MatrixRotate(float *m, float angle, float x, float y, float z);	// glRotatef, in degrees
+void MatrixScale(float *m, float x, float y, float z);			// glScalef
+void MatrixPerspective(float *m, float fovy, float aspect, float zNear, float zFar);	// gluPerspective
+void MatrixLookAt(float *m, float eyeX, float eyeY, float eyeZ, float atX, float atY, float atZ, float upX, float upY, float upZ);	// gluLookAt
+void MatrixOrtho(float *m, float left, float right, float bottom, float top, float zNear, float zFar);	// glOrtho
+
+#endif SHADERRENDERER_H
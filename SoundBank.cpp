@@ -0,0 +1,307 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Sound Bank
+//
+// SoundBank.cpp: implementation of the SoundBank class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "SoundBank.h"
+
+#include <windows.h>
+#include <mmsystem.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#pragma comment(lib, "winmm.lib")
+
+// Size of the header we put in front of the samples
+#define WAVE_HEADER_SIZE	44
+
+// Format tags we understand
+#define WAVE_PCM			1
+#define WAVE_FLOAT			3
+#define WAVE_EXTENSIBLE		0xFFFE
+
+static unsigned int Read16(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static unsigned int Read32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static void Write16(unsigned char *p, unsigned int v)
+{
+	p[0] = v & 0xFF;
+	p[1] = (v >> 8) & 0xFF;
+}
+
+static void Write32(unsigned char *p, unsigned int v)
+{
+	p[0] = v & 0xFF;
+	p[1] = (v >> 8) & 0xFF;
+	p[2] = (v >> 16) & 0xFF;
+	p[3] = (v >> 24) & 0xFF;
+}
+
+// Reads one sample and scales it to -1..1
+static float ReadSample(const unsigned char *p, int tag, int bits)
+{
+	if (tag == WAVE_FLOAT)
+	{
+		unsigned int u = Read32(p);
+		float f;
+		memcpy(&f, &u, sizeof(f));
+		return f;
+	}
+
+	switch (bits)
+	{
+		case 8	: return (p[0] - 128) / 128.0f;
+		case 16	: return (short)Read16(p) / 32768.0f;
+		case 24	: return (int)((p[0] << 8) | (p[1] << 16) | ((unsigned int)p[2] << 24)) / 2147483648.0f;
+		case 32	: return (int)Read32(p) / 2147483648.0f;
+	}
+
+	return 0.0f;
+}
+
+bool DecodeWave(const unsigned char *data, size_t size, short **samples, int *frames)
+{
+	*samples = NULL;
+	*frames = 0;
+
+	if (size < 12 || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0)
+		return false;
+
+	int tag = 0;
+	int channels = 0;
+	int rate = 0;
+	int align = 0;
+	int bits = 0;
+	const unsigned char *pcm = NULL;
+	size_t pcmSize = 0;
+
+	// Walk the chunks looking for the format and the data
+	size_t pos = 12;
+	while (pos + 8 <= size)
+	{
+		size_t len = Read32(data + pos + 4);
+		const unsigned char *chunk = data + pos + 8;
+
+		if (len > size - pos - 8)
+			len = size - pos - 8;
+
+		if (memcmp(data + pos, "fmt ", 4) == 0 && len >= 16)
+		{
+			tag = Read16(chunk);
+			channels = Read16(chunk + 2);
+			rate = Read32(chunk + 4);
+			align = Read16(chunk + 12);
+			bits = Read16(chunk + 14);
+
+			// The real format is at the start of the sub format GUID
+			if (tag == WAVE_EXTENSIBLE && len >= 26)
+				tag = Read16(chunk + 24);
+		}
+		else if (memcmp(data + pos, "data", 4) == 0)
+		{
+			pcm = chunk;
+			pcmSize = len;
+		}
+
+		// Chunks are padded to an even size
+		pos += 8 + len + (len & 1);
+	}
+
+	if (pcm == NULL || channels <= 0 || rate <= 0)
+		return false;
+	if (tag != WAVE_PCM && tag != WAVE_FLOAT)
+		return false;
+	if (tag == WAVE_FLOAT && bits != 32)
+		return false;
+	if (bits != 8 && bits != 16 && bits != 24 && bits != 32)
+		return false;
+	if (align < channels * (bits / 8))
+		return false;
+
+	int inFrames = (int)(pcmSize / align);
+	if (inFrames <= 0)
+		return false;
+
+	int outFrames = (int)((long long)inFrames * SOUND_RATE / rate);
+	if (outFrames <= 0)
+		outFrames = 1;
+
+	short *out = (short *)malloc(outFrames * SOUND_CHANNELS * sizeof(short));
+	if (out == NULL)
+		return false;
+
+	int bytes = bits / 8;
+	double step = (double)rate / SOUND_RATE;
+
+	// Straight line between the two nearest samples is plenty for
+	// game effects, and a no-op when the rate already matches
+	for (int i = 0; i < outFrames; i++)
+	{
+		double where = i * step;
+		int i0 = (int)where;
+		int i1 = i0 + 1 < inFrames ? i0 + 1 : i0;
+		float t = (float)(where - i0);
+
+		const unsigned char *f0 = pcm + (size_t)i0 * align;
+		const unsigned char *f1 = pcm + (size_t)i1 * align;
+
+		for (int c = 0; c < SOUND_CHANNELS; c++)
+		{
+			int src = c < channels ? c : channels - 1;
+
+			float a = ReadSample(f0 + src * bytes, tag, bits);
+			float b = ReadSample(f1 + src * bytes, tag, bits);
+			float v = (a + (b - a) * t) * 32767.0f;
+
+			if (v > 32767.0f) v = 32767.0f;
+			if (v < -32768.0f) v = -32768.0f;
+
+			out[i * SOUND_CHANNELS + c] = (short)(v < 0.0f ? v - 0.5f : v + 0.5f);
+		}
+	}
+
+	*samples = out;
+	*frames = outFrames;
+
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+SoundBank::SoundBank()
+{
+	memset(sounds, 0, sizeof(sounds));
+}
+
+SoundBank::~SoundBank()
+{
+	Free();
+}
+
+void SoundBank::Free()
+{
+	// Stop anything that might still be reading our memory
+	PlaySound(NULL, NULL, 0);
+
+	for (int i = 0; i < SOUND_COUNT; i++)
+		free(sounds[i].wave);
+
+	memset(sounds, 0, sizeof(sounds));
+}
+
+bool SoundBank::Load(SoundId id, const char *name)
+{
+	FILE *file = fopen(name, "rb");
+
+	if (file == NULL)
+		return false;
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	unsigned char *data = (unsigned char *)malloc(size > 0 ? size : 1);
+	if (data == NULL || fread(data, 1, size, file) != (size_t)size)
+	{
+		free(data);
+		fclose(file);
+		return false;
+	}
+
+	fclose(file);
+
+	short *samples;
+	int frames;
+	bool ok = DecodeWave(data, size, &samples, &frames);
+	free(data);
+
+	if (!ok)
+		return false;
+
+	// Put a plain PCM header in front so PlaySound can use it too
+	size_t dataSize = (size_t)frames * SOUND_CHANNELS * sizeof(short);
+	unsigned char *wave = (unsigned char *)malloc(WAVE_HEADER_SIZE + dataSize);
+
+	if (wave == NULL)
+	{
+		free(samples);
+		return false;
+	}
+
+	memcpy(wave, "RIFF", 4);
+	Write32(wave + 4, (unsigned int)(WAVE_HEADER_SIZE - 8 + dataSize));
+	memcpy(wave + 8, "WAVEfmt ", 8);
+	Write32(wave + 16, 16);
+	Write16(wave + 20, WAVE_PCM);
+	Write16(wave + 22, SOUND_CHANNELS);
+	Write32(wave + 24, SOUND_RATE);
+	Write32(wave + 28, SOUND_RATE * SOUND_CHANNELS * sizeof(short));
+	Write16(wave + 32, SOUND_CHANNELS * sizeof(short));
+	Write16(wave + 34, 16);
+	memcpy(wave + 36, "data", 4);
+	Write32(wave + 40, (unsigned int)dataSize);
+	memcpy(wave + WAVE_HEADER_SIZE, samples, dataSize);
+
+	free(samples);
+
+	// Replace whatever was in this slot before
+	if (sounds[id].wave != NULL)
+	{
+		PlaySound(NULL, NULL, 0);
+		free(sounds[id].wave);
+	}
+
+	sounds[id].wave = wave;
+	sounds[id].waveSize = WAVE_HEADER_SIZE + dataSize;
+	sounds[id].samples = (short *)(wave + WAVE_HEADER_SIZE);
+	sounds[id].frames = frames;
+
+	return true;
+}
+
+bool SoundBank::Loaded(SoundId id)
+{
+	return id >= 0 && id < SOUND_COUNT && sounds[id].wave != NULL;
+}
+
+void SoundBank::Play(SoundId id)
+{
+	if (!Loaded(id))
+		return;
+
+	// The memory stays put for as long as the bank does
+	PlaySound((LPCTSTR)sounds[id].wave, NULL, SND_ASYNC | SND_MEMORY);
+}
+
+const short *SoundBank::Samples(SoundId id)
+{
+	return Loaded(id) ? sounds[id].samples : NULL;
+}
+
+int SoundBank::Frames(SoundId id)
+{
+	return Loaded(id) ? sounds[id].frames : 0;
+}
+
+size_t SoundBank::BytesUsed()
+{
+	size_t total = 0;
+
+	for (int i = 0; i < SOUND_COUNT; i++)
+		total += sounds[i].waveSize;
+
+	return total;
+}
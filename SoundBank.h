@@ -0,0 +1,78 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Sound Bank
+//
+// SoundBank.h: interface for the SoundBank class.
+// This class loads all of the game's sounds once at startup
+// so playing one never touches the disk. Each WAV file is
+// decoded and converted to the same format (16 bit stereo at
+// 44100Hz) whatever it was saved as, so everything that plays
+// them only has to deal with one kind of buffer.
+//
+// The samples are kept with a WAV header in front of them so
+// the whole thing can be handed to PlaySound() as a memory
+// image. Sounds are looked up by their SoundId, which is just
+// an index into an array.
+//
+// Supported: PCM (8, 16, 24 and 32 bit), 32 bit float and the
+// extensible versions of both, with any number of channels
+// and any sample rate. Mono is copied to both sides and
+// anything past the first two channels is dropped.
+//
+// Usage:
+// SoundBank bank;
+//
+// bank.Load(SOUND_SHOOT, "Sounds/shoot.wav");	// Decode it now
+// bank.Play(SOUND_SHOOT);						// Play it from memory
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef SOUNDBANK_H
+#define SOUNDBANK_H
+
+#include <stddef.h>
+
+// The format every sound is converted to
+#define SOUND_RATE		44100
+#define SOUND_CHANNELS	2
+
+// Every sound the game can play
+enum SoundId {
+	SOUND_SHOOT,
+	SOUND_HIT,
+	SOUND_RELOAD,
+	SOUND_JUMP,
+	SOUND_DAMAGE,
+	SOUND_COUNT
+};
+
+class SoundBank
+{
+public:
+	bool Load(SoundId id, const char *name);	// Decodes a WAV file into the bank
+	bool Loaded(SoundId id);					// True if the sound is ready to play
+	void Play(SoundId id);						// Plays a sound through PlaySound
+	const short *Samples(SoundId id);			// The sound's interleaved stereo samples
+	int Frames(SoundId id);						// The number of stereo samples
+	size_t BytesUsed();							// Memory used by all the sounds
+	void Free();								// Throws away every sound
+	SoundBank();								// Constructor
+	virtual ~SoundBank();						// Destructor
+
+private:
+	// One decoded sound
+	struct Sound {
+		unsigned char *wave;	// A complete WAV file in memory
+		size_t waveSize;		// Size of the whole thing
+		short *samples;			// Points at the samples inside wave
+		int frames;				// Number of stereo samples
+	};
+
+	Sound sounds[SOUND_COUNT];
+};
+
+// Decodes a WAV file in memory to 16 bit stereo at SOUND_RATE.
+// samples is allocated with malloc and belongs to the caller
+bool DecodeWave(const unsigned char *data, size_t size, short **samples, int *frames);
+
+#endif SOUNDBANK_H
@@ -0,0 +1,205 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Static Mesh
+//
+// StaticMesh.cpp: implementation of the StaticMesh class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "StaticMesh.h"
+#include "GLState.h"
+
+#include <stddef.h>
+#include <math.h>
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+StaticMesh::StaticMesh()
+{
+	vertexBuffer = 0;
+	indexBuffer = 0;
+	numTriangleIndices = 0;
+	numLineIndices = 0;
+	colored = false;
+}
+
+StaticMesh::~StaticMesh()
+{
+	Destroy();
+}
+
+bool StaticMesh::Create(const ShaderVertex *vertices, int numVertices, const unsigned short *indices,
+	int numTriangleIndices, int numLineIndices, bool colored)
+{
+	Destroy();
+
+	// The indices are 16 bit
+	if (numVertices <= 0 || numVertices > 65536 || numTriangleIndices + numLineIndices <= 0)
+		return false;
+
+	this->vertices.assign(vertices, vertices + numVertices);
+	this->indices.assign(indices, indices + numTriangleIndices + numLineIndices);
+	this->numTriangleIndices = numTriangleIndices;
+	this->numLineIndices = numLineIndices;
+	this->colored = colored;
+
+	if (!GLEW_VERSION_1_5)
+		return true;
+
+	glGenBuffers(1, &vertexBuffer);
+	glGenBuffers(1, &indexBuffer);
+
+	GLState::Get()->BindBuffers(vertexBuffer, indexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(ShaderVertex), &this->vertices[0], GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(unsigned short), &this->indices[0], GL_STATIC_DRAW);
+
+	// OpenGL has them now
+	std::vector<ShaderVertex>().swap(this->vertices);
+	std::vector<unsigned short>().swap(this->indices);
+
+	return true;
+}
+
+bool StaticMesh::Create(AtlasBatch *batch)
+{
+	const std::vector<AtlasBatch::BatchVertex> &quads = batch->QuadVertices();
+	const std::vector<AtlasBatch::BatchVertex> &lines = batch->LineVertices();
+
+	std::vector<ShaderVertex> v;
+	std::vector<unsigned short> triangles;
+	std::vector<unsigned short> ends;
+
+	for (size_t i = 0; i < quads.size() + lines.size(); i++)
+	{
+		const AtlasBatch::BatchVertex &b = i < quads.size() ? quads[i] : lines[i - quads.size()];
+
+		ShaderVertex s;
+		s.x = b.x;
+		s.y = b.y;
+		s.z = b.z;
+		s.nx = 0.0f;
+		s.ny = 1.0f;
+		s.nz = 0.0f;
+		s.u = b.u;
+		s.v = b.v;
+		s.r = b.r;
+		s.g = b.g;
+		s.b = b.b;
+		s.a = b.a;
+		v.push_back(s);
+	}
+
+	// Each quad is two triangles
+	for (size_t q = 0; q + 3 < quads.size(); q += 4)
+	{
+		unsigned short first = (unsigned short)q;
+		unsigned short quad[] = { first, (unsigned short)(first + 1), (unsigned short)(first + 2),
+			first, (unsigned short)(first + 2), (unsigned short)(first + 3) };
+		triangles.insert(triangles.end(), quad, quad + 6);
+	}
+
+	for (size_t l = 0; l < lines.size(); l++)
+		ends.push_back((unsigned short)(quads.size() + l));
+
+	int numTriangles = (int)triangles.size();
+	triangles.insert(triangles.end(), ends.begin(), ends.end());
+
+	if (v.empty())
+		return false;
+
+	return Create(&v[0], (int)v.size(), &triangles[0], numTriangles, (int)ends.size(), true);
+}
+
+void StaticMesh::Destroy()
+{
+	if (vertexBuffer != 0)
+		GLState::Get()->DeleteBuffer(vertexBuffer);
+	if (indexBuffer != 0)
+		GLState::Get()->DeleteBuffer(indexBuffer);
+
+	vertexBuffer = 0;
+	indexBuffer = 0;
+	vertices.clear();
+	indices.clear();
+	numTriangleIndices = 0;
+	numLineIndices = 0;
+}
+
+bool StaticMesh::Created()
+{
+	return numTriangleIndices + numLineIndices > 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Drawing
+//////////////////////////////////////////////////////////////////////
+
+void StaticMesh::Draw()
+{
+	if (!Created())
+		return;
+
+	GLState *gl = GLState::Get();
+	gl->BindBuffers(vertexBuffer, indexBuffer);
+
+	// In a buffer the pointers are offsets into it
+	const char *base = vertexBuffer != 0 ? NULL : (const char *)&vertices[0];
+	const unsigned short *first = indexBuffer != 0 ? NULL : &indices[0];
+
+	gl->EnableArray(GL_VERTEX_ARRAY);
+	gl->EnableArray(GL_NORMAL_ARRAY);
+	gl->EnableArray(GL_TEXTURE_COORD_ARRAY);
+	gl->SetArray(GL_COLOR_ARRAY, colored);
+
+	glVertexPointer(3, GL_FLOAT, sizeof(ShaderVertex), base + offsetof(ShaderVertex, x));
+	glNormalPointer(GL_FLOAT, sizeof(ShaderVertex), base + offsetof(ShaderVertex, nx));
+	glTexCoordPointer(2, GL_FLOAT, sizeof(ShaderVertex), base + offsetof(ShaderVertex, u));
+	if (colored)
+		glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(ShaderVertex), base + offsetof(ShaderVertex, r));
+
+	if (numTriangleIndices > 0)
+		glDrawElements(GL_TRIANGLES, numTriangleIndices, GL_UNSIGNED_SHORT, first);
+	if (numLineIndices > 0)
+		glDrawElements(GL_LINES, numLineIndices, GL_UNSIGNED_SHORT, first + numTriangleIndices);
+
+	if (colored)
+	{
+		// Models don't send colors, and the current color is undefined now
+		gl->DisableArray(GL_COLOR_ARRAY);
+		gl->ForgetColor();
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+// Building
+//////////////////////////////////////////////////////////////////////
+
+void TransformVertices(ShaderVertex *vertices, int count, const float *m)
+{
+	for (int i = 0; i < count; i++)
+	{
+		ShaderVertex &v = vertices[i];
+
+		float x = m[0] * v.x + m[4] * v.y + m[8] * v.z + m[12];
+		float y = m[1] * v.x + m[5] * v.y + m[9] * v.z + m[13];
+		float z = m[2] * v.x + m[6] * v.y + m[10] * v.z + m[14];
+		v.x = x;
+		v.y = y;
+		v.z = z;
+
+		// Right for turns and for scaling along the faces' own axes (the
+		// walls), which only stretches the normal, so it's made one long again
+		float nx = m[0] * v.nx + m[4] * v.ny + m[8] * v.nz;
+		float ny = m[1] * v.nx + m[5] * v.ny + m[9] * v.nz;
+		float nz = m[2] * v.nx + m[6] * v.ny + m[10] * v.nz;
+		float length = sqrtf(nx * nx + ny * ny + nz * nz);
+		if (length > 0.0f)
+		{
+			v.nx = nx / length;
+			v.ny = ny / length;
+			v.nz = nz / length;
+		}
+	}
+}
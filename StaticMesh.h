@@ -0,0 +1,67 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Static Mesh
+//
+// StaticMesh.h: interface for the StaticMesh class.
+// A shape the game builds itself (a wall, the door, a target)
+// that never changes, put in a vertex and an index buffer once
+// and drawn from them by the fixed function pipeline. Drawing it
+// is the same handful of calls however many corners it has,
+// where glBegin and glEnd sent every corner again every frame.
+//
+// Copies of a shape go where the modelview matrix puts them.
+// Copies that never move (a level's walls) can be built into one
+// mesh with TransformVertices() so they are one draw between them.
+//
+// The vertices are ShaderVertex, like the shader path's meshes.
+// Triangles come first in the indices, then any lines. A mesh
+// made from an AtlasBatch keeps the batch's colors and atlas
+// coordinates, so it's drawn with the atlas bound. If the
+// driver doesn't have buffer objects (OpenGL 1.5) the vertices
+// stay in memory and are drawn from there.
+//
+// Usage:
+// StaticMesh mesh;
+//
+// mesh.Create(vertices, numVertices, indices, numTriangleIndices, 0, false);
+// glTranslatef(x, y, z);
+// mesh.Draw();				// Lit with the current color and texture
+// mesh.Destroy();
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef STATICMESH_H
+#define STATICMESH_H
+
+#include "ShaderRenderer.h"
+#include "TextureAtlas.h"
+
+#include <vector>
+
+class StaticMesh
+{
+public:
+	// Colored meshes use their vertex colors, the others the current color
+	bool Create(const ShaderVertex *vertices, int numVertices, const unsigned short *indices,
+		int numTriangleIndices, int numLineIndices, bool colored);
+	bool Create(AtlasBatch *batch);				// The batch's quads and lines, facing up like the shader path's batches
+	void Draw();
+	void Destroy();
+	bool Created();
+	StaticMesh();
+	virtual ~StaticMesh();
+
+private:
+	unsigned int vertexBuffer;					// 0 when the vertices are kept in memory
+	unsigned int indexBuffer;
+	std::vector<ShaderVertex> vertices;
+	std::vector<unsigned short> indices;
+	int numTriangleIndices;
+	int numLineIndices;
+	bool colored;
+};
+
+// Moves vertices by a column major matrix (see MatrixIdentity) and turns their normals with it
+void TransformVertices(ShaderVertex *vertices, int count, const float *matrix);
+
+#endif STATICMESH_H
@@ -0,0 +1,422 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Texture Atlas
+//
+// TextureAtlas.cpp: implementation of the TextureAtlas and
+// AtlasBatch classes.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "TextureAtlas.h"
+#include "ImageDecoder.h"
+#include "GLState.h"
+
+#include <windows.h>		// Header File For Windows
+#include <gl\gl.h>			// Header File For The OpenGL32 Library
+#include <gl\glu.h>			// Header File For The GLu32 Library
+#include "GLAUX.H"			// Header File For The Glaux Library
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#ifndef GL_TEXTURE_MAX_LEVEL
+#define GL_TEXTURE_MAX_LEVEL	0x813D
+#endif
+
+// Pixels of edge copied around every region
+#define ATLAS_PADDING	4
+
+// The border only protects this many mip levels
+#define ATLAS_MAX_LEVEL	2
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+TextureAtlas::TextureAtlas()
+{
+	texture[0] = 0;
+	size = 0;
+	maxRegion = 256;
+	page = NULL;
+	shelfX = 0;
+	shelfY = 0;
+	shelfHeight = 0;
+}
+
+TextureAtlas::~TextureAtlas()
+{
+	free(page);
+}
+
+void TextureAtlas::Create(int pageSize)
+{
+	free(page);
+
+	size = pageSize;
+	page = (unsigned char *)calloc(size * size, 4);
+	regions.clear();
+
+	shelfX = 0;
+	shelfY = 0;
+	shelfHeight = 0;
+}
+
+int TextureAtlas::Add(char *name, const unsigned char *pixels, int w, int h, int components)
+{
+	if (page == NULL || pixels == NULL || w <= 0 || h <= 0)
+		return -1;
+
+	// Big images get shrunk so they don't eat the whole page
+	int rw = w;
+	int rh = h;
+	if (rw > maxRegion || rh > maxRegion)
+	{
+		float shrink = (float)maxRegion / (w > h ? w : h);
+		rw = (int)(w * shrink);
+		rh = (int)(h * shrink);
+		if (rw < 1) rw = 1;
+		if (rh < 1) rh = 1;
+	}
+
+	int pw = rw + 2 * ATLAS_PADDING;
+	int ph = rh + 2 * ATLAS_PADDING;
+
+	// Start a new shelf if it doesn't fit on this one
+	if (shelfX + pw > size)
+	{
+		shelfX = 0;
+		shelfY += shelfHeight;
+		shelfHeight = 0;
+	}
+
+	// The page is full
+	if (pw > size || shelfY + ph > size)
+		return -1;
+
+	AtlasRegion r;
+	strncpy(r.name, name, sizeof(r.name) - 1);
+	r.name[sizeof(r.name) - 1] = 0;
+	r.x = shelfX + ATLAS_PADDING;
+	r.y = shelfY + ATLAS_PADDING;
+	r.width = rw;
+	r.height = rh;
+	r.u0 = (float)r.x / size;
+	r.v0 = (float)r.y / size;
+	r.u1 = (float)(r.x + rw) / size;
+	r.v1 = (float)(r.y + rh) / size;
+
+	// Copy it in, the padding repeats the closest edge pixel
+	for (int y = -ATLAS_PADDING; y < rh + ATLAS_PADDING; y++)
+	{
+		int cy = y < 0 ? 0 : (y >= rh ? rh - 1 : y);
+		int sy = cy * h / rh;
+
+		for (int x = -ATLAS_PADDING; x < rw + ATLAS_PADDING; x++)
+		{
+			int cx = x < 0 ? 0 : (x >= rw ? rw - 1 : x);
+			int sx = cx * w / rw;
+
+			const unsigned char *src = pixels + (sy * w + sx) * components;
+			unsigned char *dst = page + ((r.y + y) * size + r.x + x) * 4;
+
+			dst[0] = src[0];
+			dst[1] = components > 1 ? src[1] : src[0];
+			dst[2] = components > 2 ? src[2] : src[0];
+			dst[3] = components == 4 ? src[3] : (components == 2 ? src[1] : 255);
+		}
+	}
+
+	shelfX += pw;
+	if (ph > shelfHeight)
+		shelfHeight = ph;
+
+	regions.push_back(r);
+	return (int)regions.size() - 1;
+}
+
+int TextureAtlas::AddFile(char *name)
+{
+	int index = -1;
+
+	// Bitmaps go through glaux like everywhere else
+	if (strstr(name, ".bmp") || strstr(name, ".BMP"))
+	{
+		FILE *file = fopen(name, "rb");
+		if (file == NULL)
+			return -1;
+		fclose(file);
+
+		AUX_RGBImageRec *image = auxDIBImageLoad(name);
+		if (image == NULL)
+			return -1;
+
+		index = Add(name, image->data, image->sizeX, image->sizeY, 3);
+
+		if (image->data)
+			free(image->data);
+		free(image);
+
+		return index;
+	}
+
+	// Everything else has to be something the ImageDecoder knows
+	FILE *file = fopen(name, "rb");
+	if (file == NULL)
+		return -1;
+
+	fseek(file, 0, SEEK_END);
+	long length = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	unsigned char *data = (unsigned char *)malloc(length > 0 ? length : 1);
+	if (data != NULL && fread(data, 1, length, file) == (size_t)length)
+	{
+		ImageInfo info;
+		if (ReadImageInfo(data, length, &info))
+		{
+			unsigned char *pixels = (unsigned char *)malloc(ImageSize(&info));
+			if (pixels != NULL && DecodeImage(data, length, &info, pixels))
+				index = Add(name, pixels, info.width, info.height, info.components);
+			free(pixels);
+		}
+	}
+
+	free(data);
+	fclose(file);
+
+	return index;
+}
+
+int TextureAtlas::AddColor(char *name, unsigned char r, unsigned char g, unsigned char b)
+{
+	unsigned char data[4 * 4 * 3];	// a 4x4 block at 24 bits
+
+	for (int i = 0; i < 4 * 4 * 3; i += 3)
+	{
+		data[i] = r;
+		data[i+1] = g;
+		data[i+2] = b;
+	}
+
+	return Add(name, data, 4, 4, 3);
+}
+
+int TextureAtlas::Find(const char *name)
+{
+	for (size_t i = 0; i < regions.size(); i++)
+	{
+		if (strcmp(regions[i].name, name) == 0)
+			return (int)i;
+	}
+
+	return -1;
+}
+
+const AtlasRegion *TextureAtlas::Region(int index)
+{
+	if (index < 0 || index >= (int)regions.size())
+		return NULL;
+
+	return &regions[index];
+}
+
+int TextureAtlas::NumRegions()
+{
+	return (int)regions.size();
+}
+
+void TextureAtlas::Build()
+{
+	if (page == NULL)
+		return;
+
+	// Generate the OpenGL texture id
+	if (texture[0] == 0)
+		glGenTextures(1, &texture[0]);
+
+	// Bind this texture to its id
+	GLState::Get()->BindTexture(texture[0]);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	// Use mipmapping filter, but stop before the levels get small
+	// enough for the regions to run into each other
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAX_LEVEL,ATLAS_MAX_LEVEL);
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP);
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP);
+
+	// Generate the mipmaps
+	gluBuild2DMipmaps(GL_TEXTURE_2D, GL_RGBA, size, size, GL_RGBA, GL_UNSIGNED_BYTE, page);
+}
+
+void TextureAtlas::Use()
+{
+	GLState *gl = GLState::Get();
+	gl->Enable(GL_TEXTURE_2D);								// Enable texture mapping, unless it is
+	gl->BindTexture(texture[0]);							// Bind the texture, unless it already is
+}
+
+//////////////////////////////////////////////////////////////////////
+// AtlasBatch
+//////////////////////////////////////////////////////////////////////
+
+AtlasBatch::AtlasBatch()
+{
+	region = NULL;
+	s = 0.0f;
+	t = 0.0f;
+	color[0] = color[1] = color[2] = color[3] = 255;
+	Identity();
+}
+
+void AtlasBatch::Begin()
+{
+	// clear() keeps the memory so a steady frame doesn't allocate
+	quads.clear();
+	lines.clear();
+	Identity();
+}
+
+void AtlasBatch::Identity()
+{
+	memset(matrix, 0, sizeof(matrix));
+	matrix[0] = 1.0f;
+	matrix[4] = 1.0f;
+	matrix[8] = 1.0f;
+}
+
+void AtlasBatch::Transform(float x, float y, float z, float angle, float scale)
+{
+	// Same as glTranslatef, glRotatef(angle, 0, 1, 0), glScalef
+	float a = angle * 3.14159265f / 180.0f;
+	float c = cosf(a) * scale;
+	float sn = sinf(a) * scale;
+
+	matrix[0] = c;		matrix[1] = 0.0f;	matrix[2] = sn;
+	matrix[3] = 0.0f;	matrix[4] = scale;	matrix[5] = 0.0f;
+	matrix[6] = -sn;	matrix[7] = 0.0f;	matrix[8] = c;
+	matrix[9] = x;		matrix[10] = y;		matrix[11] = z;
+}
+
+void AtlasBatch::Region(const AtlasRegion *r)
+{
+	region = r;
+}
+
+void AtlasBatch::Color(float r, float g, float b, float a)
+{
+	color[0] = (unsigned char)(r * 255.0f + 0.5f);
+	color[1] = (unsigned char)(g * 255.0f + 0.5f);
+	color[2] = (unsigned char)(b * 255.0f + 0.5f);
+	color[3] = (unsigned char)(a * 255.0f + 0.5f);
+}
+
+void AtlasBatch::TexCoord(float ts, float tt)
+{
+	s = ts;
+	t = tt;
+}
+
+void AtlasBatch::Emit(std::vector<BatchVertex> &list, float x, float y, float z)
+{
+	BatchVertex v;
+
+	v.x = matrix[0] * x + matrix[1] * y + matrix[2] * z + matrix[9];
+	v.y = matrix[3] * x + matrix[4] * y + matrix[5] * z + matrix[10];
+	v.z = matrix[6] * x + matrix[7] * y + matrix[8] * z + matrix[11];
+
+	// Move the texture coordinate into the region
+	if (region != NULL)
+	{
+		v.u = region->u0 + (region->u1 - region->u0) * s;
+		v.v = region->v0 + (region->v1 - region->v0) * t;
+	}
+	else
+	{
+		v.u = s;
+		v.v = t;
+	}
+
+	v.r = color[0];
+	v.g = color[1];
+	v.b = color[2];
+	v.a = color[3];
+
+	list.push_back(v);
+}
+
+void AtlasBatch::QuadVertex(float x, float y, float z)
+{
+	Emit(quads, x, y, z);
+}
+
+void AtlasBatch::LineVertex(float x, float y, float z)
+{
+	Emit(lines, x, y, z);
+}
+
+void AtlasBatch::Rect(float x0, float y0, float x1, float y1, float z)
+{
+	TexCoord(0.0f, 0.0f); QuadVertex(x0, y0, z);
+	TexCoord(1.0f, 0.0f); QuadVertex(x1, y0, z);
+	TexCoord(1.0f, 1.0f); QuadVertex(x1, y1, z);
+	TexCoord(0.0f, 1.0f); QuadVertex(x0, y1, z);
+}
+
+void AtlasBatch::Draw(TextureAtlas *atlas)
+{
+	if (quads.empty() && lines.empty())
+		return;
+
+	GLState *gl = GLState::Get();
+	atlas->Use();
+
+	// The vertices are in memory, not in a static mesh's buffers
+	gl->BindBuffers(0, 0);
+	gl->EnableArray(GL_VERTEX_ARRAY);
+	gl->EnableArray(GL_TEXTURE_COORD_ARRAY);
+	gl->EnableArray(GL_COLOR_ARRAY);
+	gl->DisableArray(GL_NORMAL_ARRAY);
+
+	if (!quads.empty())
+	{
+		glVertexPointer(3, GL_FLOAT, sizeof(BatchVertex), &quads[0].x);
+		glTexCoordPointer(2, GL_FLOAT, sizeof(BatchVertex), &quads[0].u);
+		glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(BatchVertex), &quads[0].r);
+		glDrawArrays(GL_QUADS, 0, (GLsizei)quads.size());
+	}
+
+	if (!lines.empty())
+	{
+		glVertexPointer(3, GL_FLOAT, sizeof(BatchVertex), &lines[0].x);
+		glTexCoordPointer(2, GL_FLOAT, sizeof(BatchVertex), &lines[0].u);
+		glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(BatchVertex), &lines[0].r);
+		glDrawArrays(GL_LINES, 0, (GLsizei)lines.size());
+	}
+
+	// Models don't send colors, the rest they set up themselves
+	gl->DisableArray(GL_COLOR_ARRAY);
+
+	// The color array leaves the current color undefined
+	gl->ForgetColor();
+}
+
+int AtlasBatch::NumQuads()
+{
+	return (int)quads.size() / 4;
+}
+
+const std::vector<AtlasBatch::BatchVertex> &AtlasBatch::QuadVertices()
+{
+	return quads;
+}
+
+const std::vector<AtlasBatch::BatchVertex> &AtlasBatch::LineVertices()
+{
+	return lines;
+}
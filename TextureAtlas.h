@@ -0,0 +1,120 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Texture Atlas
+//
+// TextureAtlas.h: interface for the TextureAtlas and AtlasBatch
+// classes. The atlas packs lots of small textures into one big
+// texture (a page) and remembers where each one ended up, so
+// things that used to need their own texture can be drawn
+// together without rebinding anything.
+//
+// Images are packed onto shelves in the order they are added.
+// Each one gets a border of its own edge pixels so the first
+// few mipmaps don't bleed the neighbours into it. Textures
+// that need to repeat (walls, the ground) can't go in an atlas
+// since their texture coordinates go past 1.
+//
+// The AtlasBatch collects quads and lines the same way the
+// immediate mode calls would, except the texture coordinates
+// are in the region's own 0-1 space and the vertices can be
+// moved by a transform. Everything is drawn with one
+// glDrawArrays for the quads and one for the lines.
+//
+// Usage:
+// TextureAtlas atlas;
+// AtlasBatch batch;
+//
+// atlas.Create(512);
+// int target = atlas.AddFile("target.bmp");	// Packs a bitmap
+// int white = atlas.AddColor("white", 255, 255, 255);
+// atlas.Build();								// Uploads the page
+//
+// batch.Begin();
+// batch.Transform(x, y, z, angle, 1.0f);
+// batch.Region(atlas.Region(target));
+// batch.Rect(-1, -1, 1, 1, 0);				// The whole region on a quad
+// batch.Draw(&atlas);
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef TEXTUREATLAS_H
+#define TEXTUREATLAS_H
+
+#include <vector>
+
+// Where a texture is in the atlas
+struct AtlasRegion {
+	char name[64];		// The name it was added with
+	int x;				// Left edge in pixels
+	int y;				// Bottom edge in pixels
+	int width;			// Size in pixels
+	int height;
+	float u0;			// Texture coordinates of the corners
+	float v0;
+	float u1;
+	float v1;
+};
+
+class TextureAtlas
+{
+public:
+	unsigned int texture[1];					// OpenGL's number for the page
+	int size;									// Width and height of the page
+	int maxRegion;								// Anything bigger is scaled down to this
+	int Add(char *name, const unsigned char *pixels, int w, int h, int components);	// Packs an image, returns its index or -1
+	int AddFile(char *name);					// Loads a bmp, png or jpeg file and packs it
+	int AddColor(char *name, unsigned char r, unsigned char g, unsigned char b);	// Packs a block of one color
+	int Find(const char *name);					// Looks up a region's index by name
+	const AtlasRegion *Region(int index);		// The region, or NULL if the index is bad
+	int NumRegions();							// How many regions have been packed
+	void Build();								// Uploads the page to OpenGL
+	void Use();									// Binds the page
+	void Create(int pageSize);					// Starts an empty page
+	TextureAtlas();								// Constructor
+	virtual ~TextureAtlas();					// Destructor
+
+private:
+	unsigned char *page;						// The page as RGBA
+	std::vector<AtlasRegion> regions;
+	int shelfX;									// Where the next image goes
+	int shelfY;
+	int shelfHeight;							// Height of the tallest image on this shelf
+};
+
+class AtlasBatch
+{
+public:
+	// One vertex as it goes to OpenGL
+	struct BatchVertex {
+		float x, y, z;
+		float u, v;
+		unsigned char r, g, b, a;
+	};
+
+	void Begin();								// Empties the batch
+	void Transform(float x, float y, float z, float angle, float scale);	// Translate, rotate about y, then scale
+	void Identity();							// Vertices go in untouched
+	void Region(const AtlasRegion *region);		// Which part of the atlas to use
+	void Color(float r, float g, float b, float a = 1.0f);	// Color for the next vertices
+	void TexCoord(float s, float t);			// Texture coordinate inside the region
+	void QuadVertex(float x, float y, float z);	// Adds a corner of a quad
+	void LineVertex(float x, float y, float z);	// Adds an end of a line
+	void Rect(float x0, float y0, float x1, float y1, float z);	// A quad facing down z with the whole region on it
+	void Draw(TextureAtlas *atlas);				// Draws everything in one go
+	int NumQuads();								// Quads in the batch
+	const std::vector<BatchVertex> &QuadVertices();	// Four for each quad, for drawing them some other way
+	const std::vector<BatchVertex> &LineVertices();	// Two for each line
+	AtlasBatch();
+
+private:
+	void Emit(std::vector<BatchVertex> &list, float x, float y, float z);
+
+	std::vector<BatchVertex> quads;
+	std::vector<BatchVertex> lines;
+	const AtlasRegion *region;
+	float matrix[12];							// Rotation and scale in the first 9, translation in the last 3
+	float s, t;
+	unsigned char color[4];
+};
+
+#endif TEXTUREATLAS_H
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include "glew.h"
 #include "glaux.h"
+#include "GLState.h"
 
 #pragma comment(lib, "glew32.lib")
 #pragma comment(lib, "glaux.lib")
@@ -20,7 +21,7 @@ void loadPPM(GLuint *textureID, char *strFileName, int width, int height, int wr
 	}
 
 	glGenTextures(1, textureID);
-	glBindTexture(GL_TEXTURE_2D, *textureID);
+	GLState::Get()->BindTexture(*textureID);
 	gluBuild2DMipmaps(GL_TEXTURE_2D, 3, width, height, GL_RGB, GL_UNSIGNED_BYTE, data);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -45,7 +46,7 @@ void loadBMP(GLuint *textureID, char *strFileName, int wrap) {
 	}
 
 	glGenTextures(1, textureID);
-	glBindTexture(GL_TEXTURE_2D, *textureID);
+	GLState::Get()->BindTexture(*textureID);
 	gluBuild2DMipmaps(GL_TEXTURE_2D, 3, pBitmap->sizeX, pBitmap->sizeY, GL_RGB, GL_UNSIGNED_BYTE, pBitmap->data);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
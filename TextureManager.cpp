@@ -0,0 +1,301 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Texture Manager
+//
+// TextureManager.cpp: implementation of the TextureManager class.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "TextureManager.h"
+#include "GLTexture.h"
+#include "GLState.h"
+
+#include <string.h>
+
+// Textures are never shrunk smaller than this
+#define MIN_SHRINK_SIZE	64
+
+// The budget if nobody sets one
+#define DEFAULT_BUDGET	(64 * 1024 * 1024)
+
+TextureManager *TextureManager::instance = NULL;
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+TextureManager::TextureManager()
+{
+	budget = DEFAULT_BUDGET;
+	resident = 0;
+	frame = 0;
+}
+
+TextureManager *TextureManager::Get()
+{
+	// Only ever created, the counts live until the game exits
+	if (instance == NULL)
+		instance = new TextureManager();
+
+	return instance;
+}
+
+void TextureManager::Forget(GLTexture *tex)
+{
+	if (instance == NULL || tex->residency < 0)
+		return;
+
+	Entry &e = instance->entries[tex->residency];
+
+	instance->resident -= e.bytes;
+	e.inUse = false;
+	e.owner = NULL;
+
+	tex->residency = -1;
+}
+
+int TextureManager::NewSlot()
+{
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		if (!entries[i].inUse)
+			return (int)i;
+	}
+
+	Entry e;
+	memset(&e, 0, sizeof(e));
+	entries.push_back(e);
+
+	return (int)entries.size() - 1;
+}
+
+void TextureManager::Measure(Entry &e)
+{
+	GLint w = 0;
+	GLint h = 0;
+	GLint format = 0;
+
+	GLState::Get()->BindTexture(e.id);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &w);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &h);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+
+	e.width = w;
+	e.height = h;
+	e.components = (format == 4 || format == GL_RGBA || format == GL_RGBA8) ? 4 : 3;
+
+	// Add up the levels that are actually there
+	e.levels = 0;
+	e.bytes = 0;
+	for (int level = 0; level < 16 && w > 0 && h > 0; level++)
+	{
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &w);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &h);
+
+		if (w <= 0 || h <= 0)
+			break;
+
+		e.bytes += (size_t)w * h * e.components;
+		e.levels++;
+	}
+}
+
+void TextureManager::Track(GLTexture *tex)
+{
+	if (tex->texture[0] == 0)
+		return;
+
+	if (tex->residency < 0)
+		tex->residency = NewSlot();
+	else
+		resident -= entries[tex->residency].bytes;
+
+	Entry &e = entries[tex->residency];
+	e.owner = tex;
+	e.id = tex->texture[0];
+	e.dropped = 0;
+	e.lastUsed = frame;
+	e.reloading = false;
+	e.inUse = true;
+
+	Measure(e);
+	resident += e.bytes;
+}
+
+int TextureManager::TrackId(unsigned int id)
+{
+	int slot = NewSlot();
+
+	Entry &e = entries[slot];
+	e.owner = NULL;
+	e.id = id;
+	e.dropped = 0;
+	e.lastUsed = frame;
+	e.reloading = false;
+	e.inUse = true;
+
+	Measure(e);
+	resident += e.bytes;
+
+	return slot;
+}
+
+void TextureManager::Touch(int slot)
+{
+	if (slot >= 0 && slot < (int)entries.size())
+		entries[slot].lastUsed = frame;
+}
+
+bool TextureManager::CanShrink(const Entry &e)
+{
+	// We have to be able to load it again later
+	if (!e.inUse || e.owner == NULL || e.owner->texturename == NULL)
+		return false;
+
+	return e.levels > 1 && (e.width > MIN_SHRINK_SIZE || e.height > MIN_SHRINK_SIZE);
+}
+
+bool TextureManager::Shrink(Entry &e)
+{
+	GLuint type = e.components == 4 ? GL_RGBA : GL_RGB;
+
+	// Everything below the top level
+	size_t top = (size_t)e.width * e.height * e.components;
+	scratch.resize(e.bytes - top);
+
+	GLState::Get()->BindTexture(e.id);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+	// Read the lower levels back before we throw the texture away
+	size_t offset = 0;
+	int w = e.width;
+	int h = e.height;
+	for (int level = 1; level < e.levels; level++)
+	{
+		w = w > 1 ? w / 2 : 1;
+		h = h > 1 ? h / 2 : 1;
+
+		glGetTexImage(GL_TEXTURE_2D, level, type, GL_UNSIGNED_BYTE, &scratch[offset]);
+		offset += (size_t)w * h * e.components;
+	}
+
+	// Deleting it is the only way to be sure the driver lets go of
+	// the memory, binding the same number again makes a fresh one
+	GLState::Get()->DeleteTexture(e.id);
+	GLState::Get()->BindTexture(e.id);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+
+	offset = 0;
+	w = e.width;
+	h = e.height;
+	for (int level = 1; level < e.levels; level++)
+	{
+		w = w > 1 ? w / 2 : 1;
+		h = h > 1 ? h / 2 : 1;
+
+		glTexImage2D(GL_TEXTURE_2D, level - 1, type, w, h, 0, type, GL_UNSIGNED_BYTE, &scratch[offset]);
+		offset += (size_t)w * h * e.components;
+	}
+
+	resident -= top;
+
+	e.bytes -= top;
+	e.width = e.width > 1 ? e.width / 2 : 1;
+	e.height = e.height > 1 ? e.height / 2 : 1;
+	e.levels--;
+	e.dropped++;
+
+	return true;
+}
+
+void TextureManager::Update()
+{
+	// Bring back one shrunk texture that is being drawn, if it fits.
+	// Each level we dropped cut it to a quarter, so full size is the
+	// current size times 4 for each of them
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		Entry &e = entries[i];
+
+		if (!e.inUse || e.dropped == 0 || e.reloading || e.lastUsed != frame)
+			continue;
+
+		size_t full = e.bytes << (2 * e.dropped);
+		if (resident - e.bytes + full > budget)
+			continue;
+
+		// The texture will call Track() again once it's loaded, which
+		// resets all of this. Until then don't ask twice
+		char name[260];
+		strncpy(name, e.owner->texturename, sizeof(name) - 1);
+		name[sizeof(name) - 1] = 0;
+
+		e.reloading = true;
+		e.owner->LoadAsync(name);
+		break;
+	}
+
+	// Shrink the least recently used textures until we're under budget
+	while (resident > budget)
+	{
+		int oldest = -1;
+
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			Entry &e = entries[i];
+
+			// Never shrink anything that was drawn this frame
+			if (!CanShrink(e) || e.lastUsed == frame)
+				continue;
+
+			if (oldest < 0 || e.lastUsed < entries[oldest].lastUsed ||
+				(e.lastUsed == entries[oldest].lastUsed && e.bytes > entries[oldest].bytes))
+				oldest = (int)i;
+		}
+
+		if (oldest < 0 || !Shrink(entries[oldest]))
+			break;
+	}
+
+	frame++;
+}
+
+void TextureManager::SetBudget(size_t bytes)
+{
+	budget = bytes;
+}
+
+size_t TextureManager::Budget()
+{
+	return budget;
+}
+
+size_t TextureManager::BytesResident()
+{
+	return resident;
+}
+
+int TextureManager::NumTracked()
+{
+	int count = 0;
+
+	for (size_t i = 0; i < entries.size(); i++)
+		if (entries[i].inUse)
+			count++;
+
+	return count;
+}
+
+int TextureManager::NumShrunk()
+{
+	int count = 0;
+
+	for (size_t i = 0; i < entries.size(); i++)
+		if (entries[i].inUse && entries[i].dropped != 0)
+			count++;
+
+	return count;
+}
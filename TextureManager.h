@@ -0,0 +1,90 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Texture Manager
+//
+// TextureManager.h: interface for the TextureManager class.
+// This class keeps count of how much texture memory is in
+// use and keeps it under a budget. Every GLTexture tells the
+// manager when it uploads something and when it is used, so
+// the manager knows how big each texture is and when it was
+// last drawn.
+//
+// When the total goes over the budget the texture that has
+// gone unused the longest loses its top mip level, which
+// cuts its size to a quarter. That repeats until everything
+// fits or nothing unused is left to shrink. If a shrunk
+// texture gets used again and there is room for it, it is
+// loaded back from its file at full size.
+//
+// Textures that weren't loaded from a file (colors, resources)
+// and ones added with TrackId() are counted but never shrunk
+// since there'd be no way to get them back.
+//
+// Usage:
+// TextureManager::Get()->SetBudget(64 * 1024 * 1024);
+//
+// // Once per frame, after drawing
+// TextureManager::Get()->Update();
+//
+// // Textures that don't use GLTexture can still be counted
+// int slot = TextureManager::Get()->TrackId(id);
+// TextureManager::Get()->Touch(slot);	// When it's bound
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef TEXTUREMANAGER_H
+#define TEXTUREMANAGER_H
+
+#include <stddef.h>
+#include <vector>
+
+class GLTexture;
+
+class TextureManager
+{
+public:
+	static TextureManager *Get();				// The manager shared by all textures
+	static void Forget(GLTexture *tex);			// Stops counting a texture that is going away
+
+	void Track(GLTexture *tex);					// Counts the texture that is bound right now
+	int TrackId(unsigned int id);				// Counts a texture that isn't a GLTexture, returns its slot
+	void Touch(int slot);						// Marks a texture as used this frame
+	void Update();								// Ends the frame, shrinks or restores textures
+	void SetBudget(size_t bytes);				// How much texture memory we're allowed
+	size_t Budget();							// The budget in bytes
+	size_t BytesResident();						// How much texture memory is in use
+	int NumTracked();							// Number of textures being counted
+	int NumShrunk();							// Number of textures not at full size
+
+private:
+	// What we know about one texture
+	struct Entry {
+		GLTexture *owner;		// The texture, NULL if we only count it
+		unsigned int id;		// OpenGL's number for the texture
+		int width;				// Size of the top level
+		int height;
+		int components;			// 3 for RGB, 4 for RGBA
+		int levels;				// Number of mip levels
+		int dropped;			// How many top levels we've taken away
+		size_t bytes;			// Memory used by all the levels
+		unsigned int lastUsed;	// The frame it was last bound in
+		bool reloading;			// True while it is being loaded back at full size
+		bool inUse;				// False if the slot is free
+	};
+
+	TextureManager();
+	int NewSlot();
+	void Measure(Entry &e);
+	bool Shrink(Entry &e);
+	bool CanShrink(const Entry &e);
+
+	static TextureManager *instance;
+
+	std::vector<Entry> entries;
+	std::vector<unsigned char> scratch;			// Holds the levels while a texture is shrunk
+	size_t budget;
+	size_t resident;
+	unsigned int frame;
+};
+
+#endif TEXTUREMANAGER_H
@@ -0,0 +1,486 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Texture Streamer
+//
+// TextureStreamer.cpp: implementation of the TextureStreamer class.
+// The workers do everything that doesn't need the GL context:
+// reading the file, decoding it, resizing it to a power of two
+// (the same sizes gluBuild2DMipmaps would have picked) and
+// box filtering the mip levels. The main thread then just
+// calls glTexImage2D once per level.
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "TextureStreamer.h"
+#include "ImageDecoder.h"
+#include "GLTexture.h"
+#include "AllocationCounter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+// The largest texture we'll make, anything bigger gets scaled down
+#define MAX_STREAMED_SIZE	2048
+
+TextureStreamer *TextureStreamer::instance = NULL;
+
+//////////////////////////////////////////////////////////////////////
+// StagingPool
+//////////////////////////////////////////////////////////////////////
+
+StagingPool::StagingPool()
+{
+
+}
+
+StagingPool::~StagingPool()
+{
+	for (size_t i = 0; i < blocks.size(); i++)
+		free(blocks[i].data);
+}
+
+unsigned char *StagingPool::Acquire(size_t size)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	// Use the smallest free block that is big enough
+	int best = -1;
+	for (size_t i = 0; i < blocks.size(); i++)
+	{
+		if (!blocks[i].inUse && blocks[i].size >= size && (best < 0 || blocks[i].size < blocks[best].size))
+			best = (int)i;
+	}
+
+	if (best >= 0)
+	{
+		blocks[best].inUse = true;
+		return blocks[best].data;
+	}
+
+	// Nothing fits so make a new one
+	Block b;
+	b.data = (unsigned char *)malloc(size);
+	b.size = size;
+	b.inUse = true;
+
+	if (b.data == NULL)
+		return NULL;
+
+	blocks.push_back(b);
+	return b.data;
+}
+
+void StagingPool::Release(unsigned char *buffer)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	for (size_t i = 0; i < blocks.size(); i++)
+	{
+		if (blocks[i].data == buffer)
+		{
+			blocks[i].inUse = false;
+			return;
+		}
+	}
+}
+
+void StagingPool::Trim()
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	for (size_t i = 0; i < blocks.size();)
+	{
+		if (!blocks[i].inUse)
+		{
+			free(blocks[i].data);
+			blocks.erase(blocks.begin() + i);
+		}
+		else
+			i++;
+	}
+}
+
+size_t StagingPool::BytesAllocated()
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	size_t total = 0;
+	for (size_t i = 0; i < blocks.size(); i++)
+		total += blocks[i].size;
+
+	return total;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Image helpers
+//////////////////////////////////////////////////////////////////////
+
+// Finds the closest power of two, like gluScaleImage does for gluBuild2DMipmaps
+static int ClosestPowerOfTwo(int size)
+{
+	int p = 1;
+	while (p * 2 <= size)
+		p *= 2;
+
+	if (p < size && size - p > p * 2 - size)
+		p *= 2;
+
+	return p > MAX_STREAMED_SIZE ? MAX_STREAMED_SIZE : p;
+}
+
+// Works out how many levels the mip chain has and how many bytes they take up
+static size_t MipChainSize(int width, int height, int components, int *levels)
+{
+	size_t total = 0;
+	*levels = 0;
+
+	for (;;)
+	{
+		total += (size_t)width * height * components;
+		(*levels)++;
+
+		if (width == 1 && height == 1)
+			break;
+
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+
+	return total;
+}
+
+// Bilinear resize, used when the source isn't a power of two
+static void ScaleImage(const unsigned char *src, int sw, int sh, unsigned char *dst, int dw, int dh, int components)
+{
+	for (int y = 0; y < dh; y++)
+	{
+		float fy = (y + 0.5f) * sh / dh - 0.5f;
+		if (fy < 0.0f) fy = 0.0f;
+		int y0 = (int)fy;
+		int y1 = y0 + 1 < sh ? y0 + 1 : y0;
+		float ty = fy - y0;
+
+		for (int x = 0; x < dw; x++)
+		{
+			float fx = (x + 0.5f) * sw / dw - 0.5f;
+			if (fx < 0.0f) fx = 0.0f;
+			int x0 = (int)fx;
+			int x1 = x0 + 1 < sw ? x0 + 1 : x0;
+			float tx = fx - x0;
+
+			const unsigned char *p00 = src + ((size_t)y0 * sw + x0) * components;
+			const unsigned char *p10 = src + ((size_t)y0 * sw + x1) * components;
+			const unsigned char *p01 = src + ((size_t)y1 * sw + x0) * components;
+			const unsigned char *p11 = src + ((size_t)y1 * sw + x1) * components;
+			unsigned char *out = dst + ((size_t)y * dw + x) * components;
+
+			for (int c = 0; c < components; c++)
+			{
+				float top = p00[c] + (p10[c] - p00[c]) * tx;
+				float bottom = p01[c] + (p11[c] - p01[c]) * tx;
+				out[c] = (unsigned char)(top + (bottom - top) * ty + 0.5f);
+			}
+		}
+	}
+}
+
+// Averages 2x2 blocks to make the next mip level
+static void HalveImage(const unsigned char *src, int sw, int sh, unsigned char *dst, int components)
+{
+	int dw = sw > 1 ? sw / 2 : 1;
+	int dh = sh > 1 ? sh / 2 : 1;
+	int stepX = sw > 1 ? components : 0;
+	size_t stepY = sh > 1 ? (size_t)sw * components : 0;
+
+	for (int y = 0; y < dh; y++)
+	{
+		const unsigned char *row = src + (size_t)y * (sh > 1 ? 2 : 1) * sw * components;
+		unsigned char *out = dst + (size_t)y * dw * components;
+
+		for (int x = 0; x < dw; x++)
+		{
+			const unsigned char *p = row + (size_t)x * (sw > 1 ? 2 : 1) * components;
+			for (int c = 0; c < components; c++)
+				*out++ = (unsigned char)((p[c] + p[c + stepX] + p[c + stepY] + p[c + stepX + stepY] + 2) >> 2);
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////
+// TextureStreamer
+//////////////////////////////////////////////////////////////////////
+
+TextureStreamer::TextureStreamer()
+{
+	decoding = 0;
+}
+
+TextureStreamer *TextureStreamer::Get()
+{
+	// Only ever created, the workers live until the game exits
+	if (instance == NULL)
+		instance = new TextureStreamer();
+
+	return instance;
+}
+
+void TextureStreamer::Start()
+{
+	// Leave a core for the game itself
+	int count = (int)std::thread::hardware_concurrency() - 1;
+	if (count < 1)
+		count = 1;
+	if (count > 4)
+		count = 4;
+
+	for (int i = 0; i < count; i++)
+		workers.push_back(std::thread(&TextureStreamer::WorkerMain, this));
+}
+
+void TextureStreamer::Cancel(GLTexture *tex)
+{
+	if (instance == NULL)
+		return;
+
+	TextureStreamer *s = instance;
+	std::unique_lock<std::mutex> guard(s->lock);
+
+	for (size_t i = 0; i < s->jobs.size();)
+	{
+		if (s->jobs[i].tex == tex)
+			s->jobs.erase(s->jobs.begin() + i);
+		else
+			i++;
+	}
+
+	// If a worker has it we have to wait for the result to throw it away
+	while (s->decoding > 0)
+	{
+		bool busy = false;
+		for (size_t i = 0; i < s->active.size(); i++)
+			if (s->active[i] == tex)
+				busy = true;
+
+		if (!busy)
+			break;
+
+		s->finished.wait(guard);
+	}
+
+	for (size_t i = 0; i < s->results.size();)
+	{
+		if (s->results[i].tex == tex)
+		{
+			s->pool.Release(s->results[i].pixels);
+			s->results.erase(s->results.begin() + i);
+		}
+		else
+			i++;
+	}
+}
+
+void TextureStreamer::Request(GLTexture *tex, const char *name)
+{
+	Job job;
+	job.tex = tex;
+	strncpy(job.name, name, sizeof(job.name) - 1);
+	job.name[sizeof(job.name) - 1] = 0;
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		if (workers.empty())
+			Start();
+
+		jobs.push_back(job);
+	}
+
+	wake.notify_one();
+}
+
+int TextureStreamer::Pump(int maxUploads)
+{
+	int uploaded = 0;
+
+	while (uploaded < maxUploads)
+	{
+		Result r;
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+
+			if (results.empty())
+				break;
+
+			r = results.front();
+			results.pop_front();
+		}
+
+		r.tex->UploadMipmaps(r.pixels, r.width, r.height, r.components, r.levels);
+		pool.Release(r.pixels);
+		uploaded++;
+	}
+
+	// Give the staging memory back once a batch of loads is done
+	if (Pending() == 0)
+		pool.Trim();
+
+	return uploaded;
+}
+
+void TextureStreamer::Flush()
+{
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> guard(lock);
+
+			while (results.empty() && (decoding > 0 || !jobs.empty()))
+				finished.wait(guard);
+
+			if (results.empty())
+				break;
+		}
+
+		Pump(0x7FFFFFFF);
+	}
+
+	pool.Trim();
+}
+
+int TextureStreamer::Pending()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return (int)(jobs.size() + results.size()) + decoding;
+}
+
+void TextureStreamer::WorkerMain()
+{
+	AllocationScope scope(ALLOC_TEXTURES);
+
+	for (;;)
+	{
+		Job job;
+
+		{
+			std::unique_lock<std::mutex> guard(lock);
+
+			while (jobs.empty())
+				wake.wait(guard);
+
+			job = jobs.front();
+			jobs.pop_front();
+			active.push_back(job.tex);
+			decoding++;
+		}
+
+		Result result;
+		bool ok = Decode(job, &result);
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+
+			// Files that won't decode just keep their placeholder
+			if (ok)
+				results.push_back(result);
+
+			active.erase(std::find(active.begin(), active.end(), job.tex));
+			decoding--;
+		}
+
+		finished.notify_all();
+	}
+}
+
+bool TextureStreamer::Decode(const Job &job, Result *result)
+{
+	FILE *file = fopen(job.name, "rb");
+
+	if (file == NULL)
+		return false;
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	if (size <= 0)
+	{
+		fclose(file);
+		return false;
+	}
+
+	unsigned char *data = pool.Acquire(size);
+	if (data == NULL || fread(data, 1, size, file) != (size_t)size)
+	{
+		fclose(file);
+		if (data != NULL)
+			pool.Release(data);
+		return false;
+	}
+
+	fclose(file);
+
+	ImageInfo info;
+	if (!ReadImageInfo(data, size, &info))
+	{
+		pool.Release(data);
+		return false;
+	}
+
+	int width = ClosestPowerOfTwo(info.width);
+	int height = ClosestPowerOfTwo(info.height);
+	int levels;
+	unsigned char *pixels = pool.Acquire(MipChainSize(width, height, info.components, &levels));
+	bool ok = pixels != NULL;
+
+	if (ok && width == info.width && height == info.height)
+	{
+		// Already a power of two so decode straight into the top level
+		ok = DecodeImage(data, size, &info, pixels);
+	}
+	else if (ok)
+	{
+		unsigned char *scratch = pool.Acquire(ImageSize(&info));
+
+		ok = scratch != NULL && DecodeImage(data, size, &info, scratch);
+		if (ok)
+			ScaleImage(scratch, info.width, info.height, pixels, width, height, info.components);
+
+		if (scratch != NULL)
+			pool.Release(scratch);
+	}
+
+	pool.Release(data);
+
+	if (!ok)
+	{
+		if (pixels != NULL)
+			pool.Release(pixels);
+		return false;
+	}
+
+	// Build the rest of the mip chain after the top level
+	unsigned char *level = pixels;
+	int w = width;
+	int h = height;
+	for (int i = 1; i < levels; i++)
+	{
+		unsigned char *next = level + (size_t)w * h * info.components;
+		HalveImage(level, w, h, next, info.components);
+
+		level = next;
+		w = w > 1 ? w / 2 : 1;
+		h = h > 1 ? h / 2 : 1;
+	}
+
+	result->tex = job.tex;
+	result->pixels = pixels;
+	result->width = width;
+	result->height = height;
+	result->components = info.components;
+	result->levels = levels;
+
+	return true;
+}
@@ -0,0 +1,111 @@
+//////////////////////////////////////////////////////////////////////
+//
+// Texture Streamer
+//
+// TextureStreamer.h: interface for the TextureStreamer class.
+// This class decodes PNG and JPEG textures on worker threads
+// so loading a level doesn't stall the game. A worker reads
+// the file, decodes it, scales it to a power of two and builds
+// the whole mipmap chain into a staging buffer. The only thing
+// left for the main thread is handing the finished levels to
+// OpenGL, which it does in Pump().
+//
+// Staging buffers come from a pool and go back to it once the
+// texture is uploaded, so a level full of textures reuses the
+// same handful of allocations instead of making new ones.
+//
+// Usage:
+// GLTexture tex;
+//
+// tex.LoadAsync("texture.png");	// Queues the texture
+//
+// // Once per frame on the thread that owns the GL context
+// TextureStreamer::Get()->Pump(4);
+//
+// // Or wait for everything before the level starts
+// TextureStreamer::Get()->Flush();
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include <stddef.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class GLTexture;
+
+// Hands out reusable blocks of memory to the decoding threads
+class StagingPool
+{
+public:
+	unsigned char *Acquire(size_t size);	// Gets a block of at least size bytes
+	void Release(unsigned char *buffer);	// Gives a block back to the pool
+	void Trim();							// Frees all the blocks not in use
+	size_t BytesAllocated();				// Total size of the blocks we hold
+	StagingPool();
+	~StagingPool();
+
+private:
+	struct Block {
+		unsigned char *data;
+		size_t size;
+		bool inUse;
+	};
+
+	std::mutex lock;
+	std::vector<Block> blocks;
+};
+
+class TextureStreamer
+{
+public:
+	static TextureStreamer *Get();					// The streamer shared by all textures
+	static void Cancel(GLTexture *tex);				// Forgets any requests for a texture that is going away
+
+	void Request(GLTexture *tex, const char *name);	// Queues a texture to be decoded
+	int Pump(int maxUploads);						// Uploads up to maxUploads finished textures
+	void Flush();									// Waits for every queued texture and uploads it
+	int Pending();									// The number of textures not uploaded yet
+
+	StagingPool pool;								// Where the decoded images are kept
+
+private:
+	// A texture waiting to be decoded
+	struct Job {
+		GLTexture *tex;
+		char name[260];
+	};
+
+	// A decoded texture waiting to be uploaded
+	struct Result {
+		GLTexture *tex;
+		unsigned char *pixels;	// All the mip levels, largest first
+		int width;				// Width of the top level
+		int height;				// Height of the top level
+		int components;			// 3 for RGB, 4 for RGBA
+		int levels;				// Number of mip levels
+	};
+
+	TextureStreamer();
+	void Start();
+	void WorkerMain();
+	bool Decode(const Job &job, Result *result);
+
+	static TextureStreamer *instance;
+
+	std::mutex lock;
+	std::condition_variable wake;		// Signalled when a job is queued
+	std::condition_variable finished;	// Signalled when a job is decoded
+	std::deque<Job> jobs;
+	std::deque<Result> results;
+	std::vector<std::thread> workers;
+	std::vector<GLTexture *> active;	// Textures the workers are busy with
+	int decoding;						// Number of jobs the workers are busy with
+};
+
+#endif TEXTURESTREAMER_H